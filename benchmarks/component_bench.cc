@@ -0,0 +1,498 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Microbenchmarks of the components on the hot paths of the DB, run without
+// a DB, an Env nor an RDMA device. The concurrent components are swept over
+// thread counts. Built with -DTimberSaw_BUILD_COMPONENT_BENCH=ON, which
+// needs Google benchmark installed or in third_party/benchmark. Google
+// benchmark flags apply, e.g.
+//
+//   ./component_bench --benchmark_filter=SkipList
+//   ./component_bench --benchmark_format=json --benchmark_out=out.json
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TimberSaw/cache.h"
+#include "TimberSaw/comparator.h"
+#include "TimberSaw/iterator.h"
+#include "TimberSaw/write_batch.h"
+
+#include "db/dbformat.h"
+#include "db/inlineskiplist.h"
+#include "db/memtable.h"
+#include "db/memtable_rep.h"
+#include "table/block.h"
+#include "table/full_filter_block.h"
+#include "table/merger.h"
+#include "util/coding.h"
+#include "util/concurrent_arena.h"
+#include "util/crc32c.h"
+#include "util/random.h"
+#include "util/rdma.h"
+
+namespace TimberSaw {
+
+namespace {
+
+// The largest thread count of the sweeps.
+const int kMaxThreads = 16;
+
+// The i-th of the fixed size user keys, in order.
+std::string MakeKey(uint64_t i) {
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%016llu",
+                static_cast<unsigned long long>(i));
+  return buf;
+}
+
+// A data block of "keys" with values of "value_size" bytes, encoded the way
+// BlockBuilder encodes it.
+std::string BuildBlock(const std::vector<std::string>& keys,
+                       size_t value_size, int restart_interval) {
+  const std::string value(value_size, 'v');
+  std::string block;
+  std::vector<uint32_t> restarts(1, 0);
+  std::string last_key;
+  int counter = 0;
+  for (const std::string& key : keys) {
+    size_t shared = 0;
+    if (counter < restart_interval) {
+      const size_t min_length = std::min(last_key.size(), key.size());
+      while (shared < min_length && last_key[shared] == key[shared]) {
+        shared++;
+      }
+    } else {
+      restarts.push_back(block.size());
+      counter = 0;
+    }
+    PutVarint32(&block, shared);
+    PutVarint32(&block, key.size() - shared);
+    PutVarint32(&block, value.size());
+    block.append(key.data() + shared, key.size() - shared);
+    block.append(value);
+    last_key = key;
+    counter++;
+  }
+  for (uint32_t restart : restarts) {
+    PutFixed32(&block, restart);
+  }
+  PutFixed32(&block, restarts.size());
+  return block;
+}
+
+// A block over "contents", which it does not own.
+Block* NewBlock(const std::string& contents) {
+  BlockContents block_contents;
+  block_contents.data = Slice(contents);
+  return new Block(block_contents, Block_On_Memory_Side);
+}
+
+// ---------------------------------------------------------------------------
+// InlineSkipList concurrent insert, the memtable write path.
+
+typedef InlineSkipList<MemTable::KeyComparator> SkipListTable;
+
+const InternalKeyComparator& BenchInternalComparator() {
+  static const InternalKeyComparator icmp(BytewiseComparator());
+  return icmp;
+}
+
+std::unique_ptr<ConcurrentArena> skiplist_arena;
+std::unique_ptr<SkipListTable> skiplist;
+
+void BM_SkipListInsert(benchmark::State& state) {
+  if (state.thread_index() == 0) {
+    skiplist_arena.reset(new ConcurrentArena());
+    skiplist.reset(new SkipListTable(
+        MemTable::KeyComparator(BenchInternalComparator()),
+        skiplist_arena.get()));
+  }
+  // Every thread inserts keys of its own, interleaved with the others.
+  uint64_t i = state.thread_index();
+  for (auto _ : state) {
+    const std::string user_key = MakeKey(i);
+    const size_t internal_key_size = user_key.size() + 8;
+    char* buf = skiplist->AllocateKey(VarintLength(internal_key_size) +
+                                      internal_key_size);
+    char* p = EncodeVarint32(buf, internal_key_size);
+    std::memcpy(p, user_key.data(), user_key.size());
+    EncodeFixed64(p + user_key.size(), PackSequenceAndType(i, kTypeValue));
+    skiplist->InsertConcurrently(buf);
+    i += state.threads();
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    skiplist.reset();
+    skiplist_arena.reset();
+  }
+}
+// The list keeps every key, the iterations are bounded to bound its memory.
+BENCHMARK(BM_SkipListInsert)
+    ->ThreadRange(1, kMaxThreads)
+    ->Iterations(1 << 18)
+    ->UseRealTime();
+
+// ---------------------------------------------------------------------------
+// MemTableRep random inserts and point lookups, the skiplist (0) against the
+// adaptive radix tree (1), as fillrandom and readrandom see them.
+
+const uint64_t kRepKeys = 1 << 20;
+
+// The i-th key of a random order over kRepKeys keys.
+uint64_t RandomKeyIndex(uint64_t i) {
+  return (i * 0x9E3779B97F4A7C15ull) % kRepKeys;
+}
+
+MemTableRep* NewBenchRep(int64_t type, ConcurrentArena* arena) {
+  if (type == 1) {
+    return NewARTRep(arena);
+  }
+  return NewSkipListRep(MemTable::KeyComparator(BenchInternalComparator()),
+                        arena);
+}
+
+void InsertRepEntry(MemTableRep* rep, uint64_t i) {
+  const std::string user_key = MakeKey(RandomKeyIndex(i));
+  const size_t internal_key_size = user_key.size() + 8;
+  char* buf = rep->Allocate(VarintLength(internal_key_size) +
+                            internal_key_size + VarintLength(0));
+  char* p = EncodeVarint32(buf, internal_key_size);
+  std::memcpy(p, user_key.data(), user_key.size());
+  p += user_key.size();
+  EncodeFixed64(p, PackSequenceAndType(i + 1, kTypeValue));
+  EncodeVarint32(p + 8, 0);
+  rep->InsertConcurrently(buf);
+}
+
+std::unique_ptr<ConcurrentArena> rep_arena;
+std::unique_ptr<MemTableRep> rep;
+
+void BM_MemTableRepInsert(benchmark::State& state) {
+  if (state.thread_index() == 0) {
+    rep_arena.reset(new ConcurrentArena());
+    rep.reset(NewBenchRep(state.range(0), rep_arena.get()));
+  }
+  uint64_t i = state.thread_index();
+  for (auto _ : state) {
+    InsertRepEntry(rep.get(), i);
+    i += state.threads();
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    rep.reset();
+    rep_arena.reset();
+  }
+}
+BENCHMARK(BM_MemTableRepInsert)
+    ->Arg(0)
+    ->Arg(1)
+    ->ThreadRange(1, kMaxThreads)
+    ->Iterations(kRepKeys / kMaxThreads)
+    ->UseRealTime();
+
+bool CountEntry(void* arg, const char* entry) {
+  (void)entry;
+  ++*reinterpret_cast<uint64_t*>(arg);
+  return false;
+}
+
+void BM_MemTableRepGet(benchmark::State& state) {
+  if (state.thread_index() == 0) {
+    rep_arena.reset(new ConcurrentArena());
+    rep.reset(NewBenchRep(state.range(0), rep_arena.get()));
+    for (uint64_t i = 0; i < kRepKeys; i++) {
+      InsertRepEntry(rep.get(), i);
+    }
+  }
+  Random rnd(301 + state.thread_index());
+  uint64_t found = 0;
+  for (auto _ : state) {
+    LookupKey lkey(MakeKey(rnd.Uniform(kRepKeys)), kMaxSequenceNumber);
+    rep->Get(lkey.memtable_key().data(), &found, CountEntry);
+  }
+  benchmark::DoNotOptimize(found);
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    rep.reset();
+    rep_arena.reset();
+  }
+}
+BENCHMARK(BM_MemTableRepGet)
+    ->Arg(0)
+    ->Arg(1)
+    ->ThreadRange(1, kMaxThreads)
+    ->UseRealTime();
+
+// ---------------------------------------------------------------------------
+// ConcurrentArena allocation, the memtable memory.
+
+std::unique_ptr<ConcurrentArena> arena;
+
+void BM_ConcurrentArenaAllocate(benchmark::State& state) {
+  if (state.thread_index() == 0) {
+    arena.reset(new ConcurrentArena());
+  }
+  const size_t bytes = state.range(0);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(arena->AllocateAligned(bytes));
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    arena.reset();
+  }
+}
+BENCHMARK(BM_ConcurrentArenaAllocate)
+    ->Arg(32)
+    ->Arg(256)
+    ->ThreadRange(1, kMaxThreads)
+    ->Iterations(1 << 18)
+    ->UseRealTime();
+
+// ---------------------------------------------------------------------------
+// ShardedLRUCache lookup, the block and table caches.
+
+const int kCacheEntries = 100000;
+Cache* lru_cache = nullptr;
+
+void DeleteNothing(const Slice& /*key*/, void* /*value*/) {}
+
+void BM_LRUCacheLookup(benchmark::State& state) {
+  if (state.thread_index() == 0) {
+    lru_cache = NewLRUCache(kCacheEntries);
+    for (int i = 0; i < kCacheEntries; i++) {
+      lru_cache->Release(
+          lru_cache->Insert(MakeKey(i), nullptr, 1, &DeleteNothing));
+    }
+  }
+  Random rnd(301 + state.thread_index());
+  for (auto _ : state) {
+    Cache::Handle* handle =
+        lru_cache->Lookup(MakeKey(rnd.Uniform(kCacheEntries)));
+    if (handle != nullptr) {
+      lru_cache->Release(handle);
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    delete lru_cache;
+    lru_cache = nullptr;
+  }
+}
+BENCHMARK(BM_LRUCacheLookup)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+// ---------------------------------------------------------------------------
+// Bloom filter probe, the filter of a table.
+
+void BM_BloomProbe(benchmark::State& state) {
+  const int num_keys = 100000;
+  const int bits_per_key = state.range(0);
+  std::string buffer(num_keys * bits_per_key / 8 + 2 * CACHE_LINE_SIZE + 5,
+                     '\0');
+  ibv_mr mr{};
+  mr.addr = &buffer[0];
+  mr.length = buffer.size();
+  FullFilterBlockBuilder builder(&mr, bits_per_key);
+  for (int i = 0; i < num_keys; i++) {
+    builder.AddKey(MakeKey(2 * i));
+  }
+  builder.Finish();
+  FullFilterBlockReader reader(builder.result, nullptr, Memory);
+  // Half of the probes are for keys not in the filter.
+  Random rnd(301);
+  uint64_t matches = 0;
+  for (auto _ : state) {
+    matches += reader.KeyMayMatch(MakeKey(rnd.Uniform(2 * num_keys)));
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["match_rate"] =
+      static_cast<double>(matches) / std::max<int64_t>(state.iterations(), 1);
+}
+BENCHMARK(BM_BloomProbe)->Arg(10)->Arg(16);
+
+// ---------------------------------------------------------------------------
+// Block::Iter::Seek, the lookup within a data or index block.
+
+void BM_BlockIterSeek(benchmark::State& state) {
+  const int num_keys = state.range(0);
+  std::vector<std::string> keys;
+  for (int i = 0; i < num_keys; i++) {
+    keys.push_back(MakeKey(i));
+  }
+  const std::string contents = BuildBlock(keys, 100, 16);
+  std::unique_ptr<Block> block(NewBlock(contents));
+  std::unique_ptr<Iterator> iter(block->NewIterator(BytewiseComparator()));
+  Random rnd(301 + state.thread_index());
+  for (auto _ : state) {
+    iter->Seek(keys[rnd.Uniform(num_keys)]);
+    benchmark::DoNotOptimize(iter->Valid());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+// 36 and 1024 entries: a 4 KB data block and an index block.
+BENCHMARK(BM_BlockIterSeek)
+    ->Arg(36)
+    ->Arg(1024)
+    ->ThreadRange(1, kMaxThreads)
+    ->UseRealTime();
+
+// ---------------------------------------------------------------------------
+// MergingIterator::Next, the scans and the compactions.
+
+void BM_MergingIteratorNext(benchmark::State& state) {
+  const int num_children = state.range(0);
+  const int keys_per_child = 1024;
+  // The keys of the children interleave. They start with a zero byte like
+  // the fixed size keys of db_bench, which MergingIterator checks for.
+  std::vector<std::string> contents(num_children);
+  for (int c = 0; c < num_children; c++) {
+    std::vector<std::string> keys;
+    for (int i = 0; i < keys_per_child; i++) {
+      keys.push_back(std::string(1, '\0') + MakeKey(i * num_children + c));
+    }
+    contents[c] = BuildBlock(keys, 16, 16);
+  }
+  std::vector<std::unique_ptr<Block>> blocks;
+  for (int c = 0; c < num_children; c++) {
+    blocks.emplace_back(NewBlock(contents[c]));
+  }
+  auto new_merging_iterator = [&]() {
+    std::vector<Iterator*> children;
+    for (const std::unique_ptr<Block>& block : blocks) {
+      children.push_back(block->NewIterator(BytewiseComparator()));
+    }
+    Iterator* iter = NewMergingIterator(BytewiseComparator(), children.data(),
+                                        num_children);
+    iter->SeekToFirst();
+    return iter;
+  };
+  // A pass over the keys takes a new iterator, the debug builds check that
+  // the keys an iterator returns ascend.
+  std::unique_ptr<Iterator> iter(new_merging_iterator());
+  for (auto _ : state) {
+    iter->Next();
+    if (!iter->Valid()) {
+      state.PauseTiming();
+      iter.reset(new_merging_iterator());
+      state.ResumeTiming();
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MergingIteratorNext)->RangeMultiplier(2)->Range(2, 16);
+
+// ---------------------------------------------------------------------------
+// Varint decoding, the entries of the blocks and the memtables.
+
+void BM_Varint32Decode(benchmark::State& state) {
+  // Values of 1 to 5 bytes.
+  std::string encoded;
+  Random rnd(301);
+  const int count = 4096;
+  for (int i = 0; i < count; i++) {
+    PutVarint32(&encoded, rnd.Next() >> rnd.Uniform(32));
+  }
+  for (auto _ : state) {
+    const char* p = encoded.data();
+    const char* limit = p + encoded.size();
+    uint32_t v;
+    while (p < limit) {
+      p = GetVarint32Ptr(p, limit, &v);
+      benchmark::DoNotOptimize(v);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+  state.SetBytesProcessed(state.iterations() * encoded.size());
+}
+BENCHMARK(BM_Varint32Decode);
+
+void BM_Varint64Decode(benchmark::State& state) {
+  std::string encoded;
+  Random64 rnd(301);
+  const int count = 4096;
+  for (int i = 0; i < count; i++) {
+    PutVarint64(&encoded, rnd.Next() >> rnd.Uniform(64));
+  }
+  for (auto _ : state) {
+    const char* p = encoded.data();
+    const char* limit = p + encoded.size();
+    uint64_t v;
+    while (p < limit) {
+      p = GetVarint64Ptr(p, limit, &v);
+      benchmark::DoNotOptimize(v);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+  state.SetBytesProcessed(state.iterations() * encoded.size());
+}
+BENCHMARK(BM_Varint64Decode);
+
+// ---------------------------------------------------------------------------
+// crc32c, the checksums of the blocks and the log records.
+
+void BM_Crc32c(benchmark::State& state) {
+  const std::string data(state.range(0), 'x');
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(crc32c::Value(data.data(), data.size()));
+  }
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_Crc32c)->Arg(4 << 10)->Arg(64 << 10);
+
+// ---------------------------------------------------------------------------
+// In_Use_Array allocate and free, the local RDMA buffer pools.
+
+std::unique_ptr<In_Use_Array> in_use_array;
+
+void BM_InUseArrayAllocateFree(benchmark::State& state) {
+  if (state.thread_index() == 0) {
+    in_use_array.reset(new In_Use_Array(1024, 4096, nullptr));
+  }
+  for (auto _ : state) {
+    const int slot = in_use_array->allocate_memory_slot();
+    if (slot >= 0) {
+      in_use_array->deallocate_memory_slot(slot);
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    in_use_array.reset();
+  }
+}
+BENCHMARK(BM_InUseArrayAllocateFree)
+    ->ThreadRange(1, kMaxThreads)
+    ->UseRealTime();
+
+// ---------------------------------------------------------------------------
+// WriteBatch encoding, the write path.
+
+void BM_WriteBatchEncode(benchmark::State& state) {
+  const int entries = state.range(0);
+  std::vector<std::string> keys;
+  for (int i = 0; i < entries; i++) {
+    keys.push_back(MakeKey(i));
+  }
+  const std::string value(100, 'v');
+  WriteBatch batch;
+  for (auto _ : state) {
+    batch.Clear();
+    for (const std::string& key : keys) {
+      batch.Put(key, value);
+    }
+    benchmark::DoNotOptimize(batch.ApproximateSize());
+  }
+  state.SetItemsProcessed(state.iterations() * entries);
+}
+BENCHMARK(BM_WriteBatchEncode)->Arg(1)->Arg(16);
+
+}  // namespace
+
+}  // namespace TimberSaw
+
+BENCHMARK_MAIN();
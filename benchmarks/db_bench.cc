@@ -8,8 +8,10 @@
 #include <sys/types.h>
 
 #include <atomic>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <memory>
 
 #include "TimberSaw/cache.h"
 #include "db/table_cache.h"
@@ -17,8 +19,11 @@
 #include "TimberSaw/db.h"
 #include "TimberSaw/env.h"
 #include "TimberSaw/filter_policy.h"
+#include "TimberSaw/rate_limiter.h"
+#include "TimberSaw/sst_file_writer.h"
 #include "TimberSaw/write_batch.h"
 #include "port/port.h"
+#include "util/coding.h"
 #include "util/crc32c.h"
 #include "util/histogram.h"
 #include "util/mutexlock.h"
@@ -34,13 +39,27 @@
 //      fill100K      -- write N/1000 100K values in random order in async mode
 //      deleteseq     -- delete N keys in sequential order
 //      deleterandom  -- delete N keys in random order
+//      mergerandom   -- add 1 to the counters of N random keys with
+//                       DB::Merge(), without reading them
+//      ingestseq     -- build tables of N sequential keys per thread with
+//                       SstFileWriter and add them with
+//                       DB::IngestExternalFile() (single shard DBs)
 //      readseq       -- read N times sequentially
 //      readreverse   -- read N times in reverse order
 //      readrandom    -- read N times in random order
 //      readmissing   -- read N missing keys in random order
 //      readhot       -- read N times in random order from 1% section of DB
-//      seekrandom    -- N random seeks
+//      seekrandom    -- N random seeks, each reading a short range with
+//                       --seek_range
 //      seekordered   -- N ordered seeks
+//      seekprefix    -- N random prefix seeks, each reading the keys with
+//                       the prefix of its key (needs --prefix_length)
+//      ycsbload      -- load the records of the YCSB workloads
+//      ycsba..ycsbf  -- YCSB core workloads A-F on the loaded records:
+//                       a: 50% reads, 50% updates    b: 95% reads, 5% updates
+//                       c: 100% reads                d: 95% reads of the
+//                       latest records, 5% inserts   e: 95% scans, 5% inserts
+//                       f: 50% reads, 50% read-modify-writes
 //      open          -- cost of opening a DB
 //      crc32c        -- repeated crc32c of 4K of data
 //   Meta operations:
@@ -113,6 +132,16 @@ static int FLAGS_block_size = 0;
 // Negative means use no table_cache.
 static int FLAGS_cache_size = -1;
 
+// Fraction of the table_cache kept for the index and filter blocks.
+static double FLAGS_high_pri_pool_ratio = 0.0;
+
+// If true, charge the index and filter blocks to the table_cache.
+static bool FLAGS_cache_index_and_filter_blocks = false;
+
+// Number of bytes to use as a table_cache of compressed data blocks under
+// the uncompressed one. Negative means use no such table_cache.
+static int FLAGS_compressed_cache_size = -1;
+
 // Maximum number of files to keep open at the same time (use default if == 0)
 static int FLAGS_open_files = 0;
 
@@ -121,9 +150,28 @@ static int FLAGS_block_restart_interval = 1;
 // Negative means use default settings.
 static int FLAGS_bloom_bits = 10;
 
+// Filter of the tables, "bloom" or "ribbon".
+static const char* FLAGS_filter_type = "bloom";
+
+// If true, --bloom_bits is the average over the levels, see
+// Options::per_level_filter_bits.
+static bool FLAGS_per_level_filter_bits = false;
+
 // Common key prefix length.
 static int FLAGS_key_prefix = 0;
 
+// Length of the key prefixes the filters are built on, see
+// Options::prefix_length. Zero means no prefix filters.
+static int FLAGS_prefix_length = 0;
+
+// Levels of the range filters of the tables, see
+// Options::range_filter_levels. Zero means no range filters.
+static int FLAGS_range_filter_levels = 0;
+
+// If positive, seekrandom reads the keys in [k, k + seek_range) of its
+// random key k, with an iterate_upper_bound at k + seek_range.
+static int FLAGS_seek_range = 0;
+
 // If true, do not destroy the existing database.  If you set this
 // flag and also specify a benchmark that wants a fresh database, that
 // benchmark will fail.
@@ -138,9 +186,66 @@ static bool FLAGS_enable_numa = false;
 // If true, reuse existing log/MANIFEST files when re-opening a database.
 static bool FLAGS_reuse_logs = false;
 
+// If true, the random reads pin the values instead of copying them.
+static bool FLAGS_pin_values = false;
+
+// Values of at least this many bytes are separated into value logs, 0
+// keeps every value in the tables.
+static int FLAGS_min_blob_size = 0;
+
 // Use the db with the following name.
 static const char* FLAGS_db = nullptr;
 
+// Compaction style of the db, "level" or "universal".
+static const char* FLAGS_compaction_style = "level";
+
+// Index of the memtable entries, "skiplist" or "art".
+static const char* FLAGS_memtable_rep = "skiplist";
+
+// Bytes per second the flushes and compactions may send over RDMA, 0 for no
+// limit.
+static double FLAGS_rate_limit_bytes_per_sec = 0;
+
+// Cores the compactions may keep busy on average, 0 for no limit.
+static double FLAGS_compaction_cpu_shares = 0;
+
+// Get() latency the rate limiters are tuned against, 0 to keep them fixed.
+static int FLAGS_read_latency_target_micros = 0;
+
+// Part of the key range of this compute node, in percent, that ycsbload
+// fills. The YCSB inserts take the keys above it.
+static int FLAGS_ycsb_record_percent = 90;
+
+// Key distribution of the YCSB operations: "zipfian", "uniform", "latest" or
+// "hotspot". Empty for the distribution of the workload.
+static const char* FLAGS_ycsb_request_distribution = "";
+
+// Skew of the zipfian distributions, in (0, 1).
+static double FLAGS_zipfian_theta = 0.99;
+
+// The hotspot distribution sends this fraction of the operations to this
+// fraction of the records.
+static double FLAGS_hotspot_data_fraction = 0.2;
+static double FLAGS_hotspot_op_fraction = 0.8;
+
+// Length of the YCSB scans: drawn from [1, ycsb_max_scan_length] by
+// "uniform" or "zipfian" (short scans are the most frequent).
+static int FLAGS_ycsb_max_scan_length = 100;
+static const char* FLAGS_ycsb_scan_length_distribution = "uniform";
+
+// Size of the values written by the YCSB benchmarks: "fixed" (value_size),
+// or drawn from [value_size_min, value_size_max] by "uniform" or "zipfian"
+// (small values are the most frequent).
+static const char* FLAGS_value_size_distribution = "fixed";
+static int FLAGS_value_size_min = 100;
+static int FLAGS_value_size_max = 1000;
+
+// If positive, the YCSB benchmarks issue this many operations per second in
+// total, spread over the threads, whether or not the previous operations
+// have completed. The latencies are then measured from the time each
+// operation was due, which corrects for coordinated omission.
+static double FLAGS_ycsb_target_ops_per_sec = 0;
+
 static int FLAGS_readwritepercent = 90;
 static int FLAGS_ops_between_duration_checks = 2000;
 static int FLAGS_duration = 0;
@@ -268,6 +373,80 @@ class KeyBuffer {
   char buffer_[1024];
 };
 
+// Zipfian distribution over [0, n) with item 0 the most popular, see Gray et
+// al., "Quickly Generating Billion-Record Synthetic Databases". Building it
+// takes O(n), drawing O(1). Thread safe.
+class ZipfianGenerator {
+ public:
+  ZipfianGenerator(uint64_t n, double theta)
+      : n_(std::max<uint64_t>(n, 1)),
+        theta_(std::min(std::max(theta, 0.01), 0.9999)),
+        alpha_(1.0 / (1.0 - theta_)),
+        zetan_(Zeta(n_, theta_)) {
+    eta_ = (1.0 - std::pow(2.0 / n_, 1.0 - theta_)) /
+           (1.0 - Zeta(2, theta_) / zetan_);
+  }
+
+  uint64_t Next(Random64* rnd) const {
+    // 53 random bits in [0, 1).
+    const double u = (rnd->Next() >> 11) * (1.0 / 9007199254740992.0);
+    const double uz = u * zetan_;
+    if (n_ == 1 || uz < 1.0) {
+      return 0;
+    }
+    if (uz < 1.0 + std::pow(0.5, theta_)) {
+      return 1;
+    }
+    return std::min<uint64_t>(
+        n_ - 1, static_cast<uint64_t>(
+                    n_ * std::pow(eta_ * u - eta_ + 1.0, alpha_)));
+  }
+
+ private:
+  static double Zeta(uint64_t n, double theta) {
+    double sum = 0;
+    for (uint64_t i = 1; i <= n; i++) {
+      sum += 1.0 / std::pow(static_cast<double>(i), theta);
+    }
+    return sum;
+  }
+
+  const uint64_t n_;
+  const double theta_;
+  const double alpha_;
+  const double zetan_;
+  double eta_;
+};
+
+// Spreads the popular items of a zipfian distribution over the key range,
+// as YCSB's scrambled zipfian does.
+static uint64_t ScrambleItem(uint64_t item, uint64_t n) {
+  // 64-bit FNV-1a of the item.
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (int i = 0; i < 8; i++) {
+    hash ^= (item >> (i * 8)) & 0xff;
+    hash *= 0x100000001b3ull;
+  }
+  return hash % n;
+}
+
+// Operation mix of a YCSB core workload, in percent.
+struct YCSBWorkload {
+  char name;
+  int read_percent;
+  int update_percent;
+  int insert_percent;
+  int scan_percent;
+  int read_modify_write_percent;
+  const char* request_distribution;
+};
+
+static const YCSBWorkload kYCSBWorkloads[] = {
+    {'a', 50, 50, 0, 0, 0, "zipfian"}, {'b', 95, 5, 0, 0, 0, "zipfian"},
+    {'c', 100, 0, 0, 0, 0, "zipfian"}, {'d', 95, 0, 5, 0, 0, "latest"},
+    {'e', 0, 0, 5, 95, 0, "zipfian"},  {'f', 50, 0, 0, 0, 50, "zipfian"},
+};
+
 #if defined(__linux)
 static Slice TrimSpace(Slice s) {
   size_t start = 0;
@@ -302,6 +481,10 @@ class Stats {
 
   double last_op_finish_;
   Histogram hist_;
+  // Latencies from the time the operations were due, see
+  // FLAGS_ycsb_target_ops_per_sec.
+  Histogram due_latency_hist_;
+  int64_t due_latency_samples_;
   std::string message_;
 
  public:
@@ -314,6 +497,8 @@ class Stats {
   void Start() {
     next_report_ = 100;
     hist_.Clear();
+    due_latency_hist_.Clear();
+    due_latency_samples_ = 0;
     done_ = 0;
     bytes_ = 0;
     seconds_ = 0;
@@ -323,6 +508,8 @@ class Stats {
 
   void Merge(const Stats& other) {
     hist_.Merge(other.hist_);
+    due_latency_hist_.Merge(other.due_latency_hist_);
+    due_latency_samples_ += other.due_latency_samples_;
     done_ += other.done_;
     bytes_ += other.bytes_;
     seconds_ += other.seconds_;
@@ -447,6 +634,13 @@ class Stats {
 
   void AddBytes(int64_t n) { bytes_ += n; }
 
+  // Record the latency of an operation issued at a fixed rate, from the
+  // time it was due rather than the time it was issued.
+  void AddDueLatency(double micros) {
+    due_latency_hist_.Add(micros);
+    due_latency_samples_++;
+  }
+
   void Report(const Slice& name) {
     // Pretend at least one op was done in case we are running a benchmark
     // that does not call FinishedSingleOp().
@@ -472,6 +666,12 @@ class Stats {
       std::fprintf(stdout, "Microseconds per op:\n%s\n",
                    hist_.ToString().c_str());
     }
+    if (due_latency_samples_ > 0) {
+      std::fprintf(stdout,
+                   "Microseconds per op from the time it was due "
+                   "(coordinated omission corrected):\n%s\n",
+                   due_latency_hist_.ToString().c_str());
+    }
     std::fflush(stdout);
   }
   void Report_Batch(const Slice& name, int thread_num, FILE* file) {
@@ -541,8 +741,13 @@ struct ThreadState {
 class Benchmark {
  private:
   Cache* cache_;
+  Cache* compressed_cache_;
   const FilterPolicy* filter_policy_;
+  RateLimiter* rate_limiter_;
+  RateLimiter* cpu_rate_limiter_;
   DB* db_;
+  // The options of db_, also used to build the tables of ingestseq.
+  Options options_;
   int num_;
   int value_size_;
   int entries_per_batch_;
@@ -552,6 +757,14 @@ class Benchmark {
   CountComparator count_comparator_;
   int total_thread_count_;
   std::vector<std::string> validation_keys;
+  // State of the YCSB benchmarks: the workload being run, the generators
+  // shared by its threads (built on first use, they are costly for large
+  // key ranges) and the number of records inserted so far.
+  const YCSBWorkload* ycsb_workload_;
+  std::unique_ptr<ZipfianGenerator> ycsb_key_zipf_;
+  std::unique_ptr<ZipfianGenerator> ycsb_scan_zipf_;
+  std::unique_ptr<ZipfianGenerator> value_size_zipf_;
+  std::atomic<uint64_t> ycsb_inserted_{0};
 
   void PrintHeader() {
     const int kKeySize = 20 + FLAGS_key_prefix;
@@ -633,10 +846,23 @@ class Benchmark {
 
  public:
   Benchmark()
-      : cache_(FLAGS_cache_size >= 0 ? NewLRUCache(FLAGS_cache_size) : nullptr),
+      : cache_(FLAGS_cache_size >= 0
+                   ? NewLRUCache(FLAGS_cache_size, FLAGS_high_pri_pool_ratio)
+                   : nullptr),
+        compressed_cache_(FLAGS_compressed_cache_size >= 0
+                              ? NewLRUCache(FLAGS_compressed_cache_size)
+                              : nullptr),
         filter_policy_(FLAGS_bloom_bits >= 0
                            ? NewBloomFilterPolicy(FLAGS_bloom_bits)
                            : nullptr),
+        rate_limiter_(FLAGS_rate_limit_bytes_per_sec > 0
+                          ? NewGenericRateLimiter(static_cast<int64_t>(
+                                FLAGS_rate_limit_bytes_per_sec))
+                          : nullptr),
+        cpu_rate_limiter_(FLAGS_compaction_cpu_shares > 0
+                              ? NewGenericRateLimiter(static_cast<int64_t>(
+                                    FLAGS_compaction_cpu_shares * 1000000))
+                              : nullptr),
         db_(nullptr),
         num_(FLAGS_num),
         value_size_(FLAGS_value_size),
@@ -644,7 +870,8 @@ class Benchmark {
         reads_(FLAGS_reads < 0 ? FLAGS_num : FLAGS_reads),
         heap_counter_(0),
         count_comparator_(BytewiseComparator()),
-        total_thread_count_(0) {
+        total_thread_count_(0),
+        ycsb_workload_(nullptr) {
     std::vector<std::string> files;
     g_env->GetChildren(FLAGS_db, &files);
     for (size_t i = 0; i < files.size(); i++) {
@@ -660,7 +887,10 @@ class Benchmark {
   ~Benchmark() {
     delete db_;
     delete cache_;
+    delete compressed_cache_;
     delete filter_policy_;
+    delete rate_limiter_;
+    delete cpu_rate_limiter_;
   }
   Slice AllocateKey(std::unique_ptr<const char[]>* key_guard) {
     char* data = new char[FLAGS_key_size];
@@ -787,8 +1017,20 @@ class Benchmark {
         method = &Benchmark::SeekRandom;
       } else if (name == Slice("seekordered")) {
         method = &Benchmark::SeekOrdered;
+      } else if (name == Slice("seekprefix")) {
+        method = &Benchmark::SeekPrefix;
       } else if (name == Slice("readhot")) {
         method = &Benchmark::ReadHot;
+      } else if (name == Slice("ycsbload")) {
+        fresh_db = true;
+        ycsb_inserted_.store(0);
+        PrepareYCSB();
+        method = &Benchmark::YCSBLoad;
+      } else if (name.starts_with("ycsb") && name.size() == 5 &&
+                 FindYCSBWorkload(name[4]) != nullptr) {
+        ycsb_workload_ = FindYCSBWorkload(name[4]);
+        PrepareYCSB();
+        method = &Benchmark::YCSB;
       } else if (name == Slice("readrandomsmall")) {
         reads_ /= 1000;
         method = &Benchmark::ReadRandom;
@@ -796,6 +1038,11 @@ class Benchmark {
         method = &Benchmark::DeleteSeq;
       } else if (name == Slice("deleterandom")) {
         method = &Benchmark::DeleteRandom;
+      } else if (name == Slice("mergerandom")) {
+        method = &Benchmark::MergeRandom;
+      } else if (name == Slice("ingestseq")) {
+        fresh_db = true;
+        method = &Benchmark::IngestSeq;
       } else if (name == Slice("readwhilewriting")) {
         num_threads++;  // Add extra thread for writing
         method = &Benchmark::ReadWhileWriting;
@@ -992,6 +1239,13 @@ class Benchmark {
     db_->WaitforAllbgtasks(false);
     if (method == &Benchmark::WriteRandom || method == &Benchmark::WriteRandomSharded)
       sleep(3); // wait for the last sstable disgestion.
+    std::string write_amp;
+    if (db_->GetProperty("TimberSaw.write-amplification", &write_amp) &&
+        write_amp != "0.00") {
+      std::fprintf(stdout, "%-12s : write amplification %s (%s compaction)\n",
+                   name.ToString().c_str(), write_amp.c_str(),
+                   FLAGS_compaction_style);
+    }
 
     if (method == &Benchmark::ReadRandom || method == &Benchmark::ReadRandom_Sharded)
       Validation_Read();
@@ -1069,11 +1323,29 @@ class Benchmark {
     options.env = g_env;
     options.create_if_missing = !FLAGS_use_existing_db;
     options.block_cache = cache_;
+    options.cache_index_and_filter_blocks =
+        FLAGS_cache_index_and_filter_blocks;
+    options.compressed_block_cache = compressed_cache_;
     options.write_buffer_size = FLAGS_write_buffer_size;
     options.max_file_size = FLAGS_max_file_size;
     options.block_size = FLAGS_block_size;
     options.bloom_bits = FLAGS_bloom_bits;
+    if (strcmp(FLAGS_filter_type, "ribbon") == 0) {
+      options.filter_type = kRibbonFilter;
+    }
+    options.per_level_filter_bits = FLAGS_per_level_filter_bits;
+    options.prefix_length = FLAGS_prefix_length;
+    options.range_filter_levels = FLAGS_range_filter_levels;
     options.block_restart_interval = FLAGS_block_restart_interval;
+    if (strcmp(FLAGS_compaction_style, "universal") == 0) {
+      options.compaction_style = kCompactionStyleUniversal;
+    }
+    if (strcmp(FLAGS_memtable_rep, "art") == 0) {
+      options.memtable_rep = kARTRep;
+    }
+    options.rate_limiter = rate_limiter_;
+    options.cpu_rate_limiter = cpu_rate_limiter_;
+    options.read_latency_target_micros = FLAGS_read_latency_target_micros;
     if (FLAGS_comparisons) {
       options.comparator = &count_comparator_;
     }
@@ -1086,6 +1358,9 @@ class Benchmark {
 #endif
     options.filter_policy = filter_policy_;
     options.reuse_logs = FLAGS_reuse_logs;
+    options.min_blob_size = FLAGS_min_blob_size;
+    // The counters of mergerandom.
+    options.merge_operator_type = kUInt64AddOperator;
     //
     rdma_mg = Env::Default()->rdma_mg.get();
     //TODO: Keep every compute node have 100 million key range
@@ -1144,6 +1419,7 @@ class Benchmark {
 
     }
 
+    options_ = options;
     Status s = DB::Open(options, FLAGS_db, &db_);
     if (!s.ok()) {
       std::fprintf(stderr, "open error: %s\n", s.ToString().c_str());
@@ -1380,6 +1656,7 @@ class Benchmark {
     ReadOptions options;
     //TODO(ruihong): specify the table_cache option.
     std::string value;
+    PinnableSlice pinned;
     int found = 0;
 //    KeyBuffer key;
     std::unique_ptr<const char[]> key_guard;
@@ -1393,7 +1670,8 @@ class Benchmark {
 //      if (db_->Get(options, key.slice(), &value).ok()) {
 //        found++;
 //      }
-      if (db_->Get(options, key, &value).ok()) {
+      if (FLAGS_pin_values ? db_->Get(options, key, &pinned).ok()
+                           : db_->Get(options, key, &value).ok()) {
         found++;
       }
       thread->stats.FinishedSingleOp();
@@ -1406,6 +1684,7 @@ class Benchmark {
     ReadOptions options;
     //TODO(ruihong): specify the cache option.
     std::string value;
+    PinnableSlice pinned;
     int found = 0;
     //    KeyBuffer key;
     std::unique_ptr<const char[]> key_guard;
@@ -1423,7 +1702,8 @@ class Benchmark {
       //      if (db_->Get(options, key.slice(), &value).ok()) {
       //        found++;
       //      }
-      if (db_->Get(options, key, &value).ok()) {
+      if (FLAGS_pin_values ? db_->Get(options, key, &pinned).ok()
+                           : db_->Get(options, key, &value).ok()) {
         found++;
       }
       thread->stats.FinishedSingleOp();
@@ -1499,6 +1779,197 @@ GenerateKeyFromInt(thread->rand.Next() % (FLAGS_num * FLAGS_threads), &key);
 //    printf("Read average latency is %lu\n", time_elapse/reads_done);
     thread->stats.AddMessage(msg);
   }
+  static const YCSBWorkload* FindYCSBWorkload(char name) {
+    for (const YCSBWorkload& w : kYCSBWorkloads) {
+      if (w.name == name) {
+        return &w;
+      }
+    }
+    return nullptr;
+  }
+
+  // The YCSB records are the lowest ycsb_record_percent of the key range of
+  // this compute node, which its shards (fixed_compute_shards_num or one per
+  // memory node) split between them. The inserted records follow them.
+  uint64_t YCSBKeyBase() const {
+    return (RDMA_Manager::node_id - 1) / 2 * number_of_key_per_compute;
+  }
+  uint64_t YCSBRecordCount() const {
+    return std::max<uint64_t>(
+        number_of_key_per_compute * FLAGS_ycsb_record_percent / 100, 1);
+  }
+
+  void PrepareYCSB() {
+    if (ycsb_key_zipf_ == nullptr) {
+      ycsb_key_zipf_.reset(
+          new ZipfianGenerator(YCSBRecordCount(), FLAGS_zipfian_theta));
+    }
+    if (ycsb_scan_zipf_ == nullptr) {
+      ycsb_scan_zipf_.reset(
+          new ZipfianGenerator(FLAGS_ycsb_max_scan_length, FLAGS_zipfian_theta));
+    }
+    if (value_size_zipf_ == nullptr) {
+      value_size_zipf_.reset(new ZipfianGenerator(
+          FLAGS_value_size_max - FLAGS_value_size_min + 1, FLAGS_zipfian_theta));
+    }
+  }
+
+  int NextValueSize(Random64* rnd) const {
+    if (strcmp(FLAGS_value_size_distribution, "uniform") == 0) {
+      return FLAGS_value_size_min +
+             rnd->Uniform(FLAGS_value_size_max - FLAGS_value_size_min + 1);
+    } else if (strcmp(FLAGS_value_size_distribution, "zipfian") == 0) {
+      return FLAGS_value_size_min + value_size_zipf_->Next(rnd);
+    }
+    return value_size_;
+  }
+
+  // Return the record, relative to YCSBKeyBase(), an operation of the given
+  // request distribution goes to.
+  uint64_t NextYCSBRecord(const char* distribution, Random64* rnd) const {
+    const uint64_t records =
+        YCSBRecordCount() + ycsb_inserted_.load(std::memory_order_relaxed);
+    if (strcmp(distribution, "uniform") == 0) {
+      return rnd->Uniform(records);
+    } else if (strcmp(distribution, "latest") == 0) {
+      // The most recently inserted records are the most popular.
+      const uint64_t age = ycsb_key_zipf_->Next(rnd);
+      return age < records ? records - 1 - age : 0;
+    } else if (strcmp(distribution, "hotspot") == 0) {
+      const uint64_t hot = std::max<uint64_t>(
+          static_cast<uint64_t>(records * FLAGS_hotspot_data_fraction), 1);
+      if (hot >= records ||
+          rnd->Uniform(1000000) < FLAGS_hotspot_op_fraction * 1000000) {
+        return rnd->Uniform(hot);
+      }
+      return hot + rnd->Uniform(records - hot);
+    }
+    return ScrambleItem(ycsb_key_zipf_->Next(rnd), records);
+  }
+
+  // Return the record a YCSB insert writes. Once the key range of this node
+  // is full the inserts wrap around and overwrite the oldest insertions.
+  uint64_t NextYCSBInsert() {
+    const uint64_t records = YCSBRecordCount();
+    const uint64_t room =
+        std::max<uint64_t>(number_of_key_per_compute - records, 1);
+    return records + ycsb_inserted_.fetch_add(1) % room;
+  }
+
+  void YCSBLoad(ThreadState* thread) {
+    RandomGenerator gen;
+    std::unique_ptr<const char[]> key_guard;
+    Slice key = AllocateKey(&key_guard);
+    // Every thread loads its own slice of the records.
+    const uint64_t records = YCSBRecordCount();
+    const uint64_t per_thread = (records + FLAGS_threads - 1) / FLAGS_threads;
+    const uint64_t begin = std::min(per_thread * thread->tid, records);
+    const uint64_t end = std::min(begin + per_thread, records);
+    int64_t bytes = 0;
+    for (uint64_t i = begin; i < end; i++) {
+      GenerateKeyFromInt(YCSBKeyBase() + i, &key);
+      const int value_size = NextValueSize(&thread->rand);
+      Status s = db_->Put(write_options_, key, gen.Generate(value_size));
+      if (!s.ok()) {
+        std::fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+        std::exit(1);
+      }
+      bytes += value_size + key.size();
+      thread->stats.FinishedSingleOp();
+    }
+    thread->stats.AddBytes(bytes);
+  }
+
+  void YCSB(ThreadState* thread) {
+    const YCSBWorkload& w = *ycsb_workload_;
+    const char* distribution = FLAGS_ycsb_request_distribution[0] != '\0'
+                                   ? FLAGS_ycsb_request_distribution
+                                   : w.request_distribution;
+    ReadOptions options;
+    RandomGenerator gen;
+    std::string value;
+    std::unique_ptr<const char[]> key_guard;
+    Slice key = AllocateKey(&key_guard);
+    int64_t reads = 0, updates = 0, inserts = 0, scans = 0, rmws = 0;
+    int64_t found = 0;
+    int64_t bytes = 0;
+    Duration duration(FLAGS_duration, reads_);
+    // Open loop: every thread issues an operation every "interval" micros.
+    const double interval = FLAGS_ycsb_target_ops_per_sec > 0
+                                ? 1e6 * FLAGS_threads /
+                                      FLAGS_ycsb_target_ops_per_sec
+                                : 0;
+    double due = g_env->NowMicros();
+    while (!duration.Done(1)) {
+      if (interval > 0) {
+        due += interval;
+        const double now = g_env->NowMicros();
+        if (now < due) {
+          g_env->SleepForMicroseconds(static_cast<int>(due - now));
+        }
+      }
+      const int op = static_cast<int>(thread->rand.Uniform(100));
+      if (op < w.read_percent) {
+        GenerateKeyFromInt(
+            YCSBKeyBase() + NextYCSBRecord(distribution, &thread->rand), &key);
+        if (db_->Get(options, key, &value).ok()) {
+          found++;
+        }
+        reads++;
+      } else if (op < w.read_percent + w.update_percent) {
+        GenerateKeyFromInt(
+            YCSBKeyBase() + NextYCSBRecord(distribution, &thread->rand), &key);
+        const int value_size = NextValueSize(&thread->rand);
+        db_->Put(write_options_, key, gen.Generate(value_size));
+        bytes += value_size + key.size();
+        updates++;
+      } else if (op < w.read_percent + w.update_percent + w.insert_percent) {
+        GenerateKeyFromInt(YCSBKeyBase() + NextYCSBInsert(), &key);
+        const int value_size = NextValueSize(&thread->rand);
+        db_->Put(write_options_, key, gen.Generate(value_size));
+        bytes += value_size + key.size();
+        inserts++;
+      } else if (op < w.read_percent + w.update_percent + w.insert_percent +
+                          w.scan_percent) {
+        GenerateKeyFromInt(
+            YCSBKeyBase() + NextYCSBRecord(distribution, &thread->rand), &key);
+        const uint64_t length =
+            strcmp(FLAGS_ycsb_scan_length_distribution, "zipfian") == 0
+                ? 1 + ycsb_scan_zipf_->Next(&thread->rand)
+                : 1 + thread->rand.Uniform(FLAGS_ycsb_max_scan_length);
+        Iterator* iter = db_->NewIterator(options);
+        iter->Seek(key);
+        for (uint64_t i = 0; i < length && iter->Valid(); i++) {
+          bytes += iter->key().size() + iter->value().size();
+          iter->Next();
+        }
+        delete iter;
+        scans++;
+      } else {
+        GenerateKeyFromInt(
+            YCSBKeyBase() + NextYCSBRecord(distribution, &thread->rand), &key);
+        if (db_->Get(options, key, &value).ok()) {
+          found++;
+        }
+        const int value_size = NextValueSize(&thread->rand);
+        db_->Put(write_options_, key, gen.Generate(value_size));
+        bytes += value_size + key.size();
+        rmws++;
+      }
+      if (interval > 0) {
+        thread->stats.AddDueLatency(g_env->NowMicros() - due);
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    thread->stats.AddBytes(bytes);
+    char msg[200];
+    std::snprintf(msg, sizeof(msg),
+                  "(%s reads:%" PRId64 " found:%" PRId64 " updates:%" PRId64
+                  " inserts:%" PRId64 " scans:%" PRId64 " rmw:%" PRId64 ")",
+                  distribution, reads, found, updates, inserts, scans, rmws);
+    thread->stats.AddMessage(msg);
+  }
+
   void ReadMissing(ThreadState* thread) {
     ReadOptions options;
     std::string value;
@@ -1528,18 +1999,37 @@ GenerateKeyFromInt(thread->rand.Next() % (FLAGS_num * FLAGS_threads), &key);
   void SeekRandom(ThreadState* thread) {
     ReadOptions options;
     int found = 0;
+    int64_t range_keys = 0;
     KeyBuffer key;
+    KeyBuffer limit;
+    Slice upper_bound;
+    if (FLAGS_seek_range > 0) {
+      options.iterate_upper_bound = &upper_bound;
+    }
     for (int i = 0; i < reads_; i++) {
-      Iterator* iter = db_->NewIterator(options);
       const int k = thread->rand.Uniform(FLAGS_num);
       key.Set(k);
+      limit.Set(k + FLAGS_seek_range);
+      upper_bound = limit.slice();
+      Iterator* iter = db_->NewIterator(options);
       iter->Seek(key.slice());
       if (iter->Valid() && iter->key() == key.slice()) found++;
+      if (FLAGS_seek_range > 0) {
+        for (; iter->Valid(); iter->Next()) {
+          range_keys++;
+        }
+      }
       delete iter;
       thread->stats.FinishedSingleOp();
     }
     char msg[100];
-    snprintf(msg, sizeof(msg), "(%d of %d found)", found, num_);
+    if (FLAGS_seek_range > 0) {
+      snprintf(msg, sizeof(msg), "(%d of %d found, %.1f keys per range)",
+               found, num_,
+               reads_ > 0 ? static_cast<double>(range_keys) / reads_ : 0.0);
+    } else {
+      snprintf(msg, sizeof(msg), "(%d of %d found)", found, num_);
+    }
     thread->stats.AddMessage(msg);
   }
 
@@ -1562,6 +2052,38 @@ GenerateKeyFromInt(thread->rand.Next() % (FLAGS_num * FLAGS_threads), &key);
     thread->stats.AddMessage(msg);
   }
 
+  void SeekPrefix(ThreadState* thread) {
+    // The keys are numbers of 20 digits after the common prefix, a prefix
+    // of them holds a run of 10^digits keys.
+    const int digits = FLAGS_key_prefix + 20 - FLAGS_prefix_length;
+    if (FLAGS_prefix_length <= FLAGS_key_prefix || digits > 9) {
+      thread->stats.AddMessage("(--prefix_length must cut the key numbers)");
+      return;
+    }
+    int run = 1;
+    for (int i = 0; i < digits; i++) {
+      run *= 10;
+    }
+    ReadOptions options;
+    options.prefix_same_as_start = true;
+    int64_t keys = 0;
+    KeyBuffer key;
+    for (int i = 0; i < reads_; i++) {
+      Iterator* iter = db_->NewIterator(options);
+      const int k = thread->rand.Uniform(FLAGS_num);
+      key.Set(k / run * run);
+      for (iter->Seek(key.slice()); iter->Valid(); iter->Next()) {
+        keys++;
+      }
+      delete iter;
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%.1f keys per prefix)",
+                  reads_ > 0 ? static_cast<double>(keys) / reads_ : 0.0);
+    thread->stats.AddMessage(msg);
+  }
+
   void DoDelete(ThreadState* thread, bool seq) {
     RandomGenerator gen;
     WriteBatch batch;
@@ -1587,6 +2109,67 @@ GenerateKeyFromInt(thread->rand.Next() % (FLAGS_num * FLAGS_threads), &key);
 
   void DeleteRandom(ThreadState* thread) { DoDelete(thread, false); }
 
+  void MergeRandom(ThreadState* thread) {
+    WriteBatch batch;
+    Status s;
+    int64_t bytes = 0;
+    std::string operand;
+    PutFixed64(&operand, 1);
+    std::unique_ptr<const char[]> key_guard;
+    Slice key = AllocateKey(&key_guard);
+    for (int i = 0; i < num_; i += entries_per_batch_) {
+      batch.Clear();
+      for (int j = 0; j < entries_per_batch_; j++) {
+        const int k = thread->rand.Next() % (FLAGS_num * FLAGS_threads);
+        GenerateKeyFromInt(k, &key);
+        batch.Merge(key, operand);
+        bytes += operand.size() + key.size();
+        thread->stats.FinishedSingleOp();
+      }
+      s = db_->Write(write_options_, &batch);
+      if (!s.ok()) {
+        std::fprintf(stderr, "merge error: %s\n", s.ToString().c_str());
+        std::exit(1);
+      }
+    }
+    thread->stats.AddBytes(bytes);
+  }
+
+  void IngestSeq(ThreadState* thread) {
+    // Every thread loads its own range of keys, cut into tables of about
+    // max_file_size bytes.
+    RandomGenerator gen;
+    SstFileWriter writer(options_);
+    const std::string fname = std::string(FLAGS_db) + "/ingest-" +
+                              std::to_string(thread->tid) + ".sst";
+    int64_t bytes = 0;
+    std::unique_ptr<const char[]> key_guard;
+    Slice key = AllocateKey(&key_guard);
+    Status s;
+    for (int i = 0; i < num_ && s.ok(); i++) {
+      if (i == 0 || writer.FileSize() >= options_.max_file_size) {
+        if (i > 0) {
+          s = writer.Finish();
+          if (s.ok()) s = db_->IngestExternalFile({fname});
+        }
+        if (s.ok()) s = writer.Open(fname);
+      }
+      GenerateKeyFromInt(static_cast<uint64_t>(thread->tid) * num_ + i, &key);
+      if (s.ok()) s = writer.Put(key, gen.Generate(value_size_));
+      bytes += value_size_ + key.size();
+      thread->stats.FinishedSingleOp();
+    }
+    if (s.ok() && num_ > 0) {
+      s = writer.Finish();
+      if (s.ok()) s = db_->IngestExternalFile({fname});
+    }
+    if (!s.ok()) {
+      std::fprintf(stderr, "ingest error: %s\n", s.ToString().c_str());
+      std::exit(1);
+    }
+    thread->stats.AddBytes(bytes);
+  }
+
   void ReadWhileWriting(ThreadState* thread) {
     if (thread->tid > 0) {
       ReadRandom(thread);
@@ -1769,6 +2352,15 @@ int main(int argc, char** argv) {
       FLAGS_benchmarks = argv[i] + strlen("--benchmarks=");
     } else if (sscanf(argv[i], "--compression_ratio=%lf%c", &d, &junk) == 1) {
       FLAGS_compression_ratio = d;
+    } else if (sscanf(argv[i], "--rate_limit_bytes_per_sec=%lf%c", &d,
+                      &junk) == 1) {
+      FLAGS_rate_limit_bytes_per_sec = d;
+    } else if (sscanf(argv[i], "--compaction_cpu_shares=%lf%c", &d, &junk) ==
+               1) {
+      FLAGS_compaction_cpu_shares = d;
+    } else if (sscanf(argv[i], "--read_latency_target_micros=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_read_latency_target_micros = n;
     } else if (sscanf(argv[i], "--compute_node_id=%d%c", &n, &junk) == 1) {
       //Set Node id to RDMA manager's static value directly.
       TimberSaw::RDMA_Manager::node_id = 2*n+1;
@@ -1791,6 +2383,12 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--reuse_logs=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_reuse_logs = n;
+    } else if (sscanf(argv[i], "--pin_values=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_pin_values = n;
+    } else if (sscanf(argv[i], "--min_blob_size=%d%c", &n, &junk) == 1 &&
+               n >= 0) {
+      FLAGS_min_blob_size = n;
     } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
       FLAGS_num = n;
     } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
@@ -1813,27 +2411,105 @@ int main(int argc, char** argv) {
       FLAGS_block_size = n;
     } else if (sscanf(argv[i], "--key_prefix=%d%c", &n, &junk) == 1) {
       FLAGS_key_prefix = n;
+    } else if (sscanf(argv[i], "--prefix_length=%d%c", &n, &junk) == 1 &&
+               n >= 0) {
+      FLAGS_prefix_length = n;
+    } else if (sscanf(argv[i], "--range_filter_levels=%d%c", &n, &junk) ==
+                   1 &&
+               n >= 0) {
+      FLAGS_range_filter_levels = n;
+    } else if (sscanf(argv[i], "--seek_range=%d%c", &n, &junk) == 1 &&
+               n >= 0) {
+      FLAGS_seek_range = n;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
+    } else if (sscanf(argv[i], "--high_pri_pool_ratio=%lf%c", &d, &junk) ==
+                   1 &&
+               d >= 0 && d <= 1) {
+      FLAGS_high_pri_pool_ratio = d;
+    } else if (sscanf(argv[i], "--cache_index_and_filter_blocks=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_cache_index_and_filter_blocks = n;
+    } else if (sscanf(argv[i], "--compressed_cache_size=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_compressed_cache_size = n;
     } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
       FLAGS_bloom_bits = n;
+    } else if (sscanf(argv[i], "--per_level_filter_bits=%d%c", &n, &junk) ==
+                   1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_per_level_filter_bits = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
     } else if (sscanf(argv[i], "--numa_awared=%d%c", &n, &junk) == 1) {
       FLAGS_enable_numa = n;
     } else if (sscanf(argv[i], "--block_restart_interval=%d%c", &n, &junk) == 1) {
       FLAGS_block_restart_interval = n;
+    } else if (sscanf(argv[i], "--ycsb_record_percent=%d%c", &n, &junk) == 1 &&
+               n > 0 && n < 100) {
+      FLAGS_ycsb_record_percent = n;
+    } else if (strncmp(argv[i], "--ycsb_request_distribution=", 28) == 0) {
+      FLAGS_ycsb_request_distribution = argv[i] + 28;
+    } else if (sscanf(argv[i], "--zipfian_theta=%lf%c", &d, &junk) == 1) {
+      FLAGS_zipfian_theta = d;
+    } else if (sscanf(argv[i], "--hotspot_data_fraction=%lf%c", &d, &junk) ==
+               1) {
+      FLAGS_hotspot_data_fraction = d;
+    } else if (sscanf(argv[i], "--hotspot_op_fraction=%lf%c", &d, &junk) ==
+               1) {
+      FLAGS_hotspot_op_fraction = d;
+    } else if (sscanf(argv[i], "--ycsb_max_scan_length=%d%c", &n, &junk) ==
+                   1 &&
+               n > 0) {
+      FLAGS_ycsb_max_scan_length = n;
+    } else if (strncmp(argv[i], "--ycsb_scan_length_distribution=", 32) ==
+               0) {
+      FLAGS_ycsb_scan_length_distribution = argv[i] + 32;
+    } else if (strncmp(argv[i], "--value_size_distribution=", 26) == 0) {
+      FLAGS_value_size_distribution = argv[i] + 26;
+    } else if (sscanf(argv[i], "--value_size_min=%d%c", &n, &junk) == 1) {
+      FLAGS_value_size_min = n;
+    } else if (sscanf(argv[i], "--value_size_max=%d%c", &n, &junk) == 1) {
+      FLAGS_value_size_max = n;
+    } else if (sscanf(argv[i], "--ycsb_target_ops_per_sec=%lf%c", &d,
+                      &junk) == 1) {
+      FLAGS_ycsb_target_ops_per_sec = d;
     } else if (sscanf(argv[i], "--readwritepercent=%d%c", &n, &junk) == 1) {
       FLAGS_readwritepercent = n;
     } else if (sscanf(argv[i], "--duration=%d%c", &n, &junk) == 1) {
       FLAGS_duration = n;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
+    } else if (strncmp(argv[i], "--compaction_style=", 19) == 0) {
+      FLAGS_compaction_style = argv[i] + 19;
+      if (strcmp(FLAGS_compaction_style, "level") != 0 &&
+          strcmp(FLAGS_compaction_style, "universal") != 0) {
+        std::fprintf(stderr, "Invalid compaction style '%s'\n",
+                     FLAGS_compaction_style);
+        std::exit(1);
+      }
+    } else if (strncmp(argv[i], "--memtable_rep=", 15) == 0) {
+      FLAGS_memtable_rep = argv[i] + 15;
+      if (strcmp(FLAGS_memtable_rep, "skiplist") != 0 &&
+          strcmp(FLAGS_memtable_rep, "art") != 0) {
+        std::fprintf(stderr, "Invalid memtable rep '%s'\n",
+                     FLAGS_memtable_rep);
+        std::exit(1);
+      }
+    } else if (strncmp(argv[i], "--filter_type=", 14) == 0) {
+      FLAGS_filter_type = argv[i] + 14;
+      if (strcmp(FLAGS_filter_type, "bloom") != 0 &&
+          strcmp(FLAGS_filter_type, "ribbon") != 0) {
+        std::fprintf(stderr, "Invalid filter type '%s'\n", FLAGS_filter_type);
+        std::exit(1);
+      }
     } else {
       std::fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
       std::exit(1);
     }
   }
+  FLAGS_value_size_max = std::max(FLAGS_value_size_max, FLAGS_value_size_min);
   FLAGS_write_buffer_size = TimberSaw::Options().write_buffer_size;
   FLAGS_max_file_size = TimberSaw::Options().max_file_size;
   FLAGS_block_size = TimberSaw::Options().block_size;
@@ -0,0 +1,673 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// An adaptive radix tree (Leis et al., ICDE 2013) over the entries of a
+// memtable. The tree is keyed by the ART key of an entry: the user key with
+// its zero bytes escaped as 0x00 0xff and terminated by 0x00 0x00, then the
+// inverted tag big endian. The byte order of the ART keys is the order of
+// the internal keys under the byte wise comparator, and no ART key is a
+// prefix of another one.
+//
+// The inner nodes grow from 4 to 16, 48 and 256 children. Paths are
+// compressed: a node only records the depth of the key byte its children
+// are told apart by, the skipped bytes are those of its anchor, a leaf
+// below it. A node never changes its depth or its anchor, so splitting a
+// compressed path only replaces a child pointer of the parent.
+//
+// The readers take no locks. A writer locks the node it adds a child to,
+// and the parent as well to replace a node by a grown copy. The replaced
+// node is marked obsolete, a writer that finds its node obsolete or changed
+// after locking it restarts from the root. Nodes and leaves live in the
+// arena of the memtable, the replaced nodes stay readable until the
+// memtable goes away.
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <string>
+
+#include "db/memtable_rep.h"
+#include "port/port.h"
+#include "util/autovector.h"
+#include "util/coding.h"
+
+namespace TimberSaw {
+
+namespace {
+
+// The length of the ART key of "internal_key".
+size_t ARTKeyLength(const Slice& internal_key) {
+  const size_t user_key_size = internal_key.size() - 8;
+  const size_t zeros = std::count(internal_key.data(),
+                                  internal_key.data() + user_key_size, '\0');
+  return user_key_size + zeros + 2 + 8;
+}
+
+// Write the ART key of "internal_key" to "dst", ARTKeyLength() bytes.
+void EncodeARTKey(const Slice& internal_key, char* dst) {
+  const size_t user_key_size = internal_key.size() - 8;
+  for (size_t i = 0; i < user_key_size; i++) {
+    *dst++ = internal_key[i];
+    if (internal_key[i] == '\0') {
+      *dst++ = '\xff';
+    }
+  }
+  *dst++ = '\0';
+  *dst++ = '\0';
+  const uint64_t inverted_tag =
+      ~DecodeFixed64(internal_key.data() + user_key_size);
+  for (int shift = 56; shift >= 0; shift -= 8) {
+    *dst++ = static_cast<char>(inverted_tag >> shift);
+  }
+}
+
+struct Leaf {
+  const char* entry;
+  uint32_t key_size;
+
+  // The ART key follows the leaf.
+  const uint8_t* key() const {
+    return reinterpret_cast<const uint8_t*>(this + 1);
+  }
+};
+
+enum NodeType : uint8_t { kNode4, kNode16, kNode48, kNode256 };
+
+struct Node {
+  Node(NodeType t, uint32_t d, const Leaf* a) : type(t), depth(d), anchor(a) {}
+
+  void Lock() {
+    while (locked.exchange(true, std::memory_order_acquire)) {
+      port::AsmVolatilePause();
+    }
+  }
+  void Unlock() { locked.store(false, std::memory_order_release); }
+  bool Obsolete() const { return obsolete.load(std::memory_order_acquire); }
+
+  const NodeType type;
+  // The key byte the children are told apart by.
+  const uint32_t depth;
+  // A leaf below the node, the key bytes before "depth" are its bytes.
+  const Leaf* const anchor;
+  std::atomic<bool> locked{false};
+  std::atomic<bool> obsolete{false};
+};
+
+// A child is a Node*, or a Leaf* with the low bit set. 0 is no child.
+typedef uintptr_t Child;
+
+bool IsLeaf(Child c) { return (c & 1) != 0; }
+const Leaf* AsLeaf(Child c) {
+  return reinterpret_cast<const Leaf*>(c & ~uintptr_t{1});
+}
+Node* AsNode(Child c) { return reinterpret_cast<Node*>(c); }
+Child LeafChild(const Leaf* leaf) {
+  return reinterpret_cast<uintptr_t>(leaf) | 1;
+}
+Child NodeChild(const Node* node) { return reinterpret_cast<uintptr_t>(node); }
+
+// Node4 and Node16: the children in the order they were added. The key and
+// the child of a slot are written before the count covers the slot.
+template <int N, NodeType T>
+struct SmallNode : public Node {
+  SmallNode(uint32_t d, const Leaf* a) : Node(T, d, a) {
+    for (int i = 0; i < N; i++) {
+      children[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  static constexpr int kCapacity = N;
+  std::atomic<uint8_t> count{0};
+  uint8_t keys[N];
+  std::atomic<Child> children[N];
+};
+typedef SmallNode<4, kNode4> Node4;
+typedef SmallNode<16, kNode16> Node16;
+
+// Node48: the slot of a key byte, plus one, then the children. The child of
+// a slot is written before the slot is published.
+struct Node48 : public Node {
+  Node48(uint32_t d, const Leaf* a) : Node(kNode48, d, a) {
+    for (int i = 0; i < 256; i++) {
+      index[i].store(0, std::memory_order_relaxed);
+    }
+    for (int i = 0; i < 48; i++) {
+      children[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  std::atomic<uint8_t> index[256];
+  std::atomic<Child> children[48];
+  std::atomic<uint8_t> count{0};
+};
+
+struct Node256 : public Node {
+  Node256(uint32_t d, const Leaf* a) : Node(kNode256, d, a) {
+    for (int i = 0; i < 256; i++) {
+      children[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  std::atomic<Child> children[256];
+};
+
+template <typename SmallNodeType>
+Child FindSmall(const SmallNodeType* n, uint8_t b) {
+  const int count = n->count.load(std::memory_order_acquire);
+  for (int i = 0; i < count; i++) {
+    if (n->keys[i] == b) {
+      return n->children[i].load(std::memory_order_acquire);
+    }
+  }
+  return 0;
+}
+
+Child FindChild(const Node* n, uint8_t b) {
+  switch (n->type) {
+    case kNode4:
+      return FindSmall(static_cast<const Node4*>(n), b);
+    case kNode16:
+      return FindSmall(static_cast<const Node16*>(n), b);
+    case kNode48: {
+      const Node48* n48 = static_cast<const Node48*>(n);
+      const int slot = n48->index[b].load(std::memory_order_acquire);
+      return slot == 0 ? 0
+                       : n48->children[slot - 1].load(std::memory_order_acquire);
+    }
+    case kNode256:
+      return static_cast<const Node256*>(n)->children[b].load(
+          std::memory_order_acquire);
+  }
+  return 0;
+}
+
+bool IsFull(const Node* n) {
+  switch (n->type) {
+    case kNode4:
+      return static_cast<const Node4*>(n)->count.load(
+                 std::memory_order_acquire) == Node4::kCapacity;
+    case kNode16:
+      return static_cast<const Node16*>(n)->count.load(
+                 std::memory_order_acquire) == Node16::kCapacity;
+    case kNode48:
+      return static_cast<const Node48*>(n)->count.load(
+                 std::memory_order_acquire) == 48;
+    case kNode256:
+      return false;
+  }
+  return false;
+}
+
+template <typename SmallNodeType>
+void AddSmall(SmallNodeType* n, uint8_t b, Child c) {
+  const int count = n->count.load(std::memory_order_relaxed);
+  n->keys[count] = b;
+  n->children[count].store(c, std::memory_order_release);
+  n->count.store(count + 1, std::memory_order_release);
+}
+
+// REQUIRES: n is locked or not published, has room and no child "b".
+void AddChild(Node* n, uint8_t b, Child c) {
+  switch (n->type) {
+    case kNode4:
+      AddSmall(static_cast<Node4*>(n), b, c);
+      break;
+    case kNode16:
+      AddSmall(static_cast<Node16*>(n), b, c);
+      break;
+    case kNode48: {
+      Node48* n48 = static_cast<Node48*>(n);
+      const int count = n48->count.load(std::memory_order_relaxed);
+      n48->children[count].store(c, std::memory_order_release);
+      n48->index[b].store(count + 1, std::memory_order_release);
+      n48->count.store(count + 1, std::memory_order_release);
+      break;
+    }
+    case kNode256:
+      static_cast<Node256*>(n)->children[b].store(c, std::memory_order_release);
+      break;
+  }
+}
+
+template <typename SmallNodeType>
+void ReplaceSmall(SmallNodeType* n, uint8_t b, Child c) {
+  const int count = n->count.load(std::memory_order_relaxed);
+  for (int i = 0; i < count; i++) {
+    if (n->keys[i] == b) {
+      n->children[i].store(c, std::memory_order_release);
+      return;
+    }
+  }
+  assert(false);
+}
+
+// REQUIRES: n is locked and has a child "b".
+void ReplaceChild(Node* n, uint8_t b, Child c) {
+  switch (n->type) {
+    case kNode4:
+      ReplaceSmall(static_cast<Node4*>(n), b, c);
+      break;
+    case kNode16:
+      ReplaceSmall(static_cast<Node16*>(n), b, c);
+      break;
+    case kNode48: {
+      Node48* n48 = static_cast<Node48*>(n);
+      const int slot = n48->index[b].load(std::memory_order_relaxed);
+      assert(slot != 0);
+      n48->children[slot - 1].store(c, std::memory_order_release);
+      break;
+    }
+    case kNode256:
+      static_cast<Node256*>(n)->children[b].store(c, std::memory_order_release);
+      break;
+  }
+}
+
+template <typename SmallNodeType>
+int NextSmall(const SmallNodeType* n, int after, Child* c) {
+  const int count = n->count.load(std::memory_order_acquire);
+  int best = 256;
+  for (int i = 0; i < count; i++) {
+    const int b = n->keys[i];
+    if (b > after && b < best) {
+      best = b;
+      *c = n->children[i].load(std::memory_order_acquire);
+    }
+  }
+  return best;
+}
+
+// The smallest key byte of a child past "after", 256 if there is none. The
+// child goes to *c.
+int NextChild(const Node* n, int after, Child* c) {
+  switch (n->type) {
+    case kNode4:
+      return NextSmall(static_cast<const Node4*>(n), after, c);
+    case kNode16:
+      return NextSmall(static_cast<const Node16*>(n), after, c);
+    case kNode48: {
+      const Node48* n48 = static_cast<const Node48*>(n);
+      for (int b = after + 1; b < 256; b++) {
+        const int slot = n48->index[b].load(std::memory_order_acquire);
+        if (slot != 0) {
+          *c = n48->children[slot - 1].load(std::memory_order_acquire);
+          return b;
+        }
+      }
+      return 256;
+    }
+    case kNode256: {
+      const Node256* n256 = static_cast<const Node256*>(n);
+      for (int b = after + 1; b < 256; b++) {
+        *c = n256->children[b].load(std::memory_order_acquire);
+        if (*c != 0) {
+          return b;
+        }
+      }
+      return 256;
+    }
+  }
+  return 256;
+}
+
+template <typename SmallNodeType>
+int PrevSmall(const SmallNodeType* n, int before, Child* c) {
+  const int count = n->count.load(std::memory_order_acquire);
+  int best = -1;
+  for (int i = 0; i < count; i++) {
+    const int b = n->keys[i];
+    if (b < before && b > best) {
+      best = b;
+      *c = n->children[i].load(std::memory_order_acquire);
+    }
+  }
+  return best;
+}
+
+// The largest key byte of a child before "before", -1 if there is none.
+// The child goes to *c.
+int PrevChild(const Node* n, int before, Child* c) {
+  switch (n->type) {
+    case kNode4:
+      return PrevSmall(static_cast<const Node4*>(n), before, c);
+    case kNode16:
+      return PrevSmall(static_cast<const Node16*>(n), before, c);
+    case kNode48: {
+      const Node48* n48 = static_cast<const Node48*>(n);
+      for (int b = before - 1; b >= 0; b--) {
+        const int slot = n48->index[b].load(std::memory_order_acquire);
+        if (slot != 0) {
+          *c = n48->children[slot - 1].load(std::memory_order_acquire);
+          return b;
+        }
+      }
+      return -1;
+    }
+    case kNode256: {
+      const Node256* n256 = static_cast<const Node256*>(n);
+      for (int b = before - 1; b >= 0; b--) {
+        *c = n256->children[b].load(std::memory_order_acquire);
+        if (*c != 0) {
+          return b;
+        }
+      }
+      return -1;
+    }
+  }
+  return -1;
+}
+
+// Compare the ART keys "a" and "b".
+int CompareARTKeys(const uint8_t* a, size_t a_size, const uint8_t* b,
+                   size_t b_size) {
+  const int r = std::memcmp(a, b, std::min(a_size, b_size));
+  if (r != 0) {
+    return r;
+  }
+  return a_size < b_size ? -1 : (a_size > b_size ? 1 : 0);
+}
+
+class ARTRep : public MemTableRep {
+ public:
+  explicit ARTRep(ConcurrentArena* arena) : arena_(arena) {
+    root_ = NewNode<Node256>(0, nullptr);
+  }
+
+  char* Allocate(size_t len) override { return arena_->Allocate(len); }
+
+  void InsertConcurrently(const char* entry) override {
+    const Slice internal_key = GetLengthPrefixedSlice(entry);
+    const size_t key_size = ARTKeyLength(internal_key);
+    char* mem = arena_->AllocateAligned(sizeof(Leaf) + key_size);
+    Leaf* leaf = reinterpret_cast<Leaf*>(mem);
+    leaf->entry = entry;
+    leaf->key_size = static_cast<uint32_t>(key_size);
+    EncodeARTKey(internal_key, mem + sizeof(Leaf));
+    while (!TryInsert(leaf)) {
+    }
+  }
+
+  void Get(const char* memtable_key, void* arg,
+           bool (*callback_func)(void* arg, const char* entry)) override {
+    Iterator iter(this);
+    for (iter.Seek(memtable_key);
+         iter.Valid() && callback_func(arg, iter.key()); iter.Next()) {
+    }
+  }
+
+  MemTableRep::Iterator* NewIterator() override { return new Iterator(this); }
+
+ private:
+  class Iterator : public MemTableRep::Iterator {
+   public:
+    explicit Iterator(const ARTRep* rep) : rep_(rep), leaf_(nullptr) {}
+
+    bool Valid() const override { return leaf_ != nullptr; }
+    const char* key() const override { return leaf_->entry; }
+    void Next() override { Advance(); }
+    void Prev() override { Retreat(); }
+
+    void Seek(const char* memtable_key) override {
+      const Slice internal_key = GetLengthPrefixedSlice(memtable_key);
+      target_.resize(ARTKeyLength(internal_key));
+      EncodeARTKey(internal_key, &target_[0]);
+      const uint8_t* target = reinterpret_cast<const uint8_t*>(target_.data());
+      const size_t target_size = target_.size();
+
+      stack_.clear();
+      leaf_ = nullptr;
+      const Node* node = rep_->root_;
+      size_t depth = 0;
+      while (true) {
+        if (node->depth > depth) {
+          // The compressed path of the node against the target.
+          const uint8_t* prefix = node->anchor->key();
+          const size_t end = std::min<size_t>(node->depth, target_size);
+          int r = 0;
+          for (size_t i = depth; r == 0 && i < end; i++) {
+            r = static_cast<int>(target[i]) - static_cast<int>(prefix[i]);
+          }
+          if (r == 0 && end < node->depth) {
+            r = -1;
+          }
+          if (r < 0) {
+            // The whole subtree is past the target.
+            DescendFirst(NodeChild(node));
+            return;
+          }
+          if (r > 0) {
+            // The whole subtree is before the target.
+            Advance();
+            return;
+          }
+        }
+        depth = node->depth;
+        if (depth >= target_size) {
+          stack_.push_back({node, -1});
+          Advance();
+          return;
+        }
+        const int b = target[depth];
+        const Child child = FindChild(node, b);
+        stack_.push_back({node, b});
+        if (child == 0) {
+          Advance();
+          return;
+        }
+        if (IsLeaf(child)) {
+          leaf_ = AsLeaf(child);
+          if (CompareARTKeys(leaf_->key(), leaf_->key_size, target,
+                             target_size) < 0) {
+            Advance();
+          }
+          return;
+        }
+        node = AsNode(child);
+        depth++;
+      }
+    }
+
+    void SeekToFirst() override {
+      stack_.clear();
+      stack_.push_back({rep_->root_, -1});
+      Advance();
+    }
+
+    void SeekToLast() override {
+      stack_.clear();
+      stack_.push_back({rep_->root_, 256});
+      Retreat();
+    }
+
+   private:
+    // A node on the path to the current leaf and the key byte of the child
+    // taken.
+    struct Frame {
+      const Node* node;
+      int byte;
+    };
+
+    void DescendFirst(Child child) {
+      while (!IsLeaf(child)) {
+        const Node* node = AsNode(child);
+        const int b = NextChild(node, -1, &child);
+        assert(b < 256);
+        stack_.push_back({node, b});
+      }
+      leaf_ = AsLeaf(child);
+    }
+
+    void DescendLast(Child child) {
+      while (!IsLeaf(child)) {
+        const Node* node = AsNode(child);
+        const int b = PrevChild(node, 256, &child);
+        assert(b >= 0);
+        stack_.push_back({node, b});
+      }
+      leaf_ = AsLeaf(child);
+    }
+
+    // Move to the first leaf past the subtree of the top frame's child.
+    void Advance() {
+      while (!stack_.empty()) {
+        Frame& frame = stack_.back();
+        Child child;
+        const int b = NextChild(frame.node, frame.byte, &child);
+        if (b < 256) {
+          frame.byte = b;
+          DescendFirst(child);
+          return;
+        }
+        stack_.pop_back();
+      }
+      leaf_ = nullptr;
+    }
+
+    void Retreat() {
+      while (!stack_.empty()) {
+        Frame& frame = stack_.back();
+        Child child;
+        const int b = PrevChild(frame.node, frame.byte, &child);
+        if (b >= 0) {
+          frame.byte = b;
+          DescendLast(child);
+          return;
+        }
+        stack_.pop_back();
+      }
+      leaf_ = nullptr;
+    }
+
+    const ARTRep* const rep_;
+    autovector<Frame, 16> stack_;
+    const Leaf* leaf_;
+    std::string target_;
+  };
+
+  template <typename T>
+  T* NewNode(uint32_t depth, const Leaf* anchor) {
+    char* mem = arena_->AllocateAligned(sizeof(T));
+    return new (mem) T(depth, anchor);
+  }
+
+  // A copy of "n" with room for more children.
+  // REQUIRES: n is locked.
+  Node* Grow(const Node* n) {
+    Node* grown;
+    switch (n->type) {
+      case kNode4:
+        grown = NewNode<Node16>(n->depth, n->anchor);
+        break;
+      case kNode16:
+        grown = NewNode<Node48>(n->depth, n->anchor);
+        break;
+      default:
+        grown = NewNode<Node256>(n->depth, n->anchor);
+        break;
+    }
+    Child child;
+    for (int b = NextChild(n, -1, &child); b < 256;
+         b = NextChild(n, b, &child)) {
+      AddChild(grown, b, child);
+    }
+    return grown;
+  }
+
+  // Insert "leaf", return false if a concurrent insert got in the way.
+  bool TryInsert(const Leaf* leaf) {
+    const uint8_t* key = leaf->key();
+    Node* parent = nullptr;
+    uint8_t parent_byte = 0;
+    Node* node = root_;
+    size_t depth = 0;
+    while (true) {
+      if (node->depth > depth) {
+        const uint8_t* prefix = node->anchor->key();
+        size_t m = depth;
+        while (m < node->depth && key[m] == prefix[m]) {
+          m++;
+        }
+        if (m < node->depth) {
+          // The key leaves the compressed path of the node at byte m.
+          Node4* split = NewNode<Node4>(m, leaf);
+          AddChild(split, prefix[m], NodeChild(node));
+          AddChild(split, key[m], LeafChild(leaf));
+          parent->Lock();
+          const bool ok = !parent->Obsolete() &&
+                          FindChild(parent, parent_byte) == NodeChild(node);
+          if (ok) {
+            ReplaceChild(parent, parent_byte, NodeChild(split));
+          }
+          parent->Unlock();
+          return ok;
+        }
+      }
+      depth = node->depth;
+      assert(depth < leaf->key_size);
+      const uint8_t b = key[depth];
+      const Child child = FindChild(node, b);
+      if (child == 0) {
+        if (!IsFull(node)) {
+          node->Lock();
+          const bool ok =
+              !node->Obsolete() && !IsFull(node) && FindChild(node, b) == 0;
+          if (ok) {
+            AddChild(node, b, LeafChild(leaf));
+          }
+          node->Unlock();
+          return ok;
+        }
+        // A full node is replaced by a grown copy in its parent. The root
+        // never fills up.
+        parent->Lock();
+        node->Lock();
+        const bool ok = !parent->Obsolete() &&
+                        FindChild(parent, parent_byte) == NodeChild(node) &&
+                        !node->Obsolete() && FindChild(node, b) == 0;
+        if (ok) {
+          Node* grown = Grow(node);
+          AddChild(grown, b, LeafChild(leaf));
+          ReplaceChild(parent, parent_byte, NodeChild(grown));
+          node->obsolete.store(true, std::memory_order_release);
+        }
+        node->Unlock();
+        parent->Unlock();
+        return ok;
+      }
+      if (IsLeaf(child)) {
+        // The two keys part at byte m, a new node tells them apart.
+        const Leaf* other = AsLeaf(child);
+        const uint8_t* other_key = other->key();
+        size_t m = depth + 1;
+        while (key[m] == other_key[m]) {
+          m++;
+          assert(m < leaf->key_size && m < other->key_size);
+        }
+        Node4* split = NewNode<Node4>(m, leaf);
+        AddChild(split, other_key[m], child);
+        AddChild(split, key[m], LeafChild(leaf));
+        node->Lock();
+        const bool ok = !node->Obsolete() && FindChild(node, b) == child;
+        if (ok) {
+          ReplaceChild(node, b, NodeChild(split));
+        }
+        node->Unlock();
+        return ok;
+      }
+      parent = node;
+      parent_byte = b;
+      node = AsNode(child);
+      depth++;
+    }
+  }
+
+  ConcurrentArena* const arena_;
+  Node256* root_;
+};
+
+}  // namespace
+
+MemTableRep* NewARTRep(ConcurrentArena* arena) { return new ARTRep(arena); }
+
+}  // namespace TimberSaw
@@ -0,0 +1,190 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "db/memtable.h"
+#include "db/merge_helper.h"
+#include "TimberSaw/comparator.h"
+#include "TimberSaw/iterator.h"
+#include "util/random.h"
+
+#include "gtest/gtest.h"
+
+namespace TimberSaw {
+
+// The entries of a memtable, in the order of its iterator.
+static std::vector<std::pair<std::string, std::string>> Contents(
+    MemTable* mem) {
+  std::vector<std::pair<std::string, std::string>> result;
+  Iterator* iter = mem->NewIterator();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    result.emplace_back(iter->key().ToString(), iter->value().ToString());
+  }
+  delete iter;
+  return result;
+}
+
+// The ART memtable is checked against the skiplist one, which orders the
+// entries with the internal key comparator.
+class ARTRepTest : public testing::Test {
+ public:
+  ARTRepTest()
+      : cmp_(BytewiseComparator()),
+        art_(new MemTable(cmp_, nullptr, kARTRep)),
+        skiplist_(new MemTable(cmp_, nullptr, kSkipListRep)) {
+    // The tests do not fill the sequence range of the memtables.
+    art_->NotFullTableflush();
+    skiplist_->NotFullTableflush();
+    art_->Ref();
+    skiplist_->Ref();
+  }
+
+  ~ARTRepTest() override {
+    art_->Unref();
+    skiplist_->Unref();
+  }
+
+  void Add(SequenceNumber seq, ValueType type, const std::string& key,
+           const std::string& value) {
+    art_->Add(seq, type, key, value);
+    skiplist_->Add(seq, type, key, value);
+  }
+
+  // Keys over a small alphabet, so that many share prefixes and some are
+  // the prefixes of others.
+  static std::string RandomKey(Random* rnd) {
+    std::string key;
+    const int len = rnd->Uniform(12);
+    for (int i = 0; i < len; i++) {
+      key.push_back(static_cast<char>("ab\0\xff"[rnd->Uniform(4)]));
+    }
+    return key;
+  }
+
+  const InternalKeyComparator cmp_;
+  MemTable* const art_;
+  MemTable* const skiplist_;
+};
+
+TEST_F(ARTRepTest, Empty) {
+  ASSERT_TRUE(Contents(art_).empty());
+  Iterator* iter = art_->NewIterator();
+  iter->SeekToLast();
+  ASSERT_FALSE(iter->Valid());
+  iter->Seek(InternalKey("a", kMaxSequenceNumber, kValueTypeForSeek).Encode());
+  ASSERT_FALSE(iter->Valid());
+  delete iter;
+}
+
+TEST_F(ARTRepTest, OrderedLikeSkipList) {
+  Random rnd(301);
+  for (SequenceNumber seq = 1; seq <= 2000; seq++) {
+    const ValueType type = rnd.OneIn(5) ? kTypeDeletion : kTypeValue;
+    Add(seq, type, RandomKey(&rnd),
+        type == kTypeValue ? std::to_string(seq) : std::string());
+  }
+  const auto expected = Contents(skiplist_);
+  ASSERT_EQ(2000, expected.size());
+  ASSERT_EQ(expected, Contents(art_));
+
+  // Backwards.
+  Iterator* iter = art_->NewIterator();
+  size_t i = expected.size();
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    ASSERT_GT(i, 0);
+    i--;
+    ASSERT_EQ(expected[i].first, iter->key().ToString());
+  }
+  ASSERT_EQ(0, i);
+  delete iter;
+}
+
+TEST_F(ARTRepTest, Seek) {
+  Random rnd(302);
+  for (SequenceNumber seq = 1; seq <= 500; seq++) {
+    Add(seq, kTypeValue, RandomKey(&rnd), std::to_string(seq));
+  }
+  Iterator* art_iter = art_->NewIterator();
+  Iterator* skiplist_iter = skiplist_->NewIterator();
+  for (int i = 0; i < 1000; i++) {
+    const InternalKey target(RandomKey(&rnd), rnd.Uniform(600),
+                             kValueTypeForSeek);
+    art_iter->Seek(target.Encode());
+    skiplist_iter->Seek(target.Encode());
+    ASSERT_EQ(skiplist_iter->Valid(), art_iter->Valid());
+    if (art_iter->Valid()) {
+      ASSERT_EQ(skiplist_iter->key().ToString(), art_iter->key().ToString());
+      // A step back is the entry before the target.
+      art_iter->Prev();
+      skiplist_iter->Prev();
+      ASSERT_EQ(skiplist_iter->Valid(), art_iter->Valid());
+      if (art_iter->Valid()) {
+        ASSERT_EQ(skiplist_iter->key().ToString(),
+                  art_iter->key().ToString());
+      }
+    }
+  }
+  delete art_iter;
+  delete skiplist_iter;
+}
+
+TEST_F(ARTRepTest, GetNewest) {
+  Add(1, kTypeValue, "key", "v1");
+  Add(2, kTypeValue, "key", "v2");
+  Add(3, kTypeValue, "keys", "other");
+  Add(4, kTypeValue, "ke", "shorter");
+
+  std::string value;
+  Status s;
+  MergeContext merge_context;
+  ASSERT_TRUE(art_->Get(LookupKey("key", 10), &value, &s, &merge_context));
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ("v2", value);
+  ASSERT_TRUE(art_->Get(LookupKey("key", 1), &value, &s, &merge_context));
+  ASSERT_EQ("v1", value);
+  ASSERT_FALSE(art_->Get(LookupKey("k", 10), &value, &s, &merge_context));
+
+  Add(5, kTypeDeletion, "key", "");
+  ASSERT_TRUE(art_->Get(LookupKey("key", 10), &value, &s, &merge_context));
+  ASSERT_TRUE(s.IsNotFound());
+  s = Status::OK();
+  ASSERT_TRUE(art_->Get(LookupKey("keys", 10), &value, &s, &merge_context));
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ("other", value);
+}
+
+TEST_F(ARTRepTest, ConcurrentInserts) {
+  constexpr int kThreads = 4;
+  constexpr int kPerThread = 2000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([this, t]() {
+      Random rnd(400 + t);
+      for (int i = 0; i < kPerThread; i++) {
+        const SequenceNumber seq = 1 + i * kThreads + t;
+        art_->Add(seq, kTypeValue, RandomKey(&rnd), std::to_string(seq));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  const auto contents = Contents(art_);
+  ASSERT_EQ(kThreads * kPerThread, contents.size());
+  for (size_t i = 1; i < contents.size(); i++) {
+    ASSERT_LT(cmp_.Compare(contents[i - 1].first, contents[i].first), 0);
+  }
+}
+
+}  // namespace TimberSaw
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,356 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/blob_log.h"
+
+#include <cstring>
+
+#include "memory_node/memory_node_keeper.h"
+#include "TimberSaw/env.h"
+#include "util/coding.h"
+
+namespace TimberSaw {
+
+void BlobIndex::EncodeTo(std::string* dst) const {
+  PutVarint64(dst, log_id);
+  dst->push_back(static_cast<char>(target_node_id));
+  PutFixed64(dst, addr);
+  PutFixed32(dst, rkey);
+  PutVarint32(dst, size);
+}
+
+bool BlobIndex::DecodeFrom(Slice src) {
+  if (!GetVarint64(&src, &log_id) || src.size() < 1 + 8 + 4) {
+    return false;
+  }
+  target_node_id = static_cast<uint8_t>(src[0]);
+  addr = DecodeFixed64(src.data() + 1);
+  rkey = DecodeFixed32(src.data() + 9);
+  src.remove_prefix(13);
+  return GetVarint32(&src, &size) && src.empty();
+}
+
+BlobLogMetaData::BlobLogMetaData(int machine_type, uint64_t log_id,
+                                 uint8_t creator, uint8_t shard_target)
+    : rdma_mg(machine_type == 0 ? Env::Default()->rdma_mg
+                                : Memory_Node_Keeper::rdma_mg),
+      this_machine_type(machine_type),
+      id(log_id),
+      creator_node_id(creator),
+      shard_target_node_id(shard_target) {}
+
+BlobLogMetaData::~BlobLogMetaData() {
+  if (this_machine_type == 0 && !remote_mrs.empty()) {
+    if (creator_node_id == rdma_mg->node_id) {
+      for (ibv_mr* mr : remote_mrs) {
+        rdma_mg->Deallocate_Remote_RDMA_Slot(mr->addr, shard_target_node_id,
+                                             FlushBuffer);
+      }
+    } else {
+      // The chunks were allocated by the memory node itself, hand them back
+      // in a batch like the tables it wrote.
+      uint64_t* ptr;
+      bool rpc = rdma_mg->Remote_Memory_Deallocation_Fetch_Buff(
+          &ptr, remote_mrs.size(), shard_target_node_id, FlushBuffer);
+      for (size_t i = 0; i < remote_mrs.size(); i++) {
+        ptr[i] = reinterpret_cast<uint64_t>(remote_mrs[i]->addr);
+      }
+      if (rpc) {
+        rdma_mg->Memory_Deallocation_RPC(shard_target_node_id, FlushBuffer);
+      }
+    }
+  }
+  for (ibv_mr* mr : remote_mrs) {
+    delete mr;
+  }
+}
+
+void BlobLogMetaData::EncodeTo(std::string* dst) const {
+  PutVarint64(dst, id);
+  dst->push_back(static_cast<char>(creator_node_id));
+  dst->push_back(static_cast<char>(shard_target_node_id));
+  PutVarint64(dst, total_bytes);
+  PutVarint32(dst, static_cast<uint32_t>(remote_mrs.size()));
+  for (const ibv_mr* mr : remote_mrs) {
+    PutFixed64(dst, reinterpret_cast<uint64_t>(mr->addr));
+    PutVarint64(dst, mr->length);
+    PutFixed32(dst, mr->rkey);
+  }
+}
+
+Status BlobLogMetaData::DecodeFrom(Slice* src) {
+  uint32_t chunks;
+  if (!GetVarint64(src, &id) || src->size() < 2) {
+    return Status::Corruption("blob log metadata");
+  }
+  creator_node_id = static_cast<uint8_t>((*src)[0]);
+  shard_target_node_id = static_cast<uint8_t>((*src)[1]);
+  src->remove_prefix(2);
+  if (!GetVarint64(src, &total_bytes) || !GetVarint32(src, &chunks)) {
+    return Status::Corruption("blob log metadata");
+  }
+  for (uint32_t i = 0; i < chunks; i++) {
+    uint64_t addr;
+    uint64_t length;
+    uint32_t rkey;
+    if (!GetFixed64(src, &addr) || !GetVarint64(src, &length) ||
+        !GetFixed32(src, &rkey)) {
+      return Status::Corruption("blob log chunk");
+    }
+    ibv_mr* mr = new ibv_mr{};
+    mr->addr = reinterpret_cast<void*>(addr);
+    mr->length = length;
+    mr->rkey = rkey;
+    remote_mrs.push_back(mr);
+  }
+  return Status::OK();
+}
+
+BlobLogBuilder::BlobLogBuilder(std::shared_ptr<RDMA_Manager> rdma_mg,
+                               int machine_type, uint64_t log_id,
+                               uint8_t shard_target, std::string qp_type,
+                               RateLimiter* rate_limiter,
+                               RateLimiter::Priority pri)
+    : log_(std::make_shared<BlobLogMetaData>(machine_type, log_id,
+                                             rdma_mg->node_id, shard_target)),
+      chunk_size_(rdma_mg->name_to_chunksize.at(FlushBuffer)),
+      qp_type_(std::move(qp_type)),
+      rate_limiter_(rate_limiter),
+      pri_(pri) {
+  if (machine_type == 0) {
+    local_buffer_ = new ibv_mr{};
+    rdma_mg->Allocate_Local_RDMA_Slot(*local_buffer_, FlushBuffer);
+  }
+}
+
+BlobLogBuilder::~BlobLogBuilder() {
+  assert(finished_);
+  if (local_buffer_ != nullptr) {
+    log_->rdma_mg->Deallocate_Local_RDMA_Slot(local_buffer_->addr,
+                                              FlushBuffer);
+    delete local_buffer_;
+  }
+}
+
+void BlobLogBuilder::StartChunk() {
+  chunk_ = new ibv_mr{};
+  if (log_->this_machine_type == 0) {
+    log_->rdma_mg->Allocate_Remote_RDMA_Slot(
+        *chunk_, log_->shard_target_node_id, FlushBuffer);
+  } else {
+    log_->rdma_mg->Allocate_Local_RDMA_Slot(*chunk_, FlushBuffer);
+  }
+  chunk_used_ = 0;
+}
+
+void BlobLogBuilder::FinishChunk() {
+  RDMA_Manager* rdma_mg = log_->rdma_mg.get();
+  if (chunk_used_ == 0) {
+    if (log_->this_machine_type == 0) {
+      rdma_mg->Deallocate_Remote_RDMA_Slot(
+          chunk_->addr, log_->shard_target_node_id, FlushBuffer);
+    } else {
+      rdma_mg->Deallocate_Local_RDMA_Slot(chunk_->addr, FlushBuffer);
+    }
+    delete chunk_;
+  } else {
+    if (log_->this_machine_type == 0) {
+      if (rate_limiter_ != nullptr) {
+        rate_limiter_->Request(static_cast<int64_t>(chunk_used_), pri_);
+      }
+      rdma_mg->RDMA_Write(chunk_, local_buffer_, chunk_used_, qp_type_,
+                          IBV_SEND_SIGNALED, 1, log_->shard_target_node_id);
+    }
+    chunk_->length = chunk_used_;
+    log_->remote_mrs.push_back(chunk_);
+  }
+  chunk_ = nullptr;
+}
+
+void BlobLogBuilder::Add(const Slice& value, std::string* index) {
+  assert(!finished_);
+  assert(Fits(value.size()));
+  if (chunk_ == nullptr || chunk_used_ + value.size() > chunk_size_) {
+    if (chunk_ != nullptr) {
+      FinishChunk();
+    }
+    StartChunk();
+  }
+  char* dst = static_cast<char*>(log_->this_machine_type == 0
+                                     ? local_buffer_->addr
+                                     : chunk_->addr);
+  memcpy(dst + chunk_used_, value.data(), value.size());
+
+  BlobIndex bi;
+  bi.log_id = log_->id;
+  bi.target_node_id = log_->shard_target_node_id;
+  bi.addr = reinterpret_cast<uint64_t>(chunk_->addr) + chunk_used_;
+  bi.rkey = chunk_->rkey;
+  bi.size = static_cast<uint32_t>(value.size());
+  bi.EncodeTo(index);
+
+  chunk_used_ += value.size();
+  log_->total_bytes += value.size();
+}
+
+std::shared_ptr<BlobLogMetaData> BlobLogBuilder::Finish() {
+  assert(!finished_);
+  finished_ = true;
+  if (chunk_ != nullptr) {
+    FinishChunk();
+  }
+  if (log_->remote_mrs.empty()) {
+    return nullptr;
+  }
+  return log_;
+}
+
+void BlobSeparator::Separate(Slice* key, Slice* value) {
+  const size_t n = key->size();
+  if (value->size() < min_blob_size_ || n < 8 ||
+      !builder_->Fits(value->size())) {
+    return;
+  }
+  const uint64_t tag = DecodeFixed64(key->data() + n - 8);
+  if (static_cast<ValueType>(tag & 0xff) != kTypeValue) {
+    return;
+  }
+  key_buf_.assign(key->data(), n - 8);
+  PutFixed64(&key_buf_, (tag & ~uint64_t{0xff}) | kTypeBlobIndex);
+  index_buf_.clear();
+  builder_->Add(*value, &index_buf_);
+  (*refs_)[builder_->log_id()] += value->size();
+  *key = key_buf_;
+  *value = index_buf_;
+}
+
+namespace {
+
+void ReturnReadBuffer(void* arg1, void* arg2) {
+  reinterpret_cast<RDMA_Manager*>(arg1)->Return_local_read_mr(
+      reinterpret_cast<ibv_mr*>(arg2));
+}
+
+// Read the value of "bi" into "local", which is at least bi.size long.
+Status ReadBlobInto(RDMA_Manager* rdma_mg, const BlobIndex& bi,
+                    ibv_mr* local) {
+  ibv_mr remote{};
+  remote.addr = reinterpret_cast<void*>(bi.addr);
+  remote.length = bi.size;
+  remote.rkey = bi.rkey;
+  if (rdma_mg->RDMA_Read(&remote, local, bi.size, "read_local",
+                         IBV_SEND_SIGNALED, 1, bi.target_node_id) != 0) {
+    return Status::IOError("reading a separated value failed");
+  }
+  return Status::OK();
+}
+
+}  // namespace
+
+Status ReadBlob(const Slice& index, std::string* value) {
+  BlobIndex bi;
+  if (!bi.DecodeFrom(index)) {
+    return Status::Corruption("bad blob index");
+  }
+  std::shared_ptr<RDMA_Manager> rdma_mg = Env::Default()->rdma_mg;
+  Status s;
+  if (bi.size <= rdma_mg->name_to_chunksize.at(DataChunk)) {
+    ibv_mr* local = rdma_mg->Get_local_read_mr();
+    s = ReadBlobInto(rdma_mg.get(), bi, local);
+    if (s.ok()) {
+      value->assign(static_cast<char*>(local->addr), bi.size);
+    }
+  } else {
+    ibv_mr local{};
+    rdma_mg->Allocate_Local_RDMA_Slot(local, FlushBuffer);
+    s = ReadBlobInto(rdma_mg.get(), bi, &local);
+    if (s.ok()) {
+      value->assign(static_cast<char*>(local.addr), bi.size);
+    }
+    rdma_mg->Deallocate_Local_RDMA_Slot(local.addr, FlushBuffer);
+  }
+  return s;
+}
+
+Status ReadBlob(const Slice& index, PinnableSlice* value) {
+  BlobIndex bi;
+  if (!bi.DecodeFrom(index)) {
+    return Status::Corruption("bad blob index");
+  }
+  std::shared_ptr<RDMA_Manager> rdma_mg = Env::Default()->rdma_mg;
+  if (bi.size > rdma_mg->name_to_chunksize.at(DataChunk)) {
+    Status s = ReadBlob(index, value->GetSelf());
+    if (s.ok()) {
+      value->PinSelf();
+    }
+    return s;
+  }
+  ibv_mr* local = rdma_mg->Get_local_read_mr();
+  Status s = ReadBlobInto(rdma_mg.get(), bi, local);
+  if (s.ok()) {
+    ibv_mr* taken = rdma_mg->Take_local_read_mr();
+    assert(taken == local);
+    value->PinSlice(Slice(static_cast<char*>(taken->addr), bi.size),
+                    &ReturnReadBuffer, rdma_mg.get(), taken);
+  }
+  return s;
+}
+
+CompactionBlobRunner::CompactionBlobRunner(int machine_type,
+                                           const std::set<uint64_t>& relocate,
+                                           BlobLogBuilder* builder)
+    : machine_type_(machine_type), relocate_(relocate), builder_(builder) {
+  assert(relocate_.empty() || builder_ != nullptr);
+}
+
+Slice CompactionBlobRunner::Value(const Slice& internal_key,
+                                  const Slice& value,
+                                  std::map<uint64_t, uint64_t>* refs) {
+  const size_t n = internal_key.size();
+  if (n < 8 || static_cast<ValueType>(DecodeFixed64(internal_key.data() + n -
+                                                    8) &
+                                      0xff) != kTypeBlobIndex) {
+    return value;
+  }
+  BlobIndex bi;
+  if (!bi.DecodeFrom(value)) {
+    status_ = Status::Corruption("bad blob index");
+    return value;
+  }
+  if (relocate_.count(bi.log_id) == 0) {
+    (*refs)[bi.log_id] += bi.size;
+    return value;
+  }
+  Slice blob;
+  if (machine_type_ == 1) {
+    blob = Slice(reinterpret_cast<const char*>(bi.addr), bi.size);
+  } else {
+    Status s = ReadBlob(value, &value_buf_);
+    if (!s.ok()) {
+      status_ = s;
+      return value;
+    }
+    blob = value_buf_;
+  }
+  index_buf_.clear();
+  builder_->Add(blob, &index_buf_);
+  (*refs)[builder_->log_id()] += bi.size;
+  relocated_bytes_ += bi.size;
+  return index_buf_;
+}
+
+Status CompactionBlobRunner::Fetch(const Slice& index,
+                                   std::string* value) const {
+  if (machine_type_ != 1) {
+    return ReadBlob(index, value);
+  }
+  BlobIndex bi;
+  if (!bi.DecodeFrom(index)) {
+    return Status::Corruption("bad blob index");
+  }
+  value->assign(reinterpret_cast<const char*>(bi.addr), bi.size);
+  return Status::OK();
+}
+
+}  // namespace TimberSaw
@@ -0,0 +1,195 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Value logs hold the values that the flushes separate from their keys
+// (Options::min_blob_size). A value log is a set of chunks in the memory node
+// of the shard, written once and never modified. The tables keep a BlobIndex
+// (entry type kTypeBlobIndex) pointing into them instead of the value, so
+// the compactions only rewrite the keys.
+//
+// Every table holds the value logs it points into, a log is freed when the
+// last table pointing to it is gone. The bytes of a log no longer pointed to
+// are its garbage: once there is enough of it the compactions move the
+// remaining values into a new log (see CompactionBlobRunner), on the memory
+// node when the compaction is pushed down.
+
+#ifndef STORAGE_TimberSaw_DB_BLOB_LOG_H_
+#define STORAGE_TimberSaw_DB_BLOB_LOG_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "TimberSaw/pinnable_slice.h"
+#include "TimberSaw/rate_limiter.h"
+#include "TimberSaw/status.h"
+#include "util/rdma.h"
+
+namespace TimberSaw {
+
+// A value log is named by its creator node and a number unique on that node
+// for the shard: a file number on the compute node, a counter on the memory
+// node.
+inline uint64_t BlobLogId(uint64_t number, uint8_t creator_node_id) {
+  return (number << 8) | creator_node_id;
+}
+
+// Where a separated value lives.
+struct BlobIndex {
+  uint64_t log_id = 0;
+  // The memory node holding the value.
+  uint8_t target_node_id = 0;
+  uint64_t addr = 0;
+  uint32_t rkey = 0;
+  uint32_t size = 0;
+
+  void EncodeTo(std::string* dst) const;
+  bool DecodeFrom(Slice src);
+};
+
+struct BlobLogMetaData {
+  // this_machine_type 0 means compute node, 1 means memory node. Only the
+  // compute node frees the chunks of the logs.
+  BlobLogMetaData(int machine_type, uint64_t log_id, uint8_t creator,
+                  uint8_t shard_target);
+  ~BlobLogMetaData();
+
+  BlobLogMetaData(const BlobLogMetaData&) = delete;
+  BlobLogMetaData& operator=(const BlobLogMetaData&) = delete;
+
+  void EncodeTo(std::string* dst) const;
+  Status DecodeFrom(Slice* src);
+
+  std::shared_ptr<RDMA_Manager> rdma_mg;
+  int this_machine_type;
+  uint64_t id;
+  uint8_t creator_node_id;
+  uint8_t shard_target_node_id;
+  // Bytes of values written to the log.
+  uint64_t total_bytes = 0;
+  std::vector<ibv_mr*> remote_mrs;
+};
+
+// Appends values to a new value log.
+class BlobLogBuilder {
+ public:
+  // On the compute node (machine_type 0) the values are buffered locally and
+  // written to chunks of "shard_target" over RDMA through the queue pairs of
+  // "qp_type", charging "rate_limiter" (may be null) at "pri". The writes
+  // wait for their completions, so "qp_type" must not be the one of a table
+  // builder of the calling thread. On the memory node (machine_type 1) the
+  // values are copied into its own chunks.
+  BlobLogBuilder(std::shared_ptr<RDMA_Manager> rdma_mg, int machine_type,
+                 uint64_t log_id, uint8_t shard_target,
+                 std::string qp_type = "write_local_compact",
+                 RateLimiter* rate_limiter = nullptr,
+                 RateLimiter::Priority pri = RateLimiter::kHigh);
+  // REQUIRES: Finish() has been called.
+  ~BlobLogBuilder();
+
+  BlobLogBuilder(const BlobLogBuilder&) = delete;
+  BlobLogBuilder& operator=(const BlobLogBuilder&) = delete;
+
+  uint64_t log_id() const { return log_->id; }
+
+  // Values larger than a chunk stay in the tables.
+  bool Fits(size_t size) const { return size <= chunk_size_; }
+
+  // Append "value" and set *index to the encoded BlobIndex pointing to it.
+  // REQUIRES: Fits(value.size())
+  void Add(const Slice& value, std::string* index);
+
+  // Write out the buffered values. Returns the log, or null if nothing was
+  // added to it.
+  std::shared_ptr<BlobLogMetaData> Finish();
+
+ private:
+  void StartChunk();
+  void FinishChunk();
+
+  std::shared_ptr<BlobLogMetaData> log_;
+  const size_t chunk_size_;
+  const std::string qp_type_;
+  RateLimiter* const rate_limiter_;
+  const RateLimiter::Priority pri_;
+  // The chunk being filled, and on the compute node the buffer it is written
+  // from.
+  ibv_mr* chunk_ = nullptr;
+  ibv_mr* local_buffer_ = nullptr;
+  size_t chunk_used_ = 0;
+  bool finished_ = false;
+};
+
+// Moves the values of at least "min_blob_size" bytes written by a flush to
+// "builder", and counts them in the "refs" of the table.
+class BlobSeparator {
+ public:
+  BlobSeparator(BlobLogBuilder* builder, size_t min_blob_size,
+                std::map<uint64_t, uint64_t>* refs)
+      : builder_(builder), min_blob_size_(min_blob_size), refs_(refs) {}
+
+  BlobSeparator(const BlobSeparator&) = delete;
+  BlobSeparator& operator=(const BlobSeparator&) = delete;
+
+  // Make *key (an internal key) and *value point into the log if the value
+  // is separated. The rewritten entry is valid until the next call.
+  void Separate(Slice* key, Slice* value);
+
+ private:
+  BlobLogBuilder* const builder_;
+  const size_t min_blob_size_;
+  std::map<uint64_t, uint64_t>* const refs_;
+  std::string key_buf_;
+  std::string index_buf_;
+};
+
+// Fetch the value "index" points to over RDMA. The PinnableSlice variant
+// hands the read buffer of the calling thread over to *value when the value
+// fits in it. Compute node only.
+Status ReadBlob(const Slice& index, std::string* value);
+Status ReadBlob(const Slice& index, PinnableSlice* value);
+
+// Follows the separated values written by one compaction thread: counts the
+// bytes each output points to per value log, and moves the values out of the
+// logs being collected.
+class CompactionBlobRunner {
+ public:
+  // The values pointed into the logs of "relocate" are appended to
+  // "builder", which may only be null if "relocate" is empty. On the memory
+  // node (machine_type 1) the values are read from its own memory.
+  CompactionBlobRunner(int machine_type, const std::set<uint64_t>& relocate,
+                       BlobLogBuilder* builder);
+
+  CompactionBlobRunner(const CompactionBlobRunner&) = delete;
+  CompactionBlobRunner& operator=(const CompactionBlobRunner&) = delete;
+
+  // Return the value to write for "internal_key" in place of "value", and
+  // count it in "refs" if it points into a value log.
+  Slice Value(const Slice& internal_key, const Slice& value,
+              std::map<uint64_t, uint64_t>* refs);
+
+  // Fetch the value "index" points to, e.g. for the merge operands applied
+  // to it.
+  Status Fetch(const Slice& index, std::string* value) const;
+
+  Status status() const { return status_; }
+  uint64_t relocated_bytes() const { return relocated_bytes_; }
+
+ private:
+  const int machine_type_;
+  const std::set<uint64_t>& relocate_;
+  BlobLogBuilder* const builder_;
+  Status status_;
+  std::string value_buf_;
+  std::string index_buf_;
+  uint64_t relocated_bytes_ = 0;
+};
+
+}  // namespace TimberSaw
+
+#endif  // STORAGE_TimberSaw_DB_BLOB_LOG_H_
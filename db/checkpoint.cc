@@ -0,0 +1,103 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/checkpoint.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+namespace TimberSaw {
+
+namespace {
+
+// Copy the chunks of "file" through the registered buffer "buffer".
+Status CopyFile(Env* env, const CheckpointFile& file, ibv_mr* buffer,
+                uint8_t target_node_id) {
+  std::shared_ptr<RDMA_Manager> rdma_mg = env->rdma_mg;
+  WritableFile* dst;
+  Status s = env->NewWritableFile(file.fname, &dst);
+  if (!s.ok()) {
+    return s;
+  }
+  for (const ibv_mr* chunk : file.chunks) {
+    // A chunk larger than the buffer, like a value log, is read in pieces.
+    for (size_t offset = 0; s.ok() && offset < chunk->length;) {
+      const size_t n = std::min<size_t>(chunk->length - offset,
+                                        buffer->length);
+      ibv_mr remote_mr = *chunk;
+      remote_mr.addr = static_cast<char*>(chunk->addr) + offset;
+      remote_mr.length = n;
+      ibv_mr local_mr = *buffer;
+      local_mr.length = n;
+      if (rdma_mg->RDMA_Read(&remote_mr, &local_mr, n, "read_local",
+                             IBV_SEND_SIGNALED, 1, target_node_id) != 0) {
+        s = Status::IOError(file.fname, "RDMA read of a chunk failed");
+        break;
+      }
+      s = dst->Append(Slice(static_cast<char*>(buffer->addr), n));
+      offset += n;
+    }
+    if (!s.ok()) {
+      break;
+    }
+  }
+  if (s.ok()) {
+    s = dst->Sync();
+  }
+  if (s.ok()) {
+    s = dst->Close();
+  }
+  delete dst;
+  return s;
+}
+
+}  // namespace
+
+Status CopyCheckpointFiles(Env* env, const std::vector<CheckpointFile>& files,
+                           uint8_t target_node_id, int num_threads) {
+  std::atomic<size_t> next_file(0);
+  std::mutex mu;
+  Status result;
+  auto worker = [&]() {
+    ibv_mr buffer{};
+    env->rdma_mg->Allocate_Local_RDMA_Slot(buffer, FlushBuffer);
+    while (true) {
+      const size_t i = next_file.fetch_add(1);
+      if (i >= files.size()) {
+        break;
+      }
+      {
+        std::unique_lock<std::mutex> l(mu);
+        if (!result.ok()) {
+          break;
+        }
+      }
+      Status s = CopyFile(env, files[i], &buffer, target_node_id);
+      if (!s.ok()) {
+        std::unique_lock<std::mutex> l(mu);
+        if (result.ok()) {
+          result = s;
+        }
+      }
+    }
+    env->rdma_mg->Deallocate_Local_RDMA_Slot(buffer.addr, FlushBuffer);
+  };
+  num_threads = static_cast<int>(
+      std::min<size_t>(std::max(num_threads, 1), files.size()));
+  std::vector<std::thread> threads;
+  for (int i = 1; i < num_threads; i++) {
+    threads.emplace_back(worker);
+  }
+  if (num_threads > 0) {
+    worker();
+  }
+  for (std::thread& t : threads) {
+    t.join();
+  }
+  return result;
+}
+
+}  // namespace TimberSaw
@@ -0,0 +1,48 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A checkpoint (DB::CreateCheckpoint()) is a directory holding an image of
+// the tables of a DB at one point in time, copied out of remote memory:
+//
+//   CURRENT, MANIFEST-000001: a single VersionEdit record with the
+//     comparator name, the last sequence number, the next file number, every
+//     table at its level and the value logs the tables point into. The
+//     tables and the logs are described by the remote chunks they were
+//     copied from.
+//   [0-9]+.ldb: the chunks of a table in the order of their maps, the data
+//     chunks, then the index chunks, then the filter chunks. The lengths of
+//     the chunks in the MANIFEST split the file back into them.
+//   [0-9]+.blob: the chunks of a value log, named by the id of the log.
+//
+// The MANIFEST and the BlobIndex entries in the tables still hold the remote
+// addresses and keys of the chunks they were copied from, nothing reopens
+// the image or restores it to a memory node yet.
+
+#ifndef STORAGE_TimberSaw_DB_CHECKPOINT_H_
+#define STORAGE_TimberSaw_DB_CHECKPOINT_H_
+
+#include <string>
+#include <vector>
+
+#include "TimberSaw/env.h"
+#include "TimberSaw/status.h"
+#include "util/rdma.h"
+
+namespace TimberSaw {
+
+// A file of a checkpoint and the remote chunks it is the copy of.
+struct CheckpointFile {
+  std::string fname;
+  std::vector<ibv_mr*> chunks;
+};
+
+// Copy the chunks of every file out of the memory of "target_node_id", on
+// "num_threads" threads that each read a chunk at a time over RDMA and
+// append it to the file. The chunks must stay allocated until it returns.
+Status CopyCheckpointFiles(Env* env, const std::vector<CheckpointFile>& files,
+                           uint8_t target_node_id, int num_threads);
+
+}  // namespace TimberSaw
+
+#endif  // STORAGE_TimberSaw_DB_CHECKPOINT_H_
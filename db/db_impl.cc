@@ -4,14 +4,19 @@
 
 #include "db/db_impl.h"
 #include "db/db_impl_sharding.h"
+#include "db/db_impl_column_family.h"
+#include "db/blob_log.h"
 #include "db/builder.h"
+#include "db/checkpoint.h"
 #include "db/db_iter.h"
 #include "db/dbformat.h"
+#include "db/external_table.h"
 #include "db/filename.h"
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
 #include "db/memtable_list.h"
+#include "db/merge_helper.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
@@ -19,6 +24,7 @@
 #include <atomic>
 #include <cstdint>
 #include <cstdio>
+#include <ctime>
 #include <fstream>
 #include <set>
 #include <string>
@@ -28,6 +34,7 @@
 
 #include "TimberSaw/db.h"
 #include "TimberSaw/env.h"
+#include "TimberSaw/listener.h"
 #include "TimberSaw/status.h"
 #include "TimberSaw/table.h"
 
@@ -40,6 +47,7 @@
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/rate_limiter.h"
 
 namespace TimberSaw {
 
@@ -87,6 +95,11 @@ Options SanitizeOptions(const std::string& dbname,
 //  ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
 //  ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
 //  ClipToRange(&result.block_size, 1 << 10, 4 << 20);
+  ClipToRange(&result.max_bytes_for_level_multiplier, 2.0, 100.0);
+  ClipToRange(&result.remote_memory_pressure_threshold, 0.0, 0.99);
+  ClipToRange(&result.universal_sorted_run_trigger, 2, 1000);
+  ClipToRange(&result.universal_min_merge_width, 2, 1000);
+  ClipToRange(&result.universal_size_ratio, 0, 1000);
   //TODO: recover the info log below try to understand why it will fail.
   if (result.info_log == nullptr) {
     // Open a log file in the same directory as the db
@@ -427,43 +440,63 @@ DBImpl::~DBImpl() {
            Total_time_elapse.load()/flush_times.load());
 #endif
 }
+MemTable* DBImpl::NewMemTable() const {
+  RDMA_Manager* rdma_mg =
+      options_.zero_copy_flush ? env_->rdma_mg.get() : nullptr;
+  return new MemTable(internal_comparator_, rdma_mg, options_.memtable_rep);
+}
+
+void DBImpl::FlushAllMemTables() {
+  std::unique_lock<std::mutex> lck(superversion_memlist_mtx);
+  MemTable* mem = mem_.load();
+  //Use an iterator to check whether the current memtable is empty, if it is not
+  // flush it before exit.
+  Iterator* iter = mem->NewIterator();
+  iter->SeekToFirst();
+  const bool mem_empty = !iter->Valid();
+  delete iter;
+  if(!mem_empty){
+    mem->NotFullTableflush();
+    MemTable* temp_mem = NewMemTable();
+    DEBUG_arg("Not full flushed table first seq number is %lu", mem->GetFirstseq());
+    // Get the real largest seq because it is not a full table flush
+    uint64_t last_mem_seq = mem->Getlargest_seq();
+    temp_mem->SetFirstSeq(last_mem_seq+1);
+    // starting from this sequenctial number, the data should write to the new memtable
+    // set the immutable as seq_num - 1
+    temp_mem->SetLargestSeq(last_mem_seq + MEMTABLE_SEQ_SIZE);
+    temp_mem->Ref();
+    mem->SetFlushState(MemTable::FLUSH_REQUESTED);
+    mem_.store(temp_mem);
+    //set the flush flag for imm
+    assert(imm_.current_memtable_num() <= config::Immutable_StopWritesTrigger);
+    imm_.Add(mem);
+    has_imm_.store(true, std::memory_order_release);
+    InstallSuperVersion();
+    // if we have create a new table then the new table will definite be
+    // the table we will write.
+
+    //        imm_mtx.unlock();
+    MaybeScheduleFlushOrCompaction();
+  }
+
+  lck.unlock();
+
+  while (imm_.IsFlushDoable()){
+    usleep(10);
+    ForceCompactMemTable();
+  }
+  while (imm_.AllFlushNotFinished()) {
+    MaybeScheduleFlushOrCompaction();
+    usleep(1000);
+  }
+}
 // put the memtable to immutable table and flush all immutable to remote memory if the
 // immutable trigger is 1. Wait for all the background task to finish.
 void DBImpl::WaitforAllbgtasks(bool clear_mem) {
 //  slow_down_compaction.store(false);
   if (clear_mem){
-    std::unique_lock<std::mutex> lck(superversion_memlist_mtx);
-    MemTable* mem = mem_.load();
-    //Use an iterator to check whether the current memtable is empty, if it is not
-    // flush it before exit.
-    Iterator* iter = mem->NewIterator();
-    iter->SeekToFirst();
-    if(iter->Valid()){
-      mem->NotFullTableflush();
-      MemTable* temp_mem = new MemTable(internal_comparator_);
-      DEBUG_arg("Not full flushed table first seq number is %lu", mem->GetFirstseq());
-      // Get the real largest seq because it is not a full table flush
-      uint64_t last_mem_seq = mem->Getlargest_seq();
-      temp_mem->SetFirstSeq(last_mem_seq+1);
-      // starting from this sequenctial number, the data should write to the new memtable
-      // set the immutable as seq_num - 1
-      temp_mem->SetLargestSeq(last_mem_seq + MEMTABLE_SEQ_SIZE);
-      temp_mem->Ref();
-      mem->SetFlushState(MemTable::FLUSH_REQUESTED);
-      mem_.store(temp_mem);
-      //set the flush flag for imm
-      assert(imm_.current_memtable_num() <= config::Immutable_StopWritesTrigger);
-      imm_.Add(mem);
-      has_imm_.store(true, std::memory_order_release);
-      InstallSuperVersion();
-      // if we have create a new table then the new table will definite be
-      // the table we will write.
-
-      //        imm_mtx.unlock();
-      MaybeScheduleFlushOrCompaction();
-    }
-
-    lck.unlock();
+    FlushAllMemTables();
   }
   // Reset the trigger
 //  int temp = config::Immutable_FlushTrigger;
@@ -496,6 +529,41 @@ void DBImpl::WaitforAllbgtasks(bool clear_mem) {
   // ActivateRemoteCPURefresh();
   
 }
+Status DBImpl::RecoverAndStart() {
+  undefine_mutex.Lock();
+  VersionEdit edit(0);
+  // Recover handles create_if_missing, error_if_exists
+  bool save_manifest = false;
+  Status s = Recover(&edit, &save_manifest);
+  if (s.ok() && mem_ == nullptr) {
+    // Create new log and a corresponding memtable.
+    uint64_t new_log_number = versions_->NewFileNumber();
+    WritableFile* lfile;
+    s = env_->NewWritableFile(LogFileName(dbname_, new_log_number), &lfile);
+    if (s.ok()) {
+      edit.SetLogNumber(new_log_number);
+      logfile_ = lfile;
+      logfile_number_ = new_log_number;
+      log_ = new log::Writer(lfile);
+      mem_ = NewMemTable();
+      mem_.load()->SetFirstSeq(0);
+      mem_.load()->SetLargestSeq(MEMTABLE_SEQ_SIZE-1);
+      mem_.load()->Ref();
+    }
+  }
+  if (s.ok() && save_manifest) {
+    edit.SetPrevLogNumber(0);  // No older logs needed after recovery.
+    edit.SetLogNumber(logfile_number_);
+    s = versions_->LogAndApply(&edit);
+  }
+  if (s.ok()) {
+    //    RemoveObsoleteFiles();
+    MaybeScheduleFlushOrCompaction();
+  }
+  InstallSuperVersion();
+  undefine_mutex.Unlock();
+  return s;
+}
 Status DBImpl::NewDB() {
   VersionEdit new_db(0);
   new_db.SetComparatorName(user_comparator()->Name());
@@ -757,7 +825,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     WriteBatchInternal::SetContents(&batch, record);
 
     if (mem == nullptr) {
-      mem = new MemTable(internal_comparator_);
+      mem = NewMemTable();
       mem->Ref();
     }
     status = WriteBatchInternal::InsertInto(&batch, mem);
@@ -803,7 +871,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
         mem = nullptr;
       } else {
         // mem can be nullptr if lognum exists but was empty.
-        mem_.store(new MemTable(internal_comparator_));
+        mem_.store(NewMemTable());
         mem_.load()->Ref();
       }
     }
@@ -833,6 +901,9 @@ Status DBImpl::WriteLevel0Table(FlushJob* job, VersionEdit* edit) {
   DEBUG_arg("new file number for flushing is %lu\n", meta->number);
 //  pending_outputs_.insert(meta->number);
   Iterator* iter = imm_.MakeInputIterator(job);
+  if (options_.per_level_filter_bits) {
+    job->filter_bits_per_key = versions_->FilterBitsPerKey(0);
+  }
   Log(options_.info_log, "Level-0 table #%llu: started",
       (unsigned long long)meta->number);
 //  printf("now system start to serializae mem %p\n", mem);
@@ -857,6 +928,10 @@ Status DBImpl::WriteLevel0Table(FlushJob* job, VersionEdit* edit) {
 //      s.ToString().c_str());
   delete iter;
 //  pending_outputs_.erase(meta->number);
+  for (auto mem : job->mem_vec) {
+    meta->largest_seq = std::max(meta->largest_seq, mem->Getlargest_seq_supposed());
+  }
+  meta->creation_time = static_cast<uint64_t>(std::time(nullptr));
 
   // Note that if file_size is zero, the file has been deleted and
   // should not be added to the manifest.
@@ -1358,10 +1433,10 @@ void DBImpl::BackgroundCompaction(void* p) {
       assert(c->num_input_files(0) == 1);
       std::shared_ptr<RemoteMemTableMetaData> f = c->input(0, 0);
       c->edit()->RemoveFile(c->level(), f->number, f->creator_node_id);
-      c->edit()->AddFile(c->level() + 1, f);
+      c->edit()->AddFile(c->output_level(), f);
       {
         std::unique_lock<std::mutex> l(superversion_memlist_mtx);
-        f->level = c->level() + 1;
+        f->level = c->output_level();
         c->ReleaseInputs();
         status = versions_->LogAndApply(c->edit());
         InstallSuperVersion();
@@ -1372,7 +1447,7 @@ void DBImpl::BackgroundCompaction(void* p) {
       }
       VersionSet::LevelSummaryStorage tmp;
       Log(options_.info_log, "Moved #%lld to level-%d %lld bytes %s: %s\n",
-          static_cast<unsigned long long>(f->number), c->level() + 1,
+          static_cast<unsigned long long>(f->number), c->output_level(),
           static_cast<unsigned long long>(f->file_size),
           status.ToString().c_str(), versions_->LevelSummary(&tmp));
       DEBUG("Trival compaction\n");
@@ -1528,7 +1603,22 @@ long double DBImpl::RequestRemoteUtilization(){
 }
 
 bool DBImpl::CheckWhetherPushDownorNot(Compaction* compact) {
+  if (options_.compaction_filter != nullptr ||
+      options_.merge_operator != nullptr) {
+    // The application's filter and merge operator only live in this
+    // process, the memory node can run the built-in ones alone.
+    return false;
+  }
+  if (compact->output_level() == 0) {
+    // An intra-L0 compaction, the memory node installs outputs below
+    // level 0 only.
+    return false;
+  }
 #if NEARDATACOMPACTION==2
+  if (!compact->relocate_blob_logs().empty()) {
+    // The values to move are in the memory of the memory node.
+    return true;
+  }
   // Decide whether pushdown, now we get the mn_perecnt by heartbeat
   //TODO(chuqing): also decide by number of cores?
   
@@ -1683,6 +1773,11 @@ bool DBImpl::CheckWhetherPushDownorNot(Compaction* compact) {
       // TODO: THis could be more fine-grained.
 //      while(rdma_mg->local_cpu_percent.load()*)
 //      printf("remote computing power is smaller than 0.05, and compute node CPU utilization is less than 1 core");
+      if (options_.cpu_rate_limiter != nullptr) {
+        // Both nodes are busy, the CPU limiter paces the compaction locally
+        // instead of polling the utilization until a node frees up.
+        return false;
+      }
       usleep(compact->level()*500);
       goto retry;
       //      return false;
@@ -1841,14 +1936,15 @@ void DBImpl::BackgroundCompaction(void* p) {
         assert(c->num_input_files(0) == 1);
         std::shared_ptr<RemoteMemTableMetaData> f = c->input(0, 0);
         c->edit()->RemoveFile(c->level(), f->number, f->creator_node_id);
-        c->edit()->AddFile(c->level() + 1, f);
+        c->edit()->AddFile(c->output_level(), f);
         {
           std::unique_lock<std::mutex> l_sv(superversion_memlist_mtx);
 //          std::unique_lock<std::mutex> l_vs(versionset_mtx, std::defer_lock);
-          f->level = c->level() + 1;
-          status = versions_->LogAndApply(c->edit());
-          //trival move need to clear the UnderCompaction flag
+          f->level = c->output_level();
+          //trival move need to clear the UnderCompaction flag, before the
+          // new version is built so that it is not kept in in_progress.
           f->UnderCompaction = false;
+          status = versions_->LogAndApply(c->edit());
           c->ReleaseInputs();
 #ifdef WITHPERSISTENCE
           //different from normal compaction
@@ -2027,7 +2123,10 @@ Status DBImpl::OpenCompactionOutputFile(SubcompactionState* compact) {
       compact->builder = new TableBuilder_BACS(options_, Compact, shard_target_node_id);
 
     }
-
+    if (options_.per_level_filter_bits) {
+      compact->builder->SetFilterBitsPerKey(
+          versions_->FilterBitsPerKey(compact->compaction->output_level()));
+    }
   }
   return s;
 }
@@ -2061,6 +2160,10 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
       compact->builder = new TableBuilder_BACS(options_, Compact, shard_target_node_id);
 
     }
+    if (options_.per_level_filter_bits) {
+      compact->builder->SetFilterBitsPerKey(
+          versions_->FilterBitsPerKey(compact->compaction->output_level()));
+    }
   }
   return s;
 }
@@ -2095,8 +2198,10 @@ Status DBImpl::FinishCompactionOutputFile(SubcompactionState* compact,
 #endif
   const uint64_t current_bytes = compact->builder->FileSize();
   compact->current_output()->file_size = current_bytes;
+  compact->current_output()->num_entries = current_entries;
   assert(file_size == current_bytes);
   compact->total_bytes += current_bytes;
+  compact->copied_bytes += compact->builder->CopiedBytes();
   delete compact->builder;
   compact->builder = nullptr;
 
@@ -2155,8 +2260,10 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
 #endif
   const uint64_t current_bytes = compact->builder->FileSize();
   compact->current_output()->file_size = current_bytes;
+  compact->current_output()->num_entries = current_entries;
   assert(file_size == current_bytes);
   compact->total_bytes += current_bytes;
+  compact->copied_bytes += compact->builder->CopiedBytes();
   delete compact->builder;
   compact->builder = nullptr;
   assert(*compact->current_output()->largest.user_key().data() == 0);
@@ -2195,12 +2302,12 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact,
 //  assert(false);
   Log(options_.info_log, "Compacted %d@%d + %d@%d files => %lld bytes",
       compact->compaction->num_input_files(0), compact->compaction->level(),
-      compact->compaction->num_input_files(1), compact->compaction->level() + 1,
+      compact->compaction->num_input_files(1), compact->compaction->output_level(),
       static_cast<long long>(compact->total_bytes));
 
   // Add compaction outputs
   compact->compaction->AddInputDeletions(compact->compaction->edit());
-  const int level = compact->compaction->level();
+  const int output_level = compact->compaction->output_level();
   if (compact->sub_compact_states.size() == 0){
     for (size_t i = 0; i < compact->outputs.size(); i++) {
       const CompactionOutput& out = compact->outputs[i];
@@ -2208,8 +2315,12 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact,
                                                    shard_target_node_id);
       //TODO make all the metadata written into out
       meta->number = out.number;
-      meta->level = level+1;
+      meta->level = output_level;
       meta->file_size = out.file_size;
+      meta->num_entries = out.num_entries;
+      meta->num_deletions = out.num_deletions;
+      meta->largest_seq = compact->compaction->LargestInputSeq();
+      meta->creation_time = static_cast<uint64_t>(std::time(nullptr));
       meta->smallest = out.smallest;
       meta->largest = out.largest;
       assert(*meta->largest.user_key().data() == 0);
@@ -2217,10 +2328,14 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact,
       meta->remote_data_mrs = out.remote_data_mrs;
       meta->remote_dataindex_mrs = out.remote_dataindex_mrs;
       meta->remote_filter_mrs = out.remote_filter_mrs;
-      compact->compaction->edit()->AddFile(level + 1, meta);
+      meta->blob_refs = out.blob_refs;
+      compact->compaction->edit()->AddFile(output_level, meta);
       meta->table_type = compact->compaction->table_type;
       assert(!meta->UnderCompaction);
     }
+    for (const auto& log : compact->blob_logs) {
+      compact->compaction->edit()->AddBlobLog(log);
+    }
   }else{
     for(auto subcompact : compact->sub_compact_states){
       for (size_t i = 0; i < subcompact.outputs.size(); i++) {
@@ -2230,17 +2345,25 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact,
         // TODO make all the metadata written into out
         meta->number = out.number;
         meta->file_size = out.file_size;
-        meta->level = level+1;
+        meta->num_entries = out.num_entries;
+        meta->num_deletions = out.num_deletions;
+        meta->largest_seq = compact->compaction->LargestInputSeq();
+        meta->creation_time = static_cast<uint64_t>(std::time(nullptr));
+        meta->level = output_level;
         meta->smallest = out.smallest;
         meta->largest = out.largest;
         meta->remote_data_mrs = out.remote_data_mrs;
         meta->remote_dataindex_mrs = out.remote_dataindex_mrs;
         meta->remote_filter_mrs = out.remote_filter_mrs;
+        meta->blob_refs = out.blob_refs;
         meta->table_type = compact->compaction->table_type;
 
-        compact->compaction->edit()->AddFile(level + 1, meta);
+        compact->compaction->edit()->AddFile(output_level, meta);
         assert(!meta->UnderCompaction);
       }
+      for (const auto& log : subcompact.blob_logs) {
+        compact->compaction->edit()->AddBlobLog(log);
+      }
     }
   }
   assert(compact->compaction->edit()->GetNewFilesNum() > 0 );
@@ -2483,8 +2606,86 @@ void DBImpl::InstallSuperVersion() {
       old_superversion->Cleanup();
     }
   }
+  RecalculateWriteStallConditions();
+}
+static const char* WriteStallConditionName(WriteStallCondition condition) {
+  switch (condition) {
+    case WriteStallCondition::kNormal:
+      return "normal";
+    case WriteStallCondition::kDelayed:
+      return "delayed";
+    case WriteStallCondition::kStopped:
+      return "stopped";
+  }
+  return "unknown";
+}
+void DBImpl::RecalculateWriteStallConditions() {
+  Version* current = versions_->current();
+  const int num_level0_files = current->NumFiles(0);
+  const int num_imm = imm_.current_memtable_num();
+  const uint64_t pending_bytes = current->EstimatedCompactionNeededBytes();
+  const WriteStallCondition prev = write_controller_.condition();
+  const uint64_t prev_rate = write_controller_.delayed_write_rate();
+  WriteStallCondition cur = WriteStallCondition::kNormal;
+  uint64_t rate = prev_rate;
+  if (num_imm >= config::Immutable_StopWritesTrigger ||
+      num_level0_files >= config::kL0_StopWritesTrigger ||
+      (options_.hard_pending_compaction_bytes_limit > 0 &&
+       pending_bytes >= options_.hard_pending_compaction_bytes_limit)) {
+    cur = WriteStallCondition::kStopped;
+  } else if (num_imm >= config::Immutable_SlowdownWritesTrigger ||
+             num_level0_files >= config::kL0_SlowdownWritesTrigger ||
+             (options_.soft_pending_compaction_bytes_limit > 0 &&
+              pending_bytes >= options_.soft_pending_compaction_bytes_limit)) {
+    cur = WriteStallCondition::kDelayed;
+    if (prev == WriteStallCondition::kNormal) {
+      rate = write_controller_.max_delayed_write_rate();
+    } else if (prev == WriteStallCondition::kStopped ||
+               pending_bytes > last_pending_compaction_bytes_) {
+      // The background work is still falling behind.
+      rate = static_cast<uint64_t>(prev_rate * 0.8);
+    } else if (pending_bytes < last_pending_compaction_bytes_) {
+      rate = static_cast<uint64_t>(prev_rate * 1.25);
+    }
+    if (num_level0_files >= config::kL0_StopWritesTrigger - 2 ||
+        num_imm >= config::Immutable_StopWritesTrigger - 1) {
+      // Close to a stop, slow down harder.
+      rate = static_cast<uint64_t>(rate * 0.6);
+    }
+  }
+  last_pending_compaction_bytes_ = pending_bytes;
+  write_controller_.SetCondition(cur, rate);
+  if (prev == WriteStallCondition::kStopped &&
+      cur != WriteStallCondition::kStopped) {
+    write_stall_cv.notify_all();
+  }
+
+  const bool rate_changed = cur == WriteStallCondition::kDelayed &&
+                            write_controller_.delayed_write_rate() != prev_rate;
+  if (cur != prev || rate_changed) {
+    if (cur != prev) {
+      Log(options_.info_log,
+          "Write stall condition %s -> %s: L0 files %d, immutables %d, "
+          "pending compaction %llu bytes, delayed rate %llu bytes/s\n",
+          WriteStallConditionName(prev), WriteStallConditionName(cur),
+          num_level0_files, num_imm,
+          static_cast<unsigned long long>(pending_bytes),
+          static_cast<unsigned long long>(write_controller_.delayed_write_rate()));
+    }
+    if (options_.listener != nullptr) {
+      WriteStallInfo info;
+      info.cur = cur;
+      info.prev = prev;
+      info.delayed_write_rate = write_controller_.delayed_write_rate();
+      info.pending_compaction_bytes = pending_bytes;
+      info.num_level0_files = num_level0_files;
+      info.num_immutable_memtables = num_imm;
+      options_.listener->OnStallConditionsChanged(info);
+    }
+  }
 }
 void DBImpl::NearDataCompaction(Compaction* c) {
+  const uint64_t start_micros = env_->NowMicros();
   std::shared_ptr<RDMA_Manager> rdma_mg = env_->rdma_mg;
   // register the memory block from the remote memory
   RDMA_Request* send_pointer;
@@ -2515,6 +2716,7 @@ void DBImpl::NearDataCompaction(Compaction* c) {
   send_pointer = (RDMA_Request*)send_mr.addr;
   send_pointer->command = near_data_compaction;
   send_pointer->content.sstCompact.buffer_size = serilized_c.size() + 1;
+  send_pointer->content.sstCompact.shard_id = shard_id;
   send_pointer->buffer = receive_mr.addr;
   send_pointer->rkey = receive_mr.rkey;
   send_pointer->buffer_large = mr_c.addr;
@@ -2668,6 +2870,19 @@ void DBImpl::NearDataCompaction(Compaction* c) {
   DEBUG_arg("new file number for end is %lu \n", file_number_start);
   DEBUG_arg("Edit new file number is %lu\n", new_file_size);
   edit.SetFileNumbers(file_number_start);
+  CompactionStats stats;
+  stats.micros = env_->NowMicros() - start_micros;
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < c->num_input_files(which); i++) {
+      stats.bytes_read += c->input(which, i)->file_size;
+    }
+  }
+  for (const auto& iter : *edit.GetNewFiles()) {
+    stats.bytes_written += iter.second->file_size;
+  }
+  undefine_mutex.Lock();
+  stats_[c->output_level()].Add(stats);
+  undefine_mutex.Unlock();
   {
     std::unique_lock<std::mutex> sv_lck(superversion_memlist_mtx);
     // TODO: remove the version id argument because we no longer need it.
@@ -2736,7 +2951,8 @@ void DBImpl::sync_option_to_remote(uint8_t target_node_id) {
   memset((char*)send_mr_ve.addr + sizeof(options_), 1, 1);
   send_pointer = (RDMA_Request*)send_mr.addr;
   send_pointer->command = sync_option;
-  send_pointer->content.ive.buffer_size = sizeof(options_) + 1;
+  send_pointer->content.optSync.buffer_size = sizeof(options_) + 1;
+  send_pointer->content.optSync.shard_id = shard_id;
   send_pointer->buffer = receive_mr.addr;
   send_pointer->rkey = receive_mr.rkey;
 
@@ -3005,6 +3221,10 @@ void DBImpl::WaitForComputeMessageHandlingThread(uint8_t target_memory_id,
       sync_option_to_remote(2*i);
     }
 
+  } else if (shard_id != 0) {
+    // The other shards (e.g. column families) may have options of their own,
+    // the near data compactions of the shard use them.
+    sync_option_to_remote(shard_target_node_id);
   }
 //  main_comm_threads.emplace_back(
 //      &DBImpl::client_message_polling_and_handling_thread, this, "main");
@@ -3395,7 +3615,11 @@ Status DBImpl::DoCompactionWorkWithSubcompaction(CompactionState* compact) {
     for (size_t i = 0; i < iter.outputs.size(); i++) {
       stats.bytes_written += iter.outputs[i].file_size;
     }
+    stats.bytes_copied += iter.copied_bytes;
   }
+  undefine_mutex.Lock();
+  stats_[compact->compaction->output_level()].Add(stats);
+  undefine_mutex.Unlock();
 
 // TODO: we can remove this lock.
 
@@ -3450,6 +3674,27 @@ void DBImpl::ProcessKeyValueCompaction(SubcompactionState* sub_compact){
   }
 
   Iterator* input = versions_->MakeInputIterator(sub_compact->compaction);
+  CompactionPacer pacer(options_.rate_limiter, options_.cpu_rate_limiter);
+  // The values moved out of garbage value logs go to a log of this thread,
+  // written through the queue pairs the table builders do not use.
+  std::unique_ptr<BlobLogBuilder> blob_builder;
+  if (!sub_compact->compaction->relocate_blob_logs().empty()) {
+    blob_builder.reset(new BlobLogBuilder(
+        env_->rdma_mg, 0,
+        BlobLogId(versions_->NewFileNumber(), env_->rdma_mg->node_id),
+        shard_target_node_id, "write_local_flush", options_.rate_limiter,
+        RateLimiter::kLow));
+  }
+  CompactionBlobRunner blobs(0, sub_compact->compaction->relocate_blob_logs(),
+                             blob_builder.get());
+  CompactionFilterRunner filters(options_.compaction_filter,
+                                 expiry_filter_.get(),
+                                 sub_compact->compaction->output_level(),
+                                 sub_compact->smallest_snapshot, &blobs);
+  // The merge operands of a key are collapsed as the key is rewritten.
+  CompactionMergeRunner merges(merge_operator_, user_comparator(),
+                               sub_compact->compaction->output_level(),
+                               sub_compact->smallest_snapshot, &blobs);
 
   // Release mutex while we're actually doing the compaction work
 //  undefine_mutex.Unlock();
@@ -3474,6 +3719,8 @@ void DBImpl::ProcessKeyValueCompaction(SubcompactionState* sub_compact){
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
   Slice key;
+  // Last key added to the current output.
+  std::string last_output_key;
   assert(input->Valid());
 #ifndef NDEBUG
   printf("first key is %s", input->key().ToString().c_str());
@@ -3545,7 +3792,38 @@ void DBImpl::ProcessKeyValueCompaction(SubcompactionState* sub_compact){
 #ifndef NDEBUG
     number_of_key++;
 #endif
+    // Collapse the merge operands of the key, input is then past them.
+    const bool merged = !drop && merges.Merge(input, end);
+    if (merged) {
+      if (!merges.status().ok()) {
+        status = merges.status();
+        break;
+      }
+      if (!merges.hides_older()) {
+        // The older entries of the key left are not hidden by the operand.
+        last_sequence_for_key = kMaxSequenceNumber;
+      }
+      key = merges.key();
+    }
+    const Slice value = merged ? merges.value() : input->value();
+    if (!drop && filters.Drop(key, value)) {
+      drop = true;
+    }
     if (!drop) {
+      // The filters may have turned the entry into a deletion marker.
+      key = filters.key();
+      // Cut the output on a grandparent boundary, or once it overlaps too
+      // many grandparent bytes.
+      if (sub_compact->compaction->ShouldStopBefore(
+              key, sub_compact->builder == nullptr ? 0 : sub_compact->builder->FileSize(),
+              user_comparator(), &sub_compact->cut) &&
+          sub_compact->builder != nullptr) {
+        sub_compact->current_output()->largest.DecodeFrom(last_output_key);
+        status = FinishCompactionOutputFile(sub_compact, input);
+        if (!status.ok()) {
+          break;
+        }
+      }
       // Open output file if necessary
       if (sub_compact->builder == nullptr) {
         status = OpenCompactionOutputFile(sub_compact);
@@ -3559,7 +3837,13 @@ void DBImpl::ProcessKeyValueCompaction(SubcompactionState* sub_compact){
 #ifndef NDEBUG
       Not_drop_counter++;
 #endif
-      sub_compact->builder->Add(key, input->value());
+      if (ikey.type == kTypeDeletion || filters.deleted()) {
+        sub_compact->current_output()->num_deletions++;
+      }
+      sub_compact->builder->Add(
+          key, blobs.Value(key, filters.value(),
+                           &sub_compact->current_output()->blob_refs));
+      last_output_key.assign(key.data(), key.size());
 //      assert(key.data()[0] == '0');
       // Close output file if it is big enough
       if (sub_compact->builder->FileSize() >=
@@ -3577,7 +3861,10 @@ void DBImpl::ProcessKeyValueCompaction(SubcompactionState* sub_compact){
       break;
     }
 //    assert(key.data()[0] == '0');
-    input->Next();
+    pacer.Consumed(key.size() + value.size());
+    if (!merged) {
+      input->Next();
+    }
     //NOTE(ruihong): When the level iterator is invalid it will be deleted and then the key will
     // be invalid also.
 //    assert(key.data()[0] == '0');
@@ -3604,7 +3891,24 @@ void DBImpl::ProcessKeyValueCompaction(SubcompactionState* sub_compact){
   if (status.ok()) {
     status = input->status();
   }
+  if (status.ok()) {
+    status = blobs.status();
+  }
+  if (blob_builder != nullptr) {
+    std::shared_ptr<BlobLogMetaData> log = blob_builder->Finish();
+    if (log != nullptr) {
+      sub_compact->blob_logs.push_back(log);
+    }
+  }
   delete input;
+  filter_removed_entries_.fetch_add(filters.num_removed(),
+                                    std::memory_order_relaxed);
+  filter_changed_entries_.fetch_add(filters.num_changed(),
+                                    std::memory_order_relaxed);
+  output_boundary_cuts_.fetch_add(sub_compact->cut.boundary_cuts,
+                                  std::memory_order_relaxed);
+  output_overlap_cuts_.fetch_add(sub_compact->cut.overlap_cuts,
+                                 std::memory_order_relaxed);
 //  input = nullptr;
 }
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
@@ -3614,7 +3918,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   Log(options_.info_log, "Compacting %d@%d + %d@%d files",
       compact->compaction->num_input_files(0), compact->compaction->level(),
       compact->compaction->num_input_files(1),
-      compact->compaction->level() + 1);
+      compact->compaction->output_level());
 
   assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
   assert(compact->builder == nullptr);
@@ -3626,6 +3930,27 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   }
 
   Iterator* input = versions_->MakeInputIterator(compact->compaction);
+  CompactionPacer pacer(options_.rate_limiter, options_.cpu_rate_limiter);
+  // The values moved out of garbage value logs go to a log of this thread,
+  // written through the queue pairs the table builders do not use.
+  std::unique_ptr<BlobLogBuilder> blob_builder;
+  if (!compact->compaction->relocate_blob_logs().empty()) {
+    blob_builder.reset(new BlobLogBuilder(
+        env_->rdma_mg, 0,
+        BlobLogId(versions_->NewFileNumber(), env_->rdma_mg->node_id),
+        shard_target_node_id, "write_local_flush", options_.rate_limiter,
+        RateLimiter::kLow));
+  }
+  CompactionBlobRunner blobs(0, compact->compaction->relocate_blob_logs(),
+                             blob_builder.get());
+  CompactionFilterRunner filters(options_.compaction_filter,
+                                 expiry_filter_.get(),
+                                 compact->compaction->output_level(),
+                                 compact->smallest_snapshot, &blobs);
+  // The merge operands of a key are collapsed as the key is rewritten.
+  CompactionMergeRunner merges(merge_operator_, user_comparator(),
+                               compact->compaction->output_level(),
+                               compact->smallest_snapshot, &blobs);
 
   // Release mutex while we're actually doing the compaction work
 //  undefine_mutex.Unlock();
@@ -3643,6 +3968,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
   std::string key;
+  // Last key added to the current output.
+  std::string last_output_key;
   assert(input->Valid());
 #ifndef NDEBUG
   printf("first key is %s", input->key().ToString().c_str());
@@ -3707,7 +4034,40 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
 #ifndef NDEBUG
     number_of_key++;
 #endif
+    // Collapse the merge operands of the key, input is then past them.
+    const bool merged = !drop && merges.Merge(input, nullptr);
+    if (merged) {
+      if (!merges.status().ok()) {
+        status = merges.status();
+        break;
+      }
+      if (!merges.hides_older()) {
+        // The older entries of the key left are not hidden by the operand.
+        last_sequence_for_key = kMaxSequenceNumber;
+      }
+      key = merges.key().ToString();
+    }
+    const Slice value = merged ? merges.value() : input->value();
+    if (!drop && filters.Drop(key, value)) {
+      drop = true;
+    }
     if (!drop) {
+      if (filters.deleted()) {
+        // The filters turned the entry into a deletion marker.
+        key = filters.key().ToString();
+      }
+      // Cut the output on a grandparent boundary, or once it overlaps too
+      // many grandparent bytes.
+      if (compact->compaction->ShouldStopBefore(
+              key, compact->builder == nullptr ? 0 : compact->builder->FileSize(),
+              user_comparator(), &compact->cut) &&
+          compact->builder != nullptr) {
+        compact->current_output()->largest.DecodeFrom(last_output_key);
+        status = FinishCompactionOutputFile(compact, input);
+        if (!status.ok()) {
+          break;
+        }
+      }
       // Open output file if necessary
       if (compact->builder == nullptr) {
         status = OpenCompactionOutputFile(compact);
@@ -3721,7 +4081,13 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
 #ifndef NDEBUG
       Not_drop_counter++;
 #endif
-      compact->builder->Add(key, input->value());
+      if (ikey.type == kTypeDeletion || filters.deleted()) {
+        compact->current_output()->num_deletions++;
+      }
+      compact->builder->Add(
+          key, blobs.Value(key, filters.value(),
+                           &compact->current_output()->blob_refs));
+      last_output_key.assign(key.data(), key.size());
 //      assert(key.data()[0] == '0');
       // Close output file if it is big enough
 
@@ -3746,7 +4112,10 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     // the key will be corrupted when assigning it to "largest" in the table metadata.
     // Or I can make the cahched buffer always a full block size so the deallocaiton is long enogu
     // to avoid the bug
-    input->Next();
+    pacer.Consumed(key.size() + value.size());
+    if (!merged) {
+      input->Next();
+    }
 //    if(*key.data() != 0){
 //      printf("break here");
 //    }
@@ -3777,8 +4146,25 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   if (status.ok()) {
     status = input->status();
   }
+  if (status.ok()) {
+    status = blobs.status();
+  }
+  if (blob_builder != nullptr) {
+    std::shared_ptr<BlobLogMetaData> log = blob_builder->Finish();
+    if (log != nullptr) {
+      compact->blob_logs.push_back(log);
+    }
+  }
   delete input;
   input = nullptr;
+  filter_removed_entries_.fetch_add(filters.num_removed(),
+                                    std::memory_order_relaxed);
+  filter_changed_entries_.fetch_add(filters.num_changed(),
+                                    std::memory_order_relaxed);
+  output_boundary_cuts_.fetch_add(compact->cut.boundary_cuts,
+                                  std::memory_order_relaxed);
+  output_overlap_cuts_.fetch_add(compact->cut.overlap_cuts,
+                                 std::memory_order_relaxed);
 
   CompactionStats stats;
   stats.micros = env_->NowMicros() - start_micros - imm_micros;
@@ -3790,9 +4176,10 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     stats.bytes_written += compact->outputs[i].file_size;
   }
+  stats.bytes_copied = compact->copied_bytes;
   // TODO: we can remove this lock.
   undefine_mutex.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
+  stats_[compact->compaction->output_level()].Add(stats);
 
   if (status.ok()) {
     std::unique_lock<std::mutex> l(superversion_memlist_mtx, std::defer_lock);
@@ -3861,7 +4248,7 @@ Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
                                       SequenceNumber* latest_snapshot,
                                       uint32_t* seed) {
   SequenceNumber snapshot;
-  *latest_snapshot = versions_->LastSequence();
+  *latest_snapshot = VisibleSequence();
   // TODO: make the user defined snapshot work. THe superversion should be confirmed when
   // creating the snapshot.
   SuperVersion* sv;
@@ -3870,10 +4257,9 @@ Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
         static_cast<const SnapshotImpl*>(options.snapshot)->sequence_number();
 
   } else {
-    snapshot = versions_->LastSequence();
-    sv = GetThreadLocalSuperVersion();
-
+    snapshot = *latest_snapshot;
   }
+  sv = GetThreadLocalSuperVersion();
 
   MemTable* mem = sv->mem;
   MemTableListVersion* imm = sv->imm;
@@ -4003,13 +4389,26 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
 
 Status DBImpl::Get(const ReadOptions& options, const Slice& key,
                    std::string* value) {
+  return GetImpl(options, key, value, nullptr);
+}
+
+Status DBImpl::Get(const ReadOptions& options, const Slice& key,
+                   PinnableSlice* value) {
+  value->Reset();
+  return GetImpl(options, key, nullptr, value);
+}
+
+Status DBImpl::GetImpl(const ReadOptions& options, const Slice& key,
+                       std::string* value, PinnableSlice* pinned) {
+  const bool time_read = options_.read_latency_target_micros > 0;
+  const uint64_t start_micros = time_read ? env_->NowMicros() : 0;
   Status s;
   SequenceNumber snapshot;
   if (options.snapshot != nullptr) {
     snapshot =
         static_cast<const SnapshotImpl*>(options.snapshot)->sequence_number();
   } else {
-    snapshot = versions_->LastSequence();
+    snapshot = VisibleSequence();
   }
   //TODO: we should move the get version before the fetching of snapshot.
   auto sv = GetThreadLocalSuperVersion();
@@ -4020,6 +4419,7 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
 
 
   Version::GetStats stats;
+  bool have_stat_update = false;
 
   // Unlock while reading from files and memtables
   {
@@ -4027,22 +4427,42 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
     // First look in the memtable, then in the immutable memtable (if any).
     LookupKey lkey(key, snapshot);
 
-    if (mem->Get(lkey, value, &s)) {
-      // Done
-    } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
-      // Done
-    } else {
-      s = current->Get(options, lkey, value, &stats);
-//      have_stat_update = true;
+    // The memtables may be freed once the super version is returned, so
+    // their values are always copied.
+    std::string* mem_value = pinned != nullptr ? pinned->GetSelf() : value;
+    MergeContext merge_context;
+    bool copied = true;
+    if (!mem->Get(lkey, mem_value, &s, &merge_context) &&
+        (imm == nullptr || !imm->Get(lkey, mem_value, &s, &merge_context))) {
+      s = pinned != nullptr
+              ? current->Get(options, lkey, pinned, &stats, &merge_context)
+              : current->Get(options, lkey, value, &stats, &merge_context);
+      have_stat_update = true;
+      // Unless there are operands to apply, the value of a table is pinned.
+      copied = !merge_context.empty();
+    }
+    if (!merge_context.empty() && (s.ok() || s.IsNotFound())) {
+      // The value found, if any, was copied into mem_value.
+      std::string merged;
+      const Slice base(*mem_value);
+      s = merge_context.Merge(merge_operator_, key,
+                              s.ok() ? &base : nullptr, &merged);
+      mem_value->swap(merged);
+    }
+    if (pinned != nullptr && copied && s.ok()) {
+      pinned->PinSelf();
     }
 //    undefine_mutex.Lock();
   }
-  // TODO keep the file compaction. we remove it as we want.
-//  if (have_stat_update && current->UpdateStats(stats)) {
-//    MaybeScheduleFlushOrCompaction();
-//  }
+  if (have_stat_update) {
+    MaybeSampleGetStats(current, stats);
+  }
   //TOthink: whether we need a lock for the dereference
   ReturnAndCleanupSuperVersion(sv);
+  if (time_read) {
+    const uint64_t now_micros = env_->NowMicros();
+    RecordReadLatency(now_micros - start_micros, now_micros);
+  }
   return s;
 }
 
@@ -4055,7 +4475,7 @@ Iterator* DBImpl::NewIterator(const ReadOptions& options) {
                             ? static_cast<const SnapshotImpl*>(options.snapshot)
                                   ->sequence_number()
                             : latest_snapshot),
-                       seed);
+                       seed, options, options_.prefix_length);
 }
 //#ifdef BYTEADDRESSABLE
 //Iterator* DBImpl::NewSEQIterator(const ReadOptions& options) {
@@ -4071,8 +4491,95 @@ Iterator* DBImpl::NewIterator(const ReadOptions& options) {
 //}
 //#endif
 void DBImpl::RecordReadSample(Slice key) {
-  MutexLock l(&undefine_mutex);
   if (versions_->current()->RecordReadSample(key)) {
+    MaybeScheduleSeekCompaction();
+  }
+}
+
+namespace {
+// Reads left before the next sampled Get() of this thread. Kept per thread so
+// that the readers do not share a counter.
+thread_local int reads_until_sample = 0;
+}  // namespace
+
+void DBImpl::MaybeSampleGetStats(Version* current,
+                                 const Version::GetStats& stats) {
+  if (reads_until_sample > 0) {
+    reads_until_sample--;
+    return;
+  }
+  reads_until_sample = config::kReadSamplePeriod - 1;
+  read_samples_.fetch_add(1, std::memory_order_relaxed);
+  read_sample_probes_.fetch_add(stats.files_probed, std::memory_order_relaxed);
+  for (int level = 0; level < config::kNumLevels; level++) {
+    if (stats.filter_checks[level] == 0) {
+      continue;
+    }
+    filter_checks_[level].fetch_add(stats.filter_checks[level],
+                                    std::memory_order_relaxed);
+    filter_negatives_[level].fetch_add(stats.filter_negatives[level],
+                                       std::memory_order_relaxed);
+    filter_false_positives_[level].fetch_add(
+        stats.filter_false_positives[level], std::memory_order_relaxed);
+  }
+  if (current->UpdateStats(stats, config::kReadSamplePeriod)) {
+    MaybeScheduleSeekCompaction();
+  }
+}
+
+void DBImpl::RecordReadLatency(uint64_t latency_micros,
+                               uint64_t now_micros) {
+  read_latency_sum_.fetch_add(latency_micros, std::memory_order_relaxed);
+  read_latency_count_.fetch_add(1, std::memory_order_relaxed);
+  uint64_t next = next_rate_tune_micros_.load(std::memory_order_relaxed);
+  // Only the reader that moves the deadline forward tunes the limiters.
+  if (now_micros < next ||
+      !next_rate_tune_micros_.compare_exchange_strong(
+          next, now_micros + config::kRateLimiterTunePeriodMicros)) {
+    return;
+  }
+  const uint64_t count = read_latency_count_.exchange(0);
+  const uint64_t sum = read_latency_sum_.exchange(0);
+  if (count >= config::kRateLimiterTuneMinReads) {
+    TuneRateLimiters(sum / count);
+  }
+}
+
+void DBImpl::TuneRateLimiters(uint64_t avg_read_micros) {
+  const uint64_t target = options_.read_latency_target_micros;
+  for (RateLimiter* limiter :
+       {options_.rate_limiter, options_.cpu_rate_limiter}) {
+    if (limiter == nullptr) {
+      continue;
+    }
+    const int64_t max_rate = limiter->GetMaxCreditsPerSecond();
+    const int64_t rate = limiter->GetCreditsPerSecond();
+    int64_t new_rate = rate;
+    if (write_controller_.condition() != WriteStallCondition::kNormal) {
+      // Slowing the compactions down further would only stop the writes.
+      new_rate = max_rate;
+    } else if (avg_read_micros > target) {
+      new_rate = std::max<int64_t>(
+          rate * 4 / 5, max_rate / config::kRateLimiterMinRateFraction);
+    } else if (avg_read_micros < target / 2) {
+      new_rate = std::min<int64_t>(rate * 5 / 4 + 1, max_rate);
+    }
+    if (new_rate != rate) {
+      limiter->SetCreditsPerSecond(new_rate);
+      Log(options_.info_log,
+          "Background rate limit %lld -> %lld per second, average read "
+          "latency %llu us",
+          static_cast<long long>(rate), static_cast<long long>(new_rate),
+          static_cast<unsigned long long>(avg_read_micros));
+    }
+  }
+}
+
+void DBImpl::MaybeScheduleSeekCompaction() {
+  std::unique_lock<std::mutex> lck(superversion_memlist_mtx);
+  // The file may have been compacted away or picked up already, look for it
+  // in the current version.
+  if (versions_->current()->UpdateSeekCompaction()) {
     MaybeScheduleFlushOrCompaction();
   }
 }
@@ -4080,7 +4587,7 @@ void DBImpl::RecordReadSample(Slice key) {
 const Snapshot* DBImpl::GetSnapshot() {
   //TODO: get snapshot need to get the superversion before the sequential number
   MutexLock l(&undefine_mutex);
-  return snapshots_.New(versions_->LastSequence());
+  return snapshots_.New(VisibleSequence());
 }
 
 void DBImpl::ReleaseSnapshot(const Snapshot* snapshot) {
@@ -4096,6 +4603,259 @@ Status DBImpl::Put(const WriteOptions& o, const Slice& key, const Slice& val) {
 Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
   return DB::Delete(options, key);
 }
+
+Status DBImpl::Merge(const WriteOptions& options, const Slice& key,
+                     const Slice& value) {
+  if (merge_operator_ == nullptr) {
+    return Status::NotSupported("no merge operator");
+  }
+  return DB::Merge(options, key, value);
+}
+
+// Whether "mem" has an entry of a user key in [smallest,largest].
+static bool MemTableOverlaps(MemTable* mem, const Comparator* ucmp,
+                             const Slice& smallest, const Slice& largest) {
+  Iterator* iter = mem->NewIterator();
+  InternalKey start(smallest, kMaxSequenceNumber, kValueTypeForSeek);
+  iter->Seek(start.Encode());
+  const bool overlaps =
+      iter->Valid() && ucmp->Compare(ExtractUserKey(iter->key()), largest) <= 0;
+  delete iter;
+  return overlaps;
+}
+
+// Store in *sequence the sequence number of the newest entry of "user_key"
+// in "mem" and return true, or return false if there is none.
+static bool MemTableLatestSequence(MemTable* mem, const Comparator* ucmp,
+                                   const Slice& user_key,
+                                   SequenceNumber* sequence) {
+  Iterator* iter = mem->NewIterator();
+  InternalKey start(user_key, kMaxSequenceNumber, kValueTypeForSeek);
+  iter->Seek(start.Encode());
+  ParsedInternalKey ikey;
+  const bool found = iter->Valid() && ParseInternalKey(iter->key(), &ikey) &&
+                     ucmp->Compare(ikey.user_key, user_key) == 0;
+  if (found) {
+    *sequence = ikey.sequence;
+  }
+  delete iter;
+  return found;
+}
+
+Status DBImpl::GetLatestSequenceForKey(const Slice& key, uint64_t* sequence) {
+  const Comparator* ucmp = internal_comparator_.user_comparator();
+  SuperVersion* sv = GetThreadLocalSuperVersion();
+  // The memtables are searched from the newest, the first entry found is the
+  // newest one.
+  SequenceNumber latest = 0;
+  bool found = MemTableLatestSequence(sv->mem, ucmp, key, &latest);
+  if (sv->imm != nullptr) {
+    for (MemTable* m : sv->imm->memlist_) {
+      if (found) {
+        break;
+      }
+      found = MemTableLatestSequence(m, ucmp, key, &latest);
+    }
+  }
+  if (!found) {
+    InternalKey ikey(key, kMaxSequenceNumber, kValueTypeForSeek);
+    for (int level = 0; level < config::kNumLevels; level++) {
+      const auto& files = sv->current->LevelFiles(level);
+      if (level == 0) {
+        for (const auto& f : files) {
+          if (ucmp->Compare(key, f->smallest.user_key()) >= 0 &&
+              ucmp->Compare(key, f->largest.user_key()) <= 0) {
+            latest = std::max(latest, f->largest_seq);
+          }
+        }
+        continue;
+      }
+      const size_t i = FindFile(internal_comparator_, files, ikey.Encode());
+      if (i < files.size() &&
+          ucmp->Compare(key, files[i]->smallest.user_key()) >= 0) {
+        latest = std::max(latest, files[i]->largest_seq);
+      }
+    }
+  }
+  ReturnAndCleanupSuperVersion(sv);
+  *sequence = latest;
+  return Status::OK();
+}
+
+Status DBImpl::IngestExternalFile(const std::vector<std::string>& files) {
+  const Comparator* ucmp = internal_comparator_.user_comparator();
+  std::vector<std::shared_ptr<RemoteMemTableMetaData>> tables;
+  Status s;
+  for (const std::string& fname : files) {
+    std::shared_ptr<RemoteMemTableMetaData> table;
+    s = ReadExternalTable(env_, fname, table_cache_, &table);
+    if (!s.ok()) {
+      break;
+    }
+    tables.push_back(table);
+    if (table->shard_target_node_id != shard_target_node_id) {
+      s = Status::InvalidArgument(fname, "built for another memory node");
+      break;
+    }
+  }
+  std::sort(tables.begin(), tables.end(),
+            [ucmp](const std::shared_ptr<RemoteMemTableMetaData>& a,
+                   const std::shared_ptr<RemoteMemTableMetaData>& b) {
+              return ucmp->Compare(a->smallest.user_key(),
+                                   b->smallest.user_key()) < 0;
+            });
+  for (size_t i = 1; s.ok() && i < tables.size(); i++) {
+    if (ucmp->Compare(tables[i]->smallest.user_key(),
+                      tables[i - 1]->largest.user_key()) <= 0) {
+      s = Status::InvalidArgument("the external tables overlap");
+    }
+  }
+
+  if (s.ok()) {
+    // The entries of the tables have sequence number 0, they would be
+    // hidden by any entry of their keys already in the DB. Holding the lock
+    // keeps the memtables from being flushed and the compactions from
+    // being picked while the tables are placed.
+    VersionEdit edit(0);
+    std::unique_lock<std::mutex> l(superversion_memlist_mtx);
+    MemTable* mem = mem_.load();
+    MemTableListVersion* imm = imm_.current();
+    Version* base = versions_->current();
+    for (const auto& table : tables) {
+      const Slice smallest = table->smallest.user_key();
+      const Slice largest = table->largest.user_key();
+      bool overlaps = MemTableOverlaps(mem, ucmp, smallest, largest);
+      for (MemTable* m : imm->memlist_) {
+        overlaps = overlaps || MemTableOverlaps(m, ucmp, smallest, largest);
+      }
+      const int level =
+          overlaps ? -1 : base->PickLevelForIngestedTable(smallest, largest);
+      if (level < 0) {
+        s = Status::InvalidArgument("the DB has keys in the range of an "
+                                    "external table");
+        break;
+      }
+      table->level = level;
+      table->number = versions_->NewFileNumber();
+      edit.AddFile(level, table);
+    }
+    if (s.ok()) {
+      s = versions_->LogAndApply(&edit);
+#ifdef WITHPERSISTENCE
+      Edit_sync_to_remote(&edit, shard_target_node_id);
+#endif
+      InstallSuperVersion();
+    }
+  }
+
+  if (!s.ok()) {
+    // The chunks stay with the descriptors, the tables can be ingested
+    // once the range is cleared.
+    for (const auto& table : tables) {
+      table->ReleaseChunks();
+    }
+    return s;
+  }
+  for (size_t i = 0; i < files.size(); i++) {
+    env_->RemoveFile(files[i]);
+  }
+  for (const auto& table : tables) {
+    Log(options_.info_log, "Ingested #%llu to level-%d %llu bytes",
+        static_cast<unsigned long long>(table->number),
+        static_cast<int>(table->level),
+        static_cast<unsigned long long>(table->file_size));
+  }
+  return s;
+}
+Status DBImpl::CreateCheckpoint(const std::string& checkpoint_dir) {
+  if (env_->FileExists(checkpoint_dir)) {
+    return Status::InvalidArgument(checkpoint_dir, "exists");
+  }
+  Status s = env_->CreateDir(checkpoint_dir);
+  if (!s.ok()) {
+    return s;
+  }
+  FlushAllMemTables();
+
+  // The reference keeps the tables of the version, and the value logs they
+  // point into, from being freed by the compactions while they are copied.
+  std::unique_lock<std::mutex> l(superversion_memlist_mtx);
+  Version* base = versions_->current();
+  base->Ref(8);
+  const uint64_t next_file = versions_->NewFileNumber();
+  l.unlock();
+
+  VersionEdit edit(0);
+  edit.SetComparatorName(user_comparator()->Name());
+  edit.SetLogNumber(0);
+  edit.SetNextFile(next_file);
+  SequenceNumber last_sequence = 0;
+  std::vector<CheckpointFile> files;
+  std::set<uint64_t> blob_logs;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    for (const auto& table : base->LevelFiles(level)) {
+      edit.AddFile(level, table);
+      last_sequence = std::max(last_sequence, table->largest_seq);
+      CheckpointFile file;
+      file.fname = TableFileName(checkpoint_dir, table->number);
+      for (const auto& chunk : table->remote_data_mrs) {
+        file.chunks.push_back(chunk.second);
+      }
+      for (const auto& chunk : table->remote_dataindex_mrs) {
+        file.chunks.push_back(chunk.second);
+      }
+      for (const auto& chunk : table->remote_filter_mrs) {
+        file.chunks.push_back(chunk.second);
+      }
+      files.push_back(file);
+      for (const auto& log : table->blob_logs) {
+        if (blob_logs.insert(log->id).second) {
+          edit.AddBlobLog(log);
+          files.push_back(
+              CheckpointFile{BlobLogFileName(checkpoint_dir, log->id),
+                             log->remote_mrs});
+        }
+      }
+    }
+  }
+  edit.SetLastSequence(last_sequence);
+
+  uint64_t bytes = 0;
+  for (const CheckpointFile& file : files) {
+    for (const ibv_mr* chunk : file.chunks) {
+      bytes += chunk->length;
+    }
+  }
+  s = CopyCheckpointFiles(env_, files, shard_target_node_id,
+                          config::kCheckpointCopyThreads);
+  if (s.ok()) {
+    const std::string manifest = DescriptorFileName(checkpoint_dir, 1);
+    WritableFile* file;
+    s = env_->NewWritableFile(manifest, &file);
+    if (s.ok()) {
+      log::Writer log(file);
+      std::string record;
+      edit.EncodeTo(&record);
+      s = log.AddRecord(record);
+      if (s.ok()) {
+        s = file->Sync();
+      }
+      if (s.ok()) {
+        s = file->Close();
+      }
+      delete file;
+    }
+  }
+  if (s.ok()) {
+    s = SetCurrentFile(env_, checkpoint_dir, 1);
+  }
+  base->Unref(8);
+
+  Log(options_.info_log, "Checkpoint %s: %d files, %llu bytes: %s",
+      checkpoint_dir.c_str(), static_cast<int>(files.size()),
+      static_cast<unsigned long long>(bytes), s.ToString().c_str());
+  return s;
+}
 //
 //Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
 //  Writer w(&undefine_mutex);
@@ -4185,8 +4945,11 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   auto total_start = std::chrono::high_resolution_clock::now();
 #endif
   size_t kv_num = WriteBatchInternal::Count(updates);
-  assert(kv_num == 1);
-  uint64_t sequence = versions_->AssignSequnceNumbers(kv_num);
+  assert(kv_num >= 1);
+  ThrottleWrite(WriteBatchInternal::ByteSize(updates));
+  // The readers only see a batch of more entries once all of them are in.
+  uint64_t sequence = kv_num == 1 ? versions_->AssignSequnceNumbers(kv_num)
+                                  : AssignBatchSequence(kv_num);
   //todo: remove
 //  kv_counter0.fetch_add(1);
   MemTable* mem;
@@ -4220,8 +4983,13 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
 //      status = WriteBatchInternal::InsertInto(updates, imm_);
 //    }
     assert(sequence <= mem->Getlargest_seq_supposed() && sequence >= mem->GetFirstseq());
-    status = WriteBatchInternal::InsertInto(updates, mem);
-    mem->increase_seq_count(kv_num);
+    if (kv_num == 1) {
+      status = WriteBatchInternal::InsertInto(updates, mem);
+      mem->increase_seq_count(kv_num);
+    } else {
+      status = InsertBatchEntries(updates, sequence, mem);
+      PublishBatch(sequence);
+    }
 #if defined(LOG_TYPE) && LOG_TYPE == 0
     std::unique_lock<std::mutex> l(log_mtx);
     status = log_->AddRecord(WriteBatchInternal::Contents(updates));
@@ -4266,6 +5034,111 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
 // seldom Lock
 //// TOTHINK The write batch should not too large. other wise the wait function may
 //// memtable could overflow even before the actual write.
+namespace {
+// Collects the entries of a batch, which point into the batch.
+class BatchEntryCollector : public WriteBatch::Handler {
+ public:
+  struct Entry {
+    ValueType type;
+    Slice key;
+    Slice value;
+  };
+  std::vector<Entry> entries;
+
+  void Put(const Slice& key, const Slice& value) override {
+    entries.push_back(Entry{kTypeValue, key, value});
+  }
+  void Delete(const Slice& key) override {
+    entries.push_back(Entry{kTypeDeletion, key, Slice()});
+  }
+  void Merge(const Slice& key, const Slice& value) override {
+    entries.push_back(Entry{kTypeMerge, key, value});
+  }
+};
+}  // namespace
+
+Status DBImpl::InsertBatchEntries(WriteBatch* updates, uint64_t sequence,
+                                  MemTable* mem) {
+  // The number skipped by AssignBatchSequence() still counts towards the
+  // memtable it belongs to.
+  MemTable* skipped;
+  Status s = PickupTableToWrite(false, sequence - 1, skipped);
+  if (!s.ok()) {
+    return s;
+  }
+  skipped->increase_seq_count(1);
+  BatchEntryCollector collector;
+  s = updates->Iterate(&collector);
+  if (!s.ok()) {
+    return s;
+  }
+  // The sequence numbers of the batch may run past the end of the range of
+  // "mem", every entry goes to the memtable its number belongs to.
+  for (size_t i = 0; i < collector.entries.size(); i++) {
+    const BatchEntryCollector::Entry& e = collector.entries[i];
+    if (i > 0) {
+      s = PickupTableToWrite(false, sequence + i, mem);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    mem->Add(sequence + i, e.type, e.key, e.value);
+    mem->increase_seq_count(1);
+  }
+  return s;
+}
+
+void DBImpl::ThrottleWrite(size_t batch_bytes) {
+  user_bytes_written_.fetch_add(batch_bytes, std::memory_order_relaxed);
+  const uint64_t delay = write_controller_.GetDelay(env_, batch_bytes);
+  if (delay > 0) {
+    env_->SleepForMicroseconds(static_cast<int>(delay));
+    write_delay_micros_.fetch_add(delay, std::memory_order_relaxed);
+    write_delay_count_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+SequenceNumber DBImpl::AssignBatchSequence(size_t n) {
+  std::lock_guard<std::mutex> l(hidden_batches_mtx_);
+  num_hidden_batches_.fetch_add(1);
+  // A read at versions_->LastSequence() sees the next number assigned, so
+  // one more number is taken and the batch starts after it, see
+  // InsertBatchEntries().
+  const SequenceNumber first = versions_->AssignSequnceNumbers(n + 1) + 1;
+  hidden_batches_.insert(first);
+  return first;
+}
+
+Status DBImpl::InsertBatchAt(WriteBatch* updates, SequenceNumber sequence) {
+  MemTable* mem;
+  Status s = PickupTableToWrite(false, sequence, mem);
+  if (s.ok()) {
+    WriteBatchInternal::SetSequence(updates, sequence);
+    s = InsertBatchEntries(updates, sequence, mem);
+  }
+  return s;
+}
+
+void DBImpl::PublishBatch(SequenceNumber first) {
+  std::lock_guard<std::mutex> l(hidden_batches_mtx_);
+  hidden_batches_.erase(hidden_batches_.find(first));
+  num_hidden_batches_.fetch_sub(1);
+}
+
+SequenceNumber DBImpl::VisibleSequence() {
+  // Loaded before num_hidden_batches_: a batch whose numbers are included
+  // is then either counted or fully inserted.
+  const SequenceNumber last = versions_->LastSequence();
+  if (num_hidden_batches_.load() == 0) {
+    return last;
+  }
+  std::lock_guard<std::mutex> l(hidden_batches_mtx_);
+  if (hidden_batches_.empty()) {
+    return last;
+  }
+  return std::min(last, *hidden_batches_.begin() - 1);
+}
+
 Status DBImpl::PickupTableToWrite(bool force, uint64_t seq_num, MemTable*& mem_r) {
   Status s = Status::OK();
   //Get a snapshot it is vital for the CAS but not vital for the wait logic.
@@ -4273,15 +5146,14 @@ Status DBImpl::PickupTableToWrite(bool force, uint64_t seq_num, MemTable*& mem_r
   // First check whether we need to switch the table, we do not Lock here, because
   // most of the time the memtable will not be switched. we will Lock inside and
   // get the table
-  bool delayed = false;
   //TODO(RUIHONG): Avoid lock twice when swithing the memtable.
   while(seq_num > mem_r->Getlargest_seq_supposed()){
     //before switch the table we need to check whether there is enough room
-    // for a new table.
-
-    size_t level0_filenum = versions_->NumLevelFiles(0);
+    // for a new table. The smooth slowdown is done by write_controller_ in
+    // Write(), here the writers only stop.
     if (imm_.current_memtable_num() >= config::Immutable_StopWritesTrigger
-        || level0_filenum >= config::kL0_StopWritesTrigger) {
+        || versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger
+        || write_controller_.IsStopped()) {
       // We have filled up the current memtable, but the previous
       // one is still being compacted, so we wait.
       // the wait will never get signalled.
@@ -4290,9 +5162,11 @@ Status DBImpl::PickupTableToWrite(bool force, uint64_t seq_num, MemTable*& mem_r
       std::unique_lock<std::mutex> lck(superversion_memlist_mtx);
 //      imm_mtx.lock();
       Log(options_.info_log, "Current memtable full; waiting...\n");
+      const uint64_t stop_start_micros = env_->NowMicros();
       mem_r = mem_.load();
       while ((imm_.current_memtable_num() >= config::Immutable_StopWritesTrigger || versions_->NumLevelFiles(0) >=
-             config::kL0_StopWritesTrigger) && seq_num > mem_r->Getlargest_seq_supposed()) {
+             config::kL0_StopWritesTrigger || write_controller_.IsStopped()) &&
+             seq_num > mem_r->Getlargest_seq_supposed()) {
         assert(seq_num > mem_r->GetFirstseq());
 //        std::cout << "Writer is going to wait current immutable number " << (imm_.current_memtable_num()) << " Level 0 file number "
 //                  << (versions_->NumLevelFiles(0)) <<std::endl;
@@ -4300,10 +5174,10 @@ Status DBImpl::PickupTableToWrite(bool force, uint64_t seq_num, MemTable*& mem_r
 //        printf("thread was waked up\n");
         mem_r = mem_.load();
       }
+      write_stop_micros_.fetch_add(env_->NowMicros() - stop_start_micros,
+                                   std::memory_order_relaxed);
+      write_stop_count_.fetch_add(1, std::memory_order_relaxed);
 //      imm_mtx.unlock();
-    } else if(level0_filenum > config::kL0_SlowdownWritesTrigger && !delayed){
-      env_->SleepForMicroseconds(1000);
-      delayed = true;
     }else{
       std::unique_lock<std::mutex> l(superversion_memlist_mtx);
 //      assert(locked == false);
@@ -4319,9 +5193,10 @@ Status DBImpl::PickupTableToWrite(bool force, uint64_t seq_num, MemTable*& mem_r
       //After aquire the lock check the status again
       if (imm_.current_memtable_num() <= config::Immutable_StopWritesTrigger&&
           versions_->NumLevelFiles(0) <= config::kL0_StopWritesTrigger &&
+          !write_controller_.IsStopped() &&
           seq_num > mem_r->Getlargest_seq_supposed()){
         assert(versions_->PrevLogNumber() == 0);
-        MemTable* temp_mem = new MemTable(internal_comparator_);
+        MemTable* temp_mem = NewMemTable();
         uint64_t last_mem_seq = mem_r->Getlargest_seq_supposed();
         //The memtable seq barrier is (  ];
         temp_mem->SetFirstSeq(last_mem_seq+1);
@@ -4649,23 +5524,165 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
   } else if (in == "stats") {
     char buf[200];
     std::snprintf(buf, sizeof(buf),
-                  "                               Compactions\n"
-                  "Level  Files Size(MB) Time(sec) Read(MB) Write(MB)\n"
-                  "--------------------------------------------------\n");
+                  "                                         Compactions\n"
+                  "Level  Files Size(MB) Target(MB) Time(sec) Read(MB) Write(MB)\n"
+                  "-------------------------------------------------------------\n");
     value->append(buf);
+    Version* current = versions_->current();
     for (int level = 0; level < config::kNumLevels; level++) {
       int files = versions_->NumLevelFiles(level);
       if (stats_[level].micros > 0 || files > 0) {
-        std::snprintf(buf, sizeof(buf), "%3d %8d %8.0f %9.0f %8.0f %9.0f\n",
+        std::snprintf(buf, sizeof(buf), "%3d %8d %8.0f %10.0f %9.0f %8.0f %9.0f\n",
                       level, files, versions_->NumLevelBytes(level) / 1048576.0,
+                      level == 0 ? 0.0 : current->MaxBytesForLevel(level) / 1048576.0,
                       stats_[level].micros / 1e6,
                       stats_[level].bytes_read / 1048576.0,
                       stats_[level].bytes_written / 1048576.0);
         value->append(buf);
       }
     }
+    std::snprintf(buf, sizeof(buf),
+                  "Write delayed: %llu writes %.3f sec, stopped: %llu writes "
+                  "%.3f sec\n",
+                  static_cast<unsigned long long>(write_delay_count_.load()),
+                  write_delay_micros_.load() / 1e6,
+                  static_cast<unsigned long long>(write_stop_count_.load()),
+                  write_stop_micros_.load() / 1e6);
+    value->append(buf);
+    std::snprintf(buf, sizeof(buf),
+                  "Write stall condition: %s, delayed rate %.1f MB/s, "
+                  "pending compaction %.0f MB\n",
+                  WriteStallConditionName(write_controller_.condition()),
+                  write_controller_.delayed_write_rate() / 1048576.0,
+                  current->EstimatedCompactionNeededBytes() / 1048576.0);
+    value->append(buf);
+    int64_t compaction_written = 0;
+    int64_t compaction_copied = 0;
+    for (int level = 1; level < config::kNumLevels; level++) {
+      compaction_written += stats_[level].bytes_written;
+      compaction_copied += stats_[level].bytes_copied;
+    }
+    std::snprintf(buf, sizeof(buf),
+                  "Compaction output memcpy bytes per written byte: %.4f\n",
+                  compaction_written == 0
+                      ? 0.0
+                      : static_cast<double>(compaction_copied) /
+                            compaction_written);
+    value->append(buf);
+    const uint64_t read_samples = read_samples_.load();
+    std::snprintf(buf, sizeof(buf),
+                  "Sampled reads: %llu, tables probed per read %.2f, "
+                  "seek compactions: %llu\n",
+                  static_cast<unsigned long long>(read_samples),
+                  read_samples == 0
+                      ? 0.0
+                      : static_cast<double>(read_sample_probes_.load()) /
+                            read_samples,
+                  static_cast<unsigned long long>(
+                      versions_->NumSeekCompactions()));
+    value->append(buf);
+    std::snprintf(buf, sizeof(buf),
+                  "Compaction filters removed %llu, changed %llu entries, "
+                  "periodic compactions: %llu\n",
+                  static_cast<unsigned long long>(
+                      filter_removed_entries_.load()),
+                  static_cast<unsigned long long>(
+                      filter_changed_entries_.load()),
+                  static_cast<unsigned long long>(
+                      versions_->NumPeriodicCompactions()));
+    value->append(buf);
+    if (options_.min_blob_size > 0) {
+      uint64_t blob_logs, blob_bytes, blob_live_bytes;
+      versions_->GetBlobLogStats(&blob_logs, &blob_bytes, &blob_live_bytes);
+      std::snprintf(buf, sizeof(buf),
+                    "Value logs: %llu, %.1f MB written, %.1f MB live, "
+                    "collections: %llu\n",
+                    static_cast<unsigned long long>(blob_logs),
+                    blob_bytes / 1048576.0, blob_live_bytes / 1048576.0,
+                    static_cast<unsigned long long>(
+                        versions_->NumBlobGCCompactions()));
+      value->append(buf);
+    }
+    if (options_.filter_policy != nullptr) {
+      // Over the sampled reads: the data block reads a lookup makes in the
+      // tables of a level, and those its filters let through in vain.
+      std::snprintf(buf, sizeof(buf),
+                    "Level Bits/key Filter checks  FP rate Reads/lookup "
+                    "FP reads/lookup\n");
+      value->append(buf);
+      for (int level = 0; level < config::kNumLevels; level++) {
+        const uint64_t checks = filter_checks_[level].load();
+        if (checks == 0 && versions_->NumLevelFiles(level) == 0) {
+          continue;
+        }
+        const uint64_t negatives = filter_negatives_[level].load();
+        const uint64_t false_positives = filter_false_positives_[level].load();
+        std::snprintf(
+            buf, sizeof(buf), "%5d %8d %13llu %8.5f %12.4f %15.4f\n", level,
+            versions_->FilterBitsPerKey(level),
+            static_cast<unsigned long long>(checks),
+            negatives + false_positives == 0
+                ? 0.0
+                : static_cast<double>(false_positives) /
+                      (negatives + false_positives),
+            read_samples == 0
+                ? 0.0
+                : static_cast<double>(checks - negatives) / read_samples,
+            read_samples == 0
+                ? 0.0
+                : static_cast<double>(false_positives) / read_samples);
+        value->append(buf);
+      }
+    }
+    const uint64_t upper_input = versions_->CompactionUpperInputBytes();
+    std::snprintf(buf, sizeof(buf),
+                  "Compaction input overlap ratio: %.2f (%.1f MB level-n, "
+                  "%.1f MB level-n+1), outputs cut at grandparent boundaries "
+                  "%llu, at grandparent overlap %llu\n",
+                  upper_input == 0
+                      ? 0.0
+                      : static_cast<double>(
+                            versions_->CompactionLowerInputBytes()) /
+                            upper_input,
+                  upper_input / 1048576.0,
+                  versions_->CompactionLowerInputBytes() / 1048576.0,
+                  static_cast<unsigned long long>(output_boundary_cuts_.load()),
+                  static_cast<unsigned long long>(output_overlap_cuts_.load()));
+    value->append(buf);
+    const char* limiter_names[] = {"RDMA rate limiter", "CPU rate limiter"};
+    const RateLimiter* limiters[] = {options_.rate_limiter,
+                                     options_.cpu_rate_limiter};
+    for (int i = 0; i < 2; i++) {
+      if (limiters[i] == nullptr) {
+        continue;
+      }
+      std::snprintf(
+          buf, sizeof(buf),
+          "%s: %lld/%lld per second, through high %lld low %lld, "
+          "waited high %.3f low %.3f s\n",
+          limiter_names[i],
+          static_cast<long long>(limiters[i]->GetCreditsPerSecond()),
+          static_cast<long long>(limiters[i]->GetMaxCreditsPerSecond()),
+          static_cast<long long>(
+              limiters[i]->GetTotalCreditsThrough(RateLimiter::kHigh)),
+          static_cast<long long>(
+              limiters[i]->GetTotalCreditsThrough(RateLimiter::kLow)),
+          limiters[i]->GetTotalWaitMicros(RateLimiter::kHigh) / 1e6,
+          limiters[i]->GetTotalWaitMicros(RateLimiter::kLow) / 1e6);
+      value->append(buf);
+    }
     return true;
-  } else if (in == "sstables") {
+  } else if (in == "write-amplification") {
+    uint64_t table_bytes = 0;
+    uint64_t user_bytes = 0;
+    GetWriteAmplificationBytes(&table_bytes, &user_bytes);
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%.2f",
+                  user_bytes == 0 ? 0.0
+                                  : static_cast<double>(table_bytes) / user_bytes);
+    value->append(buf);
+    return true;
+} else if (in == "sstables") {
     *value = versions_->current()->DebugString();
     return true;
   } else if (in == "approximate-memory-usage") {
@@ -4686,6 +5703,15 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
   return false;
 }
 
+void DBImpl::GetWriteAmplificationBytes(uint64_t* table_bytes,
+                                        uint64_t* user_bytes) {
+  *table_bytes = 0;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    *table_bytes += stats_[level].bytes_written;
+  }
+  *user_bytes = user_bytes_written_.load();
+}
+
 void DBImpl::GetApproximateSizes(const Range* range, int n, uint64_t* sizes) {
   // TODO(opt): better implementation
   MutexLock l(&undefine_mutex);
@@ -4719,6 +5745,94 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::Merge(const WriteOptions& opt, const Slice& key,
+                 const Slice& value) {
+  WriteBatch batch;
+  batch.Merge(key, value);
+  return Write(opt, &batch);
+}
+
+Status DB::IngestExternalFile(const std::vector<std::string>& /*files*/) {
+  return Status::NotSupported("external tables");
+}
+
+Status DB::CreateCheckpoint(const std::string& /*checkpoint_dir*/) {
+  return Status::NotSupported("checkpoints");
+}
+
+Status DB::GetLatestSequenceForKey(const Slice& /*key*/,
+                                   uint64_t* /*sequence*/) {
+  return Status::NotSupported("sequence numbers of keys");
+}
+
+const char* const kDefaultColumnFamilyName = "default";
+
+ColumnFamilyHandle::~ColumnFamilyHandle() = default;
+
+Status DB::Put(const WriteOptions& options, ColumnFamilyHandle* column_family,
+               const Slice& key, const Slice& value) {
+  if (column_family->GetID() != 0) {
+    return Status::InvalidArgument(column_family->GetName(),
+                                   "unknown column family");
+  }
+  return Put(options, key, value);
+}
+
+Status DB::Delete(const WriteOptions& options,
+                  ColumnFamilyHandle* column_family, const Slice& key) {
+  if (column_family->GetID() != 0) {
+    return Status::InvalidArgument(column_family->GetName(),
+                                   "unknown column family");
+  }
+  return Delete(options, key);
+}
+
+Status DB::Merge(const WriteOptions& options,
+                 ColumnFamilyHandle* column_family, const Slice& key,
+                 const Slice& value) {
+  if (column_family->GetID() != 0) {
+    return Status::InvalidArgument(column_family->GetName(),
+                                   "unknown column family");
+  }
+  return Merge(options, key, value);
+}
+
+Status DB::Get(const ReadOptions& options, ColumnFamilyHandle* column_family,
+               const Slice& key, std::string* value) {
+  if (column_family->GetID() != 0) {
+    return Status::InvalidArgument(column_family->GetName(),
+                                   "unknown column family");
+  }
+  return Get(options, key, value);
+}
+
+Iterator* DB::NewIterator(const ReadOptions& options,
+                          ColumnFamilyHandle* column_family) {
+  if (column_family->GetID() != 0) {
+    return NewErrorIterator(Status::InvalidArgument(
+        column_family->GetName(), "unknown column family"));
+  }
+  return NewIterator(options);
+}
+
+bool DB::GetProperty(ColumnFamilyHandle* column_family, const Slice& property,
+                     std::string* value) {
+  if (column_family->GetID() != 0) {
+    return false;
+  }
+  return GetProperty(property, value);
+}
+
+Status DB::Get(const ReadOptions& options, const Slice& key,
+               PinnableSlice* value) {
+  value->Reset();
+  Status s = Get(options, key, value->GetSelf());
+  if (s.ok()) {
+    value->PinSelf();
+  }
+  return s;
+}
+
 DB::~DB() = default;
 
 Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
@@ -4727,40 +5841,7 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
   if (options.ShardInfo == nullptr){
     //If it is not sharded
     DBImpl* impl = new DBImpl(options, dbname);
-    impl->undefine_mutex.Lock();
-    VersionEdit edit(0);
-    // Recover handles create_if_missing, error_if_exists
-    bool save_manifest = false;
-    Status s = impl->Recover(&edit, &save_manifest);
-    if (s.ok() && impl->mem_ == nullptr) {
-      // Create new log and a corresponding memtable.
-      uint64_t new_log_number = impl->versions_->NewFileNumber();
-      WritableFile* lfile;
-      s = options.env->NewWritableFile(LogFileName(dbname, new_log_number),
-                                       &lfile);
-      if (s.ok()) {
-        edit.SetLogNumber(new_log_number);
-        impl->logfile_ = lfile;
-        impl->logfile_number_ = new_log_number;
-        impl->log_ = new log::Writer(lfile);
-        impl->mem_ = new MemTable(impl->internal_comparator_);
-        impl->mem_.load()->SetFirstSeq(0);
-        impl->mem_.load()->SetLargestSeq(MEMTABLE_SEQ_SIZE-1);
-        impl->mem_.load()->Ref();
-      }
-    }
-    if (s.ok() && save_manifest) {
-      edit.SetPrevLogNumber(0);  // No older logs needed after recovery.
-      edit.SetLogNumber(impl->logfile_number_);
-      //    std::unique_lock<std::mutex> lck(impl->versionset_mtx,std::defer_lock);
-      s = impl->versions_->LogAndApply(&edit);
-    }
-    if (s.ok()) {
-      //    impl->RemoveObsoleteFiles();
-      impl->MaybeScheduleFlushOrCompaction();
-    }
-    impl->InstallSuperVersion();
-    impl->undefine_mutex.Unlock();
+    Status s = impl->RecoverAndStart();
     if (s.ok()) {
       assert(impl->mem_ != nullptr);
       *dbptr = impl;
@@ -4771,55 +5852,13 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
     return s;
   }else{// If it is sharded.
     Status s;
-    uint8_t memory_node_num = Env::Default()->rdma_mg->memory_nodes.size();
     DBImpl_Sharding* impl_with_shards = new DBImpl_Sharding(options, dbname);
     *dbptr = impl_with_shards;
-//    int i = 0;
-//    uint8_t shard_target_node_id = 2*i;
     for(auto iter : *impl_with_shards->GetShards_pool()){
-
-      DBImpl* impl = iter.second;
       //The node id space are shared by both compute nodes and memory nodes.
       // we need to twice the id.
-//      shard_target_node_id = 2*i;
-      //TODO: the target node id should be set before we setup the client handling threads.
-//      impl->SetTargetnodeid(shard_target_node_id);
-//      i++;
-//      impl->SetTargetnodeid()
-      impl->undefine_mutex.Lock();
-      VersionEdit edit(0);
-      // Recover handles create_if_missing, error_if_exists
-      bool save_manifest = false;
-      s = impl->Recover(&edit, &save_manifest);
-      if (s.ok() && impl->mem_ == nullptr) {
-        // Create new log and a corresponding memtable.
-        uint64_t new_log_number = impl->versions_->NewFileNumber();
-        WritableFile* lfile;
-        s = options.env->NewWritableFile(LogFileName(dbname, new_log_number),
-                                         &lfile);
-        if (s.ok()) {
-          edit.SetLogNumber(new_log_number);
-          impl->logfile_ = lfile;
-          impl->logfile_number_ = new_log_number;
-          impl->log_ = new log::Writer(lfile);
-          impl->mem_ = new MemTable(impl->internal_comparator_);
-          impl->mem_.load()->SetFirstSeq(0);
-          impl->mem_.load()->SetLargestSeq(MEMTABLE_SEQ_SIZE-1);
-          impl->mem_.load()->Ref();
-        }
-      }
-      if (s.ok() && save_manifest) {
-        edit.SetPrevLogNumber(0);  // No older logs needed after recovery.
-        edit.SetLogNumber(impl->logfile_number_);
-        //    std::unique_lock<std::mutex> lck(impl->versionset_mtx,std::defer_lock);
-        s = impl->versions_->LogAndApply(&edit);
-      }
-      if (s.ok()) {
-        //    impl->RemoveObsoleteFiles();
-        impl->MaybeScheduleFlushOrCompaction();
-      }
-      impl->InstallSuperVersion();
-      impl->undefine_mutex.Unlock();
+      DBImpl* impl = iter.second;
+      s = impl->RecoverAndStart();
       if (s.ok()) {
           assert(impl->mem_ != nullptr);
       }else{
@@ -4827,8 +5866,6 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
       }
     }
     if (s.ok()) {
-      //    assert(impl->mem_ != nullptr);
-//      assert(false);
       *dbptr = impl_with_shards;
     } else {
       assert(false);
@@ -4841,6 +5878,37 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
 
 }
 
+Status DB::Open(const Options& options, const std::string& dbname,
+                const std::vector<ColumnFamilyDescriptor>& column_families,
+                std::vector<ColumnFamilyHandle*>* handles, DB** dbptr) {
+  *dbptr = nullptr;
+  handles->clear();
+  if (options.ShardInfo != nullptr) {
+    return Status::NotSupported("column families of a sharded DB");
+  }
+  Status s = DBImpl_ColumnFamilies::CheckDescriptors(column_families);
+  if (!s.ok()) {
+    return s;
+  }
+  options.env->CreateDir(dbname);
+  DBImpl_ColumnFamilies* impl =
+      new DBImpl_ColumnFamilies(options, dbname, column_families);
+  for (size_t i = 0; s.ok() && i < impl->NumFamilies(); i++) {
+    DBImpl* family = impl->Family(i);
+    s = family->RecoverAndStart();
+    if (s.ok()) {
+      assert(family->mem_ != nullptr);
+    }
+  }
+  if (!s.ok()) {
+    delete impl;
+    return s;
+  }
+  impl->GetHandles(column_families, handles);
+  *dbptr = impl;
+  return s;
+}
+
 Snapshot::~Snapshot() = default;
 
 Status DestroyDB(const std::string& dbname, const Options& options) {
@@ -8,6 +8,7 @@
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
+#include "db/write_controller.h"
 #include <atomic>
 #include <condition_variable>
 #include <deque>
@@ -16,6 +17,7 @@
 
 #include "TimberSaw/db.h"
 #include "TimberSaw/env.h"
+#include "TimberSaw/merge_operator.h"
 
 #include "port/port.h"
 #include "port/thread_annotations.h"
@@ -96,9 +98,17 @@ class DBImpl : public DB{
   Status Put(const WriteOptions&, const Slice& key,
              const Slice& value) override;
   Status Delete(const WriteOptions&, const Slice& key) override;
+  Status Merge(const WriteOptions&, const Slice& key,
+               const Slice& value) override;
   Status Write(const WriteOptions& options, WriteBatch* updates) override;
+  Status IngestExternalFile(const std::vector<std::string>& files) override;
+  Status CreateCheckpoint(const std::string& checkpoint_dir) override;
+  Status GetLatestSequenceForKey(const Slice& key,
+                                 uint64_t* sequence) override;
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override;
+  Status Get(const ReadOptions& options, const Slice& key,
+             PinnableSlice* value) override;
   Iterator* NewIterator(const ReadOptions&) override;
 //#ifdef BYTEADDRESSABLE
 //  Iterator* NewSEQIterator(const ReadOptions&) override;
@@ -131,6 +141,18 @@ class DBImpl : public DB{
   // Samples are taken approximately once every config::kReadBytesPeriod
   // bytes.
   void RecordReadSample(Slice key);
+  // Options::merge_operator, or the built-in operator it defaults to. Null
+  // if DB::Merge() is not supported.
+  const MergeOperator* merge_operator() const { return merge_operator_; }
+  // Charge the files probed by a Get to their allowed seeks, for one in
+  // config::kReadSamplePeriod reads of the calling thread.
+  void MaybeSampleGetStats(Version* current, const Version::GetStats& stats);
+  // Account the latency of a Get() finished at "now_micros", and retune the
+  // background rate limiters once per config::kRateLimiterTunePeriodMicros.
+  void RecordReadLatency(uint64_t latency_micros, uint64_t now_micros);
+  void TuneRateLimiters(uint64_t avg_read_micros);
+  // Schedule a seek triggered compaction once a file ran out of seeks.
+  void MaybeScheduleSeekCompaction();
   void CleanupSuperVersion(SuperVersion* sv);
   void ReturnAndCleanupSuperVersion(SuperVersion* sv);
   SuperVersion* GetThreadLocalSuperVersion();
@@ -138,6 +160,23 @@ class DBImpl : public DB{
   void ResetThreadLocalSuperVersions();
   void InstallSuperVersion();
   void WaitforAllbgtasks(bool clear_mem) override;
+  // Bytes written by flushes and compactions, and by the user, see the
+  // "TimberSaw.write-amplification" property.
+  void GetWriteAmplificationBytes(uint64_t* table_bytes, uint64_t* user_bytes);
+  // Account a batch of "batch_bytes" written by the user, and delay the
+  // writer as write_controller_ asks. Called before its sequence numbers are
+  // assigned, so that a delayed writer does not hold back a flush.
+  void ThrottleWrite(size_t batch_bytes);
+  // Assign the sequence numbers of a batch of "n" entries and return the
+  // first one. The batch is hidden from VisibleSequence() until
+  // PublishBatch() is called with that number.
+  SequenceNumber AssignBatchSequence(size_t n);
+  void PublishBatch(SequenceNumber first);
+  // Insert "updates" at the numbers from AssignBatchSequence(), starting at
+  // "sequence". Write() does the same for a batch of more entries, this is
+  // for a writer publishing several batches at once (see
+  // DBImpl_ColumnFamilies::Write()).
+  Status InsertBatchAt(WriteBatch* updates, SequenceNumber sequence);
   void SetTargetnodeid(uint8_t id){
     shard_target_node_id = id;
 //    imm_.SetTargetnodeid(id);
@@ -166,6 +205,10 @@ class DBImpl : public DB{
     InternalKey tmp_storage;   // Used to keep track of compaction progress
   };
 
+  // Shared by the Get()s, exactly one of "value" and "pinned" is not null.
+  Status GetImpl(const ReadOptions& options, const Slice& key,
+                 std::string* value, PinnableSlice* pinned);
+
 
 
   Iterator* NewInternalIterator(const ReadOptions&,
@@ -194,6 +237,11 @@ class DBImpl : public DB{
   // Errors are recorded in bg_error_.
   void CompactMemTable();
   void ForceCompactMemTable();
+  // Move the memtable, if not empty, to the immutable list and schedule its
+  // flush, then flush the immutable memtables left and wait for the flushes.
+  void FlushAllMemTables();
+  // A new memtable, in registered memory with options_.zero_copy_flush.
+  MemTable* NewMemTable() const;
   Status RecoverLogFile(uint64_t log_number, bool last_log, bool* save_manifest,
                         VersionEdit* edit, SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(undefine_mutex);
@@ -202,8 +250,23 @@ class DBImpl : public DB{
       EXCLUSIVE_LOCKS_REQUIRED(undefine_mutex);
   Status WriteLevel0Table(MemTable* job, VersionEdit* edit, Version* base)
   EXCLUSIVE_LOCKS_REQUIRED(undefine_mutex);
+  // Recover the DB, or create it, and start its memtable, for DB::Open().
+  Status RecoverAndStart();
   Status PickupTableToWrite(bool force, uint64_t seq_num, MemTable*& mem_r)
       EXCLUSIVE_LOCKS_REQUIRED(undefine_mutex);
+  // Insert the entries of a batch whose numbers come from
+  // AssignBatchSequence(), whose first sequence number is "sequence" and
+  // belongs to "mem".
+  Status InsertBatchEntries(WriteBatch* updates, uint64_t sequence,
+                            MemTable* mem);
+  // The sequence number the reads without a snapshot, and the new snapshots,
+  // read at: versions_->LastSequence(), kept below the batches still being
+  // inserted.
+  SequenceNumber VisibleSequence();
+  // Update write_controller_ from the flush backlog and the compaction debt
+  // of the current version, and notify options_.listener of the changes.
+  // REQUIRES: superversion_memlist_mtx is held.
+  void RecalculateWriteStallConditions();
   WriteBatch* BuildBatchGroup(Writer** last_writer)
       EXCLUSIVE_LOCKS_REQUIRED(undefine_mutex);
 
@@ -330,6 +393,55 @@ class DBImpl : public DB{
   Status bg_error_;
 
   CompactionStats stats_[config::kNumLevels];
+  // Bytes of the write batches applied by the user, the denominator of the
+  // write amplification.
+  std::atomic<uint64_t> user_bytes_written_{0};
+  WriteController write_controller_{options_.delayed_write_rate};
+  // First sequence numbers of the batches being inserted, see
+  // AssignBatchSequence(). num_hidden_batches_ lets the readers skip the
+  // mutex while there are none.
+  std::mutex hidden_batches_mtx_;
+  std::multiset<SequenceNumber> hidden_batches_;
+  std::atomic<size_t> num_hidden_batches_{0};
+  // Compaction debt seen by the last RecalculateWriteStallConditions().
+  uint64_t last_pending_compaction_bytes_ = 0;
+  // Time the writers spent throttled by write_controller_ and stopped on
+  // write_stall_cv, and the number of such writes.
+  std::atomic<uint64_t> write_delay_micros_{0};
+  std::atomic<uint64_t> write_delay_count_{0};
+  std::atomic<uint64_t> write_stop_micros_{0};
+  std::atomic<uint64_t> write_stop_count_{0};
+  // Sampled Get() calls that reached the tables and the number of tables
+  // they probed, see MaybeSampleGetStats().
+  std::atomic<uint64_t> read_samples_{0};
+  std::atomic<uint64_t> read_sample_probes_{0};
+  // The filter checks of the sampled Get() calls per level, see
+  // Version::GetStats.
+  std::atomic<uint64_t> filter_checks_[config::kNumLevels] = {};
+  std::atomic<uint64_t> filter_negatives_[config::kNumLevels] = {};
+  std::atomic<uint64_t> filter_false_positives_[config::kNumLevels] = {};
+  // Get() latencies since the last tuning of the rate limiters, and the time
+  // of the next tuning, see RecordReadLatency().
+  std::atomic<uint64_t> read_latency_sum_{0};
+  std::atomic<uint64_t> read_latency_count_{0};
+  std::atomic<uint64_t> next_rate_tune_micros_{0};
+  // Filter of Options::expire_values, run after options_.compaction_filter.
+  std::unique_ptr<const CompactionFilter> expiry_filter_{
+      options_.expire_values ? NewExpiryCompactionFilter() : nullptr};
+  // Operator of Options::merge_operator_type, used if
+  // options_.merge_operator is null.
+  std::unique_ptr<const MergeOperator> builtin_merge_operator_{
+      NewMergeOperator(options_.merge_operator_type)};
+  const MergeOperator* const merge_operator_{
+      options_.merge_operator != nullptr ? options_.merge_operator
+                                         : builtin_merge_operator_.get()};
+  // Entries the compaction filters removed or rewrote so far.
+  std::atomic<uint64_t> filter_removed_entries_{0};
+  std::atomic<uint64_t> filter_changed_entries_{0};
+  // Compaction outputs of this node cut on a grandparent boundary and cut
+  // because of too much grandparent overlap, see Compaction::ShouldStopBefore.
+  std::atomic<uint64_t> output_boundary_cuts_{0};
+  std::atomic<uint64_t> output_overlap_cuts_{0};
 //  std::atomic<size_t> memtable_counter = 0;
 //  std::atomic<size_t> kv_counter0 = 0;
 //  std::atomic<size_t> kv_counter1 = 0;
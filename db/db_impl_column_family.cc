@@ -0,0 +1,366 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/db_impl_column_family.h"
+
+#include <set>
+
+#include "db/write_batch_internal.h"
+
+namespace TimberSaw {
+
+namespace {
+
+// The directory of the family "name" of the DB "dbname".
+std::string ColumnFamilyDir(const std::string& dbname,
+                            const std::string& name) {
+  return name == kDefaultColumnFamilyName ? dbname : dbname + "/" + name;
+}
+
+// Splits a batch into the batches of the families.
+class ColumnFamilySplitter : public WriteBatch::Handler {
+ public:
+  explicit ColumnFamilySplitter(std::vector<WriteBatch>* batches)
+      : batches_(batches) {}
+
+  void Put(const Slice& key, const Slice& value) override {
+    (*batches_)[0].Put(key, value);
+  }
+  void Delete(const Slice& key) override { (*batches_)[0].Delete(key); }
+  void Merge(const Slice& key, const Slice& value) override {
+    (*batches_)[0].Merge(key, value);
+  }
+  Status PutCF(uint32_t column_family_id, const Slice& key,
+               const Slice& value) override {
+    if (column_family_id >= batches_->size()) {
+      return UnknownFamily();
+    }
+    (*batches_)[column_family_id].Put(key, value);
+    return Status::OK();
+  }
+  Status DeleteCF(uint32_t column_family_id, const Slice& key) override {
+    if (column_family_id >= batches_->size()) {
+      return UnknownFamily();
+    }
+    (*batches_)[column_family_id].Delete(key);
+    return Status::OK();
+  }
+  Status MergeCF(uint32_t column_family_id, const Slice& key,
+                 const Slice& value) override {
+    if (column_family_id >= batches_->size()) {
+      return UnknownFamily();
+    }
+    (*batches_)[column_family_id].Merge(key, value);
+    return Status::OK();
+  }
+
+ private:
+  static Status UnknownFamily() {
+    return Status::InvalidArgument("unknown column family");
+  }
+
+  std::vector<WriteBatch>* const batches_;
+};
+
+}  // namespace
+
+DBImpl_ColumnFamilies::DBImpl_ColumnFamilies(
+    const Options& options, const std::string& dbname,
+    const std::vector<ColumnFamilyDescriptor>& column_families) {
+  // The default family first, so that it gets id 0.
+  std::vector<const ColumnFamilyDescriptor*> ordered;
+  for (const ColumnFamilyDescriptor& cf : column_families) {
+    if (cf.name == kDefaultColumnFamilyName) {
+      ordered.insert(ordered.begin(), &cf);
+    } else {
+      ordered.push_back(&cf);
+    }
+  }
+  for (const ColumnFamilyDescriptor* cf : ordered) {
+    Options family_options = cf->options;
+    family_options.env = options.env;
+    family_options.create_if_missing = options.create_if_missing;
+    family_options.error_if_exists = options.error_if_exists;
+    family_options.ShardInfo = nullptr;
+    families_.push_back(new DBImpl(family_options,
+                                   ColumnFamilyDir(dbname, cf->name), "", ""));
+    names_.push_back(cf->name);
+  }
+  // The families are placed on the memory nodes like the shards. Every
+  // family syncs its options to the memory nodes, for the near data
+  // compactions of its tables.
+  const size_t memory_node_num = options.env->rdma_mg->memory_nodes.size();
+  for (size_t i = 0; i < families_.size(); i++) {
+    assert(i < 256);
+    families_[i]->WaitForComputeMessageHandlingThread(
+        2 * (i % memory_node_num), i);
+  }
+}
+
+DBImpl_ColumnFamilies::~DBImpl_ColumnFamilies() {
+  for (DBImpl* family : families_) {
+    delete family;
+  }
+}
+
+Status DBImpl_ColumnFamilies::CheckDescriptors(
+    const std::vector<ColumnFamilyDescriptor>& column_families) {
+  std::set<std::string> names;
+  for (const ColumnFamilyDescriptor& cf : column_families) {
+    if (cf.name.empty() || cf.name == "." || cf.name == ".." ||
+        cf.name.find('/') != std::string::npos) {
+      return Status::InvalidArgument(cf.name, "bad column family name");
+    }
+    if (!names.insert(cf.name).second) {
+      return Status::InvalidArgument(cf.name, "duplicate column family");
+    }
+    if (cf.options.ShardInfo != nullptr) {
+      return Status::NotSupported(cf.name, "sharded column family");
+    }
+  }
+  if (names.count(kDefaultColumnFamilyName) == 0) {
+    return Status::InvalidArgument("no default column family");
+  }
+  if (names.size() > 256) {
+    return Status::InvalidArgument("too many column families");
+  }
+  return Status::OK();
+}
+
+void DBImpl_ColumnFamilies::GetHandles(
+    const std::vector<ColumnFamilyDescriptor>& column_families,
+    std::vector<ColumnFamilyHandle*>* handles) const {
+  handles->clear();
+  for (const ColumnFamilyDescriptor& cf : column_families) {
+    for (size_t id = 0; id < names_.size(); id++) {
+      if (names_[id] == cf.name) {
+        handles->push_back(new ColumnFamilyHandleImpl(cf.name, id));
+        break;
+      }
+    }
+  }
+}
+
+DBImpl* DBImpl_ColumnFamilies::GetFamily(
+    ColumnFamilyHandle* column_family) const {
+  const uint32_t id = column_family->GetID();
+  return id < families_.size() ? families_[id] : nullptr;
+}
+
+ReadOptions DBImpl_ColumnFamilies::FamilyReadOptions(const ReadOptions& options,
+                                                     size_t id) {
+  ReadOptions family_options = options;
+  if (options.snapshot != nullptr) {
+    family_options.snapshot =
+        static_cast<const ColumnFamiliesSnapshot*>(options.snapshot)
+            ->snapshots[id];
+  }
+  return family_options;
+}
+
+Status DBImpl_ColumnFamilies::Put(const WriteOptions& options,
+                                  const Slice& key, const Slice& value) {
+  return families_[0]->Put(options, key, value);
+}
+
+Status DBImpl_ColumnFamilies::Delete(const WriteOptions& options,
+                                     const Slice& key) {
+  return families_[0]->Delete(options, key);
+}
+
+Status DBImpl_ColumnFamilies::Merge(const WriteOptions& options,
+                                    const Slice& key, const Slice& value) {
+  return families_[0]->Merge(options, key, value);
+}
+
+Status DBImpl_ColumnFamilies::Write(const WriteOptions& options,
+                                    WriteBatch* updates) {
+  // The whole batch is checked before any family is written, a batch
+  // naming an unknown family writes nothing.
+  std::vector<WriteBatch> batches(families_.size());
+  ColumnFamilySplitter splitter(&batches);
+  Status s = updates->Iterate(&splitter);
+  if (!s.ok()) {
+    return s;
+  }
+  std::vector<size_t> ids;
+  for (size_t id = 0; id < batches.size(); id++) {
+    if (WriteBatchInternal::Count(&batches[id]) > 0) {
+      ids.push_back(id);
+    }
+  }
+  if (ids.size() == 1) {
+    return families_[ids[0]]->Write(options, &batches[ids[0]]);
+  }
+  for (size_t id : ids) {
+    families_[id]->ThrottleWrite(WriteBatchInternal::ByteSize(&batches[id]));
+  }
+  // Every family hides its part of the batch until all the parts are in,
+  // then they are published together.
+  std::vector<SequenceNumber> sequences(batches.size());
+  {
+    std::lock_guard<std::mutex> l(batch_mutex_);
+    for (size_t id : ids) {
+      sequences[id] = families_[id]->AssignBatchSequence(
+          WriteBatchInternal::Count(&batches[id]));
+    }
+  }
+  // All the parts are inserted even if one fails, the memtables count on
+  // every number assigned.
+  for (size_t id : ids) {
+    Status family_s = families_[id]->InsertBatchAt(&batches[id], sequences[id]);
+    if (s.ok()) {
+      s = family_s;
+    }
+  }
+  {
+    std::lock_guard<std::mutex> l(batch_mutex_);
+    for (size_t id : ids) {
+      families_[id]->PublishBatch(sequences[id]);
+    }
+  }
+  return s;
+}
+
+Status DBImpl_ColumnFamilies::IngestExternalFile(
+    const std::vector<std::string>& files) {
+  return families_[0]->IngestExternalFile(files);
+}
+
+Status DBImpl_ColumnFamilies::CreateCheckpoint(
+    const std::string& checkpoint_dir) {
+  // The default family creates "checkpoint_dir", the others go to their
+  // directories in it, the same layout as the DB.
+  Status s;
+  for (size_t id = 0; s.ok() && id < families_.size(); id++) {
+    s = families_[id]->CreateCheckpoint(
+        ColumnFamilyDir(checkpoint_dir, names_[id]));
+  }
+  return s;
+}
+
+Status DBImpl_ColumnFamilies::GetLatestSequenceForKey(const Slice& key,
+                                                      uint64_t* sequence) {
+  return families_[0]->GetLatestSequenceForKey(key, sequence);
+}
+
+Status DBImpl_ColumnFamilies::Get(const ReadOptions& options, const Slice& key,
+                                  std::string* value) {
+  return families_[0]->Get(FamilyReadOptions(options, 0), key, value);
+}
+
+Status DBImpl_ColumnFamilies::Get(const ReadOptions& options, const Slice& key,
+                                  PinnableSlice* value) {
+  return families_[0]->Get(FamilyReadOptions(options, 0), key, value);
+}
+
+Iterator* DBImpl_ColumnFamilies::NewIterator(const ReadOptions& options) {
+  return families_[0]->NewIterator(FamilyReadOptions(options, 0));
+}
+
+Status DBImpl_ColumnFamilies::Put(const WriteOptions& options,
+                                  ColumnFamilyHandle* column_family,
+                                  const Slice& key, const Slice& value) {
+  DBImpl* family = GetFamily(column_family);
+  if (family == nullptr) {
+    return Status::InvalidArgument(column_family->GetName(),
+                                   "unknown column family");
+  }
+  return family->Put(options, key, value);
+}
+
+Status DBImpl_ColumnFamilies::Delete(const WriteOptions& options,
+                                     ColumnFamilyHandle* column_family,
+                                     const Slice& key) {
+  DBImpl* family = GetFamily(column_family);
+  if (family == nullptr) {
+    return Status::InvalidArgument(column_family->GetName(),
+                                   "unknown column family");
+  }
+  return family->Delete(options, key);
+}
+
+Status DBImpl_ColumnFamilies::Merge(const WriteOptions& options,
+                                    ColumnFamilyHandle* column_family,
+                                    const Slice& key, const Slice& value) {
+  DBImpl* family = GetFamily(column_family);
+  if (family == nullptr) {
+    return Status::InvalidArgument(column_family->GetName(),
+                                   "unknown column family");
+  }
+  return family->Merge(options, key, value);
+}
+
+Status DBImpl_ColumnFamilies::Get(const ReadOptions& options,
+                                  ColumnFamilyHandle* column_family,
+                                  const Slice& key, std::string* value) {
+  DBImpl* family = GetFamily(column_family);
+  if (family == nullptr) {
+    return Status::InvalidArgument(column_family->GetName(),
+                                   "unknown column family");
+  }
+  return family->Get(FamilyReadOptions(options, column_family->GetID()), key,
+                     value);
+}
+
+Iterator* DBImpl_ColumnFamilies::NewIterator(
+    const ReadOptions& options, ColumnFamilyHandle* column_family) {
+  DBImpl* family = GetFamily(column_family);
+  if (family == nullptr) {
+    return NewErrorIterator(Status::InvalidArgument(
+        column_family->GetName(), "unknown column family"));
+  }
+  return family->NewIterator(
+      FamilyReadOptions(options, column_family->GetID()));
+}
+
+bool DBImpl_ColumnFamilies::GetProperty(ColumnFamilyHandle* column_family,
+                                        const Slice& property,
+                                        std::string* value) {
+  DBImpl* family = GetFamily(column_family);
+  return family != nullptr && family->GetProperty(property, value);
+}
+
+void DBImpl_ColumnFamilies::WaitforAllbgtasks(bool clear_mem) {
+  for (DBImpl* family : families_) {
+    family->WaitforAllbgtasks(clear_mem);
+  }
+}
+
+const Snapshot* DBImpl_ColumnFamilies::GetSnapshot() {
+  // Every family has sequence numbers of its own, the snapshot holds one
+  // snapshot per family.
+  ColumnFamiliesSnapshot* snapshot = new ColumnFamiliesSnapshot;
+  std::lock_guard<std::mutex> l(batch_mutex_);
+  for (DBImpl* family : families_) {
+    snapshot->snapshots.push_back(family->GetSnapshot());
+  }
+  return snapshot;
+}
+
+void DBImpl_ColumnFamilies::ReleaseSnapshot(const Snapshot* snapshot) {
+  const ColumnFamiliesSnapshot* s =
+      static_cast<const ColumnFamiliesSnapshot*>(snapshot);
+  for (size_t id = 0; id < families_.size(); id++) {
+    families_[id]->ReleaseSnapshot(s->snapshots[id]);
+  }
+  delete s;
+}
+
+bool DBImpl_ColumnFamilies::GetProperty(const Slice& property,
+                                        std::string* value) {
+  return families_[0]->GetProperty(property, value);
+}
+
+void DBImpl_ColumnFamilies::GetApproximateSizes(const Range* range, int n,
+                                                uint64_t* sizes) {
+  families_[0]->GetApproximateSizes(range, n, sizes);
+}
+
+void DBImpl_ColumnFamilies::CompactRange(const Slice* begin,
+                                         const Slice* end) {
+  families_[0]->CompactRange(begin, end);
+}
+
+}  // namespace TimberSaw
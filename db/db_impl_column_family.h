@@ -0,0 +1,118 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_TimberSaw_DB_DB_IMPL_COLUMN_FAMILY_H_
+#define STORAGE_TimberSaw_DB_DB_IMPL_COLUMN_FAMILY_H_
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "db/db_impl.h"
+
+namespace TimberSaw {
+
+class ColumnFamilyHandleImpl : public ColumnFamilyHandle {
+ public:
+  ColumnFamilyHandleImpl(const std::string& name, uint32_t id)
+      : name_(name), id_(id) {}
+
+  const std::string& GetName() const override { return name_; }
+  uint32_t GetID() const override { return id_; }
+
+ private:
+  const std::string name_;
+  const uint32_t id_;
+};
+
+// A snapshot of every family, taken at once by
+// DBImpl_ColumnFamilies::GetSnapshot().
+class ColumnFamiliesSnapshot : public Snapshot {
+ public:
+  // Indexed by the ids of the families.
+  std::vector<const Snapshot*> snapshots;
+};
+
+// A DB opened with column families (see DB::Open()). Every family is a
+// DBImpl of its own, set up like a shard of DBImpl_Sharding: the families
+// use the RDMA_Manager and the background thread pools of the Env, and the
+// remote memory of the memory node they are placed on, round robin like
+// the shards. Family 0 is the default one.
+class DBImpl_ColumnFamilies : public DB {
+ public:
+  // REQUIRES: CheckDescriptors(column_families) is OK.
+  DBImpl_ColumnFamilies(const Options& options, const std::string& dbname,
+                        const std::vector<ColumnFamilyDescriptor>& column_families);
+
+  DBImpl_ColumnFamilies(const DBImpl_ColumnFamilies&) = delete;
+  DBImpl_ColumnFamilies& operator=(const DBImpl_ColumnFamilies&) = delete;
+
+  ~DBImpl_ColumnFamilies() override;
+
+  // Returns InvalidArgument unless the families have distinct names that
+  // can name a directory and one of them is the default family.
+  static Status CheckDescriptors(
+      const std::vector<ColumnFamilyDescriptor>& column_families);
+
+  size_t NumFamilies() const { return families_.size(); }
+  DBImpl* Family(size_t id) const { return families_[id]; }
+
+  // Fill *handles with new handles of "column_families", in their order.
+  void GetHandles(const std::vector<ColumnFamilyDescriptor>& column_families,
+                  std::vector<ColumnFamilyHandle*>* handles) const;
+
+  // Implementations of the DB interface
+  Status Put(const WriteOptions& options, const Slice& key,
+             const Slice& value) override;
+  Status Delete(const WriteOptions& options, const Slice& key) override;
+  Status Merge(const WriteOptions& options, const Slice& key,
+               const Slice& value) override;
+  Status Write(const WriteOptions& options, WriteBatch* updates) override;
+  Status IngestExternalFile(const std::vector<std::string>& files) override;
+  Status CreateCheckpoint(const std::string& checkpoint_dir) override;
+  Status GetLatestSequenceForKey(const Slice& key,
+                                 uint64_t* sequence) override;
+  Status Get(const ReadOptions& options, const Slice& key,
+             std::string* value) override;
+  Status Get(const ReadOptions& options, const Slice& key,
+             PinnableSlice* value) override;
+  Iterator* NewIterator(const ReadOptions& options) override;
+  Status Put(const WriteOptions& options, ColumnFamilyHandle* column_family,
+             const Slice& key, const Slice& value) override;
+  Status Delete(const WriteOptions& options, ColumnFamilyHandle* column_family,
+                const Slice& key) override;
+  Status Merge(const WriteOptions& options, ColumnFamilyHandle* column_family,
+               const Slice& key, const Slice& value) override;
+  Status Get(const ReadOptions& options, ColumnFamilyHandle* column_family,
+             const Slice& key, std::string* value) override;
+  Iterator* NewIterator(const ReadOptions& options,
+                        ColumnFamilyHandle* column_family) override;
+  bool GetProperty(ColumnFamilyHandle* column_family, const Slice& property,
+                   std::string* value) override;
+  void WaitforAllbgtasks(bool clear_mem) override;
+  const Snapshot* GetSnapshot() override;
+  void ReleaseSnapshot(const Snapshot* snapshot) override;
+  bool GetProperty(const Slice& property, std::string* value) override;
+  void GetApproximateSizes(const Range* range, int n, uint64_t* sizes) override;
+  void CompactRange(const Slice* begin, const Slice* end) override;
+
+ private:
+  // The family of "column_family", nullptr if the DB has none with its id.
+  DBImpl* GetFamily(ColumnFamilyHandle* column_family) const;
+  // "options" with the snapshot of the family "id" in place of the snapshot
+  // of all the families.
+  static ReadOptions FamilyReadOptions(const ReadOptions& options, size_t id);
+
+  // Indexed by the ids of the families.
+  std::vector<DBImpl*> families_;
+  std::vector<std::string> names_;
+  // Held while the sequence numbers of a batch of several families are
+  // assigned or published, and while a snapshot is taken, so that a
+  // snapshot sees such a batch in all of its families or in none.
+  std::mutex batch_mutex_;
+};
+
+}  // namespace TimberSaw
+
+#endif  // STORAGE_TimberSaw_DB_DB_IMPL_COLUMN_FAMILY_H_
@@ -4,6 +4,8 @@
 
 #include "db_impl_sharding.h"
 
+#include "db/external_table.h"
+
 namespace TimberSaw {
 
 DBImpl_Sharding::DBImpl_Sharding(const Options& options, const std::string& dbname) {
@@ -73,6 +75,17 @@ Status DBImpl_Sharding::Delete(const WriteOptions& options, const Slice& key) {
   }
 
 }
+Status DBImpl_Sharding::Merge(const WriteOptions& options, const Slice& key,
+                              const Slice& value) {
+  DBImpl* db;
+  if(Get_Target_Shard(db, key)){
+    return db->Merge(options, key, value);
+  }else{
+    // forward to other shards
+    assert(false);
+    return Status::Corruption("Shard not found\n");
+  }
+}
 Status DBImpl_Sharding::Write(const WriteOptions& options,
                               WriteBatch* updates) {
   DBImpl* db = nullptr;
@@ -88,6 +101,60 @@ Status DBImpl_Sharding::Write(const WriteOptions& options,
   }
 
 }
+Status DBImpl_Sharding::IngestExternalFile(
+    const std::vector<std::string>& files) {
+  // Every table goes to the shard of its keys. The shards add their tables
+  // one after the other.
+  std::map<DBImpl*, std::vector<std::string>> shard_files;
+  for (const std::string& fname : files) {
+    std::shared_ptr<RemoteMemTableMetaData> table;
+    Status s = ReadExternalTable(Env::Default(), fname, nullptr, &table);
+    if (!s.ok()) {
+      return s;
+    }
+    DBImpl* first = nullptr;
+    DBImpl* last = nullptr;
+    const bool found = Get_Target_Shard(first, table->smallest.user_key()) &&
+                       Get_Target_Shard(last, table->largest.user_key());
+    table->ReleaseChunks();
+    if (!found || first != last) {
+      return Status::InvalidArgument(fname, "spans several shards");
+    }
+    shard_files[first].push_back(fname);
+  }
+  for (const auto& shard : shard_files) {
+    Status s = shard.first->IngestExternalFile(shard.second);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return Status::OK();
+}
+Status DBImpl_Sharding::CreateCheckpoint(const std::string& checkpoint_dir) {
+  // Every shard is a DB of its own, checkpointed into a directory named by
+  // the position of its range.
+  Env* env = Env::Default();
+  if (env->FileExists(checkpoint_dir)) {
+    return Status::InvalidArgument(checkpoint_dir, "exists");
+  }
+  Status s = env->CreateDir(checkpoint_dir);
+  int i = 0;
+  for (auto iter = shards_pool.begin(); s.ok() && iter != shards_pool.end();
+       ++iter, i++) {
+    s = iter->second->CreateCheckpoint(checkpoint_dir + "/shard-" +
+                                       std::to_string(i));
+  }
+  return s;
+}
+Status DBImpl_Sharding::GetLatestSequenceForKey(const Slice& key,
+                                                uint64_t* sequence) {
+  DBImpl* db;
+  if (Get_Target_Shard(db, key)) {
+    return db->GetLatestSequenceForKey(key, sequence);
+  }
+  assert(false);
+  return Status::Corruption("Shard not found\n");
+}
 Status DBImpl_Sharding::Get(const ReadOptions& options, const Slice& key,
                             std::string* value) {
   DBImpl* db;
@@ -99,6 +166,16 @@ Status DBImpl_Sharding::Get(const ReadOptions& options, const Slice& key,
   }
 
 }
+Status DBImpl_Sharding::Get(const ReadOptions& options, const Slice& key,
+                            PinnableSlice* value) {
+  DBImpl* db;
+  if(Get_Target_Shard(db, key)){
+    return db->Get(options, key, value);
+  }else{
+    assert(false);
+    return Status::Corruption("Shard not found\n");
+  }
+}
 Iterator* DBImpl_Sharding::NewIterator(const ReadOptions& options) {
   //TODO: support cross shard iterator.
   DBImpl* db = shards_pool.begin()->second;
@@ -118,6 +195,25 @@ const Snapshot* DBImpl_Sharding::GetSnapshot() {
 }
 void DBImpl_Sharding::ReleaseSnapshot(const Snapshot* snapshot) {}
 bool DBImpl_Sharding::GetProperty(const Slice& property, std::string* value) {
+  value->clear();
+  if (property == Slice("TimberSaw.write-amplification")) {
+    uint64_t table_bytes = 0;
+    uint64_t user_bytes = 0;
+    for (auto iter : shards_pool) {
+      uint64_t shard_table_bytes = 0;
+      uint64_t shard_user_bytes = 0;
+      iter.second->GetWriteAmplificationBytes(&shard_table_bytes,
+                                              &shard_user_bytes);
+      table_bytes += shard_table_bytes;
+      user_bytes += shard_user_bytes;
+    }
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%.2f",
+                  user_bytes == 0 ? 0.0
+                                  : static_cast<double>(table_bytes) / user_bytes);
+    value->append(buf);
+    return true;
+  }
   //Not implemented.
   return false;
 }
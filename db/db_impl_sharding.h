@@ -21,9 +21,17 @@ class DBImpl_Sharding : public DB {
   Status Put(const WriteOptions& options, const Slice& key,
              const Slice& value) override;
   Status Delete(const WriteOptions& options, const Slice& key) override;
+  Status Merge(const WriteOptions& options, const Slice& key,
+               const Slice& value) override;
   Status Write(const WriteOptions& options, WriteBatch* updates) override;
+  Status IngestExternalFile(const std::vector<std::string>& files) override;
+  Status CreateCheckpoint(const std::string& checkpoint_dir) override;
+  Status GetLatestSequenceForKey(const Slice& key,
+                                 uint64_t* sequence) override;
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override;
+  Status Get(const ReadOptions& options, const Slice& key,
+             PinnableSlice* value) override;
   Iterator* NewIterator(const ReadOptions& options) override;
 //#ifdef BYTEADDRESSABLE
 //  Iterator* NewSEQIterator(const ReadOptions& options) override;
@@ -4,9 +4,11 @@
 
 #include "db/db_iter.h"
 
+#include "db/blob_log.h"
 #include "db/db_impl.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/merge_helper.h"
 #include "TimberSaw/env.h"
 #include "TimberSaw/iterator.h"
 #include "port/port.h"
@@ -46,11 +48,13 @@ class DBIter : public Iterator {
   enum Direction { kForward, kReverse };
 
   DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+         uint32_t seed, const ReadOptions& options, size_t prefix_length)
       : db_(db),
         user_comparator_(cmp),
         iter_(iter),
         sequence_(s),
+        upper_bound_(options.iterate_upper_bound),
+        prefix_length_(options.prefix_same_as_start ? prefix_length : 0),
         direction_(kForward),
         valid_(false),
         rnd_(seed),
@@ -63,11 +67,15 @@ class DBIter : public Iterator {
   bool Valid() const override { return valid_; }
   Slice key() const override {
     assert(valid_);
-    return (direction_ == kForward) ? ExtractUserKey(iter_->key()) : saved_key_;
+    return (direction_ == kForward && !merged_) ? ExtractUserKey(iter_->key())
+                                                : saved_key_;
   }
   Slice value() const override {
     assert(valid_);
-    return (direction_ == kForward) ? iter_->value() : saved_value_;
+    if (direction_ == kReverse) {
+      return saved_value_;
+    }
+    return buffered_ ? Slice(buffered_value_) : iter_->value();
   }
   Status status() const override {
     if (status_.ok()) {
@@ -85,9 +93,20 @@ class DBIter : public Iterator {
 
  private:
   void FindNextUserEntry(bool skipping, std::string* skip);
+  // Apply the merge operand iter_ is at to the older entries of its key,
+  // moving iter_ past them.
+  void MergeForward();
   void FindPrevUserEntry();
   bool ParseKey(ParsedInternalKey* key);
 
+  // True if "user_key" is at or after the upper bound, or after the keys
+  // with the prefix of a prefix seek.
+  bool PastEnd(const Slice& user_key) const {
+    return (upper_bound_ != nullptr &&
+            user_comparator_->Compare(user_key, *upper_bound_) >= 0) ||
+           (!prefix_.empty() && !user_key.starts_with(prefix_));
+  }
+
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
   }
@@ -110,9 +129,22 @@ class DBIter : public Iterator {
   const Comparator* const user_comparator_;
   Iterator* const iter_;
   SequenceNumber const sequence_;
+  const Slice* const upper_bound_;
+  // Non-zero if a seek only returns the keys with the prefix of its target.
+  const size_t prefix_length_;
+  // The prefix of the last seek target, empty outside of a prefix seek.
+  std::string prefix_;
   Status status_;
   std::string saved_key_;    // == current key when direction_==kReverse
   std::string saved_value_;  // == current raw value when direction_==kReverse
+  // When moving forward, the value of the current entry was fetched from a
+  // value log (kTypeBlobIndex) or merged into buffered_value_.
+  bool buffered_ = false;
+  std::string buffered_value_;
+  // When moving forward, the current entry was merged: saved_key_ holds its
+  // key and iter_ is past the entries merged.
+  bool merged_ = false;
+  MergeContext merge_context_;
   Direction direction_;
   bool valid_;
   Random rnd_;
@@ -157,6 +189,14 @@ void DBIter::Next() {
       return;
     }
     // saved_key_ already contains the key to skip past.
+  } else if (merged_) {
+    // iter_ is already past the entries merged, the older entries of the
+    // key left are skipped below.
+    if (!iter_->Valid()) {
+      valid_ = false;
+      saved_key_.clear();
+      return;
+    }
   } else {
     // Store in saved_key_ the current key so we skip it below.
     SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
@@ -181,10 +221,19 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   // Loop until we hit an acceptable entry to yield
   assert(iter_->Valid());
   assert(direction_ == kForward);
+  buffered_ = false;
+  merged_ = false;
   do {
     ParsedInternalKey ikey;
+    const bool parsed = ParseKey(&ikey);
+    if (parsed && PastEnd(ikey.user_key)) {
+      // The entries left are past the end, so are the ones of the children.
+      saved_key_.clear();
+      valid_ = false;
+      return;
+    }
     //TODO: why the sequence here is zero?
-    if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+    if (parsed && ikey.sequence <= sequence_) {
       switch (ikey.type) {
         case kTypeDeletion:
           // Arrange to skip all upcoming entries for this key since
@@ -193,15 +242,38 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
           skipping = true;
           break;
         case kTypeValue:
+        case kTypeBlobIndex:
           if (skipping &&
               user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
             // Entry hidden
           } else {
+            buffered_ = ikey.type == kTypeBlobIndex;
+            if (buffered_) {
+              Status s = ReadBlob(iter_->value(), &buffered_value_);
+              if (!s.ok()) {
+                status_ = s;
+                valid_ = false;
+                saved_key_.clear();
+                return;
+              }
+            }
             valid_ = true;
             saved_key_.clear();
             return;
           }
           break;
+        case kTypeMerge:
+          if (skipping &&
+              user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
+            // Entry hidden
+          } else {
+            MergeForward();
+            return;
+          }
+          break;
+        default:
+          // The column family types are only found in a WriteBatch.
+          break;
       }
     }
     iter_->Next();
@@ -211,16 +283,82 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   valid_ = false;
 }
 
+void DBIter::MergeForward() {
+  SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+  merge_context_.Clear();
+  merge_context_.PushOlderOperand(iter_->value());
+  // The entries of the key older than a visible one are visible.
+  Status s;
+  bool has_base = false;
+  std::string base;
+  for (iter_->Next(); iter_->Valid(); iter_->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseKey(&ikey)) {
+      valid_ = false;
+      saved_key_.clear();
+      return;
+    }
+    if (user_comparator_->Compare(ikey.user_key, saved_key_) != 0) {
+      break;
+    }
+    if (ikey.type == kTypeMerge) {
+      merge_context_.PushOlderOperand(iter_->value());
+      continue;
+    }
+    if (ikey.type == kTypeValue) {
+      base.assign(iter_->value().data(), iter_->value().size());
+      has_base = true;
+    } else if (ikey.type == kTypeBlobIndex) {
+      s = ReadBlob(iter_->value(), &base);
+      has_base = true;
+    }
+    iter_->Next();
+    break;
+  }
+  if (s.ok()) {
+    const Slice base_slice(base);
+    s = merge_context_.Merge(db_->merge_operator(), saved_key_,
+                             has_base ? &base_slice : nullptr,
+                             &buffered_value_);
+  }
+  if (!s.ok()) {
+    status_ = s;
+    valid_ = false;
+    saved_key_.clear();
+    return;
+  }
+  buffered_ = true;
+  merged_ = true;
+  valid_ = true;
+}
+
 void DBIter::Prev() {
   assert(valid_);
 
+  if (!prefix_.empty()) {
+    // The children skipped the tables without the prefix, they can not be
+    // moved back in order.
+    status_ = Status::NotSupported("Prev() after a prefix seek");
+    valid_ = false;
+    saved_key_.clear();
+    ClearSavedValue();
+    return;
+  }
+
   if (direction_ == kForward) {  // Switch directions?
-    // iter_ is pointing at the current entry.  Scan backwards until
-    // the key changes so we can use the normal reverse scanning code.
-    assert(iter_->Valid());  // Otherwise valid_ would have been false
-    SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    // iter_ is pointing at the current entry, or past it if it was merged.
+    // Scan backwards until the key changes so we can use the normal reverse
+    // scanning code.
+    if (merged_) {
+      merged_ = false;
+      if (!iter_->Valid()) {
+        iter_->SeekToLast();
+      }
+    } else {
+      assert(iter_->Valid());  // Otherwise valid_ would have been false
+      SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    }
     while (true) {
-      iter_->Prev();
       if (!iter_->Valid()) {
         valid_ = false;
         saved_key_.clear();
@@ -231,6 +369,7 @@ void DBIter::Prev() {
           0) {
         break;
       }
+      iter_->Prev();
     }
     direction_ = kReverse;
   }
@@ -242,6 +381,10 @@ void DBIter::FindPrevUserEntry() {
   assert(direction_ == kReverse);
 
   ValueType value_type = kTypeDeletion;
+  // The type of the entry the merge operands newer than it apply to, its
+  // value is in saved_value_.
+  ValueType base_type = kTypeDeletion;
+  merge_context_.Clear();
   if (iter_->Valid()) {
     do {
       ParsedInternalKey ikey;
@@ -255,6 +398,11 @@ void DBIter::FindPrevUserEntry() {
         if (value_type == kTypeDeletion) {
           saved_key_.clear();
           ClearSavedValue();
+          merge_context_.Clear();
+          base_type = kTypeDeletion;
+        } else if (value_type == kTypeMerge) {
+          SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+          merge_context_.PushNewerOperand(iter_->value());
         } else {
           Slice raw_value = iter_->value();
           if (saved_value_.capacity() > raw_value.size() + 1048576) {
@@ -263,13 +411,32 @@ void DBIter::FindPrevUserEntry() {
           }
           SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
           saved_value_.assign(raw_value.data(), raw_value.size());
+          merge_context_.Clear();
+          base_type = value_type;
         }
       }
       iter_->Prev();
     } while (iter_->Valid());
   }
 
-  if (value_type == kTypeDeletion) {
+  Status s;
+  if (value_type == kTypeBlobIndex ||
+      (value_type == kTypeMerge && base_type == kTypeBlobIndex)) {
+    const std::string index = saved_value_;
+    s = ReadBlob(index, &saved_value_);
+  }
+  if (s.ok() && value_type == kTypeMerge) {
+    std::string merged;
+    const Slice base(saved_value_);
+    s = merge_context_.Merge(db_->merge_operator(), saved_key_,
+                             base_type != kTypeDeletion ? &base : nullptr,
+                             &merged);
+    saved_value_.swap(merged);
+  }
+  if (!s.ok()) {
+    status_ = s;
+  }
+  if (value_type == kTypeDeletion || !s.ok()) {
     // End
     valid_ = false;
     saved_key_.clear();
@@ -283,6 +450,11 @@ void DBIter::FindPrevUserEntry() {
 void DBIter::Seek(const Slice& target) {
   direction_ = kForward;
   ClearSavedValue();
+  if (prefix_length_ > 0 && target.size() >= prefix_length_) {
+    prefix_.assign(target.data(), prefix_length_);
+  } else {
+    prefix_.clear();
+  }
   saved_key_.clear();
   AppendInternalKey(&saved_key_,
                     ParsedInternalKey(target, sequence_, kValueTypeForSeek));
@@ -300,6 +472,7 @@ void DBIter::Seek(const Slice& target) {
 void DBIter::SeekToFirst() {
   direction_ = kForward;
   ClearSavedValue();
+  prefix_.clear();
   iter_->SeekToFirst();
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
@@ -311,7 +484,18 @@ void DBIter::SeekToFirst() {
 void DBIter::SeekToLast() {
   direction_ = kReverse;
   ClearSavedValue();
-  iter_->SeekToLast();
+  prefix_.clear();
+  if (upper_bound_ != nullptr) {
+    // Start from the last entry before the bound rather than from the last
+    // one of the DB.
+    saved_key_.clear();
+    AppendInternalKey(&saved_key_, ParsedInternalKey(*upper_bound_,
+                                                     kMaxSequenceNumber,
+                                                     kValueTypeForSeek));
+    iter_->SeekForPrev(saved_key_);
+  } else {
+    iter_->SeekToLast();
+  }
   FindPrevUserEntry();
 }
 
@@ -319,8 +503,10 @@ void DBIter::SeekToLast() {
 
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+                        uint32_t seed, const ReadOptions& options,
+                        size_t prefix_length) {
+  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed,
+                    options, prefix_length);
 }
 
 }  // namespace TimberSaw
@@ -16,10 +16,13 @@ class DBImpl;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys. The iterator keeps to the iterate_upper_bound
+// and the prefix_same_as_start of "options", "prefix_length" is
+// Options::prefix_length.
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed);
+                        uint32_t seed, const ReadOptions& options,
+                        size_t prefix_length);
 
 }  // namespace TimberSaw
 
@@ -31,8 +31,13 @@ static const int Immutable_FlushTrigger = 1;
 // 16 totally across shards in M-M (including memtable)
 // with 8 fixed shard per compute node this equals 2 or 1
 static const int Immutable_StopWritesTrigger = 15; // Default 0 shard should be 15, add memtable should be totally 16 (new 16 shards:2
+// Writes are throttled once this many immutable memtables wait to be flushed.
+static const int Immutable_SlowdownWritesTrigger = Immutable_StopWritesTrigger * 3 / 4;
 // Level-0 compaction is started when we hit this many files.
 static const int kL0_CompactionTrigger = 1;
+// Minimum number of level-0 files merged together by an intra level-0
+// compaction, which runs when level 1 is busy with another compaction.
+static const int kL0_IntraCompactionMinFiles = 4;
 
 // Soft limit on number of level-0 files.  We slow down writes at this point.
 // in M-M the total number of kL0_SlowdownWritesTrigger accross shard is 24
@@ -64,6 +69,38 @@ static const int kMaxMemCompactLevel = 2;
 // Approximate gap in bytes between samples of data read during iteration.
 static const int kReadBytesPeriod = 1048576;
 
+// Get() charges the files it probed once every kReadSamplePeriod reads of a
+// thread, with a weight of kReadSamplePeriod seeks.
+static const int kReadSamplePeriod = 16;
+
+// The background rate limiters are tuned against
+// Options::read_latency_target_micros every kRateLimiterTunePeriodMicros,
+// from the Get() latencies of the period if there were at least
+// kRateLimiterTuneMinReads of them. The limiters are never tuned below
+// 1/kRateLimiterMinRateFraction of their initial rate.
+static const uint64_t kRateLimiterTunePeriodMicros = 200000;
+static const uint64_t kRateLimiterTuneMinReads = 64;
+static const int kRateLimiterMinRateFraction = 16;
+
+// A pipelined flush hands the memtable entries over to the table builder in
+// batches of kFlushPipelineBatchEntries, with at most kFlushPipelineDepth
+// batches in flight.
+static const size_t kFlushPipelineBatchEntries = 1024;
+static const int kFlushPipelineDepth = 4;
+
+// Compaction outputs of at least kMinOutputFileSizePercent of the maximum
+// file size end where the keys cross into the next file of the level below
+// the output level.
+static const int kMinOutputFileSizePercent = 50;
+
+// DB::CreateCheckpoint() copies the tables and the value logs out of remote
+// memory on kCheckpointCopyThreads threads.
+static const int kCheckpointCopyThreads = 4;
+
+// An OptimisticTransactionDB validates and writes a transaction with the
+// locks of the stripes of its keys held, out of kTransactionLockStripes.
+static const int kTransactionLockStripes = 256;
+
 }  // namespace config
 
 class InternalKey;
@@ -71,14 +108,30 @@ class InternalKey;
 // Value types encoded as the last component of internal keys.
 // DO NOT CHANGE THESE ENUM VALUES: they are embedded in the on-disk
 // data structures.
-enum ValueType { kTypeDeletion = 0x0, kTypeValue = 0x1 };
+enum ValueType {
+  kTypeDeletion = 0x0,
+  kTypeValue = 0x1,
+  // The value is an encoded BlobIndex pointing into a value log (see
+  // db/blob_log.h). Never found in a memtable, the flushes separate the
+  // large values.
+  kTypeBlobIndex = 0x2,
+  // The value is an operand of Options::merge_operator written by
+  // DB::Merge(), to be applied to the older entries of the key.
+  kTypeMerge = 0x3,
+  // Only found in the records of a WriteBatch, for the updates of a column
+  // family other than the default one. The type is followed by the id of
+  // the family.
+  kTypeColumnFamilyDeletion = 0x4,
+  kTypeColumnFamilyValue = 0x5,
+  kTypeColumnFamilyMerge = 0x6
+};
 // kValueTypeForSeek defines the ValueType that should be passed when
 // constructing a ParsedInternalKey object for seeking to a particular
 // sequence number (since we sort sequence numbers in decreasing order
 // and the value type is embedded as the low 8 bits in the sequence
 // number in internal keys, we need to use the highest-numbered
 // ValueType, not the lowest).
-static const ValueType kValueTypeForSeek = kTypeValue;
+static const ValueType kValueTypeForSeek = kTypeMerge;
 
 typedef uint64_t SequenceNumber;
 
@@ -457,7 +510,7 @@ inline bool ParseInternalKey(const Slice& internal_key,
   result->sequence = num >> 8;
   result->type = static_cast<ValueType>(c);
   result->user_key = Slice(internal_key.data(), n - 8);
-  return (c <= static_cast<uint8_t>(kTypeValue));
+  return (c <= static_cast<uint8_t>(kTypeMerge));
 }
 
 // A helper class useful for DBImpl::Get()
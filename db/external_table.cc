@@ -0,0 +1,44 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/external_table.h"
+
+#include "util/coding.h"
+
+namespace TimberSaw {
+
+static const uint64_t kExternalTableMagic = 0x54535f696e676573ull;
+
+Status WriteExternalTable(Env* env, const RemoteMemTableMetaData& table,
+                          const std::string& fname) {
+  std::string descriptor;
+  PutFixed64(&descriptor, kExternalTableMagic);
+  table.EncodeTo(&descriptor);
+  return WriteStringToFile(env, descriptor, fname);
+}
+
+Status ReadExternalTable(Env* env, const std::string& fname,
+                         TableCache* table_cache,
+                         std::shared_ptr<RemoteMemTableMetaData>* table) {
+  std::string descriptor;
+  Status s = ReadFileToString(env, fname, &descriptor);
+  if (!s.ok()) {
+    return s;
+  }
+  Slice input(descriptor);
+  uint64_t magic;
+  if (!GetFixed64(&input, &magic) || magic != kExternalTableMagic) {
+    return Status::InvalidArgument(fname, "not an external table descriptor");
+  }
+  auto result = std::make_shared<RemoteMemTableMetaData>(0, table_cache, 0);
+  s = result->DecodeFrom(input);
+  if (!s.ok()) {
+    result->ReleaseChunks();
+    return s;
+  }
+  *table = std::move(result);
+  return s;
+}
+
+}  // namespace TimberSaw
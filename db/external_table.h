@@ -0,0 +1,39 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A table built by SstFileWriter lives in remote memory from the start. The
+// file the writer leaves on the local file system is only a descriptor of
+// it: a magic number followed by the encoded RemoteMemTableMetaData (the
+// remote chunks, the key range, the number of entries). Until the table is
+// ingested, nobody owns the chunks; DB::IngestExternalFile() takes them over
+// and removes the descriptor, so that it can not be ingested twice.
+
+#ifndef STORAGE_TimberSaw_DB_EXTERNAL_TABLE_H_
+#define STORAGE_TimberSaw_DB_EXTERNAL_TABLE_H_
+
+#include <memory>
+#include <string>
+
+#include "db/version_edit.h"
+#include "TimberSaw/env.h"
+#include "TimberSaw/status.h"
+
+namespace TimberSaw {
+
+class TableCache;
+
+// Write the descriptor of "table" to "fname".
+Status WriteExternalTable(Env* env, const RemoteMemTableMetaData& table,
+                          const std::string& fname);
+
+// Read the descriptor in "fname" into a new *table served by "table_cache".
+// The caller owns the chunks of *table from then on: it must install the
+// table into a version, or call ReleaseChunks() on it before dropping it.
+Status ReadExternalTable(Env* env, const std::string& fname,
+                         TableCache* table_cache,
+                         std::shared_ptr<RemoteMemTableMetaData>* table);
+
+}  // namespace TimberSaw
+
+#endif  // STORAGE_TimberSaw_DB_EXTERNAL_TABLE_H_
@@ -40,6 +40,10 @@ std::string SSTTableFileName(const std::string& dbname, uint64_t number) {
   return MakeFileName(dbname, number, "sst");
 }
 
+std::string BlobLogFileName(const std::string& dbname, uint64_t log_id) {
+  return MakeFileName(dbname, log_id, "blob");
+}
+
 std::string DescriptorFileName(const std::string& dbname, uint64_t number) {
   assert(number > 0);
   char buf[100];
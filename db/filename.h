@@ -43,6 +43,11 @@ std::string TableFileName(const std::string& dbname, uint64_t number);
 // "dbname".
 std::string SSTTableFileName(const std::string& dbname, uint64_t number);
 
+// Return the name of the copy of the value log with the specified id in
+// the checkpoint "dbname", see db/checkpoint.h. The result will be prefixed
+// with "dbname".
+std::string BlobLogFileName(const std::string& dbname, uint64_t log_id);
+
 // Return the name of the descriptor file for the db named by
 // "dbname" and the specified incarnation number.  The result will be
 // prefixed with "dbname".
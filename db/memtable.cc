@@ -4,12 +4,16 @@
 
 #include "db/memtable.h"
 #include "db/dbformat.h"
+#include "db/memtable_rep.h"
+#include "db/merge_helper.h"
 #include "TimberSaw/comparator.h"
 #include "TimberSaw/env.h"
 #include "TimberSaw/iterator.h"
 #include "db/version_edit.h"
 #include "util/coding.h"
 
+#include <cstring>
+
 namespace TimberSaw {
 #ifdef PROCESSANALYSIS
 std::atomic<uint64_t> MemTable::GetTimeElapseSum = 0;
@@ -25,8 +29,19 @@ std::atomic<uint64_t> MemTable::foundNum = 0;
 //}
 std::atomic_int64_t Memtable_created = 0;
 std::atomic_int64_t Memtable_deallocated = 0;
-MemTable::MemTable(const InternalKeyComparator& cmp)
-    : comparator(cmp), refs_(0), table_(comparator, &arena_) {
+MemTable::MemTable(const InternalKeyComparator& cmp, RDMA_Manager* rdma_mg,
+                   MemTableRepType rep)
+    : comparator(cmp),
+      refs_(0),
+      arena_(Arena::kMinBlockSize, nullptr, 0, rdma_mg) {
+  // The radix tree orders the entries by their bytes, it stands in for the
+  // byte wise comparator only.
+  if (rep == kARTRep && std::strcmp(cmp.user_comparator()->Name(),
+                                    BytewiseComparator()->Name()) == 0) {
+    table_.reset(NewARTRep(&arena_));
+  } else {
+    table_.reset(NewSkipListRep(comparator, &arena_));
+  }
 //#ifndef NDEBUG
 //  printf("Memtable %p  get created, total created %lu\n", this, Memtable_created.fetch_add(1));
 //#endif
@@ -71,33 +86,34 @@ static const char* EncodeKey(std::string* scratch, const Slice& target) {
 
 class MemTableIterator : public Iterator {
  public:
-  explicit MemTableIterator(MemTable::Table* table) : iter_(table) {}
+  explicit MemTableIterator(MemTableRep* table)
+      : iter_(table->NewIterator()) {}
 
   MemTableIterator(const MemTableIterator&) = delete;
   MemTableIterator& operator=(const MemTableIterator&) = delete;
 
   ~MemTableIterator() override = default;
 
-  bool Valid() const override { return iter_.Valid(); }
-  void Seek(const Slice& k) override { iter_.Seek(EncodeKey(&tmp_, k)); }
-  void SeekToFirst() override { iter_.SeekToFirst(); }
-  void SeekToLast() override { iter_.SeekToLast(); }
-  void Next() override { iter_.Next(); }
-  void Prev() override { iter_.Prev(); }
-  Slice key() const override { return GetLengthPrefixedSlice(iter_.key()); }
+  bool Valid() const override { return iter_->Valid(); }
+  void Seek(const Slice& k) override { iter_->Seek(EncodeKey(&tmp_, k)); }
+  void SeekToFirst() override { iter_->SeekToFirst(); }
+  void SeekToLast() override { iter_->SeekToLast(); }
+  void Next() override { iter_->Next(); }
+  void Prev() override { iter_->Prev(); }
+  Slice key() const override { return GetLengthPrefixedSlice(iter_->key()); }
   Slice value() const override {
-    Slice key_slice = GetLengthPrefixedSlice(iter_.key());
+    Slice key_slice = GetLengthPrefixedSlice(iter_->key());
     return GetLengthPrefixedSlice(key_slice.data() + key_slice.size());
   }
 
   Status status() const override { return Status::OK(); }
 
  private:
-  MemTable::Table::Iterator iter_;
+  std::unique_ptr<MemTableRep::Iterator> iter_;
   std::string tmp_;  // For passing to EncodeKey
 };
 
-Iterator* MemTable::NewIterator() { return new MemTableIterator(&table_); }
+Iterator* MemTable::NewIterator() { return new MemTableIterator(table_.get()); }
 
   void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
                    const Slice& value) {
@@ -115,7 +131,7 @@ Iterator* MemTable::NewIterator() { return new MemTableIterator(&table_); }
   char* buf = nullptr;
   // TODO this is not correct since, the key and value should write to 1
   //  sizeof(Node) larger than the buf now!
-  buf = table_.AllocateKey(encoded_len);
+  buf = table_->Allocate(encoded_len);
   char* p = EncodeVarint32(buf, internal_key_size);
   std::memcpy(p, key.data(), key_size);
   p += key_size;
@@ -124,47 +140,82 @@ Iterator* MemTable::NewIterator() { return new MemTableIterator(&table_); }
   p = EncodeVarint32(p, val_size);
   std::memcpy(p, value.data(), val_size);
   assert(p + val_size == buf + encoded_len);
-  table_.InsertConcurrently(buf);
+  table_->InsertConcurrently(buf);
 }
 
-bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+namespace {
+
+// The state of a MemTable::Get() walking down the entries of its key.
+struct Saver {
+  const Comparator* user_comparator;
+  const LookupKey* key;
+  std::string* value;
+  Status* s;
+  MergeContext* merge_context;
+  bool found;
+};
+
+// Take the entry into the lookup, return true to go on with the next one.
+bool SaveValue(void* arg, const char* entry) {
+  Saver* saver = reinterpret_cast<Saver*>(arg);
+  // entry format is:
+  //    klength  varint32
+  //    userkey  char[klength]
+  //    tag      uint64
+  //    vlength  varint32
+  //    value    char[vlength]
+  // Check that it belongs to same user key.  We do not check the
+  // sequence number since the Seek() call in the rep should have skipped
+  // all entries with overly large sequence numbers.
+  uint32_t key_length;
+  const char* key_ptr = GetVarint32Ptr(entry, entry + 5, &key_length);
+  if (saver->user_comparator->Compare(Slice(key_ptr, key_length - 8),
+                                      saver->key->user_key()) != 0) {
+    return false;
+  }
+  // Correct user key
+  const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+  switch (static_cast<ValueType>(tag & 0xff)) {
+    case kTypeValue: {
+      Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+      saver->value->assign(v.data(), v.size());
+      saver->found = true;
+      return false;
+    }
+    case kTypeDeletion:
+      *saver->s = Status::NotFound(Slice());
+      saver->found = true;
+      return false;
+    case kTypeMerge:
+      // Walk down the merge operands of the key to the entry they apply to.
+      saver->merge_context->PushOlderOperand(
+          GetLengthPrefixedSlice(key_ptr + key_length));
+      return true;
+    default:
+      // The flushes separate the large values, never the memtables.
+      *saver->s = Status::Corruption("unexpected entry type in a memtable");
+      saver->found = true;
+      return false;
+  }
+}
+
+}  // namespace
+
+bool MemTable::Get(const LookupKey& key, std::string* value, Status* s,
+                   MergeContext* merge_context) {
 #ifdef PROCESSANALYSIS
   auto start = std::chrono::high_resolution_clock::now();
 #endif
-  Slice memkey = key.memtable_key();
-  Table::Iterator iter(&table_);
-  iter.Seek(memkey.data());
-  if (iter.Valid()) {
-    // entry format is:
-    //    klength  varint32
-    //    userkey  char[klength]
-    //    tag      uint64
-    //    vlength  varint32
-    //    value    char[vlength]
-    // Check that it belongs to same user key.  We do not check the
-    // sequence number since the Seek() call above should have skipped
-    // all entries with overly large sequence numbers.
-    const char* entry = iter.key();
-    uint32_t key_length;
-    const char* key_ptr = GetVarint32Ptr(entry, entry + 5, &key_length);
-    if (comparator.comparator.user_comparator()->Compare(
-            Slice(key_ptr, key_length - 8), key.user_key()) == 0) {
-      // Correct user key
-      const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
-      switch (static_cast<ValueType>(tag & 0xff)) {
-        case kTypeValue: {
-          Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
-          value->assign(v.data(), v.size());
+  Saver saver{comparator.comparator.user_comparator(), &key, value, s,
+              merge_context, false};
+  table_->Get(key.memtable_key().data(), &saver, SaveValue);
+  if (saver.found) {
 #ifdef PROCESSANALYSIS
-          foundNum.fetch_add(1);
-#endif
-          return true;
-        }
-        case kTypeDeletion:
-          *s = Status::NotFound(Slice());
-          return true;
-      }
+    if (s->ok()) {
+      foundNum.fetch_add(1);
     }
+#endif
+    return true;
   }
 #ifdef PROCESSANALYSIS
   auto stop = std::chrono::high_resolution_clock::now();
@@ -11,7 +11,8 @@
 // because of the merge
 // #define MEMTABLE_SEQ_SIZE 610081
 #include "db/dbformat.h"
-#include "db/inlineskiplist.h"
+#include "util/concurrent_arena.h"
+#include <memory>
 #include <string>
 
 #include "TimberSaw/db.h"
@@ -22,6 +23,8 @@ namespace TimberSaw {
 
 class InternalKeyComparator;
 class MemTableIterator;
+class MemTableRep;
+class MergeContext;
 class RemoteMemTableMetaData;
 
 class MemTable {
@@ -54,15 +57,19 @@ class MemTable {
   static std::atomic<uint64_t> GetNum;
   static std::atomic<uint64_t> foundNum;
 #endif
-  explicit MemTable(const InternalKeyComparator& cmp);
+  // If rdma_mg is not nullptr, the entries are allocated in memory
+  // registered with its device, see Options::zero_copy_flush. "rep" is the
+  // index of the entries, see Options::memtable_rep.
+  explicit MemTable(const InternalKeyComparator& cmp,
+                    RDMA_Manager* rdma_mg = nullptr,
+                    MemTableRepType rep = kSkipListRep);
   MemTable(const MemTable&) = delete;
   MemTable& operator=(const MemTable&) = delete;
   ~MemTable();
 
-  typedef InlineSkipList<KeyComparator> Table;
-  Table* GetTable(){
-    return &table_;
-  }
+  // The memory of the entries, the keys and values a MemTableIterator
+  // returns point into it.
+  const ConcurrentArena& GetArena() const { return arena_; }
   // Increase reference count.
   void Ref() { refs_.fetch_add(1); }
   void NotFullTableflush(){full_table_flush = false;}
@@ -113,7 +120,10 @@ class MemTable {
   // If memtable contains a deletion for key, store a NotFound() error
   // in *status and return true.
   // Else, return false.
-  bool Get(const LookupKey& key, std::string* value, Status* s);
+  // The merge operands newer than the value or the deletion are added to
+  // *merge_context, the caller applies them.
+  bool Get(const LookupKey& key, std::string* value, Status* s,
+           MergeContext* merge_context);
   void SetLargestSeq(uint64_t seq){
     largest_seq_supposed = seq;
   }
@@ -178,7 +188,7 @@ class MemTable {
   std::atomic<size_t> seq_count = 0;
 
   ConcurrentArena arena_;
-  Table table_;
+  std::unique_ptr<MemTableRep> table_;
   std::atomic<FlushStateEnum> flush_state_ = FLUSH_NOT_REQUESTED;
   int64_t first_seq;
   std::atomic<int64_t> largest_seq_till_now = 0;
@@ -6,9 +6,14 @@
 #include "db/memtable_list.h"
 
 #include <cinttypes>
+#include <condition_variable>
+#include <deque>
 #include <limits>
+#include <mutex>
 #include <queue>
 #include <string>
+#include <thread>
+#include "db/blob_log.h"
 #include "db/db_impl.h"
 #include "db/memtable.h"
 #include "db/version_set.h"
@@ -119,8 +124,8 @@ int MemTableList::NumFlushed() const {
 // Return the most recent value found, if any.
 // Operands stores the list of merge operations to apply, so far.
 bool MemTableListVersion::Get(const LookupKey& key, std::string* value,
-                              Status* s) {
-  return GetFromList(&memlist_, key, value, s);
+                              Status* s, MergeContext* merge_context) {
+  return GetFromList(&memlist_, key, value, s, merge_context);
 }
 
 //void MemTableListVersion::MultiGet(const ReadOptions& read_options,
@@ -159,14 +164,14 @@ bool MemTableListVersion::Get(const LookupKey& key, std::string* value,
 
 bool MemTableListVersion::GetFromList(std::list<MemTable*>* list,
                                       const LookupKey& key, std::string* value,
-                                      Status* s) {
+                                      Status* s, MergeContext* merge_context) {
 //#ifdef GETANALYSIS
 //  auto start = std::chrono::high_resolution_clock::now();
 //#endif
   for (auto& memtable : *list) {
     SequenceNumber current_seq = kMaxSequenceNumber;
 
-    bool done = memtable->Get(key, value, s);
+    bool done = memtable->Get(key, value, s, merge_context);
 
     if (done) {
       return true;
@@ -825,6 +830,188 @@ FlushJob::FlushJob(std::condition_variable* write_stall_cv,
                    const InternalKeyComparator* cmp)
     : write_stall_cv_(write_stall_cv),
       user_cmp(cmp){}
+namespace {
+
+// Keeps the newest version of every user key of the flushed memtables. The
+// keys point into the memtable arenas, which stay alive until the flush is
+// installed, so the current user key is not copied.
+class NewestVersionFilter {
+ public:
+  explicit NewestVersionFilter(const InternalKeyComparator* cmp) : cmp_(cmp) {}
+
+  // Return false on a corrupt key, otherwise set *keep and parse the key into
+  // *ikey.
+  bool Check(const Slice& key, ParsedInternalKey* ikey, bool* keep) {
+    if (!ParseInternalKey(key, ikey)) {
+      return false;
+    }
+    *keep = !has_current_user_key_ ||
+            cmp_->Compare(ikey->user_key, current_user_key_) != 0;
+    current_user_key_ = ikey->user_key;
+    has_current_user_key_ = true;
+    return true;
+  }
+
+ private:
+  const InternalKeyComparator* const cmp_;
+  Slice current_user_key_;
+  bool has_current_user_key_ = false;
+};
+
+// Entries handed over from the thread reading the memtables to the thread
+// building the table.
+struct FlushBatch {
+  struct Entry {
+    Slice key;
+    Slice value;
+    uint32_t filter_hash;
+  };
+  std::vector<Entry> entries;
+};
+
+// The batches of a pipelined flush: the reader takes free batches and puts
+// them back full, the builder takes full batches and puts them back free.
+class FlushBatchQueue {
+ public:
+  FlushBatchQueue() : batches_(config::kFlushPipelineDepth) {
+    for (FlushBatch& batch : batches_) {
+      batch.entries.reserve(config::kFlushPipelineBatchEntries);
+      free_.push_back(&batch);
+    }
+  }
+
+  FlushBatch* TakeFree() {
+    std::unique_lock<std::mutex> lck(mu_);
+    cv_.wait(lck, [this] { return !free_.empty(); });
+    FlushBatch* batch = free_.front();
+    free_.pop_front();
+    return batch;
+  }
+  void PutFull(FlushBatch* batch) {
+    std::lock_guard<std::mutex> lck(mu_);
+    full_.push_back(batch);
+    cv_.notify_all();
+  }
+  // Called by the reader after its last PutFull().
+  void Close() {
+    std::lock_guard<std::mutex> lck(mu_);
+    closed_ = true;
+    cv_.notify_all();
+  }
+  // Return nullptr once the reader is done and every batch is consumed.
+  FlushBatch* TakeFull() {
+    std::unique_lock<std::mutex> lck(mu_);
+    cv_.wait(lck, [this] { return !full_.empty() || closed_; });
+    if (full_.empty()) {
+      return nullptr;
+    }
+    FlushBatch* batch = full_.front();
+    full_.pop_front();
+    return batch;
+  }
+  void PutFree(FlushBatch* batch) {
+    batch->entries.clear();
+    std::lock_guard<std::mutex> lck(mu_);
+    free_.push_back(batch);
+    cv_.notify_all();
+  }
+
+ private:
+  std::vector<FlushBatch> batches_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::deque<FlushBatch*> free_;
+  std::deque<FlushBatch*> full_;
+  bool closed_ = false;
+};
+
+}  // namespace
+
+Status FlushJob::AddEntries(Iterator* iter, TableBuilder* builder,
+                            RemoteMemTableMetaData* meta, BlobSeparator* blobs,
+                            Slice* last_key) {
+  NewestVersionFilter filter(user_cmp);
+  ParsedInternalKey ikey;
+  for (; iter->Valid(); iter->Next()) {
+    const Slice key = iter->key();
+    *last_key = key;
+    bool keep;
+    if (!filter.Check(key, &ikey, &keep)) {
+      printf("Corrupt key value detected\n");
+      return Status::IOError("Corrupt key value detected\n");
+    }
+    if (keep) {
+      if (ikey.type == kTypeDeletion) {
+        meta->num_deletions++;
+      }
+      Slice entry_key = key;
+      Slice value = iter->value();
+      if (blobs != nullptr) {
+        blobs->Separate(&entry_key, &value);
+      }
+      builder->Add(entry_key, value);
+    }
+  }
+  return Status::OK();
+}
+
+Status FlushJob::AddEntriesPipelined(Iterator* iter, TableBuilder* builder,
+                                     RemoteMemTableMetaData* meta,
+                                     bool with_filter, BlobSeparator* blobs,
+                                     Slice* last_key) {
+  FlushBatchQueue queue;
+  Status read_status;
+  // The builder and the value log keep issuing their RDMA writes from the
+  // calling thread, only the memtable walk, the duplicate removal and the
+  // filter hashing move to the reader.
+  std::thread reader([&]() {
+    NewestVersionFilter filter(user_cmp);
+    ParsedInternalKey ikey;
+    FlushBatch* batch = queue.TakeFree();
+    for (; iter->Valid(); iter->Next()) {
+      const Slice key = iter->key();
+      *last_key = key;
+      bool keep;
+      if (!filter.Check(key, &ikey, &keep)) {
+        printf("Corrupt key value detected\n");
+        read_status = Status::IOError("Corrupt key value detected\n");
+        break;
+      }
+      if (!keep) {
+        continue;
+      }
+      if (ikey.type == kTypeDeletion) {
+        meta->num_deletions++;
+      }
+      batch->entries.push_back(
+          {key, iter->value(), with_filter ? BloomHash(ikey.user_key) : 0});
+      if (batch->entries.size() == config::kFlushPipelineBatchEntries) {
+        queue.PutFull(batch);
+        batch = queue.TakeFree();
+      }
+    }
+    if (batch->entries.empty()) {
+      queue.PutFree(batch);
+    } else {
+      queue.PutFull(batch);
+    }
+    queue.Close();
+  });
+  while (FlushBatch* batch = queue.TakeFull()) {
+    for (const FlushBatch::Entry& entry : batch->entries) {
+      Slice key = entry.key;
+      Slice value = entry.value;
+      if (blobs != nullptr) {
+        blobs->Separate(&key, &value);
+      }
+      builder->AddWithFilterHash(key, value, entry.filter_hash);
+    }
+    queue.PutFree(batch);
+  }
+  reader.join();
+  return read_status;
+}
+
 Status FlushJob::BuildTable(const std::string& dbname, Env* env,
                             const Options& options, TableCache* table_cache,
                             Iterator* iter,
@@ -834,56 +1021,64 @@ Status FlushJob::BuildTable(const std::string& dbname, Env* env,
   Status s;
 //  meta->file_size = 0;
   iter->SeekToFirst();
-#ifndef NDEBUG
-  int Not_drop_counter = 0;
-  int number_of_key = 0;
-#endif
-  ParsedInternalKey ikey;
-  std::string current_user_key;
-  bool has_current_user_key = false;
   TableBuilder* builder;
   if (iter->Valid()) {
     if (table_type == block_based){
       builder = new TableBuilder_ComputeSide(options, type, target_node_id);
 
     } else{
-      builder = new TableBuilder_BACS(options, type, target_node_id);
+      TableBuilder_BACS* bacs_builder =
+          new TableBuilder_BACS(options, type, target_node_id);
+      if (options.zero_copy_flush) {
+        // The entries are written from the memtables, which stay referenced
+        // by the job until the table is built.
+        std::vector<const ConcurrentArena*> arenas;
+        for (MemTable* mem : mem_vec) {
+          arenas.push_back(&mem->GetArena());
+        }
+        bacs_builder->SetGatherSources(arenas);
+      }
+      builder = bacs_builder;
+    }
+    if (filter_bits_per_key != 0) {
+      builder->SetFilterBitsPerKey(filter_bits_per_key);
     }
     meta->table_type = table_type;
     meta->smallest.DecodeFrom(iter->key());
+    // The table builder writes through "write_local_flush", the value log
+    // through the other queue pairs of the thread.
+    std::unique_ptr<BlobLogBuilder> blob_builder;
+    std::unique_ptr<BlobSeparator> blobs;
+    if (options.min_blob_size > 0) {
+      blob_builder.reset(new BlobLogBuilder(
+          env->rdma_mg, 0, BlobLogId(meta->number, env->rdma_mg->node_id),
+          target_node_id, "write_local_compact", options.rate_limiter,
+          RateLimiter::kHigh));
+      blobs.reset(new BlobSeparator(blob_builder.get(), options.min_blob_size,
+                                    &meta->blob_refs));
+    }
     Slice key;
-    for (; iter->Valid(); iter->Next()) {
-      key = iter->key();
-//      assert(key.data()[0] == '0');
-      bool drop = false;
-      if (!ParseInternalKey(key, &ikey)) {
-        // Do not hide error keys
-        current_user_key.clear();
-        has_current_user_key = false;
-        printf("Corrupt key value detected\n");
-        s = Status::IOError("Corrupt key value detected\n");
-        break;
-      } else {
-        if (!has_current_user_key ||
-            user_cmp->Compare(ikey.user_key, Slice(current_user_key)) != 0) {
-          // First occurrence of this user key
-          current_user_key.assign(ikey.user_key.data(), ikey.user_key.size());
-          has_current_user_key = true;
-          // this will result in the key not drop, next if will always be false because of the last_sequence_for_key.
-        }else{
-          drop = true;
-        }
-      }
-#ifndef NDEBUG
-      number_of_key++;
-#endif
-      if (!drop){
-#ifndef NDEBUG
-        Not_drop_counter++;
-#endif
-        builder->Add(key, iter->value());
+    if (options.pipelined_flush) {
+      s = AddEntriesPipelined(iter, builder, meta.get(),
+                              options.filter_policy != nullptr, blobs.get(),
+                              &key);
+    } else {
+      s = AddEntries(iter, builder, meta.get(), blobs.get(), &key);
+    }
+    if (blob_builder != nullptr) {
+      std::shared_ptr<BlobLogMetaData> log = blob_builder->Finish();
+      if (log != nullptr) {
+        meta->blob_logs.push_back(log);
       }
-
+    }
+    ParsedInternalKey first;
+    if (blobs != nullptr &&
+        ParseInternalKey(meta->smallest.Encode(), &first) &&
+        first.type == kTypeValue) {
+      // The first entry may have been separated, which sorts it before the
+      // key it was read with.
+      meta->smallest = InternalKey(first.user_key, first.sequence,
+                                   kTypeBlobIndex);
     }
 
     if (s.ok()) {
@@ -893,10 +1088,6 @@ Status FlushJob::BuildTable(const std::string& dbname, Env* env,
       delete builder;
       return s;
     }
-#ifndef NDEBUG
-    printf("For flush, Total number of key touched is %d, KV left is %d\n", number_of_key,
-           Not_drop_counter);
-#endif
     // Finish and check for builder errors
 
     s = builder->Finish();
@@ -12,6 +12,7 @@
 #include <string>
 #include <vector>
 
+#include "db/blob_log.h"
 #include "db/dbformat.h"
 //#include "db/logs_with_prep_tracker.h"
 #include "db/memtable.h"
@@ -32,6 +33,7 @@ namespace TimberSaw {
 
 class InternalKeyComparator;
 
+class MergeContext;
 class MergeIteratorBuilder;
 class MemTableList;
 
@@ -60,7 +62,11 @@ class MemTableListVersion {
   // If any operation was found for this key, its most recent sequence number
   // will be stored in *seq on success (regardless of whether true/false is
   // returned).  Otherwise, *seq will be set to kMaxSequenceNumber.
-  bool Get(const LookupKey& key, std::string* value,Status* s);
+  //
+  // The merge operands found on the way are added to *merge_context, see
+  // MemTable::Get().
+  bool Get(const LookupKey& key, std::string* value, Status* s,
+           MergeContext* merge_context);
 
 //  bool Get(const LookupKey& key, std::string* value, std::string* timestamp,
 //           Status* s, MergeContext* merge_context,
@@ -151,7 +157,8 @@ class MemTableListVersion {
   bool TrimHistory(size_t usage);
 
   bool GetFromList(std::list<MemTable*>* list, const LookupKey& key,
-                   std::string* value, Status* s);
+                   std::string* value, Status* s,
+                   MergeContext* merge_context);
 
   void AddMemTable(MemTable* m);
 
@@ -427,6 +434,9 @@ class FlushJob {
   std::condition_variable* write_stall_cv_;
   std::shared_ptr<RemoteMemTableMetaData> sst;
   const InternalKeyComparator* user_cmp;
+  // If non-zero, the bits per key of the filter of the table built instead
+  // of Options::bloom_bits, see Options::per_level_filter_bits.
+  int filter_bits_per_key = 0;
   void Waitforpendingwriter();
   void SetAllMemStateProcessing();
   Status BuildTable(const std::string& dbname, Env* env, const Options& options,
@@ -435,6 +445,16 @@ class FlushJob {
                     IO_type type, uint8_t target_node_id,
                     Table_Type table_type);
 
+ private:
+  // Feed the newest version of every key of "iter" to "builder", on the
+  // calling thread or through a reader thread. *last_key is set to the last
+  // key of "iter". The large values go through "blobs" if it is not null.
+  Status AddEntries(Iterator* iter, TableBuilder* builder,
+                    RemoteMemTableMetaData* meta, BlobSeparator* blobs,
+                    Slice* last_key);
+  Status AddEntriesPipelined(Iterator* iter, TableBuilder* builder,
+                             RemoteMemTableMetaData* meta, bool with_filter,
+                             BlobSeparator* blobs, Slice* last_key);
 };
 // Installs memtable atomic flush results.
 // In most cases, imm_lists is nullptr, and the function simply uses the
@@ -0,0 +1,70 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// MemTableRep is the index of the entries of a MemTable. An entry is the
+// length prefixed internal key and value MemTable::Add() encodes in memory
+// from Allocate(). The rep orders the entries by their internal keys.
+
+#ifndef STORAGE_TimberSaw_DB_MEMTABLE_REP_H_
+#define STORAGE_TimberSaw_DB_MEMTABLE_REP_H_
+
+#include "db/memtable.h"
+#include "util/concurrent_arena.h"
+
+namespace TimberSaw {
+
+class MemTableRep {
+ public:
+  class Iterator {
+   public:
+    virtual ~Iterator() = default;
+
+    virtual bool Valid() const = 0;
+
+    // The entry at the current position.
+    // REQUIRES: Valid()
+    virtual const char* key() const = 0;
+
+    virtual void Next() = 0;
+    virtual void Prev() = 0;
+
+    // Position at the first entry whose internal key is at or past the one
+    // of "memtable_key", a length prefixed internal key.
+    virtual void Seek(const char* memtable_key) = 0;
+    virtual void SeekToFirst() = 0;
+    virtual void SeekToLast() = 0;
+  };
+
+  MemTableRep() = default;
+  MemTableRep(const MemTableRep&) = delete;
+  MemTableRep& operator=(const MemTableRep&) = delete;
+
+  virtual ~MemTableRep() = default;
+
+  // Memory for an entry of "len" bytes, freed with the rep.
+  virtual char* Allocate(size_t len) = 0;
+
+  // Index an entry built in memory from Allocate(). Safe to call with other
+  // inserts and with the reads.
+  // REQUIRES: no entry with the same internal key is in the rep.
+  virtual void InsertConcurrently(const char* entry) = 0;
+
+  // Call callback_func(arg, entry) on the entries from the first one at or
+  // past "memtable_key" on, until it returns false or the entries run out.
+  virtual void Get(const char* memtable_key, void* arg,
+                   bool (*callback_func)(void* arg, const char* entry)) = 0;
+
+  virtual Iterator* NewIterator() = 0;
+};
+
+// The entries in an InlineSkipList.
+MemTableRep* NewSkipListRep(const MemTable::KeyComparator& cmp,
+                            ConcurrentArena* arena);
+
+// The entries in an adaptive radix tree, for the byte wise comparator only.
+MemTableRep* NewARTRep(ConcurrentArena* arena);
+
+}  // namespace TimberSaw
+
+#endif  // STORAGE_TimberSaw_DB_MEMTABLE_REP_H_
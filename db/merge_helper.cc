@@ -0,0 +1,117 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/merge_helper.h"
+
+#include <vector>
+
+#include "db/blob_log.h"
+
+namespace TimberSaw {
+
+Status MergeContext::Merge(const MergeOperator* merge_operator,
+                           const Slice& user_key, const Slice* base,
+                           std::string* value) const {
+  if (merge_operator == nullptr) {
+    return Status::NotSupported("merge operands without a merge operator");
+  }
+  std::vector<Slice> operands(operands_.begin(), operands_.end());
+  if (!merge_operator->FullMerge(user_key, base, operands, value)) {
+    return Status::Corruption("merge failed for ", user_key);
+  }
+  return Status::OK();
+}
+
+CompactionMergeRunner::CompactionMergeRunner(
+    const MergeOperator* merge_operator, const Comparator* user_comparator,
+    int output_level, SequenceNumber smallest_snapshot,
+    CompactionBlobRunner* blobs)
+    : merge_operator_(merge_operator),
+      user_comparator_(user_comparator),
+      output_level_(output_level),
+      smallest_snapshot_(smallest_snapshot),
+      blobs_(blobs) {}
+
+bool CompactionMergeRunner::Merge(Iterator* input, const Slice* end) {
+  if (merge_operator_ == nullptr) {
+    return false;
+  }
+  ParsedInternalKey ikey;
+  if (!ParseInternalKey(input->key(), &ikey) || ikey.type != kTypeMerge ||
+      ikey.sequence > smallest_snapshot_) {
+    return false;
+  }
+  if (end != nullptr && user_comparator_->Compare(ikey.user_key, *end) >= 0) {
+    return false;
+  }
+  user_key_.assign(ikey.user_key.data(), ikey.user_key.size());
+  const SequenceNumber sequence = ikey.sequence;
+  operand_.assign(input->value().data(), input->value().size());
+
+  // All the older entries of the key are read, unless an operand could not
+  // be combined with operand_.
+  bool key_done = true;
+  bool found_base = false;
+  bool has_base = false;
+  for (input->Next(); input->Valid(); input->Next()) {
+    ParsedInternalKey older;
+    if (!ParseInternalKey(input->key(), &older)) {
+      key_done = false;
+      break;
+    }
+    if (user_comparator_->Compare(older.user_key, user_key_) != 0) {
+      break;
+    }
+    num_merged_++;
+    if (older.type == kTypeMerge) {
+      merged_.clear();
+      if (!merge_operator_->PartialMerge(user_key_, input->value(), operand_,
+                                         &merged_)) {
+        num_merged_--;
+        key_done = false;
+        break;
+      }
+      operand_.swap(merged_);
+      continue;
+    }
+    found_base = true;
+    if (older.type == kTypeValue) {
+      base_buf_.assign(input->value().data(), input->value().size());
+      has_base = true;
+    } else if (older.type == kTypeBlobIndex) {
+      status_ = blobs_ != nullptr
+                    ? blobs_->Fetch(input->value(), &base_buf_)
+                    : Status::Corruption("separated value without a log");
+      has_base = true;
+    }
+    input->Next();
+    break;
+  }
+
+  key_buf_.clear();
+  if (found_base || (key_done && output_level_ == config::kNumLevels - 1)) {
+    // No older version of the key can be below the last level.
+    merged_.clear();
+    if (status_.ok()) {
+      const Slice base(base_buf_);
+      if (!merge_operator_->FullMerge(user_key_, has_base ? &base : nullptr,
+                                      {Slice(operand_)}, &merged_)) {
+        status_ = Status::Corruption("merge failed for ", user_key_);
+      }
+    }
+    AppendInternalKey(&key_buf_,
+                      ParsedInternalKey(user_key_, sequence, kTypeValue));
+    value_ = merged_;
+    hides_older_ = true;
+  } else {
+    AppendInternalKey(&key_buf_,
+                      ParsedInternalKey(user_key_, sequence, kTypeMerge));
+    value_ = operand_;
+    hides_older_ = false;
+  }
+  key_ = key_buf_;
+  return true;
+}
+
+}  // namespace TimberSaw
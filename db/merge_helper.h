@@ -0,0 +1,106 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// The entries written by DB::Merge() (kTypeMerge) hold operands of the merge
+// operator instead of values. A read collects the operands of its key from
+// the newest entry down to the first value or deletion marker, and applies
+// them (MergeContext). A compaction collapses the operands of a key it
+// rewrites into one operand, or into a value once it meets the entry they
+// apply to (CompactionMergeRunner), so that the chains stay short.
+
+#ifndef STORAGE_TimberSaw_DB_MERGE_HELPER_H_
+#define STORAGE_TimberSaw_DB_MERGE_HELPER_H_
+
+#include <deque>
+#include <string>
+
+#include "db/dbformat.h"
+#include "TimberSaw/iterator.h"
+#include "TimberSaw/merge_operator.h"
+#include "TimberSaw/status.h"
+
+namespace TimberSaw {
+
+class CompactionBlobRunner;
+
+// The operands of a key collected by a read.
+class MergeContext {
+ public:
+  MergeContext() = default;
+
+  MergeContext(const MergeContext&) = delete;
+  MergeContext& operator=(const MergeContext&) = delete;
+
+  // Add an operand older, resp. newer, than the ones added so far.
+  void PushOlderOperand(const Slice& operand) {
+    operands_.emplace_front(operand.data(), operand.size());
+  }
+  void PushNewerOperand(const Slice& operand) {
+    operands_.emplace_back(operand.data(), operand.size());
+  }
+
+  bool empty() const { return operands_.empty(); }
+  void Clear() { operands_.clear(); }
+
+  // Apply the operands to "base" (null if the key has no value) of
+  // "user_key" and store the result in *value.
+  Status Merge(const MergeOperator* merge_operator, const Slice& user_key,
+               const Slice* base, std::string* value) const;
+
+ private:
+  // Oldest first.
+  std::deque<std::string> operands_;
+};
+
+// Collapses the operands of the keys a compaction thread rewrites.
+class CompactionMergeRunner {
+ public:
+  // Entries newer than "smallest_snapshot" are left alone, a snapshot may
+  // still read them. "blobs" fetches the separated values the operands
+  // apply to. A null "merge_operator" disables the runner.
+  CompactionMergeRunner(const MergeOperator* merge_operator,
+                        const Comparator* user_comparator, int output_level,
+                        SequenceNumber smallest_snapshot,
+                        CompactionBlobRunner* blobs);
+
+  CompactionMergeRunner(const CompactionMergeRunner&) = delete;
+  CompactionMergeRunner& operator=(const CompactionMergeRunner&) = delete;
+
+  // If "input" is at an operand to collapse, merge it with the older entries
+  // of its key that follow it, advance "input" past them and return true:
+  // key() and value() are then the entry to write in their place. The keys
+  // at or after "end" (a user key, null for none) belong in part to the
+  // next subcompaction and are not merged.
+  bool Merge(Iterator* input, const Slice* end);
+  Slice key() const { return key_; }
+  Slice value() const { return value_; }
+  // True if the entry of the last Merge() replaced the entry its operands
+  // applied to, the older entries of the key left in "input" are hidden.
+  bool hides_older() const { return hides_older_; }
+
+  Status status() const { return status_; }
+  uint64_t num_merged() const { return num_merged_; }
+
+ private:
+  const MergeOperator* const merge_operator_;
+  const Comparator* const user_comparator_;
+  const int output_level_;
+  const SequenceNumber smallest_snapshot_;
+  CompactionBlobRunner* const blobs_;
+
+  Slice key_;
+  Slice value_;
+  bool hides_older_ = false;
+  Status status_;
+  std::string user_key_;
+  std::string key_buf_;
+  std::string operand_;
+  std::string merged_;
+  std::string base_buf_;
+  uint64_t num_merged_ = 0;
+};
+
+}  // namespace TimberSaw
+
+#endif  // STORAGE_TimberSaw_DB_MERGE_HELPER_H_
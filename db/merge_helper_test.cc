@@ -0,0 +1,303 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/merge_helper.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "db/memtable.h"
+#include "TimberSaw/comparator.h"
+#include "TimberSaw/merge_operator.h"
+#include "util/coding.h"
+
+#include "gtest/gtest.h"
+
+namespace TimberSaw {
+
+static std::string Fixed64(uint64_t v) {
+  std::string result;
+  PutFixed64(&result, v);
+  return result;
+}
+
+static std::string IKey(const std::string& user_key, SequenceNumber seq,
+                        ValueType type) {
+  std::string result;
+  AppendInternalKey(&result, ParsedInternalKey(user_key, seq, type));
+  return result;
+}
+
+// Applies the operands but can not combine them.
+class FullMergeOnlyOperator : public MergeOperator {
+ public:
+  const char* Name() const override { return "FullMergeOnly"; }
+  bool FullMerge(const Slice& key, const Slice* existing_value,
+                 const std::vector<Slice>& operands,
+                 std::string* new_value) const override {
+    return append_->FullMerge(key, existing_value, operands, new_value);
+  }
+
+ private:
+  std::unique_ptr<const MergeOperator> append_{
+      NewMergeOperator(kStringAppendOperator)};
+};
+
+// Fails every merge.
+class FailingOperator : public MergeOperator {
+ public:
+  const char* Name() const override { return "Failing"; }
+  bool FullMerge(const Slice&, const Slice*, const std::vector<Slice>&,
+                 std::string*) const override {
+    return false;
+  }
+};
+
+TEST(MergeOperatorTest, NoOperator) {
+  ASSERT_EQ(nullptr, NewMergeOperator(kNoMergeOperator));
+}
+
+TEST(MergeOperatorTest, UInt64Add) {
+  std::unique_ptr<const MergeOperator> op(NewMergeOperator(kUInt64AddOperator));
+  std::string value;
+  const std::string one = Fixed64(1), two = Fixed64(2), ten = Fixed64(10);
+  const Slice base = ten;
+  ASSERT_TRUE(op->FullMerge("k", &base, {one, two}, &value));
+  ASSERT_EQ(Fixed64(13), value);
+  ASSERT_TRUE(op->FullMerge("k", nullptr, {one, two}, &value));
+  ASSERT_EQ(Fixed64(3), value);
+  // Values and operands of another size count as 0.
+  const Slice bad = "bad";
+  ASSERT_TRUE(op->FullMerge("k", &bad, {one, "x"}, &value));
+  ASSERT_EQ(Fixed64(1), value);
+  // Wraps around.
+  const std::string max_value = Fixed64(~uint64_t{0});
+  const Slice max = max_value;
+  ASSERT_TRUE(op->FullMerge("k", &max, {two}, &value));
+  ASSERT_EQ(Fixed64(1), value);
+
+  ASSERT_TRUE(op->PartialMerge("k", one, two, &value));
+  ASSERT_EQ(Fixed64(3), value);
+}
+
+TEST(MergeOperatorTest, StringAppend) {
+  std::unique_ptr<const MergeOperator> op(
+      NewMergeOperator(kStringAppendOperator));
+  std::string value;
+  const Slice base = "a";
+  ASSERT_TRUE(op->FullMerge("k", &base, {"b", "c"}, &value));
+  ASSERT_EQ("a,b,c", value);
+  ASSERT_TRUE(op->FullMerge("k", nullptr, {"b", "c"}, &value));
+  ASSERT_EQ("b,c", value);
+  ASSERT_TRUE(op->PartialMerge("k", "b", "c", &value));
+  ASSERT_EQ("b,c", value);
+  // The default does not combine operands.
+  FailingOperator failing;
+  ASSERT_FALSE(failing.PartialMerge("k", "b", "c", &value));
+}
+
+TEST(MergeContextTest, Merge) {
+  std::unique_ptr<const MergeOperator> op(
+      NewMergeOperator(kStringAppendOperator));
+  MergeContext context;
+  ASSERT_TRUE(context.empty());
+  context.PushOlderOperand("b");
+  context.PushNewerOperand("c");
+  context.PushOlderOperand("a");
+  ASSERT_FALSE(context.empty());
+
+  std::string value;
+  ASSERT_TRUE(context.Merge(op.get(), "k", nullptr, &value).ok());
+  ASSERT_EQ("a,b,c", value);
+  const Slice base = "base";
+  ASSERT_TRUE(context.Merge(op.get(), "k", &base, &value).ok());
+  ASSERT_EQ("base,a,b,c", value);
+
+  ASSERT_TRUE(
+      context.Merge(nullptr, "k", nullptr, &value).IsNotSupportedError());
+  FailingOperator failing;
+  ASSERT_TRUE(context.Merge(&failing, "k", nullptr, &value).IsCorruption());
+
+  context.Clear();
+  ASSERT_TRUE(context.empty());
+}
+
+// The runner reads the entries of a compaction input, a memtable holds them
+// here in the same internal key order.
+class CompactionMergeRunnerTest : public testing::Test {
+ public:
+  CompactionMergeRunnerTest()
+      : cmp_(BytewiseComparator()),
+        mem_(new MemTable(cmp_)),
+        append_(NewMergeOperator(kStringAppendOperator)) {
+    mem_->NotFullTableflush();
+    mem_->Ref();
+  }
+
+  ~CompactionMergeRunnerTest() override {
+    delete iter_;
+    mem_->Unref();
+  }
+
+  void Add(SequenceNumber seq, ValueType type, const std::string& key,
+           const std::string& value) {
+    mem_->Add(seq, type, key, value);
+  }
+
+  // An iterator at the first entry of the input.
+  Iterator* Input() {
+    delete iter_;
+    iter_ = mem_->NewIterator();
+    iter_->SeekToFirst();
+    return iter_;
+  }
+
+  // The operands of "k" at 3 and 2, then its entry at 1 of "base_type",
+  // followed by "l".
+  void AddOperands(ValueType base_type) {
+    Add(3, kTypeMerge, "k", "c");
+    Add(2, kTypeMerge, "k", "b");
+    if (base_type != kTypeMerge) {
+      Add(1, base_type, "k", base_type == kTypeValue ? "a" : "");
+    }
+    Add(4, kTypeValue, "l", "next");
+  }
+
+  const InternalKeyComparator cmp_;
+  MemTable* const mem_;
+  std::unique_ptr<const MergeOperator> append_;
+  Iterator* iter_ = nullptr;
+};
+
+TEST_F(CompactionMergeRunnerTest, Value) {
+  AddOperands(kTypeValue);
+  CompactionMergeRunner runner(append_.get(), BytewiseComparator(), 1,
+                               kMaxSequenceNumber, nullptr);
+  Iterator* input = Input();
+  ASSERT_TRUE(runner.Merge(input, nullptr));
+  ASSERT_TRUE(runner.status().ok());
+  ASSERT_EQ(IKey("k", 3, kTypeValue), runner.key().ToString());
+  ASSERT_EQ("a,b,c", runner.value().ToString());
+  ASSERT_TRUE(runner.hides_older());
+  ASSERT_EQ(2, runner.num_merged());
+  // Past the entries of the key.
+  ASSERT_TRUE(input->Valid());
+  ASSERT_EQ(IKey("l", 4, kTypeValue), input->key().ToString());
+
+  // Not an operand.
+  ASSERT_FALSE(runner.Merge(input, nullptr));
+  ASSERT_EQ(IKey("l", 4, kTypeValue), input->key().ToString());
+}
+
+TEST_F(CompactionMergeRunnerTest, Deletion) {
+  AddOperands(kTypeDeletion);
+  CompactionMergeRunner runner(append_.get(), BytewiseComparator(), 1,
+                               kMaxSequenceNumber, nullptr);
+  Iterator* input = Input();
+  ASSERT_TRUE(runner.Merge(input, nullptr));
+  ASSERT_EQ(IKey("k", 3, kTypeValue), runner.key().ToString());
+  ASSERT_EQ("b,c", runner.value().ToString());
+  ASSERT_TRUE(runner.hides_older());
+  ASSERT_EQ(IKey("l", 4, kTypeValue), input->key().ToString());
+}
+
+TEST_F(CompactionMergeRunnerTest, NoBase) {
+  AddOperands(kTypeMerge);
+  {
+    // The value may be in a lower level, the operands stay an operand.
+    CompactionMergeRunner runner(append_.get(), BytewiseComparator(), 1,
+                                 kMaxSequenceNumber, nullptr);
+    Iterator* input = Input();
+    ASSERT_TRUE(runner.Merge(input, nullptr));
+    ASSERT_EQ(IKey("k", 3, kTypeMerge), runner.key().ToString());
+    ASSERT_EQ("b,c", runner.value().ToString());
+    ASSERT_FALSE(runner.hides_older());
+    ASSERT_EQ(IKey("l", 4, kTypeValue), input->key().ToString());
+  }
+  {
+    // Nothing is below the last level.
+    CompactionMergeRunner runner(append_.get(), BytewiseComparator(),
+                                 config::kNumLevels - 1, kMaxSequenceNumber,
+                                 nullptr);
+    Iterator* input = Input();
+    ASSERT_TRUE(runner.Merge(input, nullptr));
+    ASSERT_EQ(IKey("k", 3, kTypeValue), runner.key().ToString());
+    ASSERT_EQ("b,c", runner.value().ToString());
+    ASSERT_TRUE(runner.hides_older());
+  }
+}
+
+TEST_F(CompactionMergeRunnerTest, NoPartialMerge) {
+  AddOperands(kTypeValue);
+  FullMergeOnlyOperator op;
+  CompactionMergeRunner runner(&op, BytewiseComparator(), 1,
+                               kMaxSequenceNumber, nullptr);
+  Iterator* input = Input();
+  // The newest operand is written alone, the input stays at the next one.
+  ASSERT_TRUE(runner.Merge(input, nullptr));
+  ASSERT_EQ(IKey("k", 3, kTypeMerge), runner.key().ToString());
+  ASSERT_EQ("c", runner.value().ToString());
+  ASSERT_FALSE(runner.hides_older());
+  ASSERT_EQ(0, runner.num_merged());
+  ASSERT_EQ(IKey("k", 2, kTypeMerge), input->key().ToString());
+
+  // The last operand meets the value.
+  ASSERT_TRUE(runner.Merge(input, nullptr));
+  ASSERT_EQ(IKey("k", 2, kTypeValue), runner.key().ToString());
+  ASSERT_EQ("a,b", runner.value().ToString());
+  ASSERT_TRUE(runner.hides_older());
+}
+
+TEST_F(CompactionMergeRunnerTest, LeftAlone) {
+  AddOperands(kTypeValue);
+  {
+    CompactionMergeRunner runner(nullptr, BytewiseComparator(), 1,
+                                 kMaxSequenceNumber, nullptr);
+    ASSERT_FALSE(runner.Merge(Input(), nullptr));
+  }
+  {
+    // A snapshot at 2 may still read the operand at 3.
+    CompactionMergeRunner runner(append_.get(), BytewiseComparator(), 1, 2,
+                                 nullptr);
+    Iterator* input = Input();
+    ASSERT_FALSE(runner.Merge(input, nullptr));
+    ASSERT_EQ(IKey("k", 3, kTypeMerge), input->key().ToString());
+  }
+  {
+    // The key belongs to the next subcompaction.
+    CompactionMergeRunner runner(append_.get(), BytewiseComparator(), 1,
+                                 kMaxSequenceNumber, nullptr);
+    const Slice end = "k";
+    ASSERT_FALSE(runner.Merge(Input(), &end));
+  }
+}
+
+TEST_F(CompactionMergeRunnerTest, Failures) {
+  {
+    // A separated value without the log it lives in.
+    Add(3, kTypeMerge, "k", "c");
+    Add(1, kTypeBlobIndex, "k", "index");
+    CompactionMergeRunner runner(append_.get(), BytewiseComparator(), 1,
+                                 kMaxSequenceNumber, nullptr);
+    ASSERT_TRUE(runner.Merge(Input(), nullptr));
+    ASSERT_TRUE(runner.status().IsCorruption());
+  }
+  {
+    FailingOperator op;
+    CompactionMergeRunner runner(&op, BytewiseComparator(),
+                                 config::kNumLevels - 1, kMaxSequenceNumber,
+                                 nullptr);
+    ASSERT_TRUE(runner.Merge(Input(), nullptr));
+    ASSERT_TRUE(runner.status().IsCorruption());
+  }
+}
+
+}  // namespace TimberSaw
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
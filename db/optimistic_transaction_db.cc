@@ -0,0 +1,194 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "TimberSaw/optimistic_transaction_db.h"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "TimberSaw/write_batch.h"
+
+#include "db/dbformat.h"
+#include "util/hash.h"
+
+namespace TimberSaw {
+
+struct OptimisticTransactionDB::Rep {
+  explicit Rep(DB* d) : db(d) {}
+  ~Rep() { delete db; }
+
+  // The stripe of the locks "key" is under.
+  int Stripe(const Slice& key) const {
+    return Hash(key.data(), key.size(), 0) % config::kTransactionLockStripes;
+  }
+
+  DB* const db;
+  std::mutex stripes[config::kTransactionLockStripes];
+};
+
+struct Transaction::Rep {
+  struct PendingWrite {
+    bool deleted;
+    std::string value;
+  };
+
+  Rep(OptimisticTransactionDB::Rep* d, const WriteOptions& opt)
+      : db(d), options(opt) {}
+
+  // Note the newest sequence number of "key" the first time the transaction
+  // accesses it.
+  Status Track(const Slice& key) {
+    std::string k = key.ToString();
+    if (tracked.count(k) != 0) {
+      return Status::OK();
+    }
+    uint64_t sequence;
+    Status s = db->db->GetLatestSequenceForKey(key, &sequence);
+    if (s.ok()) {
+      tracked.emplace(std::move(k), sequence);
+    }
+    return s;
+  }
+
+  OptimisticTransactionDB::Rep* const db;
+  const WriteOptions options;
+  std::map<std::string, uint64_t> tracked;
+  std::map<std::string, PendingWrite> writes;
+  bool done = false;
+};
+
+Transaction::Transaction(Rep* rep) : rep_(rep) {}
+
+Transaction::~Transaction() { delete rep_; }
+
+Status Transaction::Get(const ReadOptions& options, const Slice& key,
+                        std::string* value) {
+  Rep* r = rep_;
+  if (r->done) {
+    return Status::InvalidArgument("the transaction is over");
+  }
+  // Noted before the read, so that a write landing during the read fails
+  // the commit.
+  Status s = r->Track(key);
+  if (!s.ok()) {
+    return s;
+  }
+  auto w = r->writes.find(key.ToString());
+  if (w != r->writes.end()) {
+    if (w->second.deleted) {
+      return Status::NotFound(Slice());
+    }
+    *value = w->second.value;
+    return Status::OK();
+  }
+  return r->db->db->Get(options, key, value);
+}
+
+Status Transaction::Put(const Slice& key, const Slice& value) {
+  Rep* r = rep_;
+  if (r->done) {
+    return Status::InvalidArgument("the transaction is over");
+  }
+  Status s = r->Track(key);
+  if (s.ok()) {
+    r->writes[key.ToString()] = Rep::PendingWrite{false, value.ToString()};
+  }
+  return s;
+}
+
+Status Transaction::Delete(const Slice& key) {
+  Rep* r = rep_;
+  if (r->done) {
+    return Status::InvalidArgument("the transaction is over");
+  }
+  Status s = r->Track(key);
+  if (s.ok()) {
+    r->writes[key.ToString()] = Rep::PendingWrite{true, std::string()};
+  }
+  return s;
+}
+
+Status Transaction::Commit() {
+  Rep* r = rep_;
+  if (r->done) {
+    return Status::InvalidArgument("the transaction is over");
+  }
+  r->done = true;
+  if (r->writes.empty()) {
+    return Status::OK();
+  }
+
+  // The stripes are locked in order, the commits sharing some cannot
+  // deadlock.
+  std::vector<int> stripes;
+  for (const auto& t : r->tracked) {
+    stripes.push_back(r->db->Stripe(t.first));
+  }
+  std::sort(stripes.begin(), stripes.end());
+  stripes.erase(std::unique(stripes.begin(), stripes.end()), stripes.end());
+  for (int i : stripes) {
+    r->db->stripes[i].lock();
+  }
+
+  Status s;
+  for (const auto& t : r->tracked) {
+    uint64_t sequence;
+    s = r->db->db->GetLatestSequenceForKey(t.first, &sequence);
+    if (s.ok() && sequence > t.second) {
+      s = Status::Busy(t.first, "changed since the transaction read it");
+    }
+    if (!s.ok()) {
+      break;
+    }
+  }
+  if (s.ok()) {
+    WriteBatch batch;
+    for (const auto& w : r->writes) {
+      if (w.second.deleted) {
+        batch.Delete(w.first);
+      } else {
+        batch.Put(w.first, w.second.value);
+      }
+    }
+    s = r->db->db->Write(r->options, &batch);
+  }
+
+  for (int i : stripes) {
+    r->db->stripes[i].unlock();
+  }
+  r->writes.clear();
+  return s;
+}
+
+void Transaction::Rollback() {
+  rep_->done = true;
+  rep_->writes.clear();
+}
+
+OptimisticTransactionDB::OptimisticTransactionDB(Rep* rep) : rep_(rep) {}
+
+OptimisticTransactionDB::~OptimisticTransactionDB() { delete rep_; }
+
+Status OptimisticTransactionDB::Open(const Options& options,
+                                     const std::string& name,
+                                     OptimisticTransactionDB** dbptr) {
+  *dbptr = nullptr;
+  DB* db;
+  Status s = DB::Open(options, name, &db);
+  if (s.ok()) {
+    *dbptr = new OptimisticTransactionDB(new Rep(db));
+  }
+  return s;
+}
+
+Transaction* OptimisticTransactionDB::BeginTransaction(
+    const WriteOptions& options) {
+  return new Transaction(new Transaction::Rep(rep_, options));
+}
+
+DB* OptimisticTransactionDB::GetBaseDB() const { return rep_->db; }
+
+}  // namespace TimberSaw
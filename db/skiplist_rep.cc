@@ -0,0 +1,64 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/inlineskiplist.h"
+#include "db/memtable_rep.h"
+
+namespace TimberSaw {
+
+namespace {
+
+class SkipListRep : public MemTableRep {
+ public:
+  SkipListRep(const MemTable::KeyComparator& cmp, ConcurrentArena* arena)
+      : skip_list_(cmp, arena) {}
+
+  char* Allocate(size_t len) override { return skip_list_.AllocateKey(len); }
+
+  void InsertConcurrently(const char* entry) override {
+    skip_list_.InsertConcurrently(entry);
+  }
+
+  void Get(const char* memtable_key, void* arg,
+           bool (*callback_func)(void* arg, const char* entry)) override {
+    Table::Iterator iter(&skip_list_);
+    for (iter.Seek(memtable_key);
+         iter.Valid() && callback_func(arg, iter.key()); iter.Next()) {
+    }
+  }
+
+  MemTableRep::Iterator* NewIterator() override {
+    return new Iterator(&skip_list_);
+  }
+
+ private:
+  typedef InlineSkipList<MemTable::KeyComparator> Table;
+
+  class Iterator : public MemTableRep::Iterator {
+   public:
+    explicit Iterator(const Table* table) : iter_(table) {}
+
+    bool Valid() const override { return iter_.Valid(); }
+    const char* key() const override { return iter_.key(); }
+    void Next() override { iter_.Next(); }
+    void Prev() override { iter_.Prev(); }
+    void Seek(const char* memtable_key) override { iter_.Seek(memtable_key); }
+    void SeekToFirst() override { iter_.SeekToFirst(); }
+    void SeekToLast() override { iter_.SeekToLast(); }
+
+   private:
+    Table::Iterator iter_;
+  };
+
+  Table skip_list_;
+};
+
+}  // namespace
+
+MemTableRep* NewSkipListRep(const MemTable::KeyComparator& cmp,
+                            ConcurrentArena* arena) {
+  return new SkipListRep(cmp, arena);
+}
+
+}  // namespace TimberSaw
@@ -0,0 +1,146 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "TimberSaw/sst_file_writer.h"
+
+#include <ctime>
+#include <memory>
+
+#include "db/dbformat.h"
+#include "db/external_table.h"
+#include "db/version_edit.h"
+#include "table/table_builder_bacs.h"
+#include "table/table_builder_computeside.h"
+
+namespace TimberSaw {
+
+struct SstFileWriter::Rep {
+  Rep(const Options& opt, uint8_t node_id)
+      : internal_comparator(opt.comparator),
+        internal_filter_policy(opt.filter_policy),
+        options(opt),
+        target_node_id(node_id) {
+    options.comparator = &internal_comparator;
+    options.filter_policy =
+        opt.filter_policy != nullptr ? &internal_filter_policy : nullptr;
+  }
+
+  const InternalKeyComparator internal_comparator;
+  const InternalFilterPolicy internal_filter_policy;
+  // Referred to by the builder.
+  Options options;
+  const uint8_t target_node_id;
+  Table_Type table_type = block_based;
+  std::string file_path;
+  std::unique_ptr<TableBuilder> builder;
+  std::string smallest_key;
+  std::string last_key;
+  uint64_t num_entries = 0;
+};
+
+SstFileWriter::SstFileWriter(const Options& options, uint8_t target_node_id)
+    : rep_(new Rep(options, target_node_id)) {}
+
+SstFileWriter::~SstFileWriter() {
+  if (rep_->builder != nullptr) {
+    rep_->builder->Abandon();
+  }
+  delete rep_;
+}
+
+Status SstFileWriter::Open(const std::string& file_path) {
+  Rep* r = rep_;
+  if (r->builder != nullptr) {
+    return Status::InvalidArgument("a table is already open");
+  }
+  // Built like the flushes build theirs, through the compaction queue pair
+  // of the thread so that a bulk load does not hold back the flushes.
+#if TABLE_STRATEGY==0
+  r->table_type = block_based;
+  r->builder.reset(
+      new TableBuilder_ComputeSide(r->options, Compact, r->target_node_id));
+#else
+  r->table_type = byte_addressable;
+  r->builder.reset(
+      new TableBuilder_BACS(r->options, Compact, r->target_node_id));
+#endif
+  r->file_path = file_path;
+  r->smallest_key.clear();
+  r->last_key.clear();
+  r->num_entries = 0;
+  return Status::OK();
+}
+
+Status SstFileWriter::Put(const Slice& key, const Slice& value) {
+  Rep* r = rep_;
+  if (r->builder == nullptr) {
+    return Status::InvalidArgument("no table is open");
+  }
+  if (r->num_entries > 0 &&
+      r->internal_comparator.user_comparator()->Compare(key, r->last_key) <=
+          0) {
+    return Status::InvalidArgument("keys must be added in increasing order");
+  }
+  InternalKey ikey(key, 0, kTypeValue);
+  r->builder->Add(ikey.Encode(), value);
+  if (r->num_entries == 0) {
+    r->smallest_key.assign(key.data(), key.size());
+  }
+  r->last_key.assign(key.data(), key.size());
+  r->num_entries++;
+  return r->builder->status();
+}
+
+Status SstFileWriter::Finish(ExternalSstFileInfo* info) {
+  Rep* r = rep_;
+  if (r->builder == nullptr) {
+    return Status::InvalidArgument("no table is open");
+  }
+  std::unique_ptr<TableBuilder> builder = std::move(r->builder);
+  if (r->num_entries == 0) {
+    builder->Abandon();
+    return Status::InvalidArgument("empty table");
+  }
+  Status s = builder->Finish();
+  auto table = std::make_shared<RemoteMemTableMetaData>(0, nullptr,
+                                                        r->target_node_id);
+  builder->get_datablocks_map(table->remote_data_mrs);
+  builder->get_dataindexblocks_map(table->remote_dataindex_mrs);
+  builder->get_filter_map(table->remote_filter_mrs);
+  if (!s.ok()) {
+    return s;
+  }
+  table->table_type = r->table_type;
+  table->level = 0;
+  table->number = 0;
+  table->file_size = 0;
+  for (const auto& chunk : table->remote_data_mrs) {
+    table->file_size += chunk.second->length;
+  }
+  table->num_entries = builder->get_numentries();
+  table->largest_seq = 0;
+  table->creation_time = static_cast<uint64_t>(std::time(nullptr));
+  table->smallest = InternalKey(r->smallest_key, 0, kTypeValue);
+  table->largest = InternalKey(r->last_key, 0, kTypeValue);
+  s = WriteExternalTable(r->options.env, *table, r->file_path);
+  if (!s.ok()) {
+    // Nobody can find the table, free it.
+    return s;
+  }
+  table->ReleaseChunks();
+  if (info != nullptr) {
+    info->file_path = r->file_path;
+    info->smallest_key = r->smallest_key;
+    info->largest_key = r->last_key;
+    info->num_entries = r->num_entries;
+    info->file_size = table->file_size;
+  }
+  return s;
+}
+
+uint64_t SstFileWriter::FileSize() const {
+  return rep_->builder != nullptr ? rep_->builder->FileSize() : 0;
+}
+
+}  // namespace TimberSaw
@@ -51,12 +51,15 @@ RemoteMemTableMetaData::RemoteMemTableMetaData(int side)
 RemoteMemTableMetaData::~RemoteMemTableMetaData() {
   //TODO and Tothink: when destroy this metadata check whether this is compute node, if yes, send a message to
   // home node to deference. Or the remote dereference is conducted in the granularity of version.
-  assert(remote_dataindex_mrs.size() == 1);
+  assert(remote_dataindex_mrs.size() <= 1);
   assert(this_machine_type ==0 || this_machine_type == 1);
 //  assert(creator_node_id == 0 || creator_node_id == 1);
 
-  if (this_machine_type == 0){
-    assert(table_cache!= nullptr);
+  if (remote_data_mrs.empty() && remote_dataindex_mrs.empty() &&
+      remote_filter_mrs.empty()) {
+    // The chunks were released, see ReleaseChunks().
+  } else if (this_machine_type == 0){
+    // A table built by SstFileWriter has no cache until it is ingested.
     if (table_cache != nullptr){
       table_cache->Evict(number, creator_node_id);
     }
@@ -117,6 +120,10 @@ void RemoteMemTableMetaData::EncodeTo(std::string* dst) const {
   dst->append(reinterpret_cast<const char*>(&shard_target_node_id), sizeof(shard_target_node_id));
 
   PutFixed64(dst, file_size);
+  PutFixed64(dst, num_entries);
+  PutFixed64(dst, num_deletions);
+  PutFixed64(dst, largest_seq);
+  PutFixed64(dst, creation_time);
   PutLengthPrefixedSlice(dst, smallest.Encode());
   PutLengthPrefixedSlice(dst, largest.Encode());
   uint64_t remote_data_chunk_num = remote_data_mrs.size();
@@ -152,6 +159,11 @@ void RemoteMemTableMetaData::EncodeTo(std::string* dst) const {
     PutFixed32(dst, iter.first);
     mr_serialization(dst,iter.second);
   }
+  PutVarint32(dst, static_cast<uint32_t>(blob_refs.size()));
+  for (const auto& ref : blob_refs) {
+    PutVarint64(dst, ref.first);
+    PutVarint64(dst, ref.second);
+  }
 //  size_t
 }
 Status RemoteMemTableMetaData::DecodeFrom(Slice& src) {
@@ -180,6 +192,12 @@ Status RemoteMemTableMetaData::DecodeFrom(Slice& src) {
   assert(shard_target_node_id < 36);
 
   GetFixed64(&src, &file_size);
+  uint64_t num_entries_temp = 0;
+  GetFixed64(&src, &num_entries_temp);
+  num_entries = num_entries_temp;
+  GetFixed64(&src, &num_deletions);
+  GetFixed64(&src, &largest_seq);
+  GetFixed64(&src, &creation_time);
   Slice temp;
   GetLengthPrefixedSlice(&src, &temp);
   smallest.DecodeFrom(temp);
@@ -249,6 +267,18 @@ Status RemoteMemTableMetaData::DecodeFrom(Slice& src) {
     remote_filter_mrs.insert({offset, mr});
   }
   assert(!remote_filter_mrs.empty());
+  uint32_t blob_ref_num = 0;
+  if (!GetVarint32(&src, &blob_ref_num)) {
+    return Status::Corruption("blob refs");
+  }
+  for (uint32_t i = 0; i < blob_ref_num; i++) {
+    uint64_t log_id;
+    uint64_t bytes;
+    if (!GetVarint64(&src, &log_id) || !GetVarint64(&src, &bytes)) {
+      return Status::Corruption("blob refs");
+    }
+    blob_refs[log_id] = bytes;
+  }
   return s;
 }
 void RemoteMemTableMetaData::mr_serialization(std::string* dst, ibv_mr* mr) const {
@@ -273,7 +303,8 @@ enum Tag {
   kDeletedFile = 6,
   kNewFile = 7,
   // 8 was used for large value refs
-  kPrevLogNumber = 9
+  kPrevLogNumber = 9,
+  kNewBlobLog = 10
 };
 
 void VersionEdit::Clear() {
@@ -289,6 +320,7 @@ void VersionEdit::Clear() {
   has_last_sequence_ = false;
   deleted_files_.clear();
   new_files_.clear();
+  new_blob_logs_.clear();
 }
 
 void VersionEdit::EncodeTo(std::string* dst) const {
@@ -336,6 +368,10 @@ void VersionEdit::EncodeTo(std::string* dst) const {
     f->EncodeTo(dst);
 
   }
+  for (const auto& log : new_blob_logs_) {
+    PutVarint32(dst, kNewBlobLog);
+    log->EncodeTo(dst);
+  }
 //  assert(dst->size() < new_files_[0].second->rdma_mg->name_to_size["version_edit"]);
 }
 void VersionEdit::EncodeToDiskFormat(std::string* dst) const {
@@ -494,6 +530,16 @@ Status VersionEdit::DecodeFrom(const Slice src, int this_machine_type,
         }
         break;
 
+      case kNewBlobLog: {
+        auto log = std::make_shared<BlobLogMetaData>(this_machine_type, 0, 0, 0);
+        if (log->DecodeFrom(&input).ok()) {
+          new_blob_logs_.push_back(log);
+        } else {
+          msg = "new blob log";
+        }
+        break;
+      }
+
       default:
         msg = "unknown tag";
         break;
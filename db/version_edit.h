@@ -5,10 +5,12 @@
 #ifndef STORAGE_TimberSaw_DB_VERSION_EDIT_H_
 #define STORAGE_TimberSaw_DB_VERSION_EDIT_H_
 
+#include <atomic>
 #include <set>
 #include <utility>
 #include <vector>
 
+#include "db/blob_log.h"
 #include "db/dbformat.h"
 #include "util/rdma.h"
 
@@ -92,6 +94,17 @@ struct RemoteMemTableMetaData {
     }
     return true;
   }
+  // Forget the remote chunks of the table without freeing them, e.g. once
+  // an external table descriptor names them (see db/external_table.h).
+  void ReleaseChunks() {
+    for (auto* map : {&remote_data_mrs, &remote_dataindex_mrs,
+                      &remote_filter_mrs}) {
+      for (auto& chunk : *map) {
+        delete chunk.second;
+      }
+      map->clear();
+    }
+  }
   void EncodeTo(std::string* dst) const;
   Status DecodeFrom(Slice& src);
   void mr_serialization(std::string* dst, ibv_mr* mr) const;
@@ -103,7 +116,9 @@ struct RemoteMemTableMetaData {
   uint8_t shard_target_node_id;
   //  uint64_t refs;
   uint64_t level;
-  uint64_t allowed_seeks;  // Seeks allowed until compaction
+  // Seeks allowed until compaction. Charged by the readers without holding
+  // any lock, so it can go below zero.
+  std::atomic<int64_t> allowed_seeks;
   uint64_t number;
 
   // The uint32_t is the offset within the file.
@@ -112,7 +127,23 @@ struct RemoteMemTableMetaData {
   std::map<uint32_t, ibv_mr*> remote_filter_mrs;
   //std::vector<ibv_mr*> remote_data_mrs
   uint64_t file_size;    // File size in bytes
-  size_t num_entries;
+  size_t num_entries = 0;
+  // Number of deletion markers in the table, used to favour compactions that
+  // reclaim the most remote memory.
+  uint64_t num_deletions = 0;
+  // Upper bound of the sequence numbers in the table. Level-0 tables are
+  // searched in descending order of it, because an intra level-0 compaction
+  // output gets a new file number but keeps the sequence range of its inputs.
+  uint64_t largest_seq = 0;
+  // Time, in seconds since the epoch, the table was written by a flush or a
+  // compaction, i.e. the last time its entries went through the compaction
+  // filters. 0 if unknown. Drives Options::periodic_compaction_seconds.
+  uint64_t creation_time = 0;
+  // Bytes of separated values the table points to, per value log id (see
+  // db/blob_log.h), and the logs themselves so that they outlive it. The
+  // logs are resolved from the ids by VersionSet::LogAndApply().
+  std::map<uint64_t, uint64_t> blob_refs;
+  std::vector<std::shared_ptr<BlobLogMetaData>> blob_logs;
   InternalKey smallest;  // Smallest internal key served by table
   InternalKey largest;   // Largest internal key served by table
   TableCache* table_cache = nullptr;
@@ -187,6 +218,13 @@ class VersionEdit {
     if (remote_table->file_size >0)
       new_files_.emplace_back(level, remote_table);
  }
+  // Add a value log written for the new files of this edit.
+  void AddBlobLog(const std::shared_ptr<BlobLogMetaData>& log) {
+    new_blob_logs_.push_back(log);
+  }
+  const std::vector<std::shared_ptr<BlobLogMetaData>>& GetNewBlobLogs() const {
+    return new_blob_logs_;
+  }
   // Delete the specified "file" from the specified "level".
   void RemoveFile(int level, uint64_t file, uint8_t node_id) {
     //TODO(ruihong): remove this.
@@ -230,6 +268,7 @@ class VersionEdit {
   std::vector<std::pair<int, InternalKey>> compact_pointers_;
   DeletedFileSet deleted_files_;// level, file_number, creator_node_id
   std::vector<std::pair<int, std::shared_ptr<RemoteMemTableMetaData>>> new_files_;
+  std::vector<std::shared_ptr<BlobLogMetaData>> new_blob_logs_;
 };
 class VersionEdit_Merger {
  public:
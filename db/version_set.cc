@@ -11,7 +11,9 @@
 #include "db/table_cache.h"
 //#include "db/dbformat.h"
 #include <algorithm>
+#include <cmath>
 #include <cstdio>
+#include <ctime>
 
 #include "TimberSaw/env.h"
 
@@ -52,7 +54,7 @@ static double MaxBytesForLevel(const Options* options, int level) {
   // Result for both level-0 and level-1
   double result = config::max_mega_bytes_for_level_base * 1048576.0;
   while (level > 1) {
-    result *= 10;
+    result *= options->max_bytes_for_level_multiplier;
     level--;
   }
   return result;
@@ -71,6 +73,22 @@ static int64_t TotalFileSize(const std::vector<std::shared_ptr<RemoteMemTableMet
   return sum;
 }
 
+// Fraction of the entries in "files" that are deletion markers. Compacting a
+// level with a high density reclaims the tombstones and the values they
+// shadow from the remote memory.
+static double TombstoneDensity(const std::vector<std::shared_ptr<RemoteMemTableMetaData>>& files) {
+  uint64_t entries = 0;
+  uint64_t deletions = 0;
+  for (size_t i = 0; i < files.size(); i++) {
+    entries += files[i]->num_entries;
+    deletions += files[i]->num_deletions;
+  }
+  if (entries == 0) {
+    return 0;
+  }
+  return static_cast<double>(deletions) / static_cast<double>(entries);
+}
+
 Version::~Version() {
   // TODO: make a version set lock here, so that we do not need any lock for just a unref.
   assert(refs_.load() == 0);
@@ -192,12 +210,49 @@ static Iterator* GetFileIterator_Memoryside(
   return cache->NewIterator_MemorySide(options, remote_table);
 }
 
+static void DeleteInputFileList(void* arg1, void* /*arg2*/) {
+  delete reinterpret_cast<std::vector<std::shared_ptr<RemoteMemTableMetaData>>*>(
+      arg1);
+}
+// Append to *list the iterators over "files" which hold several whole levels
+// ordered by level (the first input of a universal compaction): one iterator
+// per level-0 file and one concatenating iterator per level >= 1.
+static void AppendMultiLevelIterators(
+    const InternalKeyComparator& icmp, TableCache* table_cache,
+    const ReadOptions& options,
+    Iterator* (*file_function)(void*, const ReadOptions&,
+                               std::shared_ptr<RemoteMemTableMetaData>),
+    const std::vector<std::shared_ptr<RemoteMemTableMetaData>>& files,
+    std::vector<Iterator*>* list) {
+  size_t i = 0;
+  while (i < files.size()) {
+    const int level = static_cast<int>(files[i]->level);
+    if (level == 0) {
+      list->push_back(file_function(table_cache, options, files[i]));
+      i++;
+      continue;
+    }
+    // The compaction may be shared by several subcompaction threads, so the
+    // per level file list is owned by the iterator instead of the compaction.
+    auto* level_files = new std::vector<std::shared_ptr<RemoteMemTableMetaData>>();
+    while (i < files.size() && static_cast<int>(files[i]->level) == level) {
+      level_files->push_back(files[i++]);
+    }
+    Iterator* iter = NewTwoLevelFileIterator(
+        new Version::LevelFileNumIterator(icmp, level_files), file_function,
+        table_cache, options);
+    iter->RegisterCleanup(&DeleteInputFileList, level_files, nullptr);
+    list->push_back(iter);
+  }
+}
+
 
 Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
                                             int level) const {
   return NewTwoLevelFileIterator(
       new LevelFileNumIterator(vset_->icmp_, &levels_[level]), &GetFileIterator,
-      vset_->table_cache_, options);
+      vset_->table_cache_, options,
+      IterateBound(options, &vset_->icmp_, vset_->options_->prefix_length));
 }
 //#ifdef BYTEADDRESSABLE
 //Iterator* Version::NewConcatenatingSEQIterator(const ReadOptions& options,
@@ -266,6 +321,9 @@ void Version::AddIterators(const ReadOptions& options,
 //#endif
 
 static bool NewestFirst(std::shared_ptr<RemoteMemTableMetaData> a, std::shared_ptr<RemoteMemTableMetaData> b) {
+  if (a->largest_seq != b->largest_seq) {
+    return a->largest_seq > b->largest_seq;
+  }
   return a->number > b->number;
 }
 
@@ -373,12 +431,31 @@ void Version::ForEachOverlappingAsync(Slice user_key, Slice internal_key, void*
 
 
 Status Version::Get(const ReadOptions& options, const LookupKey& k,
-                    std::string* value, GetStats* stats) {
+                    std::string* value, GetStats* stats,
+                    MergeContext* merge_context) {
+  return GetImpl(options, k, value, nullptr, stats, merge_context);
+}
+
+Status Version::Get(const ReadOptions& options, const LookupKey& k,
+                    PinnableSlice* value, GetStats* stats,
+                    MergeContext* merge_context) {
+  return GetImpl(options, k, nullptr, value, stats, merge_context);
+}
+
+Status Version::GetImpl(const ReadOptions& options, const LookupKey& k,
+                        std::string* value, PinnableSlice* pinned,
+                        GetStats* stats, MergeContext* merge_context) {
 #ifdef PROCESSANALYSIS
   auto start = std::chrono::high_resolution_clock::now();
 #endif
   stats->seek_file = nullptr;
   stats->seek_file_level = -1;
+  stats->files_probed = 0;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    stats->filter_checks[level] = 0;
+    stats->filter_negatives[level] = 0;
+    stats->filter_false_positives[level] = 0;
+  }
 
   struct State {
     Saver saver;
@@ -391,6 +468,17 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
     VersionSet* vset;
     Status s;
     bool found;
+    // Where the value merge operands apply to is copied, and the key
+    // looked up for the entries older than the last operand.
+    std::string* value_copy;
+    std::string merge_ikey;
+
+    // The operands are applied to a copy of the value, never to a pinned
+    // one.
+    void CopyValue() {
+      saver.pinned = nullptr;
+      saver.value = value_copy;
+    }
 
     static bool Match(void* arg, int level, std::shared_ptr<RemoteMemTableMetaData> f) {
       State* state = reinterpret_cast<State*>(arg);
@@ -404,15 +492,46 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
 
       state->last_file_read = f;
       state->last_file_read_level = level;
-
-      state->s = state->vset->table_cache_->Get(*state->options, f,
-          state->ikey, &state->saver, SaveValue);
-      if (!state->s.ok()) {
-        state->found = true;
-        return false;
+      state->stats->files_probed++;
+      state->saver.filter_checked = false;
+      state->saver.filter_negative = false;
+      bool merged = false;
+
+      while (true) {
+        state->s = state->vset->table_cache_->Get(*state->options, f,
+            state->ikey, &state->saver, SaveValue);
+        if (!state->s.ok()) {
+          state->found = true;
+          return false;
+        }
+        if (state->saver.state != kMerge) {
+          break;
+        }
+        // The older entries of the key may follow in the same file.
+        merged = true;
+        state->CopyValue();
+        state->saver.state = kNotFound;
+        if (state->saver.merge_sequence == 0) {
+          break;
+        }
+        state->merge_ikey.clear();
+        AppendInternalKey(&state->merge_ikey,
+                          ParsedInternalKey(state->saver.user_key,
+                                            state->saver.merge_sequence - 1,
+                                            kValueTypeForSeek));
+        state->ikey = state->merge_ikey;
+      }
+      if (state->saver.filter_checked) {
+        state->stats->filter_checks[level]++;
+        if (state->saver.filter_negative) {
+          state->stats->filter_negatives[level]++;
+        } else if (!merged && state->saver.state == kNotFound) {
+          state->stats->filter_false_positives[level]++;
+        }
       }
       switch (state->saver.state) {
         case kNotFound:
+        case kMerge:
           return true;  // Keep searching in other files
         case kFound:
           state->found = true;
@@ -446,12 +565,29 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
   state.saver.ucmp = vset_->icmp_.user_comparator();
   state.saver.user_key = k.user_key();
   state.saver.value = value;
+  state.saver.pinned = pinned;
+  state.saver.merge_context = merge_context;
+  state.value_copy = value != nullptr ? value : pinned->GetSelf();
+  if (!merge_context->empty()) {
+    state.CopyValue();
+  }
 
 #ifndef ASYNC_READ
   ForEachOverlapping(state.saver.user_key, state.ikey, &state, &State::Match);
 #else
   ForEachOverlappingAsync(state.saver.user_key, state.ikey, &state, &State::Match, &State::Match);
 #endif
+  if (state.found && state.s.ok() && state.saver.blob_index) {
+    // The table only holds where the value lives.
+    if (state.saver.pinned != nullptr) {
+      const std::string index(pinned->data(), pinned->size());
+      pinned->Reset();
+      state.s = ReadBlob(index, pinned);
+    } else {
+      const std::string index = *state.saver.value;
+      state.s = ReadBlob(index, state.saver.value);
+    }
+  }
 
 #ifdef PROCESSANALYSIS
   if (!state.found){
@@ -466,14 +602,70 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
   return state.found ? state.s : Status::NotFound(Slice());
 }
 
-bool Version::UpdateStats(const GetStats& stats) {
+bool Version::UpdateStats(const GetStats& stats, int64_t weight) {
   std::shared_ptr<RemoteMemTableMetaData> f = stats.seek_file;
-  if (f != nullptr) {
-    f->allowed_seeks--;
-    if (f->allowed_seeks <= 0 && file_to_compact_ == nullptr) {
-      file_to_compact_ = f;
-      file_to_compact_level_ = stats.seek_file_level;
-      return true;
+  if (f != nullptr && stats.files_probed > 1) {
+    // A remote probe is charged per extra file, so that the ranges covered
+    // by many overlapping tables run out of allowed seeks first.
+    const int64_t charge = weight * (stats.files_probed - 1);
+    const int64_t before =
+        f->allowed_seeks.fetch_sub(charge, std::memory_order_relaxed);
+    // Only the reader that crosses zero reports it.
+    return before > 0 && before <= charge;
+  }
+  return false;
+}
+
+bool Version::UpdateSeekCompaction() {
+  file_to_compact_ = nullptr;
+  file_to_compact_level_ = -1;
+  // The last level has no level to push its files to.
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    for (const auto& f : levels_[level]) {
+      if (f->allowed_seeks.load(std::memory_order_relaxed) <= 0 &&
+          !f->UnderCompaction) {
+        file_to_compact_ = f;
+        file_to_compact_level_ = level;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool Version::UpdatePeriodicCompaction(uint64_t oldest_allowed_time) {
+  expired_file_ = nullptr;
+  expired_file_level_ = -1;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    for (const auto& f : levels_[level]) {
+      // 0 is a file written before the creation times were recorded.
+      if (f->creation_time != 0 && f->creation_time < oldest_allowed_time &&
+          !f->UnderCompaction) {
+        expired_file_ = f;
+        expired_file_level_ = level;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool Version::UpdateBlobGarbageCompaction() {
+  blob_gc_file_ = nullptr;
+  blob_gc_file_level_ = -1;
+  if (garbage_blob_logs_.empty()) {
+    return false;
+  }
+  for (int level = 0; level < config::kNumLevels; level++) {
+    for (const auto& f : levels_[level]) {
+      if (f->UnderCompaction) continue;
+      for (const auto& ref : f->blob_refs) {
+        if (garbage_blob_logs_.count(ref.first) != 0) {
+          blob_gc_file_ = f;
+          blob_gc_file_level_ = level;
+          return true;
+        }
+      }
     }
   }
   return false;
@@ -497,6 +689,7 @@ bool Version::RecordReadSample(Slice internal_key) {
         state->stats.seek_file = f;
         state->stats.seek_file_level = level;
       }
+      state->stats.files_probed = state->matches;
       // We can stop iterating once we have a second match.
       return state->matches < 2;
     }
@@ -582,6 +775,41 @@ int Version::PickLevelForMemTableOutput(const Slice& smallest_user_key,
   return level;
 }
 
+int Version::PickLevelForIngestedTable(const Slice& smallest_user_key,
+                                       const Slice& largest_user_key) {
+  for (int level = 0; level < config::kNumLevels; level++) {
+    if (OverlapInLevel(level, &smallest_user_key, &largest_user_key)) {
+      return -1;
+    }
+  }
+  // A compaction writes its outputs at or below the levels of its inputs,
+  // anywhere between their smallest and their largest key. Level 0 tables
+  // may overlap each other.
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  Slice busy_smallest;
+  Slice busy_largest;
+  bool busy = false;
+  int level = 0;
+  for (int next = 0; next < config::kNumLevels; next++) {
+    for (const auto& f : in_progress[next]) {
+      if (!busy || ucmp->Compare(f->smallest.user_key(), busy_smallest) < 0) {
+        busy_smallest = f->smallest.user_key();
+      }
+      if (!busy || ucmp->Compare(f->largest.user_key(), busy_largest) > 0) {
+        busy_largest = f->largest.user_key();
+      }
+      busy = true;
+    }
+    if (next > 0 && busy &&
+        ucmp->Compare(smallest_user_key, busy_largest) <= 0 &&
+        ucmp->Compare(largest_user_key, busy_smallest) >= 0) {
+      break;
+    }
+    level = next;
+  }
+  return level;
+}
+
 // Store in "*inputs" all files in "level" that overlap [begin,end]
 bool Version::GetOverlappingInputs(int level, const InternalKey* begin,
                                    const InternalKey* end,
@@ -937,6 +1165,9 @@ VersionSet::VersionSet(const std::string& dbname, const Options* options,
       dummy_versions_(this),
       current_(nullptr),
       sv_mtx(mtx){
+  for (int level = 0; level < config::kNumLevels; level++) {
+    filter_bits_per_key_[level].store(options_->bloom_bits);
+  }
   AppendVersion(new Version(this));
 
 }
@@ -1054,6 +1285,7 @@ Status VersionSet::LogAndApply(VersionEdit* edit) {
   metadata_install_counter++;
 #endif
   edit->SetLastSequence(last_sequence_);
+  LinkBlobLogs(edit);
   Version* v;
   v = new Version(this);
 #ifdef WITHPERSISTENCE
@@ -1336,10 +1568,171 @@ void VersionSet::MarkFileNumberUsed(uint64_t number) {
   }
 }
 
+void VersionSet::CalculateLevelTargets(Version* v) {
+  for (int level = 0; level < config::kNumLevels; level++) {
+    v->max_bytes_for_level_[level] = MaxBytesForLevel(options_, level);
+  }
+  if (!options_->level_compaction_dynamic_level_bytes) {
+    return;
+  }
+  // The reference level is the level holding the most bytes (the deepest one
+  // on ties). Its target and the targets below it keep the static shape, so
+  // that it can still overflow into the next level. The levels above it are
+  // sized backwards from its actual size, bounded by the level-1 base and
+  // the static target.
+  int ref_level = 0;
+  int64_t ref_bytes = 0;
+  for (int level = 1; level < config::kNumLevels; level++) {
+    const int64_t level_bytes = TotalFileSize(v->levels_[level]);
+    if (level_bytes > 0 && level_bytes >= ref_bytes) {
+      ref_level = level;
+      ref_bytes = level_bytes;
+    }
+  }
+  const double base = MaxBytesForLevel(options_, 1);
+  double target = static_cast<double>(ref_bytes);
+  for (int level = ref_level - 1; level >= 1; level--) {
+    target /= options_->max_bytes_for_level_multiplier;
+    v->max_bytes_for_level_[level] =
+        std::min(std::max(target, base), v->max_bytes_for_level_[level]);
+  }
+}
+
+void VersionSet::LinkBlobLogs(VersionEdit* edit) {
+  std::unique_lock<std::mutex> lck(blob_logs_mtx_);
+  for (const auto& log : edit->GetNewBlobLogs()) {
+    blob_logs_[log->id] = log;
+  }
+  for (auto& pair : *edit->GetNewFiles()) {
+    // The flushes hand their logs over with the table.
+    for (const auto& log : pair.second->blob_logs) {
+      blob_logs_[log->id] = log;
+    }
+  }
+  for (auto& pair : *edit->GetNewFiles()) {
+    const std::shared_ptr<RemoteMemTableMetaData>& f = pair.second;
+    for (const auto& ref : f->blob_refs) {
+      bool linked = false;
+      for (const auto& log : f->blob_logs) {
+        if (log->id == ref.first) {
+          linked = true;
+          break;
+        }
+      }
+      if (linked) continue;
+      // The memory node does not see the logs the compute node wrote before
+      // it came up, its tables only need the ids.
+      auto iter = blob_logs_.find(ref.first);
+      if (iter != blob_logs_.end()) {
+        std::shared_ptr<BlobLogMetaData> log = iter->second.lock();
+        if (log != nullptr) {
+          f->blob_logs.push_back(std::move(log));
+        }
+      }
+    }
+  }
+  for (auto iter = blob_logs_.begin(); iter != blob_logs_.end();) {
+    if (iter->second.expired()) {
+      iter = blob_logs_.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+}
+
+void VersionSet::UpdateBlobGarbage(Version* v) {
+  v->garbage_blob_logs_.clear();
+  if (options_->blob_gc_garbage_ratio >= 1) {
+    return;
+  }
+  std::map<uint64_t, uint64_t> live_bytes;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    for (const auto& f : v->levels_[level]) {
+      for (const auto& ref : f->blob_refs) {
+        live_bytes[ref.first] += ref.second;
+      }
+    }
+  }
+  std::unique_lock<std::mutex> lck(blob_logs_mtx_);
+  for (const auto& pair : live_bytes) {
+    auto iter = blob_logs_.find(pair.first);
+    if (iter == blob_logs_.end()) continue;
+    std::shared_ptr<BlobLogMetaData> log = iter->second.lock();
+    if (log == nullptr || log->total_bytes == 0) continue;
+    const double garbage =
+        1.0 - static_cast<double>(pair.second) / log->total_bytes;
+    if (garbage >= options_->blob_gc_garbage_ratio) {
+      v->garbage_blob_logs_.insert(pair.first);
+    }
+  }
+}
+
+void VersionSet::GetBlobLogStats(uint64_t* num_logs, uint64_t* total_bytes,
+                                 uint64_t* live_bytes) {
+  *num_logs = 0;
+  *total_bytes = 0;
+  *live_bytes = 0;
+  Version* v = current_.load();
+  for (int level = 0; level < config::kNumLevels; level++) {
+    for (const auto& f : v->levels_[level]) {
+      for (const auto& ref : f->blob_refs) {
+        *live_bytes += ref.second;
+      }
+    }
+  }
+  std::unique_lock<std::mutex> lck(blob_logs_mtx_);
+  for (const auto& pair : blob_logs_) {
+    std::shared_ptr<BlobLogMetaData> log = pair.second.lock();
+    if (log != nullptr) {
+      (*num_logs)++;
+      *total_bytes += log->total_bytes;
+    }
+  }
+}
+
+void VersionSet::SetupBlobRelocation(Compaction* c, Version* current_snap) {
+  if (current_snap->garbage_blob_logs_.empty()) {
+    return;
+  }
+  for (int which = 0; which < 2; which++) {
+    for (const auto& f : c->inputs_[which]) {
+      for (const auto& ref : f->blob_refs) {
+        if (current_snap->garbage_blob_logs_.count(ref.first) != 0) {
+          c->relocate_blob_logs_.insert(ref.first);
+        }
+      }
+    }
+  }
+}
+
 void VersionSet::Finalize(Version* v) {
   // Precomputed best level for next compaction
 //  int best_level = -1;
 //  double best_score = -1;
+  CalculateLevelTargets(v);
+  EstimateCompactionNeededBytes(v);
+  UpdateBlobGarbage(v);
+  UpdateFilterBitsPerKey(v);
+  if (options_->compaction_style == kCompactionStyleUniversal) {
+    FinalizeUniversal(v);
+    return;
+  }
+  // When the tables of this DB take up most of their remote memory budget,
+  // levels with more reclaimable bytes get an extra boost.
+  double pressure_boost = 0;
+  if (options_->remote_memory_limit > 0) {
+    int64_t remote_bytes = 0;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      remote_bytes += TotalFileSize(v->levels_[level]);
+    }
+    const double usage = static_cast<double>(remote_bytes) /
+                         static_cast<double>(options_->remote_memory_limit);
+    const double threshold = options_->remote_memory_pressure_threshold;
+    if (usage > threshold) {
+      pressure_boost = options_->remote_memory_pressure_weight *
+                       std::min(1.0, (usage - threshold) / (1.0 - threshold));
+    }
+  }
 
   for (int level = 0; level < config::kNumLevels - 1; level++) {
     double score;
@@ -1367,11 +1760,16 @@ void VersionSet::Finalize(Version* v) {
       // Compute the ratio of current size to size limit.
       const uint64_t level_bytes = TotalFileSize(v->levels_[level]) - TotalFileSize(v->in_progress[level]);
       score =
-          static_cast<double>(level_bytes) / MaxBytesForLevel(options_, level);
+          static_cast<double>(level_bytes) / v->max_bytes_for_level_[level];
       assert(score>=0);
       v->compaction_level_[level] = level;
       v->compaction_score_[level] = score;
     }
+    const double weight = options_->tombstone_compaction_weight + pressure_boost;
+    if (weight > 0) {
+      v->compaction_score_[level] *=
+          1.0 + weight * TombstoneDensity(v->levels_[level]);
+    }
 
 //    if (score > best_score) {
 //      best_level = level;
@@ -1394,11 +1792,197 @@ void VersionSet::Finalize(Version* v) {
   if (v->levels_[0].size() == 0){
     DEBUG("level 0 file equals 0 marker\n");
   }
+  // Files that ran out of seeks in an older version are still eligible.
+  v->UpdateSeekCompaction();
+  if (options_->periodic_compaction_seconds > 0) {
+    const uint64_t now = static_cast<uint64_t>(std::time(nullptr));
+    v->UpdatePeriodicCompaction(
+        now > options_->periodic_compaction_seconds
+            ? now - options_->periodic_compaction_seconds
+            : 0);
+  }
+  v->UpdateBlobGarbageCompaction();
 
 //  v->compaction_level_ = best_level;
 //  v->compaction_score_ = best_score;
 }
 
+void VersionSet::UpdateFilterBitsPerKey(Version* v) {
+  if (!options_->per_level_filter_bits || options_->bloom_bits <= 0) {
+    return;
+  }
+  // A lookup which misses checks one filter per sorted run: every level-0
+  // table and every level below. Its expected number of remote reads is the
+  // sum of their false positive rates, e^(-b ln2^2) for b bits per key.
+  // Under the budget sum(n_i * b_i) = bloom_bits * sum(n_i) that sum is the
+  // smallest with the rates proportional to the run sizes n_i:
+  //   b_i = C - ln(n_i) / ln2^2.
+  // The runs the formula gives less than one bit get one, and C is solved
+  // again over the others. Table sizes stand for their numbers of keys.
+  const double ln2_squared = std::log(2.0) * std::log(2.0);
+  const double kMinBits = 1;
+  struct Run {
+    double size;
+    bool clamped;
+  };
+  std::vector<Run> runs;
+  double level0_size = 0;
+  for (const auto& f : v->levels_[0]) {
+    runs.push_back({std::max<double>(f->file_size, 1), false});
+    level0_size += std::max<double>(f->file_size, 1);
+  }
+  level0_size = v->levels_[0].empty()
+                    ? static_cast<double>(options_->write_buffer_size)
+                    : level0_size / v->levels_[0].size();
+  for (int level = 1; level < config::kNumLevels; level++) {
+    const int64_t bytes = TotalFileSize(v->levels_[level]);
+    if (bytes > 0) {
+      runs.push_back({static_cast<double>(bytes), false});
+    }
+  }
+  if (runs.empty()) {
+    return;
+  }
+  double c = options_->bloom_bits;
+  for (bool changed = true; changed;) {
+    changed = false;
+    double budget = 0;
+    double free_size = 0;
+    double free_log_sum = 0;
+    for (const Run& run : runs) {
+      budget += options_->bloom_bits * run.size;
+      if (run.clamped) {
+        budget -= kMinBits * run.size;
+      } else {
+        free_size += run.size;
+        free_log_sum += run.size * std::log(run.size) / ln2_squared;
+      }
+    }
+    if (free_size == 0) {
+      break;
+    }
+    c = (budget + free_log_sum) / free_size;
+    for (Run& run : runs) {
+      if (!run.clamped && c - std::log(run.size) / ln2_squared < kMinBits) {
+        run.clamped = true;
+        changed = true;
+      }
+    }
+  }
+  // The levels not written yet get the bits of a level of their target
+  // size, and level 0 those of one of its tables.
+  for (int level = 0; level < config::kNumLevels; level++) {
+    double size = level0_size;
+    if (level > 0) {
+      const int64_t bytes = TotalFileSize(v->levels_[level]);
+      size = bytes > 0 ? static_cast<double>(bytes)
+                       : v->max_bytes_for_level_[level];
+    }
+    double bits = c - std::log(std::max(size, 1.0)) / ln2_squared;
+    bits = std::max(kMinBits, std::min(bits, 4.0 * options_->bloom_bits));
+    filter_bits_per_key_[level].store(static_cast<int>(std::lround(bits)),
+                                      std::memory_order_relaxed);
+  }
+}
+
+// A group of sorted runs that universal compaction never splits: all the
+// level-0 files (each of them is a run, but their outputs can only go below
+// the remaining level-0 files if they are taken together) or one level >= 1.
+struct UniversalUnit {
+  int level;
+  int num_runs;
+  uint64_t size;
+};
+static void GetUniversalUnits(
+    const std::vector<std::shared_ptr<RemoteMemTableMetaData>>* levels,
+    std::vector<UniversalUnit>* units, int* num_runs) {
+  *num_runs = 0;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    if (levels[level].empty()) continue;
+    UniversalUnit unit;
+    unit.level = level;
+    unit.num_runs = level == 0 ? static_cast<int>(levels[level].size()) : 1;
+    unit.size = TotalFileSize(levels[level]);
+    units->push_back(unit);
+    *num_runs += unit.num_runs;
+  }
+}
+// Whether the runs newer than the oldest one take more than
+// universal_max_size_amplification_percent of its size.
+static bool UniversalSpaceAmpExceeded(const Options* options,
+                                      const std::vector<UniversalUnit>& units) {
+  if (units.size() < 2) return false;
+  uint64_t newer_bytes = 0;
+  for (size_t i = 0; i + 1 < units.size(); i++) {
+    newer_bytes += units[i].size;
+  }
+  return newer_bytes * 100 >=
+         static_cast<uint64_t>(options->universal_max_size_amplification_percent) *
+             units.back().size;
+}
+void VersionSet::FinalizeUniversal(Version* v) {
+  // Only the first score drives universal compaction, it is the number of
+  // sorted runs over the trigger. A single universal compaction runs at a
+  // time, because its output may be installed to any level below its inputs.
+  for (int i = 0; i < config::kNumLevels - 1; i++) {
+    v->compaction_level_[i] = i;
+    v->compaction_score_[i] = 0;
+  }
+  for (int level = 0; level < config::kNumLevels; level++) {
+    if (!v->in_progress[level].empty()) return;
+  }
+  std::vector<UniversalUnit> units;
+  int num_runs = 0;
+  GetUniversalUnits(v->levels_, &units, &num_runs);
+  if (num_runs < 2) return;
+  double score = num_runs /
+      static_cast<double>(options_->universal_sorted_run_trigger);
+  if (UniversalSpaceAmpExceeded(options_, units)) {
+    score = std::max(score, 1.0);
+  }
+  v->compaction_score_[0] = score;
+}
+
+void VersionSet::EstimateCompactionNeededBytes(Version* v) {
+  uint64_t needed_bytes = 0;
+  if (options_->compaction_style == kCompactionStyleUniversal) {
+    // Every run above the oldest one will be rewritten at least once.
+    std::vector<UniversalUnit> units;
+    int num_runs = 0;
+    GetUniversalUnits(v->levels_, &units, &num_runs);
+    if (num_runs >= options_->universal_sorted_run_trigger ||
+        UniversalSpaceAmpExceeded(options_, units)) {
+      for (size_t i = 0; i + 1 < units.size(); i++) {
+        needed_bytes += units[i].size;
+      }
+    }
+    v->estimated_compaction_needed_bytes_ = needed_bytes;
+    return;
+  }
+  // Level 0 is merged into level 1 as a whole.
+  uint64_t incoming_bytes = 0;
+  if (v->levels_[0].size() >= static_cast<size_t>(config::kL0_CompactionTrigger)) {
+    incoming_bytes = TotalFileSize(v->levels_[0]);
+    needed_bytes += incoming_bytes + TotalFileSize(v->levels_[1]);
+  }
+  // The bytes above the target of a level are merged into the next level,
+  // together with the overlapping part of it.
+  for (int level = 1; level < config::kNumLevels - 1; level++) {
+    const uint64_t level_bytes = TotalFileSize(v->levels_[level]) + incoming_bytes;
+    const double excess = level_bytes - v->max_bytes_for_level_[level];
+    if (excess <= 0) {
+      incoming_bytes = 0;
+      continue;
+    }
+    const uint64_t next_level_bytes = TotalFileSize(v->levels_[level + 1]);
+    const double fanout =
+        static_cast<double>(next_level_bytes) / std::max<uint64_t>(level_bytes, 1);
+    needed_bytes += static_cast<uint64_t>(excess * (fanout + 1));
+    incoming_bytes = static_cast<uint64_t>(excess);
+  }
+  v->estimated_compaction_needed_bytes_ = needed_bytes;
+}
+
 Status VersionSet::WriteSnapshot(log::Writer* log) {
   // TODO: Break up into multiple records to reduce memory usage on recovery?
 
@@ -1570,29 +2154,27 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   // Level-0 files have to be merged together.  For other levels,
   // we will make a concatenating iterator per level.
   // TODO(opt): use concatenating iterator for level-0 if there is no overlap
-  const int space = (c->level() == 0 ? c->inputs_[0].size() + 1 : 2);
-  Iterator** list = new Iterator*[space];
-  int num = 0;
+  std::vector<Iterator*> list;
   for (int which = 0; which < 2; which++) {
     if (!c->inputs_[which].empty()) {
-      if (c->level() + which == 0) {
+      if (which == 0 && c->output_level() != c->level() + 1) {
+        AppendMultiLevelIterators(icmp_, table_cache_, options, &GetFileIterator,
+                                  c->inputs_[0], &list);
+      } else if (c->level() + which == 0) {
         const std::vector<std::shared_ptr<RemoteMemTableMetaData>>& files = c->inputs_[which];
         for (size_t i = 0; i < files.size(); i++) {
-          list[num++] = table_cache_->NewIterator(options, files[i]);
+          list.push_back(table_cache_->NewIterator(options, files[i]));
         }
       } else {
         // Create concatenating iterator for the files from this level
         // one iterator will responsible for multiple remote memtables.
-        list[num++] = NewTwoLevelFileIterator(
+        list.push_back(NewTwoLevelFileIterator(
             new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]),
-            &GetFileIterator, table_cache_, options);
+            &GetFileIterator, table_cache_, options));
       }
     }
   }
-  assert(num <= space);
-  Iterator* result = NewMergingIterator(&icmp_, list, num);
-  delete[] list;
-  return result;
+  return NewMergingIterator(&icmp_, list.data(), list.size());
 }
 Iterator* VersionSet::MakeInputIteratorMemoryServer(Compaction* c) {
   ReadOptions options;
@@ -1602,29 +2184,27 @@ Iterator* VersionSet::MakeInputIteratorMemoryServer(Compaction* c) {
   // Level-0 files have to be merged together.  For other levels,
   // we will make a concatenating iterator per level.
   // TODO(opt): use concatenating iterator for level-0 if there is no overlap
-  const int space = (c->level() == 0 ? c->inputs_[0].size() + 1 : 2);
-  Iterator** list = new Iterator*[space];
-  int num = 0;
+  std::vector<Iterator*> list;
   for (int which = 0; which < 2; which++) {
     if (!c->inputs_[which].empty()) {
-      if (c->level() + which == 0) {
+      if (which == 0 && c->output_level() != c->level() + 1) {
+        AppendMultiLevelIterators(icmp_, table_cache_, options, &GetFileIterator_Memoryside,
+                                  c->inputs_[0], &list);
+      } else if (c->level() + which == 0) {
         const std::vector<std::shared_ptr<RemoteMemTableMetaData>>& files = c->inputs_[which];
         for (size_t i = 0; i < files.size(); i++) {
-          list[num++] = table_cache_->NewIterator_MemorySide(options, files[i]);
+          list.push_back(table_cache_->NewIterator_MemorySide(options, files[i]));
         }
       } else {
         // Create concatenating iterator for the files from this level
         // one iterator will responsible for multiple remote memtables.
-        list[num++] = NewTwoLevelFileIterator(
+        list.push_back(NewTwoLevelFileIterator(
             new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]),
-            &GetFileIterator_Memoryside, table_cache_, options);
+            &GetFileIterator_Memoryside, table_cache_, options));
       }
     }
   }
-  assert(num <= space);
-  Iterator* result = NewMergingIterator(&icmp_, list, num);
-  delete[] list;
-  return result;
+  return NewMergingIterator(&icmp_, list.data(), list.size());
 }
 //Iterator* VersionSet::NewIterator(std::shared_ptr<RemoteMemTableMetaData> f) {
 //  Cache::Handle* handle = nullptr;
@@ -1699,15 +2279,97 @@ Iterator* VersionSet::MakeInputIteratorMemoryServer(Compaction* c) {
 //  return sst->UnderCompaction;
 //}
 // TODO: Implement the file picking up for those file who exceed their peeking limit.
+// Move a level-0 file to level 1 by metadata only. The file must not overlap
+// any other level-0 file, since it would then be searched after older data,
+// nor any level-1 file, nor the key range a running level-0 compaction may
+// write to level 1 (its outputs can fill the gaps between its inputs).
+bool VersionSet::PickL0TrivialMove(Compaction* c, Version* current_snap) {
+  const Comparator* user_cmp = icmp_.user_comparator();
+  const auto& level0 = current_snap->levels_[0];
+  std::vector<std::shared_ptr<RemoteMemTableMetaData>> running =
+      current_snap->in_progress[0];
+  running.insert(running.end(), current_snap->in_progress[1].begin(),
+                 current_snap->in_progress[1].end());
+  InternalKey running_smallest, running_largest;
+  if (!running.empty()) {
+    GetRange(running, &running_smallest, &running_largest);
+  }
+  for (const auto& f : level0) {
+    if (f->UnderCompaction) continue;
+    const Slice smallest = f->smallest.user_key();
+    const Slice largest = f->largest.user_key();
+    bool overlap = false;
+    for (const auto& other : level0) {
+      if (other != f &&
+          user_cmp->Compare(other->largest.user_key(), smallest) >= 0 &&
+          user_cmp->Compare(other->smallest.user_key(), largest) <= 0) {
+        overlap = true;
+        break;
+      }
+    }
+    if (overlap) continue;
+    if (!running.empty() &&
+        user_cmp->Compare(running_largest.user_key(), smallest) >= 0 &&
+        user_cmp->Compare(running_smallest.user_key(), largest) <= 0) {
+      continue;
+    }
+    if (current_snap->OverlapInLevel(1, &smallest, &largest)) continue;
+    f->UnderCompaction = true;
+    c->inputs_[0].push_back(f);
+    current_snap->in_progress[0].push_back(f);
+    return true;
+  }
+  return false;
+}
+// Merge the level-0 files that are not under compaction into level 0 again,
+// when level 1 is busy. Those files are all newer than the ones being
+// compacted to level 1 (which took the whole level 0), so the oldest of them
+// form a contiguous sequence range that can be merged on its own.
+bool VersionSet::PickIntraL0Compaction(Compaction* c, Version* current_snap) {
+  std::vector<std::shared_ptr<RemoteMemTableMetaData>> candidates;
+  for (const auto& f : current_snap->levels_[0]) {
+    if (!f->UnderCompaction) candidates.push_back(f);
+  }
+  if (candidates.size() < static_cast<size_t>(config::kL0_IntraCompactionMinFiles)) {
+    return false;
+  }
+  std::sort(candidates.begin(), candidates.end(),
+            [](const std::shared_ptr<RemoteMemTableMetaData>& a,
+               const std::shared_ptr<RemoteMemTableMetaData>& b) {
+              return a->largest_seq < b->largest_seq;
+            });
+  // Keep the output around a single table.
+  uint64_t total_bytes = 0;
+  for (const auto& f : candidates) {
+    if (c->inputs_[0].size() >= static_cast<size_t>(config::kL0_IntraCompactionMinFiles) &&
+        total_bytes + f->file_size > options_->max_file_size) {
+      break;
+    }
+    total_bytes += f->file_size;
+    c->inputs_[0].push_back(f);
+  }
+  c->SetOutputLevel(0);
+  for (const auto& f : c->inputs_[0]) {
+    f->UnderCompaction = true;
+  }
+  current_snap->in_progress[0].insert(current_snap->in_progress[0].end(),
+                                      c->inputs_[0].begin(),
+                                      c->inputs_[0].end());
+  return true;
+}
 bool VersionSet::PickFileToCompact(int level, Compaction* c,
                                    Version* current_snap) {
   assert(c->inputs_[0].empty());
   assert(c->inputs_[1].empty());
   if (level==0){
-    // if there is pending compaction, skip level 0
+    if (PickL0TrivialMove(c, current_snap)) {
+      return true;
+    }
+    // if there is pending compaction, level 1 can not take more level 0
+    // files, merge the new level 0 files together instead.
     if (current_snap->in_progress[level].size()>0){
 //      assert(current_->levels_[level][0]->UnderCompaction);
-      return false;
+      return PickIntraL0Compaction(c, current_snap);
     }
     //Directly pickup all the pending table in level 0
     c->inputs_[0] = current_snap->levels_[level];
@@ -1735,6 +2397,8 @@ bool VersionSet::PickFileToCompact(int level, Compaction* c,
       c->inputs_[0].clear();
       c->inputs_[1].clear();
 //      return false;
+      // The overlapping level 1 files are under compaction.
+      return PickIntraL0Compaction(c, current_snap);
     }
   }else {
     size_t current_level_size = current_snap->levels_[level].size();
@@ -1813,6 +2477,138 @@ bool VersionSet::PickFileToCompact(int level, Compaction* c,
   return !c->inputs_[0].empty();
 
 }
+bool VersionSet::PickUniversalCompaction(Compaction* c,
+                                         Version* current_snap) {
+  assert(c->inputs_[0].empty());
+  assert(c->inputs_[1].empty());
+  for (int level = 0; level < config::kNumLevels; level++) {
+    if (!current_snap->in_progress[level].empty()) return false;
+  }
+  std::vector<UniversalUnit> units;
+  int num_runs = 0;
+  GetUniversalUnits(current_snap->levels_, &units, &num_runs);
+  if (num_runs < 2) return false;
+  const size_t n = units.size();
+  size_t start = 0;
+  size_t end = 0;  // exclusive
+  if (UniversalSpaceAmpExceeded(options_, units)) {
+    // Reduce the space amplification by merging everything into the last run.
+    end = n;
+  } else if (num_runs >= options_->universal_sorted_run_trigger) {
+    // Merge the first window of adjacent runs whose next run is not much
+    // larger than the accumulated size of the window.
+    for (size_t i = 0; i < n && end == 0; i++) {
+      uint64_t window_bytes = units[i].size;
+      int window_runs = units[i].num_runs;
+      size_t j = i + 1;
+      while (j < n && units[j].size * 100 <=
+                          window_bytes * (100 + options_->universal_size_ratio)) {
+        window_bytes += units[j].size;
+        window_runs += units[j].num_runs;
+        j++;
+      }
+      if (window_runs >= options_->universal_min_merge_width) {
+        start = i;
+        end = j;
+      }
+    }
+    if (end == 0) {
+      // Too many runs but none of similar size, merge the newest ones.
+      end = std::min<size_t>(n, 2);
+    }
+  } else {
+    return false;
+  }
+  // The output goes to the deepest level before the next older run. A window
+  // of level-0 files right above a non-empty level 1 has no such level, so it
+  // also takes level 1.
+  int output_level = (end < n ? units[end].level : config::kNumLevels) - 1;
+  if (output_level == 0) {
+    assert(end < n);
+    end++;
+    output_level = (end < n ? units[end].level : config::kNumLevels) - 1;
+  }
+  assert(output_level >= units[end - 1].level);
+  c->SetLevel(units[start].level);
+  c->SetOutputLevel(output_level);
+  for (size_t i = start; i < end; i++) {
+    const int level = units[i].level;
+    auto& inputs = c->inputs_[level == output_level ? 1 : 0];
+    for (auto f : current_snap->levels_[level]) {
+      f->UnderCompaction = true;
+      inputs.push_back(f);
+    }
+    current_snap->in_progress[level].insert(
+        current_snap->in_progress[level].end(),
+        current_snap->levels_[level].begin(),
+        current_snap->levels_[level].end());
+  }
+  // The window has at least two units (universal_min_merge_width >= 2), so
+  // at least one of them is above the output level.
+  assert(!c->inputs_[0].empty());
+  return true;
+}
+bool VersionSet::PickFileCompaction(
+    Compaction* c, Version* current_snap,
+    const std::shared_ptr<RemoteMemTableMetaData>& f, int level) {
+  assert(c->inputs_[0].empty());
+  if (f == nullptr || f->UnderCompaction) {
+    return false;
+  }
+  c->SetLevel(level);
+  const bool last_level = level == config::kNumLevels - 1;
+  if (last_level) {
+    // Nothing below to push to, rewrite the file in place.
+    c->SetOutputLevel(level);
+  }
+  if (level == 0) {
+    // Level-0 files overlap each other, take them the usual way.
+    return PickFileToCompact(level, c, current_snap);
+  }
+  const auto& files = current_snap->levels_[level];
+  auto iter = std::find(files.begin(), files.end(), f);
+  assert(iter != files.end());
+  if (iter == files.end()) {
+    return false;
+  }
+  c->inputs_[0].push_back(f);
+  // The older versions of the largest user key of f may continue in the next
+  // file, they can not stay above f.
+  auto user_cmp = icmp_.user_comparator();
+  if (iter + 1 != files.end() &&
+      user_cmp->Compare((*(iter + 1))->smallest.user_key(),
+                        f->largest.user_key()) == 0) {
+    if ((*(iter + 1))->UnderCompaction) {
+      c->inputs_[0].clear();
+      return false;
+    }
+    c->inputs_[0].push_back(*(iter + 1));
+  }
+  if (!last_level) {
+    InternalKey smallest, largest;
+    GetRange(c->inputs_[0], &smallest, &largest);
+    if (!current_snap->GetOverlappingInputs(level + 1, &smallest, &largest,
+                                            &c->inputs_[1])) {
+      c->inputs_[0].clear();
+      c->inputs_[1].clear();
+      return false;
+    }
+  }
+  for (auto input : c->inputs_[0]) {
+    input->UnderCompaction = true;
+  }
+  current_snap->in_progress[level].insert(current_snap->in_progress[level].end(),
+                                          c->inputs_[0].begin(), c->inputs_[0].end());
+  if (last_level) {
+    return true;
+  }
+  for (auto input : c->inputs_[1]) {
+    input->UnderCompaction = true;
+  }
+  current_snap->in_progress[level+1].insert(current_snap->in_progress[level+1].end(),
+                                            c->inputs_[1].begin(), c->inputs_[1].end());
+  return true;
+}
 Compaction* VersionSet::PickCompaction(std::mutex* sv_mtx_within_function) {
 
   Compaction* c;
@@ -1827,7 +2623,19 @@ Compaction* VersionSet::PickCompaction(std::mutex* sv_mtx_within_function) {
   //TODO: may be we can create a verion for current_, and only use a read lock
   // when fetch the current from the list.
   // TOTHINK: Is this unique locak necessary here, will this have impact over the read performance?
-
+  if (options_->compaction_style == kCompactionStyleUniversal) {
+    if (current_snap->CompactionScore(0) >= 1 &&
+        PickUniversalCompaction(c, current_snap)) {
+      c->input_version_ = current_snap;
+      c->input_version_->Ref(2);
+      SetupBlobRelocation(c, current_snap);
+      // Zero the score until this compaction is installed.
+      Finalize(current_snap);
+      return c;
+    }
+    delete c;
+    return nullptr;
+  }
   for (int i = 0; i < config::kNumLevels - 1; i++) {
     level = current_snap->CompactionLevel(i);
     level_score = current_snap->CompactionScore(i);
@@ -1862,9 +2670,39 @@ Compaction* VersionSet::PickCompaction(std::mutex* sv_mtx_within_function) {
       break;
     }
   }
+  // Compactions triggered by seeks only run when no level is over its target.
+  if (c->inputs_[0].empty() &&
+      PickFileCompaction(c, current_snap, current_snap->file_to_compact_,
+                         current_snap->file_to_compact_level_)) {
+    num_seek_compactions_.fetch_add(1, std::memory_order_relaxed);
+  }
+  // Then the files holding data older than periodic_compaction_seconds, so
+  // that the compaction filters get to see it.
+  if (c->inputs_[0].empty() &&
+      PickFileCompaction(c, current_snap, current_snap->expired_file_,
+                         current_snap->expired_file_level_)) {
+    c->SetPeriodic();
+    num_periodic_compactions_.fetch_add(1, std::memory_order_relaxed);
+  }
+  // Then the files pointing into value logs that are mostly garbage. Any
+  // compaction moves the values of such logs it comes across, see
+  // SetupBlobRelocation().
+  if (c->inputs_[0].empty() &&
+      PickFileCompaction(c, current_snap, current_snap->blob_gc_file_,
+                         current_snap->blob_gc_file_level_)) {
+    num_blob_gc_compactions_.fetch_add(1, std::memory_order_relaxed);
+  }
   if (!c->inputs_[0].empty()) {
     c->input_version_ = current_snap;
     c->input_version_->Ref(2);
+    SetupBlobRelocation(c, current_snap);
+    SetupGrandparents(c, current_snap);
+    if (!c->IsTrivialMove()) {
+      compaction_upper_input_bytes_.fetch_add(TotalFileSize(c->inputs_[0]),
+                                              std::memory_order_relaxed);
+      compaction_lower_input_bytes_.fetch_add(TotalFileSize(c->inputs_[1]),
+                                              std::memory_order_relaxed);
+    }
     //Recalculate the scores so that next time pick from a different level.
     Finalize(current_snap);
 //    if (c->inputs_[1].size() == 1){
@@ -1875,32 +2713,6 @@ Compaction* VersionSet::PickCompaction(std::mutex* sv_mtx_within_function) {
     delete c;
     return nullptr;
   }
-  //TODO: enable the file seek time compaciton in the future.
-//  if (current_->file_to_compact_ != nullptr) {
-//    level = current_->file_to_compact_level_;
-//    c->SetLevel(level);
-//    assert(c->inputs_[0].empty()&& c->inputs_[1].empty());
-//    c->inputs_[0].push_back(current_->file_to_compact_);
-//  } else {
-//    return nullptr;
-//  }
-
-
-
-//  // Files in level 0 may overlap each other, so pick up all overlapping ones
-//  if (level == 0) {
-//    InternalKey smallest, largest;
-//    GetRange(c->inputs_[0], &smallest, &largest);
-//    // Note that the next call will discard the file we placed in
-//    // c->inputs_[0] earlier and replace it with an overlapping set
-//    // which will include the picked file.
-//    current_->GetOverlappingInputs(0, &smallest, &largest, &c->inputs_[0]);
-//    assert(!c->inputs_[0].empty());
-//  }
-//
-//  SetupOtherInputs(c);
-
-
 }
 // Finds the largest key in a vector of files. Returns true if files it not
 // empty.
@@ -2029,10 +2841,7 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
 
   // Compute the set of grandparent files that overlap this compaction
   // (parent == level+1; grandparent == level+2)
-  if (level + 2 < config::kNumLevels) {
-    current_.load()->GetOverlappingInputs(level + 2, &all_start, &all_limit,
-                                   &c->grandparents_);
-  }
+  SetupGrandparents(c, current_.load());
 
   // Update the place where we will do the next compaction for this level.
   // We update this immediately instead of waiting for the VersionEdit
@@ -2042,6 +2851,32 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
   c->edit_.SetCompactPointer(level, largest);
 }
 
+void VersionSet::SetupGrandparents(Compaction* c, Version* current_snap) {
+  c->grandparents_.clear();
+  c->grandparent_limits_.clear();
+  c->grandparent_sizes_.clear();
+  const int grandparent_level = c->output_level() + 1;
+  if (grandparent_level >= config::kNumLevels || c->inputs_[0].empty()) {
+    return;
+  }
+  InternalKey all_start, all_limit;
+  GetRange2(c->inputs_[0], c->inputs_[1], &all_start, &all_limit);
+  // Unlike GetOverlappingInputs() this does not care whether the files are
+  // under compaction, they are only used as cutting points.
+  const Comparator* user_cmp = icmp_.user_comparator();
+  for (const auto& f : current_snap->levels_[grandparent_level]) {
+    if (user_cmp->Compare(f->largest.user_key(), all_start.user_key()) < 0) {
+      continue;
+    }
+    if (user_cmp->Compare(f->smallest.user_key(), all_limit.user_key()) > 0) {
+      break;
+    }
+    c->grandparents_.push_back(f);
+    c->grandparent_limits_.push_back(f->largest.user_key().ToString());
+    c->grandparent_sizes_.push_back(f->file_size);
+  }
+}
+
 Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
                                      const InternalKey* end) {
   std::vector<std::shared_ptr<RemoteMemTableMetaData>> inputs;
@@ -2078,12 +2913,10 @@ Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
 
 Compaction::Compaction(const Options* options, int level)
     : level_(level),
+      output_level_(level + 1),
       opt_ptr(options),
       max_output_file_size_(MaxFileSizeForLevel(options, level)),
       input_version_(nullptr),
-      grandparent_index_(0),
-      seen_key_(false),
-      overlapped_bytes_(0),
       edit_(0) {
   for (int i = 0; i < config::kNumLevels; i++) {
     level_ptrs_[i] = 0;
@@ -2093,9 +2926,6 @@ Compaction::Compaction(const Options* options, int level)
 Compaction::Compaction(const Options* options)
     : opt_ptr(options),
       input_version_(nullptr),
-      grandparent_index_(0),
-      seen_key_(false),
-      overlapped_bytes_(0),
       edit_(0) {
   for (int i = 0; i < config::kNumLevels; i++) {
     level_ptrs_[i] = 0;
@@ -2116,7 +2946,8 @@ bool Compaction::IsTrivialMove() const {
   // Avoid a move if there is lots of overlapping grandparent data.
   // Otherwise, the move could create a parent file that will require
   // a very expensive merge later on.
-  return (num_input_files(0) == 1 && num_input_files(1) == 0 &&
+  return (!periodic_ && relocate_blob_logs_.empty() &&
+          num_input_files(0) == 1 && num_input_files(1) == 0 &&
           TotalFileSize(grandparents_) <=
               MaxGrandParentOverlapBytes(vset->options_));
 }
@@ -2124,7 +2955,8 @@ bool Compaction::IsTrivialMove() const {
 void Compaction::AddInputDeletions(VersionEdit* edit) {
   for (int which = 0; which < 2; which++) {
     for (size_t i = 0; i < inputs_[which].size(); i++) {
-      edit->RemoveFile(level_ + which, inputs_[which][i]->number, inputs_[which][i]->creator_node_id);
+      edit->RemoveFile(inputs_[which][i]->level, inputs_[which][i]->number,
+                       inputs_[which][i]->creator_node_id);
     }
   }
 }
@@ -2134,6 +2966,9 @@ void Compaction::DecodeFrom(const Slice src, int side) {
   uint16_t level = 0;
   GetFixed16(&input, &level);
   level_ = level;
+  uint16_t output_level = 0;
+  GetFixed16(&input, &output_level);
+  output_level_ = output_level;
   uint32_t temp_type_buff;
   GetFixed32(&input, &temp_type_buff);
   table_type = static_cast<Table_Type>(temp_type_buff);
@@ -2151,12 +2986,33 @@ void Compaction::DecodeFrom(const Slice src, int side) {
     f->DecodeFrom(input);
     inputs_[1].push_back(f);
   }
+  uint32_t grandparent_num = 0;
+  GetFixed32(&input, &grandparent_num);
+  for (size_t i = 0; i < grandparent_num; i++) {
+    Slice limit;
+    uint64_t size = 0;
+    if (!GetLengthPrefixedSlice(&input, &limit) || !GetFixed64(&input, &size)) {
+      break;
+    }
+    grandparent_limits_.push_back(limit.ToString());
+    grandparent_sizes_.push_back(size);
+  }
+  uint32_t relocate_num = 0;
+  GetFixed32(&input, &relocate_num);
+  for (size_t i = 0; i < relocate_num; i++) {
+    uint64_t log_id;
+    if (!GetVarint64(&input, &log_id)) {
+      break;
+    }
+    relocate_blob_logs_.insert(log_id);
+  }
   max_output_file_size_ = MaxFileSizeForLevel(opt_ptr, level);
 }
 void Compaction::EncodeTo(std::string* dst){
   uint16_t level = level_;
 //  dst->append(reinterpret_cast<const char*>(&level), sizeof(char));
   PutFixed16(dst,level);
+  PutFixed16(dst, static_cast<uint16_t>(output_level_));
   uint32_t first_level_len = inputs_[0].size();
   uint32_t temp_type_buf =  static_cast<uint32_t>(table_type);
   PutFixed32(dst, temp_type_buf);
@@ -2178,11 +3034,20 @@ void Compaction::EncodeTo(std::string* dst){
     f->EncodeTo(dst);
 
   }
+  PutFixed32(dst, static_cast<uint32_t>(grandparent_limits_.size()));
+  for (size_t i = 0; i < grandparent_limits_.size(); i++) {
+    PutLengthPrefixedSlice(dst, grandparent_limits_[i]);
+    PutFixed64(dst, grandparent_sizes_[i]);
+  }
+  PutFixed32(dst, static_cast<uint32_t>(relocate_blob_logs_.size()));
+  for (uint64_t log_id : relocate_blob_logs_) {
+    PutVarint64(dst, log_id);
+  }
 }
 bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
   // Maybe use binary search to find right entry instead of linear search?
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
-  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+  for (int lvl = output_level_ + 1; lvl < config::kNumLevels; lvl++) {
     const std::vector<std::shared_ptr<RemoteMemTableMetaData>>& files = input_version_->levels_[lvl];
     while (level_ptrs_[lvl] < files.size()) {
       std::shared_ptr<RemoteMemTableMetaData> f = files[level_ptrs_[lvl]];
@@ -2199,29 +3064,49 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
   }
   return true;
 }
-//Note do not use it if it is a near data compaction.
-bool Compaction::ShouldStopBefore(const Slice& internal_key) {
-  const VersionSet* vset = input_version_->vset_;
-  // Scan to find earliest grandparent file that contains key.
-  const InternalKeyComparator* icmp = &vset->icmp_;
-  while (grandparent_index_ < grandparents_.size() &&
-         icmp->Compare(internal_key,
-                       grandparents_[grandparent_index_]->largest.Encode()) >
-             0) {
-    if (seen_key_) {
-      overlapped_bytes_ += grandparents_[grandparent_index_]->file_size;
+bool Compaction::ShouldStopBefore(const Slice& internal_key,
+                                  uint64_t output_size,
+                                  const Comparator* user_cmp,
+                                  OutputCutState* state) const {
+  // Scan to find earliest grandparent file that contains key. The user keys
+  // are compared so that the versions of a key never straddle two outputs.
+  const Slice user_key = ExtractUserKey(internal_key);
+  bool crossed_boundary = false;
+  while (state->grandparent_index < grandparent_limits_.size() &&
+         user_cmp->Compare(user_key,
+                           grandparent_limits_[state->grandparent_index]) > 0) {
+    if (state->seen_key) {
+      state->overlapped_bytes +=
+          grandparent_sizes_[state->grandparent_index];
+      crossed_boundary = true;
     }
-    grandparent_index_++;
+    state->grandparent_index++;
   }
-  seen_key_ = true;
+  state->seen_key = true;
 
-  if (overlapped_bytes_ > MaxGrandParentOverlapBytes(vset->options_)) {
+  if (state->overlapped_bytes >
+      static_cast<uint64_t>(MaxGrandParentOverlapBytes(opt_ptr))) {
     // Too much overlap for current output; start new output
-    overlapped_bytes_ = 0;
+    state->overlapped_bytes = 0;
+    state->overlap_cuts++;
     return true;
-  } else {
-    return false;
   }
+  if (crossed_boundary && output_size >= MinOutputFileSize()) {
+    // End the output with the grandparent file it has reached the end of.
+    state->overlapped_bytes = 0;
+    state->boundary_cuts++;
+    return true;
+  }
+  return false;
+}
+uint64_t Compaction::LargestInputSeq() const {
+  uint64_t largest_seq = 0;
+  for (int which = 0; which < 2; which++) {
+    for (const auto& f : inputs_[which]) {
+      largest_seq = std::max(largest_seq, f->largest_seq);
+    }
+  }
+  return largest_seq;
 }
 uint64_t Compaction::FirstLevelSize(){
   uint64_t sum_size = 0;
@@ -2305,5 +3190,80 @@ uint64_t Compaction::GetFileSizesForLevel(int level){
   return inputs_[level].size();
 }
 
+CompactionFilterRunner::CompactionFilterRunner(const CompactionFilter* first,
+                                               const CompactionFilter* second,
+                                               int output_level,
+                                               SequenceNumber smallest_snapshot,
+                                               const CompactionBlobRunner* blobs)
+    : filters_{first, second},
+      output_level_(output_level),
+      smallest_snapshot_(smallest_snapshot),
+      blobs_(blobs) {}
+
+bool CompactionFilterRunner::Drop(const Slice& internal_key,
+                                  const Slice& value) {
+  key_ = internal_key;
+  value_ = value;
+  deleted_ = false;
+  if (filters_[0] == nullptr && filters_[1] == nullptr) {
+    return false;
+  }
+  ParsedInternalKey ikey;
+  if (!ParseInternalKey(internal_key, &ikey) ||
+      (ikey.type != kTypeValue && ikey.type != kTypeBlobIndex) ||
+      ikey.sequence > smallest_snapshot_) {
+    return false;
+  }
+  // The filters see the separated value itself. If it cannot be read the
+  // entry is kept as is, a later compaction filters it again.
+  const bool separated = ikey.type == kTypeBlobIndex;
+  Slice filtered = value_;
+  if (separated) {
+    if (blobs_ == nullptr || !blobs_->Fetch(value, &blob_buf_).ok()) {
+      return false;
+    }
+    filtered = blob_buf_;
+  }
+  for (const CompactionFilter* filter : filters_) {
+    if (filter == nullptr) {
+      continue;
+    }
+    new_value_.clear();
+    switch (filter->Filter(output_level_, ikey.user_key, filtered, &new_value_)) {
+      case CompactionFilter::kKeep:
+        break;
+      case CompactionFilter::kChangeValue:
+        value_buf_.swap(new_value_);
+        value_ = value_buf_;
+        filtered = value_;
+        num_changed_++;
+        if (separated && key_.data() == internal_key.data()) {
+          // The new value is written inline, in place of the pointer.
+          key_buf_.clear();
+          AppendInternalKey(&key_buf_, ParsedInternalKey(ikey.user_key,
+                                                         ikey.sequence,
+                                                         kTypeValue));
+          key_ = key_buf_;
+        }
+        break;
+      case CompactionFilter::kRemove:
+        num_removed_++;
+        if (output_level_ == config::kNumLevels - 1) {
+          // No older version of the key can be below the last level.
+          return true;
+        }
+        key_buf_.clear();
+        AppendInternalKey(&key_buf_, ParsedInternalKey(ikey.user_key,
+                                                       ikey.sequence,
+                                                       kTypeDeletion));
+        key_ = key_buf_;
+        value_ = Slice();
+        deleted_ = true;
+        return false;
+    }
+  }
+  return false;
+}
+
 
 }  // namespace TimberSaw
@@ -17,7 +17,10 @@
 
 
 #include "db/dbformat.h"
+#include "db/merge_helper.h"
 #include "db/version_edit.h"
+#include "TimberSaw/compaction_filter.h"
+#include "TimberSaw/pinnable_slice.h"
 #include <atomic>
 #include <map>
 #include <set>
@@ -48,17 +51,32 @@ enum SaverState {
   kFound,
   kDeleted,
   kCorrupt,
+  // A merge operand, the entry it applies to is older.
+  kMerge,
 };
 struct Saver {
   SaverState state = kNotFound;// set as not found as default value.
   const Comparator* ucmp;
   Slice user_key;
   std::string* value;
+  // If not null, the value is left in place: Table::InternalGet() pins the
+  // memory pointed to by pinned_value into *pinned.
+  PinnableSlice* pinned = nullptr;
+  Slice pinned_value;
+  // The value found is a BlobIndex (see db/blob_log.h).
+  bool blob_index = false;
+  // Collects the merge operands, and the sequence number of the last one.
+  MergeContext* merge_context = nullptr;
+  SequenceNumber merge_sequence = 0;
+  // Set by Table::InternalGet(): the table has a filter, and it ruled the
+  // key out.
+  bool filter_checked = false;
+  bool filter_negative = false;
 };
 }  // namespace
 // Callback from TableCache::Get()
 
-static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
+inline void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
   Saver* s = reinterpret_cast<Saver*>(arg);
   ParsedInternalKey parsed_key;
   if (!ParseInternalKey(ikey, &parsed_key)) {
@@ -66,9 +84,23 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
     s->state = kCorrupt;
   } else {
     if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {// if found mark as kFound
-      s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
+      if (parsed_key.type == kTypeMerge) {
+        s->state = kMerge;
+        s->merge_context->PushOlderOperand(v);
+        s->merge_sequence = parsed_key.sequence;
+        return;
+      }
+      s->state = (parsed_key.type == kTypeValue ||
+                  parsed_key.type == kTypeBlobIndex)
+                     ? kFound
+                     : kDeleted;
+      s->blob_index = parsed_key.type == kTypeBlobIndex;
       if (s->state == kFound) {
-        s->value->assign(v.data(), v.size());
+        if (s->pinned != nullptr) {
+          s->pinned_value = v;
+        } else {
+          s->value->assign(v.data(), v.size());
+        }
       }
     }
   }
@@ -117,6 +149,14 @@ class Version {
   struct GetStats {
     std::shared_ptr<RemoteMemTableMetaData> seek_file;
     int seek_file_level;
+    // Number of tables searched for the key.
+    int files_probed;
+    // Per level: the tables whose filter was checked, those whose filter
+    // ruled the key out and those whose filter let it through although
+    // they did not hold it.
+    int filter_checks[config::kNumLevels];
+    int filter_negatives[config::kNumLevels];
+    int filter_false_positives[config::kNumLevels];
   };
 //  std::shared_ptr<Subversion> subversion;
 
@@ -127,20 +167,48 @@ class Version {
 //#ifdef BYTEADDRESSABLE
 //  void AddSEQIterators(const ReadOptions&, std::vector<Iterator*>* iters);
 //#endif
+  // The merge operands found on the way are added to *merge_context. If it
+  // holds operands, the caller applies them to the value found.
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
-             GetStats* stats);
-
-  // Adds "stats" into the current state.  Returns true if a new
-  // compaction may need to be triggered, false otherwise.
-  // REQUIRES: lock is held
-  bool UpdateStats(const GetStats& stats);
+             GetStats* stats, MergeContext* merge_context);
+  // Like above, but the value is pinned in the block cache or in the RDMA
+  // read buffer it was fetched into rather than copied. A value merge
+  // operands apply to is copied into val->GetSelf() instead, and not
+  // pinned.
+  Status Get(const ReadOptions&, const LookupKey& key, PinnableSlice* val,
+             GetStats* stats, MergeContext* merge_context);
+
+  // Charges "weight" seeks for every extra file probed by the read described
+  // by "stats" to the first file it probed. Returns true if that file has
+  // just run out of allowed seeks, the caller should then call
+  // UpdateSeekCompaction() with the lock held.
+  // REQUIRES: lock is not held
+  bool UpdateStats(const GetStats& stats, int64_t weight = 1);
 
   // Record a sample of bytes read at the specified internal key.
   // Samples are taken approximately once every config::kReadBytesPeriod
-  // bytes.  Returns true if a new compaction may need to be triggered.
-  // REQUIRES: lock is held
+  // bytes.  Returns true as UpdateStats() does.
+  // REQUIRES: lock is not held
   bool RecordReadSample(Slice key);
 
+  // Pick the file that a seek triggered compaction should start from: a file
+  // above the last level that has run out of allowed seeks and is not under
+  // compaction. Returns true if there is one.
+  // REQUIRES: lock is held
+  bool UpdateSeekCompaction();
+
+  // Pick the file that a periodic compaction should start from: a file
+  // written before "oldest_allowed_time" (seconds since the epoch) that is
+  // not under compaction. Returns true if there is one.
+  // REQUIRES: lock is held
+  bool UpdatePeriodicCompaction(uint64_t oldest_allowed_time);
+
+  // Pick the file that a value log collection should start from: a file not
+  // under compaction pointing into one of garbage_blob_logs_. Returns true
+  // if there is one.
+  // REQUIRES: lock is held
+  bool UpdateBlobGarbageCompaction();
+
   // Reference count management (so Versions do not disappear out from
   // under live iterators)
   void Ref(int mark);
@@ -166,8 +234,27 @@ class Version {
   int PickLevelForMemTableOutput(const Slice& smallest_user_key,
                                  const Slice& largest_user_key);
 
+  // Return the level at which an external table covering the range
+  // [smallest_user_key,largest_user_key] is installed, or -1 if some table
+  // overlaps the range. That is the deepest level no running compaction may
+  // write an output overlapping the range to.
+  int PickLevelForIngestedTable(const Slice& smallest_user_key,
+                                const Slice& largest_user_key);
+
   int NumFiles(int level) const { return levels_[level].size(); }
 
+  // The tables of "level", held for as long as the version is referenced.
+  const std::vector<std::shared_ptr<RemoteMemTableMetaData>>& LevelFiles(
+      int level) const {
+    return levels_[level];
+  }
+
+  // Estimated number of bytes the compactions have to rewrite to bring every
+  // level under its target. Computed by VersionSet::Finalize().
+  uint64_t EstimatedCompactionNeededBytes() const {
+    return estimated_compaction_needed_bytes_;
+  }
+
   // Return a human readable string that describes this version's contents.
   std::string DebugString() const;
   // An internal iterator.  For a given version/level pair, yields
@@ -235,6 +322,8 @@ class Version {
   };
   double CompactionScore(int i);
   int CompactionLevel(int i);
+  // Size target of "level" computed by Finalize(), in bytes.
+  double MaxBytesForLevel(int level) { return max_bytes_for_level_[level]; }
   void print_version_content(){
     for (int i = 0; i < config::kNumLevels; ++i) {
       printf("Version level %d contain %zu files\n", i, levels_[i].size());
@@ -255,7 +344,10 @@ class Version {
   friend class Compaction;
   friend class VersionSet;
 
-
+  // Shared by the Get()s, exactly one of "value" and "pinned" is not null.
+  Status GetImpl(const ReadOptions& options, const LookupKey& k,
+                 std::string* value, PinnableSlice* pinned, GetStats* stats,
+                 MergeContext* merge_context);
 
   explicit Version(VersionSet* vset)
       : vset_(vset),
@@ -263,7 +355,11 @@ class Version {
         prev_(this),
         refs_(0),
         file_to_compact_(nullptr),
-        file_to_compact_level_(-1){}
+        file_to_compact_level_(-1),
+        expired_file_(nullptr),
+        expired_file_level_(-1),
+        blob_gc_file_(nullptr),
+        blob_gc_file_level_(-1){}
 
   Version(const Version&) = delete;
   Version& operator=(const Version&) = delete;
@@ -299,12 +395,25 @@ class Version {
   // Next file to compact based on seek stats.
   std::shared_ptr<RemoteMemTableMetaData> file_to_compact_;
   int file_to_compact_level_;
+  // Next file to compact because Options::periodic_compaction_seconds have
+  // passed since it was written.
+  std::shared_ptr<RemoteMemTableMetaData> expired_file_;
+  int expired_file_level_;
+  // Value logs with at least Options::blob_gc_garbage_ratio of garbage, and
+  // the next file to compact because it points into one of them.
+  std::set<uint64_t> garbage_blob_logs_;
+  std::shared_ptr<RemoteMemTableMetaData> blob_gc_file_;
+  int blob_gc_file_level_;
 
   // Level that should be compacted next and its compaction score.
   // Score < 1 means compaction is not strictly needed.  These fields
   // are initialized by Finalize().
   std::array<double, config::kNumLevels - 1> compaction_score_;
   std::array<int, config::kNumLevels - 1> compaction_level_;
+  // Per-level size targets, either static (base * fanout^(level-1)) or
+  // derived backwards from the size of the last non-empty level.
+  std::array<double, config::kNumLevels> max_bytes_for_level_;
+  uint64_t estimated_compaction_needed_bytes_ = 0;
 #ifndef NDENUG
   std::vector<int> ref_mark_collection;
   std::vector<int> unref_mark_collection;
@@ -379,7 +488,7 @@ class VersionSet {
   uint64_t LastSequence() const { return last_sequence_.load(); }
   uint64_t LastSequence_nonatomic() const { return last_sequence_; }
   uint64_t AssignSequnceNumbers(size_t n){
-    assert(n == 1);
+    assert(n >= 1);
     return last_sequence_.fetch_add(n);
   }
 
@@ -404,6 +513,50 @@ class VersionSet {
   uint64_t PrevLogNumber() const { return prev_log_number_; }
 //  static bool check_compaction_state(std::shared_ptr<RemoteMemTableMetaData> sst);
   bool PickFileToCompact(int level, Compaction* c, Version* current_snap);
+  // Level-0 helpers of PickFileToCompact, see the definitions.
+  bool PickL0TrivialMove(Compaction* c, Version* current_snap);
+  bool PickIntraL0Compaction(Compaction* c, Version* current_snap);
+  // Pick the inputs of a compaction starting from file "f" of "level": the
+  // file that ran out of allowed seeks (Version::UpdateSeekCompaction) or
+  // the file that is due for a periodic compaction
+  // (Version::UpdatePeriodicCompaction). A file of the last level is
+  // compacted into the last level.
+  // REQUIRES: sv_mtx is held.
+  bool PickFileCompaction(Compaction* c, Version* current_snap,
+                          const std::shared_ptr<RemoteMemTableMetaData>& f,
+                          int level);
+  // Number of compactions triggered by seeks and periodic compactions so far.
+  uint64_t NumSeekCompactions() const {
+    return num_seek_compactions_.load(std::memory_order_relaxed);
+  }
+  uint64_t NumPeriodicCompactions() const {
+    return num_periodic_compactions_.load(std::memory_order_relaxed);
+  }
+  uint64_t NumBlobGCCompactions() const {
+    return num_blob_gc_compactions_.load(std::memory_order_relaxed);
+  }
+  // Number of live value logs, the bytes written to them and the bytes the
+  // tables of the current version still point to.
+  void GetBlobLogStats(uint64_t* num_logs, uint64_t* total_bytes,
+                       uint64_t* live_bytes);
+  // Bytes the picked (non trivial move) compactions read from their first
+  // level and from the level they overlap below it. Their ratio is the
+  // overlap ratio: how much next level data a compaction rewrites per byte
+  // it pushes down.
+  uint64_t CompactionUpperInputBytes() const {
+    return compaction_upper_input_bytes_.load(std::memory_order_relaxed);
+  }
+  uint64_t CompactionLowerInputBytes() const {
+    return compaction_lower_input_bytes_.load(std::memory_order_relaxed);
+  }
+  // Bits per key of the filters of the tables written to "level", see
+  // Options::per_level_filter_bits. Options::bloom_bits unless that is set.
+  int FilterBitsPerKey(int level) const {
+    return filter_bits_per_key_[level].load(std::memory_order_relaxed);
+  }
+  // Pick a window of adjacent sorted runs for a universal compaction.
+  // REQUIRES: sv_mtx is held.
+  bool PickUniversalCompaction(Compaction* c, Version* current_snap);
   // Pick level and mem_vec for a new compaction.
   // Returns nullptr if there is no compaction to be done.
   // Otherwise returns a pointer to a heap-allocated object that
@@ -433,9 +586,8 @@ class VersionSet {
     // funciton.
     Version* v = current_.load();
     //TODO(ruihong): we may also need a lock for changing reading the compaction score.
-    return (v->compaction_score_[0] >= 1) ;
-    //TODO: keep the file_to compact in our implementation in the future.
-//    || (v->file_to_compact_.get() != nullptr)
+    return (v->compaction_score_[0] >= 1) || (v->file_to_compact_level_ >= 0) ||
+           (v->expired_file_level_ >= 0) || (v->blob_gc_file_level_ >= 0);
   }
   bool AllCompactionNotFinished() {
 
@@ -484,6 +636,12 @@ class VersionSet {
   bool ReuseManifest(const std::string& dscname, const std::string& dscbase);
 
   void Finalize(Version* v);
+  void FinalizeUniversal(Version* v);
+  void EstimateCompactionNeededBytes(Version* v);
+  // Fill in v->max_bytes_for_level_, see Options::level_compaction_dynamic_level_bytes.
+  void CalculateLevelTargets(Version* v);
+  // Fill in filter_bits_per_key_ from the level sizes of "v".
+  void UpdateFilterBitsPerKey(Version* v);
 
   void GetRange(const std::vector<std::shared_ptr<RemoteMemTableMetaData>>& inputs, InternalKey* smallest,
                 InternalKey* largest);
@@ -493,6 +651,18 @@ class VersionSet {
                  InternalKey* smallest, InternalKey* largest);
 
   void SetupOtherInputs(Compaction* c);
+  // Collect the files of the level below the output level of "c" that its
+  // key range overlaps, so that the outputs can be cut on their boundaries.
+  void SetupGrandparents(Compaction* c, Version* current_snap);
+  // Let "c" move the values its inputs point to in the garbage value logs of
+  // "current_snap" to a new log.
+  void SetupBlobRelocation(Compaction* c, Version* current_snap);
+
+  // Register the value logs of "edit" and give its new files the logs they
+  // point into.
+  void LinkBlobLogs(VersionEdit* edit);
+  // Fill in v->garbage_blob_logs_ and v->blob_gc_file_.
+  void UpdateBlobGarbage(Version* v);
 
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
@@ -523,10 +693,32 @@ class VersionSet {
   // Per-level key at which the next compaction at that level should start.
   // Either an empty string, or a valid InternalKey.
   std::string compact_index_[config::kNumLevels];
+  std::atomic<uint64_t> num_seek_compactions_{0};
+  std::atomic<uint64_t> num_periodic_compactions_{0};
+  std::atomic<uint64_t> num_blob_gc_compactions_{0};
+  std::atomic<uint64_t> compaction_upper_input_bytes_{0};
+  std::atomic<uint64_t> compaction_lower_input_bytes_{0};
+  std::atomic<int> filter_bits_per_key_[config::kNumLevels];
 //  std::map<size_t, Version*> memory_version_pinner;
 
+  // Every value log some table may point into, by id.
+  std::mutex blob_logs_mtx_;
+  std::map<uint64_t, std::weak_ptr<BlobLogMetaData>> blob_logs_;
 };
 
+// Where one compaction thread stands in the grandparent files of its
+// compaction, see Compaction::ShouldStopBefore().
+struct OutputCutState {
+  size_t grandparent_index = 0;
+  // Some output key has been seen.
+  bool seen_key = false;
+  // Bytes of overlap between the current output and the grandparent files.
+  uint64_t overlapped_bytes = 0;
+  // The outputs finished by ShouldStopBefore(), on a grandparent boundary
+  // or because of too much overlap.
+  uint64_t boundary_cuts = 0;
+  uint64_t overlap_cuts = 0;
+};
 
 // A Compaction encapsulates information about a compaction.
 class Compaction {
@@ -538,7 +730,15 @@ class Compaction {
   // Return the level that is being compacted.  Inputs from "level"
   // and "level+1" will be merged to produce a set of "level+1" files.
   int level() const { return level_; }
-  void SetLevel(int level) { level_ = level; }
+  void SetLevel(int level) {
+    level_ = level;
+    output_level_ = level + 1;
+  }
+  // Return the level the output files are installed to. It is level()+1
+  // except for universal compactions, whose inputs_[0] may span several
+  // levels (see VersionSet::PickUniversalCompaction).
+  int output_level() const { return output_level_; }
+  void SetOutputLevel(int level) { output_level_ = level; }
   void SetTableType(Table_Type t_type){table_type = t_type; }
   // Return the object that holds the edits to the descriptor done
   // by this compaction.
@@ -565,10 +765,24 @@ class Compaction {
   //TODO: change the 420 if it have impact to the performance.
   uint64_t MaxOutputFileSize() const { return max_output_file_size_ - 420; }
 
+  // The options of the DB the compaction is for.
+  const Options* options() const { return opt_ptr; }
+
   // Is this a trivial compaction that can be implemented by just
   // moving a single mem_vec file to the next level (no merging or splitting)
   bool IsTrivialMove() const;
 
+  // A periodic compaction has to rewrite its inputs through the compaction
+  // filters, it is never a trivial move.
+  bool periodic() const { return periodic_; }
+  void SetPeriodic() { periodic_ = true; }
+
+  // Value logs whose values the compaction moves to a new log, see
+  // db/blob_log.h. Such a compaction is never a trivial move.
+  const std::set<uint64_t>& relocate_blob_logs() const {
+    return relocate_blob_logs_;
+  }
+
   // Add all mem_vec to this compaction as delete operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
   void DecodeFrom(const Slice src, int side);
@@ -578,10 +792,23 @@ class Compaction {
   // in levels greater than "level+1".
   bool IsBaseLevelForKey(const Slice& user_key);
 
-  // Returns true iff we should stop building the current output
-  // before processing "internal_key".
-  bool ShouldStopBefore(const Slice& internal_key);
+  // Returns true iff we should stop building the current output, holding
+  // "output_size" bytes so far, before adding "internal_key". Outputs of at
+  // least MinOutputFileSize() are cut where the keys cross the end of a
+  // grandparent file, so that their next compaction overlaps few files of
+  // the level below; any output is cut once it overlaps too many grandparent
+  // bytes. "state" is owned by the compaction thread, "user_cmp" orders the
+  // user keys.
+  bool ShouldStopBefore(const Slice& internal_key, uint64_t output_size,
+                        const Comparator* user_cmp,
+                        OutputCutState* state) const;
+  // Outputs below this size are only cut to bound the grandparent overlap.
+  uint64_t MinOutputFileSize() const {
+    return MaxOutputFileSize() / 100 * config::kMinOutputFileSizePercent;
+  }
   uint64_t FirstLevelSize();
+  // Largest sequence number the inputs may contain, the outputs inherit it.
+  uint64_t LargestInputSeq() const;
   // Release the mem_vec version for the compaction, once the compaction
   // is successful.
   void ReleaseInputs();
@@ -605,6 +832,9 @@ class Compaction {
 
   Compaction(const Options* options, int level);
   int level_;
+  int output_level_;
+  bool periodic_ = false;
+  std::set<uint64_t> relocate_blob_logs_;
   const Options* opt_ptr;
   uint64_t max_output_file_size_;
   Version* input_version_;
@@ -612,13 +842,13 @@ class Compaction {
 
   // Each compaction reads mem_vec from "level_" and "level_+1"
 
-  // State used to check for number of overlapping grandparent files
-  // (parent == level_ + 1, grandparent == level_ + 2)
+  // Files of the level below the output level that overlap this compaction
+  // (parent == output_level_, grandparent == output_level_ + 1)
   std::vector<std::shared_ptr<RemoteMemTableMetaData>> grandparents_;
-  size_t grandparent_index_;  // Index in grandparent_starts_
-  bool seen_key_;             // Some output key has been seen
-  int64_t overlapped_bytes_;  // Bytes of overlap between current output
-                              // and grandparent files
+  // Largest user key and size of each grandparent, in key order. Unlike
+  // grandparents_ they are sent to the memory node with the compaction.
+  std::vector<std::string> grandparent_limits_;
+  std::vector<uint64_t> grandparent_sizes_;
 
   // State for implementing IsBaseLevelForKey
 
@@ -635,7 +865,11 @@ class Compaction {
 struct CompactionOutput {
   uint64_t number;
   uint64_t file_size;
+  uint64_t num_entries = 0;
+  uint64_t num_deletions = 0;
   InternalKey smallest, largest;
+  // Bytes of separated values the output points to, per value log.
+  std::map<uint64_t, uint64_t> blob_refs;
   std::map<uint32_t , ibv_mr*> remote_data_mrs;
   std::map<uint32_t , ibv_mr*> remote_dataindex_mrs;
   std::map<uint32_t , ibv_mr*> remote_filter_mrs;
@@ -675,16 +909,14 @@ struct SubcompactionState {
 
   // State during the subcompaction
   uint64_t total_bytes = 0;
+  // Bytes the table builders memcpy-ed into their write buffers.
+  uint64_t copied_bytes = 0;
   uint64_t num_output_records = 0;
 
   uint64_t approx_size = 0;
-  // An index that used to speed up ShouldStopBefore().
-  size_t grandparent_index = 0;
-  // The number of bytes overlapping between the current output and
-  // grandparent files used in ShouldStopBefore().
-  uint64_t overlapped_bytes = 0;
-  // A flag determine whether the key has been seen in ShouldStopBefore()
-  bool seen_key = false;
+  OutputCutState cut;
+  // Value logs written by the relocation of this subcompaction.
+  std::vector<std::shared_ptr<BlobLogMetaData>> blob_logs;
 
   SubcompactionState(Compaction* c, Slice* _start, Slice* _end, uint64_t size)
   : compaction(c), start(_start), end(_end), approx_size(size) {
@@ -717,23 +949,76 @@ struct CompactionState {
   // State kept for output being generated
   //  WritableFile* outfile;
   TableBuilder* builder;
+  OutputCutState cut;
 
   uint64_t total_bytes;
+  // Bytes the table builders memcpy-ed into their write buffers.
+  uint64_t copied_bytes = 0;
+  // Value logs written by the relocation of this compaction.
+  std::vector<std::shared_ptr<BlobLogMetaData>> blob_logs;
+};
+// Runs the compaction filters of a DB (at most two, e.g. the application's
+// filter and the expiry filter) on the entries written by one compaction
+// thread.
+class CompactionFilterRunner {
+ public:
+  // Null filters are skipped. Entries newer than "smallest_snapshot" are
+  // left alone, a snapshot may still read them. "blobs" fetches the separated
+  // values, so that they are filtered like the others.
+  CompactionFilterRunner(const CompactionFilter* first,
+                         const CompactionFilter* second, int output_level,
+                         SequenceNumber smallest_snapshot,
+                         const CompactionBlobRunner* blobs);
+
+  CompactionFilterRunner(const CompactionFilterRunner&) = delete;
+  CompactionFilterRunner& operator=(const CompactionFilterRunner&) = delete;
+
+  // Return true if "internal_key" and "value" have to be dropped. Otherwise
+  // key() and value() are the entry to write in their place: the value may
+  // have been rewritten, or the entry turned into a deletion marker.
+  bool Drop(const Slice& internal_key, const Slice& value);
+  Slice key() const { return key_; }
+  Slice value() const { return value_; }
+  // True if the last entry kept by Drop() became a deletion marker.
+  bool deleted() const { return deleted_; }
+
+  uint64_t num_removed() const { return num_removed_; }
+  uint64_t num_changed() const { return num_changed_; }
+
+ private:
+  const CompactionFilter* filters_[2];
+  const int output_level_;
+  const SequenceNumber smallest_snapshot_;
+  const CompactionBlobRunner* const blobs_;
+
+  Slice key_;
+  Slice value_;
+  bool deleted_ = false;
+  std::string key_buf_;
+  std::string value_buf_;
+  std::string new_value_;
+  std::string blob_buf_;
+  uint64_t num_removed_ = 0;
+  uint64_t num_changed_ = 0;
 };
 // Per level compaction stats.  stats_[level] stores the stats for
 // compactions that produced data for the specified "level".
 struct CompactionStats {
-  CompactionStats() : micros(0), bytes_read(0), bytes_written(0) {}
+  CompactionStats() : micros(0), bytes_read(0), bytes_written(0), bytes_copied(0) {}
 
   void Add(const CompactionStats& c) {
     this->micros += c.micros;
     this->bytes_read += c.bytes_read;
     this->bytes_written += c.bytes_written;
+    this->bytes_copied += c.bytes_copied;
   }
 
   int64_t micros;
   int64_t bytes_read;
   int64_t bytes_written;
+  // Output bytes memcpy-ed into the write buffers instead of being built in
+  // place, see TableBuilder::CopiedBytes().
+  int64_t bytes_copied;
 };
 }  // namespace TimberSaw
 
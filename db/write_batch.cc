@@ -7,8 +7,12 @@
 //    count: fixed32
 //    data: record[count]
 // record :=
-//    kTypeValue varstring varstring         |
-//    kTypeDeletion varstring
+//    kTypeValue varstring varstring                        |
+//    kTypeDeletion varstring                               |
+//    kTypeMerge varstring varstring                        |
+//    kTypeColumnFamilyValue varint32 varstring varstring   |
+//    kTypeColumnFamilyDeletion varint32 varstring          |
+//    kTypeColumnFamilyMerge varint32 varstring varstring
 // varstring :=
 //    len: varint32
 //    data: uint8[len]
@@ -32,6 +36,26 @@ WriteBatch::~WriteBatch() = default;
 
 WriteBatch::Handler::~Handler() = default;
 
+void WriteBatch::Handler::Merge(const Slice& /*key*/, const Slice& /*value*/) {
+}
+
+Status WriteBatch::Handler::PutCF(uint32_t /*column_family_id*/,
+                                  const Slice& /*key*/,
+                                  const Slice& /*value*/) {
+  return Status::InvalidArgument("column family updates are not supported");
+}
+
+Status WriteBatch::Handler::DeleteCF(uint32_t /*column_family_id*/,
+                                     const Slice& /*key*/) {
+  return Status::InvalidArgument("column family updates are not supported");
+}
+
+Status WriteBatch::Handler::MergeCF(uint32_t /*column_family_id*/,
+                                    const Slice& /*key*/,
+                                    const Slice& /*value*/) {
+  return Status::InvalidArgument("column family updates are not supported");
+}
+
 void WriteBatch::Clear() {
   rep_.clear();
   rep_.resize(kHeader);
@@ -47,6 +71,8 @@ Status WriteBatch::Iterate(Handler* handler) const {
 
   input.remove_prefix(kHeader);
   Slice key, value;
+  uint32_t column_family;
+  Status s;
   int found = 0;
   while (!input.empty()) {
     found++;
@@ -70,9 +96,46 @@ Status WriteBatch::Iterate(Handler* handler) const {
           return Status::Corruption("bad WriteBatch Delete");
         }
         break;
+      case kTypeMerge:
+        if (GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          handler->Merge(key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch Merge");
+        }
+        break;
+      case kTypeColumnFamilyValue:
+        if (GetVarint32(&input, &column_family) &&
+            GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          s = handler->PutCF(column_family, key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch Put");
+        }
+        break;
+      case kTypeColumnFamilyDeletion:
+        if (GetVarint32(&input, &column_family) &&
+            GetLengthPrefixedSlice(&input, &key)) {
+          s = handler->DeleteCF(column_family, key);
+        } else {
+          return Status::Corruption("bad WriteBatch Delete");
+        }
+        break;
+      case kTypeColumnFamilyMerge:
+        if (GetVarint32(&input, &column_family) &&
+            GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          s = handler->MergeCF(column_family, key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch Merge");
+        }
+        break;
       default:
         return Status::Corruption("unknown WriteBatch tag");
     }
+    if (!s.ok()) {
+      return s;
+    }
   }
   if (found != WriteBatchInternal::Count(this)) {
     return Status::Corruption("WriteBatch has wrong count");
@@ -109,6 +172,53 @@ void WriteBatch::Delete(const Slice& key) {
   rep_.push_back(static_cast<char>(kTypeDeletion));
   PutLengthPrefixedSlice(&rep_, key);
 }
+
+void WriteBatch::Merge(const Slice& key, const Slice& value) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeMerge));
+  PutLengthPrefixedSlice(&rep_, key);
+  PutLengthPrefixedSlice(&rep_, value);
+}
+void WriteBatch::Put(ColumnFamilyHandle* column_family, const Slice& key,
+                     const Slice& value) {
+  const uint32_t id = column_family->GetID();
+  if (id == 0) {
+    Put(key, value);
+    return;
+  }
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeColumnFamilyValue));
+  PutVarint32(&rep_, id);
+  PutLengthPrefixedSlice(&rep_, key);
+  PutLengthPrefixedSlice(&rep_, value);
+}
+
+void WriteBatch::Delete(ColumnFamilyHandle* column_family, const Slice& key) {
+  const uint32_t id = column_family->GetID();
+  if (id == 0) {
+    Delete(key);
+    return;
+  }
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeColumnFamilyDeletion));
+  PutVarint32(&rep_, id);
+  PutLengthPrefixedSlice(&rep_, key);
+}
+
+void WriteBatch::Merge(ColumnFamilyHandle* column_family, const Slice& key,
+                       const Slice& value) {
+  const uint32_t id = column_family->GetID();
+  if (id == 0) {
+    Merge(key, value);
+    return;
+  }
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeColumnFamilyMerge));
+  PutVarint32(&rep_, id);
+  PutLengthPrefixedSlice(&rep_, key);
+  PutLengthPrefixedSlice(&rep_, value);
+}
+
 Slice WriteBatch::ParseFirst() {
   Slice input = Slice(rep_.c_str()+1+kHeader, rep_.size());
   Slice output;
@@ -135,6 +245,10 @@ class MemTableInserter : public WriteBatch::Handler {
     mem_->Add(sequence_, kTypeDeletion, key, Slice());
     sequence_++;
   }
+  void Merge(const Slice& key, const Slice& value) override {
+    mem_->Add(sequence_, kTypeMerge, key, value);
+    sequence_++;
+  }
 };
 }  // namespace
 
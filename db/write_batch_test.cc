@@ -3,6 +3,7 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "gtest/gtest.h"
+#include "db/db_impl_column_family.h"
 #include "db/memtable.h"
 #include "db/write_batch_internal.h"
 #include "TimberSaw/db.h"
@@ -14,6 +15,8 @@ namespace TimberSaw {
 static std::string PrintContents(WriteBatch* b) {
   InternalKeyComparator cmp(BytewiseComparator());
   MemTable* mem = new MemTable(cmp);
+  // The batch does not fill the sequence range of the memtable.
+  mem->NotFullTableflush();
   mem->Ref();
   std::string state;
   Status s = WriteBatchInternal::InsertInto(b, mem);
@@ -37,6 +40,8 @@ static std::string PrintContents(WriteBatch* b) {
         state.append(")");
         count++;
         break;
+      default:
+        break;
     }
     state.append("@");
     state.append(NumberToString(ikey.sequence));
@@ -112,6 +117,106 @@ TEST(WriteBatchTest, Append) {
       PrintContents(&b1));
 }
 
+// Records the updates of a batch with the ids of their families.
+class ColumnFamilyRecorder : public WriteBatch::Handler {
+ public:
+  void Put(const Slice& key, const Slice& value) override {
+    state_ += "Put(0, " + key.ToString() + ", " + value.ToString() + ")";
+  }
+  void Delete(const Slice& key) override {
+    state_ += "Delete(0, " + key.ToString() + ")";
+  }
+  void Merge(const Slice& key, const Slice& value) override {
+    state_ += "Merge(0, " + key.ToString() + ", " + value.ToString() + ")";
+  }
+  Status PutCF(uint32_t column_family_id, const Slice& key,
+               const Slice& value) override {
+    state_ += "Put(" + NumberToString(column_family_id) + ", " +
+              key.ToString() + ", " + value.ToString() + ")";
+    return Status::OK();
+  }
+  Status DeleteCF(uint32_t column_family_id, const Slice& key) override {
+    state_ += "Delete(" + NumberToString(column_family_id) + ", " +
+              key.ToString() + ")";
+    return Status::OK();
+  }
+  Status MergeCF(uint32_t column_family_id, const Slice& key,
+                 const Slice& value) override {
+    state_ += "Merge(" + NumberToString(column_family_id) + ", " +
+              key.ToString() + ", " + value.ToString() + ")";
+    return Status::OK();
+  }
+
+  std::string state_;
+};
+
+TEST(WriteBatchTest, ColumnFamilies) {
+  ColumnFamilyHandleImpl default_family("default", 0);
+  ColumnFamilyHandleImpl family("other", 300);
+  WriteBatch batch;
+  batch.Put(&family, "foo", "bar");
+  batch.Put(&default_family, "baz", "boo");
+  batch.Delete(&family, "box");
+  batch.Merge(&family, "cnt", "1");
+  batch.Merge(&default_family, "cnt", "2");
+  batch.Delete("old");
+  ASSERT_EQ(6, WriteBatchInternal::Count(&batch));
+
+  ColumnFamilyRecorder recorder;
+  ASSERT_TRUE(batch.Iterate(&recorder).ok());
+  ASSERT_EQ(
+      "Put(300, foo, bar)"
+      "Put(0, baz, boo)"
+      "Delete(300, box)"
+      "Merge(300, cnt, 1)"
+      "Merge(0, cnt, 2)"
+      "Delete(0, old)",
+      recorder.state_);
+
+  // The updates of the default family are encoded as without a family.
+  WriteBatch plain;
+  plain.Put("baz", "boo");
+  WriteBatch with_default;
+  with_default.Put(&default_family, "baz", "boo");
+  ASSERT_EQ(WriteBatchInternal::Contents(&plain).ToString(),
+            WriteBatchInternal::Contents(&with_default).ToString());
+}
+
+TEST(WriteBatchTest, ColumnFamiliesAppend) {
+  ColumnFamilyHandleImpl family("other", 2);
+  WriteBatch b1, b2;
+  b1.Put("a", "va");
+  b2.Delete(&family, "b");
+  b1.Append(b2);
+  ASSERT_EQ(2, WriteBatchInternal::Count(&b1));
+  ColumnFamilyRecorder recorder;
+  ASSERT_TRUE(b1.Iterate(&recorder).ok());
+  ASSERT_EQ("Put(0, a, va)Delete(2, b)", recorder.state_);
+}
+
+TEST(WriteBatchTest, ColumnFamiliesCorruption) {
+  ColumnFamilyHandleImpl family("other", 7);
+  WriteBatch batch;
+  batch.Put("foo", "bar");
+  batch.Put(&family, "baz", "boo");
+  Slice contents = WriteBatchInternal::Contents(&batch);
+  WriteBatchInternal::SetContents(&batch,
+                                  Slice(contents.data(), contents.size() - 1));
+  ColumnFamilyRecorder recorder;
+  ASSERT_TRUE(batch.Iterate(&recorder).IsCorruption());
+  ASSERT_EQ("Put(0, foo, bar)", recorder.state_);
+}
+
+TEST(WriteBatchTest, ColumnFamiliesNotInMemTable) {
+  // A memtable belongs to one family, it rejects the updates of the others.
+  ColumnFamilyHandleImpl family("other", 1);
+  WriteBatch batch;
+  batch.Put("foo", "bar");
+  batch.Put(&family, "baz", "boo");
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ("Put(foo, bar)@100ParseError()", PrintContents(&batch));
+}
+
 TEST(WriteBatchTest, ApproximateSize) {
   WriteBatch batch;
   size_t empty_size = batch.ApproximateSize();
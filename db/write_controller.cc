@@ -0,0 +1,47 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include <algorithm>
+
+#include "TimberSaw/env.h"
+
+namespace TimberSaw {
+
+WriteController::WriteController(uint64_t max_delayed_write_rate)
+    : max_delayed_write_rate_(
+          std::max(max_delayed_write_rate, kMinDelayedWriteRate)),
+      condition_(WriteStallCondition::kNormal),
+      delayed_write_rate_(max_delayed_write_rate_) {}
+
+void WriteController::SetCondition(WriteStallCondition condition,
+                                   uint64_t rate) {
+  if (condition == WriteStallCondition::kDelayed) {
+    rate = std::min(std::max(rate, kMinDelayedWriteRate),
+                    max_delayed_write_rate_);
+    delayed_write_rate_.store(rate, std::memory_order_relaxed);
+  }
+  condition_.store(condition, std::memory_order_relaxed);
+}
+
+uint64_t WriteController::GetDelay(Env* env, uint64_t num_bytes) {
+  if (!NeedsDelay()) {
+    return 0;
+  }
+  const double rate = static_cast<double>(delayed_write_rate());
+  const double now = static_cast<double>(env->NowMicros());
+  std::lock_guard<std::mutex> lck(mu_);
+  // An idle bucket only refills up to its burst size.
+  if (next_available_micros_ < now - kMaxBurstMicros) {
+    next_available_micros_ = now - kMaxBurstMicros;
+  }
+  next_available_micros_ += num_bytes * 1000000.0 / rate;
+  if (next_available_micros_ <= now) {
+    return 0;
+  }
+  return static_cast<uint64_t>(next_available_micros_ - now);
+}
+
+}  // namespace TimberSaw
@@ -0,0 +1,72 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_TimberSaw_DB_WRITE_CONTROLLER_H_
+#define STORAGE_TimberSaw_DB_WRITE_CONTROLLER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#include "TimberSaw/listener.h"
+
+namespace TimberSaw {
+
+class Env;
+
+// Throttles the foreground writers of a DB when the background work falls
+// behind. While delayed, the writers share a token bucket refilled at
+// delayed_write_rate() bytes per second; while stopped, the writers that need
+// a new memtable wait on the write stall condition variable of the DB.
+//
+// The state is updated by the DB whenever a new SuperVersion is installed,
+// GetDelay() can be called by any number of writers concurrently.
+class WriteController {
+ public:
+  explicit WriteController(uint64_t max_delayed_write_rate);
+
+  WriteController(const WriteController&) = delete;
+  WriteController& operator=(const WriteController&) = delete;
+
+  WriteStallCondition condition() const {
+    return condition_.load(std::memory_order_relaxed);
+  }
+  bool IsStopped() const {
+    return condition() == WriteStallCondition::kStopped;
+  }
+  bool NeedsDelay() const {
+    return condition() == WriteStallCondition::kDelayed;
+  }
+  uint64_t delayed_write_rate() const {
+    return delayed_write_rate_.load(std::memory_order_relaxed);
+  }
+  uint64_t max_delayed_write_rate() const { return max_delayed_write_rate_; }
+
+  // Switch to "condition". "rate" is only used when it is kDelayed, it is
+  // clipped to [kMinDelayedWriteRate, max_delayed_write_rate()].
+  void SetCondition(WriteStallCondition condition, uint64_t rate);
+
+  // Return the number of microseconds the caller has to sleep before writing
+  // "num_bytes", 0 if the writes are not delayed.
+  uint64_t GetDelay(Env* env, uint64_t num_bytes);
+
+  static constexpr uint64_t kMinDelayedWriteRate = 16 * 1024;
+
+ private:
+  // Size of the bucket, in microseconds of the current rate. Writers do not
+  // sleep as long as they stay within this burst.
+  static constexpr uint64_t kMaxBurstMicros = 1000;
+
+  const uint64_t max_delayed_write_rate_;
+  std::atomic<WriteStallCondition> condition_;
+  std::atomic<uint64_t> delayed_write_rate_;
+
+  std::mutex mu_;
+  // The time at which the bytes granted so far have been paid for.
+  double next_available_micros_ = 0;
+};
+
+}  // namespace TimberSaw
+
+#endif  // STORAGE_TimberSaw_DB_WRITE_CONTROLLER_H_
@@ -0,0 +1,100 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include "TimberSaw/env.h"
+
+#include "gtest/gtest.h"
+
+namespace TimberSaw {
+
+// An Env whose clock only moves when told to. The controller only reads
+// the clock, so nothing is forwarded: Env::Default() would need an RDMA
+// device.
+class FakeClockEnv : public EnvWrapper {
+ public:
+  FakeClockEnv() : EnvWrapper(nullptr), now_micros_(1000000000) {}
+
+  uint64_t NowMicros() override { return now_micros_; }
+  void Schedule(void (*)(void*), void*, ThreadPoolType) override {}
+  void JoinAllThreads(bool) override {}
+  void SetBackgroundThreads(int, ThreadPoolType) override {}
+  void Advance(uint64_t micros) { now_micros_ += micros; }
+
+ private:
+  uint64_t now_micros_;
+};
+
+TEST(WriteControllerTest, NotDelayed) {
+  FakeClockEnv env;
+  WriteController controller(1 << 20);
+  ASSERT_EQ(WriteStallCondition::kNormal, controller.condition());
+  ASSERT_EQ(0, controller.GetDelay(&env, 1 << 30));
+
+  // Stopped writers wait on the DB, not in GetDelay().
+  controller.SetCondition(WriteStallCondition::kStopped, 0);
+  ASSERT_TRUE(controller.IsStopped());
+  ASSERT_FALSE(controller.NeedsDelay());
+  ASSERT_EQ(0, controller.GetDelay(&env, 1 << 30));
+}
+
+TEST(WriteControllerTest, ClipsRate) {
+  WriteController controller(1 << 20);
+  ASSERT_EQ(1 << 20, controller.max_delayed_write_rate());
+
+  controller.SetCondition(WriteStallCondition::kDelayed, 1);
+  ASSERT_TRUE(controller.NeedsDelay());
+  ASSERT_EQ(WriteController::kMinDelayedWriteRate,
+            controller.delayed_write_rate());
+  controller.SetCondition(WriteStallCondition::kDelayed, 1 << 30);
+  ASSERT_EQ(1 << 20, controller.delayed_write_rate());
+  controller.SetCondition(WriteStallCondition::kDelayed, 1 << 19);
+  ASSERT_EQ(1 << 19, controller.delayed_write_rate());
+
+  // The rate is kept when the writes are no longer delayed.
+  controller.SetCondition(WriteStallCondition::kNormal, 0);
+  ASSERT_EQ(1 << 19, controller.delayed_write_rate());
+
+  WriteController small(1);
+  ASSERT_EQ(WriteController::kMinDelayedWriteRate,
+            small.max_delayed_write_rate());
+}
+
+TEST(WriteControllerTest, Delay) {
+  FakeClockEnv env;
+  WriteController controller(1 << 20);
+  controller.SetCondition(WriteStallCondition::kDelayed, 1 << 20);
+
+  // A megabyte at a megabyte per second, less the idle burst.
+  const uint64_t delay = controller.GetDelay(&env, 1 << 20);
+  ASSERT_GT(delay, 998000);
+  ASSERT_LE(delay, 1000000);
+
+  // The next writer queues behind the first one.
+  ASSERT_GT(controller.GetDelay(&env, 1 << 10), delay);
+
+  // Once the time has been paid for, small writes go through again.
+  env.Advance(2 * 1000000);
+  ASSERT_EQ(0, controller.GetDelay(&env, 1 << 10));
+}
+
+TEST(WriteControllerTest, BurstAfterIdle) {
+  FakeClockEnv env;
+  WriteController controller(1 << 20);
+  controller.SetCondition(WriteStallCondition::kDelayed, 1 << 20);
+
+  // A long idle period only leaves a burst of about a millisecond of the
+  // rate, a thousand bytes.
+  env.Advance(10 * 1000000);
+  ASSERT_EQ(0, controller.GetDelay(&env, 1000));
+  ASSERT_GT(controller.GetDelay(&env, 1000), 0);
+}
+
+}  // namespace TimberSaw
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
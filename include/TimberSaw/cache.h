@@ -30,7 +30,13 @@ static const int kNumShardBits = 6;
 static const int kNumShards = 1 << kNumShardBits;
 // Create a new table_cache with a fixed size capacity.  This implementation
 // of Cache uses a least-recently-used eviction policy.
-TimberSaw_EXPORT Cache* NewLRUCache(size_t capacity);
+//
+// Up to high_pri_pool_ratio of the capacity is a pool for the unpinned
+// entries inserted with Priority::kHigh: they are evicted after all the low
+// priority entries, the high priority entries past the pool age out with
+// the low priority ones. With a ratio of 0 the priorities are ignored.
+TimberSaw_EXPORT Cache* NewLRUCache(size_t capacity,
+                                    double high_pri_pool_ratio = 0.0);
 
 class TimberSaw_EXPORT Cache {
  public:
@@ -45,6 +51,9 @@ class TimberSaw_EXPORT Cache {
 
   // Opaque handle to an entry stored in the table_cache.
   struct Handle {};
+
+  // How long an entry is kept against the others, see NewLRUCache().
+  enum class Priority { kHigh, kLow };
   virtual size_t GetCapacity() = 0;
   // Insert a mapping from key->value into the table_cache and assign it
   // the specified charge against the total table_cache capacity.
@@ -56,7 +65,8 @@ class TimberSaw_EXPORT Cache {
   // When the inserted entry is no longer needed, the key and
   // value will be passed to "deleter".
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
-                         void (*deleter)(const Slice& key, void* value)) = 0;
+                         void (*deleter)(const Slice& key, void* value),
+                         Priority priority = Priority::kLow) = 0;
 
   // If the table_cache has no mapping for "key", returns nullptr.
   //
@@ -0,0 +1,63 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A CompactionFilter lets the application drop or rewrite entries while the
+// compactions rewrite them, e.g. to reclaim expired records without issuing
+// Delete()s. The filter only sees the newest version of every key that is not
+// needed by a snapshot, and never sees deletion markers.
+
+#ifndef STORAGE_TimberSaw_INCLUDE_COMPACTION_FILTER_H_
+#define STORAGE_TimberSaw_INCLUDE_COMPACTION_FILTER_H_
+
+#include <cstdint>
+#include <string>
+
+#include "TimberSaw/export.h"
+#include "TimberSaw/slice.h"
+
+namespace TimberSaw {
+
+class TimberSaw_EXPORT CompactionFilter {
+ public:
+  enum Decision {
+    kKeep,
+    // The key is deleted. Unless the compaction writes to the last level,
+    // a deletion marker is written instead, so that the older versions of
+    // the key in the levels below stay hidden.
+    kRemove,
+    // The entry is written with *new_value.
+    kChangeValue,
+  };
+
+  virtual ~CompactionFilter();
+
+  // Return the name of this filter, used in the info log.
+  virtual const char* Name() const = 0;
+
+  // Decide the fate of "key" (a user key) and "value" written to "level" by
+  // a compaction. Called concurrently by the compaction threads, so it must
+  // be thread safe.
+  virtual Decision Filter(int level, const Slice& key, const Slice& value,
+                          std::string* new_value) const = 0;
+};
+
+// The values of a DB with Options::expire_values start with a fixed 8 byte
+// expiry time, in seconds since the epoch, after which the compactions drop
+// them. 0 never expires.
+TimberSaw_EXPORT void EncodeExpiringValue(uint64_t expiry_unix_seconds,
+                                          const Slice& value,
+                                          std::string* dst);
+// Split a value written by EncodeExpiringValue(). Returns false if "stored"
+// is too short to hold an expiry time.
+TimberSaw_EXPORT bool DecodeExpiringValue(const Slice& stored,
+                                          uint64_t* expiry_unix_seconds,
+                                          Slice* value);
+
+// Return the filter used by Options::expire_values: it removes the values
+// whose expiry time has passed. The caller owns the result.
+TimberSaw_EXPORT const CompactionFilter* NewExpiryCompactionFilter();
+
+}  // namespace TimberSaw
+
+#endif  // STORAGE_TimberSaw_INCLUDE_COMPACTION_FILTER_H_
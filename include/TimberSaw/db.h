@@ -7,10 +7,13 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <string>
+#include <vector>
 
 #include "TimberSaw/export.h"
 #include "TimberSaw/iterator.h"
 #include "TimberSaw/options.h"
+#include "TimberSaw/pinnable_slice.h"
 
 namespace TimberSaw {
 
@@ -42,6 +45,28 @@ struct TimberSaw_EXPORT Range {
   Slice limit;  // Not included in the range
 };
 
+// The name of the column family the calls without one go to.
+TimberSaw_EXPORT extern const char* const kDefaultColumnFamilyName;
+
+// A column family of a DB opened with column families, see DB::Open().
+// The caller deletes the handles before the DB.
+class TimberSaw_EXPORT ColumnFamilyHandle {
+ public:
+  virtual ~ColumnFamilyHandle();
+  virtual const std::string& GetName() const = 0;
+  // 0 for the default column family.
+  virtual uint32_t GetID() const = 0;
+};
+
+struct TimberSaw_EXPORT ColumnFamilyDescriptor {
+  ColumnFamilyDescriptor() = default;
+  ColumnFamilyDescriptor(const std::string& n, const Options& o)
+      : name(n), options(o) {}
+
+  std::string name;
+  Options options;
+};
+
 // A DB is a persistent ordered map from keys to values.
 // A DB is safe for concurrent access from multiple threads without
 // any external synchronization.
@@ -55,6 +80,24 @@ class TimberSaw_EXPORT DB {
   static Status Open(const Options& options, const std::string& name,
                      DB** dbptr);
 
+  // Open the database with the specified "name" as the column families
+  // "column_families", one of which must be named kDefaultColumnFamilyName.
+  // Every family is an LSM tree of its own, with its own memtables, tables
+  // and options, while the families share the RDMA connections, the
+  // background threads and the remote memory of the memory nodes. The
+  // default family lives in the directory "name", the others in
+  // subdirectories of it named after them. The env, create_if_missing and
+  // error_if_exists of "options" apply to all families.
+  //
+  // Stores a handle for every family in *handles, in the order of
+  // "column_families". The calls without a handle go to the default family.
+  // A snapshot covers all the families, and a WriteBatch naming several
+  // families is applied atomically: a snapshot or a read sees all of it or
+  // none of it.
+  static Status Open(const Options& options, const std::string& name,
+                     const std::vector<ColumnFamilyDescriptor>& column_families,
+                     std::vector<ColumnFamilyHandle*>* handles, DB** dbptr);
+
   DB() = default;
 
   DB(const DB&) = delete;
@@ -74,11 +117,61 @@ class TimberSaw_EXPORT DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Apply "value" to the database entry for "key" with the merge operator
+  // of the DB (see TimberSaw/merge_operator.h), without reading the entry.
+  // Returns NotSupported if the DB has no merge operator.
+  virtual Status Merge(const WriteOptions& options, const Slice& key,
+                       const Slice& value);
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
   virtual Status Write(const WriteOptions& options, WriteBatch* updates) = 0;
 
+  // Add the tables built by SstFileWriter (see TimberSaw/sst_file_writer.h)
+  // whose descriptors are "files" to the DB as they are, without rewriting
+  // them. Each table goes to the deepest level it can take. The tables must
+  // not overlap each other nor any key the DB has an entry for, otherwise
+  // InvalidArgument is returned and none is added. The descriptors are
+  // removed once the tables are added.
+  virtual Status IngestExternalFile(const std::vector<std::string>& files);
+
+  // Copy an image of the DB into the new local directory "checkpoint_dir":
+  // the memtables are flushed, then the tables of the current version and
+  // the value logs they point into are read out of remote memory along with
+  // a MANIFEST describing them. The writes done meanwhile are not in the
+  // image. Returns InvalidArgument if "checkpoint_dir" exists. The image
+  // is an export only, the DB cannot be reopened from it (see
+  // db/checkpoint.h).
+  virtual Status CreateCheckpoint(const std::string& checkpoint_dir);
+
+  // Store in *sequence a sequence number no older than the newest entry of
+  // "key", 0 if the DB has none. It is the number of the entry if that is
+  // in a memtable; for a key only found in the tables it is the largest
+  // sequence number of the tables whose range holds the key, which only
+  // reads their metadata. Used to detect the conflicts of transactions (see
+  // TimberSaw/optimistic_transaction_db.h).
+  virtual Status GetLatestSequenceForKey(const Slice& key, uint64_t* sequence);
+
+  // The calls above for the column family "column_family". The default
+  // implementations only know the default column family and return
+  // InvalidArgument for the others.
+  virtual Status Put(const WriteOptions& options,
+                     ColumnFamilyHandle* column_family, const Slice& key,
+                     const Slice& value);
+  virtual Status Delete(const WriteOptions& options,
+                        ColumnFamilyHandle* column_family, const Slice& key);
+  virtual Status Merge(const WriteOptions& options,
+                       ColumnFamilyHandle* column_family, const Slice& key,
+                       const Slice& value);
+  virtual Status Get(const ReadOptions& options,
+                     ColumnFamilyHandle* column_family, const Slice& key,
+                     std::string* value);
+  virtual Iterator* NewIterator(const ReadOptions& options,
+                                ColumnFamilyHandle* column_family);
+  virtual bool GetProperty(ColumnFamilyHandle* column_family,
+                           const Slice& property, std::string* value);
+
   // If the database contains an entry for "key" store the
   // corresponding value in *value and return OK.
   //
@@ -89,6 +182,15 @@ class TimberSaw_EXPORT DB {
   virtual Status Get(const ReadOptions& options, const Slice& key,
                      std::string* value) = 0;
 
+  // Same as above, but a value found in a table is not copied: *value
+  // refers to the cached block or to the RDMA read buffer holding it, and
+  // keeps that memory pinned until *value is reset or destroyed. A value
+  // found in a memtable is copied into *value.
+  //
+  // The default implementation copies the value in all cases.
+  virtual Status Get(const ReadOptions& options, const Slice& key,
+                     PinnableSlice* value);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -125,6 +227,8 @@ class TimberSaw_EXPORT DB {
   //     about the internal operation of the DB.
   //  "TimberSaw.sstables" - returns a multi-line string that describes all
   //     of the sstables that make up the db contents.
+  //  "TimberSaw.write-amplification" - returns the bytes written by flushes
+  //     and compactions divided by the bytes written by the user.
   //  "TimberSaw.approximate-memory-usage" - returns the approximate number of
   //     bytes of memory in use by the DB.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
@@ -50,7 +50,7 @@ class SequentialFile;
 class Slice;
 class WritableFile;
 
-static uint32_t tcp_port;
+inline uint32_t tcp_port;
 class TimberSaw_EXPORT Env {
  public:
   Env();
@@ -23,7 +23,7 @@
 #include "TimberSaw/slice.h"
 namespace TimberSaw {
 
-static uint32_t BloomHash(const Slice& key) {
+inline uint32_t BloomHash(const Slice& key) {
   return Hash(key.data(), key.size(), 0xbc9f1d34);
 }
 
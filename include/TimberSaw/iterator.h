@@ -47,6 +47,11 @@ class TimberSaw_EXPORT Iterator {
   // an entry that comes at or past target.
   virtual void Seek(const Slice& target) = 0;
 
+  // Position at the last key in the source that is before target.
+  // The iterator is Valid() after this call iff the source contains
+  // an entry that comes before target.
+  virtual void SeekForPrev(const Slice& target);
+
   // Moves to the next entry in the source.  After this call, Valid() is
   // true iff the iterator was not positioned at the last entry in the source.
   // REQUIRES: Valid()
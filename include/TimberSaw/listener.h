@@ -0,0 +1,51 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// An EventListener registered in Options is called back by the DB when some
+// internal conditions change, so that the application can react (e.g. shed
+// load before the writes are stopped). The callbacks are invoked from the
+// thread that caused the change, possibly with internal locks held, so they
+// must return quickly and must not call back into the DB.
+
+#ifndef STORAGE_TimberSaw_INCLUDE_LISTENER_H_
+#define STORAGE_TimberSaw_INCLUDE_LISTENER_H_
+
+#include <cstdint>
+
+#include "TimberSaw/export.h"
+
+namespace TimberSaw {
+
+enum class WriteStallCondition {
+  // Writes proceed at full speed.
+  kNormal,
+  // Writes are throttled to WriteStallInfo::delayed_write_rate.
+  kDelayed,
+  // Writes that need a new memtable wait until the condition clears.
+  kStopped,
+};
+
+struct TimberSaw_EXPORT WriteStallInfo {
+  WriteStallCondition cur = WriteStallCondition::kNormal;
+  WriteStallCondition prev = WriteStallCondition::kNormal;
+  // Bytes per second granted to the writers while delayed.
+  uint64_t delayed_write_rate = 0;
+  // The state of the DB that led to this condition.
+  uint64_t pending_compaction_bytes = 0;
+  int num_level0_files = 0;
+  int num_immutable_memtables = 0;
+};
+
+class TimberSaw_EXPORT EventListener {
+ public:
+  virtual ~EventListener() = default;
+
+  // Called when the write stall condition of the DB changes, or when the
+  // delayed write rate is adjusted while the writes are delayed.
+  virtual void OnStallConditionsChanged(const WriteStallInfo& /*info*/) {}
+};
+
+}  // namespace TimberSaw
+
+#endif  // STORAGE_TimberSaw_INCLUDE_LISTENER_H_
@@ -0,0 +1,58 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A MergeOperator turns read-modify-write updates (counters, appends) into
+// blind writes: DB::Merge() stores an operand for the key, and the reads and
+// the compactions combine the operands with the value they apply to when
+// they meet them. No value has to be read to write an update.
+
+#ifndef STORAGE_TimberSaw_INCLUDE_MERGE_OPERATOR_H_
+#define STORAGE_TimberSaw_INCLUDE_MERGE_OPERATOR_H_
+
+#include <string>
+#include <vector>
+
+#include "TimberSaw/export.h"
+#include "TimberSaw/options.h"
+#include "TimberSaw/slice.h"
+
+namespace TimberSaw {
+
+class TimberSaw_EXPORT MergeOperator {
+ public:
+  virtual ~MergeOperator();
+
+  // Return the name of this operator, used in the info log.
+  virtual const char* Name() const = 0;
+
+  // Apply "operands", oldest first, to "existing_value" of "key" (a user
+  // key), or to nothing if existing_value is null, and store the result in
+  // *new_value. Return false if the operands can not be applied, the read
+  // or the compaction then fails with a corruption.
+  virtual bool FullMerge(const Slice& key, const Slice* existing_value,
+                         const std::vector<Slice>& operands,
+                         std::string* new_value) const = 0;
+
+  // Combine two operands of "key" into one operand with the effect of
+  // "left" followed by "right", so that long chains of operands collapse
+  // before the value they apply to is found. Return false if they can not be
+  // combined, the default, they are then kept apart.
+  virtual bool PartialMerge(const Slice& key, const Slice& left,
+                            const Slice& right, std::string* new_value) const;
+};
+
+// Return the operator of "type", used by Options::merge_operator_type, or
+// null for kNoMergeOperator. The caller owns the result.
+//
+// kUInt64AddOperator: the values and the operands are fixed 8 byte little
+// endian unsigned integers, the operands are added to the value (wrapping
+// around). A value or an operand of another size counts as 0.
+//
+// kStringAppendOperator: the operands are appended to the value, separated
+// by ','.
+TimberSaw_EXPORT const MergeOperator* NewMergeOperator(MergeOperatorType type);
+
+}  // namespace TimberSaw
+
+#endif  // STORAGE_TimberSaw_INCLUDE_MERGE_OPERATOR_H_
@@ -0,0 +1,99 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// OptimisticTransactionDB runs multi-key read-modify-write transactions on
+// a DB without locking the keys while the transaction runs. A transaction
+// notes the sequence number of the newest entry of every key it reads or
+// writes (see DB::GetLatestSequenceForKey()) and buffers its writes. Commit
+// checks that no key got a newer entry meanwhile and writes the buffered
+// updates as one WriteBatch; otherwise it returns Busy and the caller
+// retries the transaction.
+//
+// Only the commits of transactions sharing a lock stripe of their keys wait
+// for each other, the others validate and write in parallel. Writes done to
+// the DB directly are not ordered with the commits: one that lands between
+// the validation and the write of a commit is not detected. A key flushed or
+// compacted since it was read may fail a commit that has no real conflict.
+//
+// The keys of a transaction on a sharded DB must be in one shard.
+
+#ifndef STORAGE_TimberSaw_INCLUDE_OPTIMISTIC_TRANSACTION_DB_H_
+#define STORAGE_TimberSaw_INCLUDE_OPTIMISTIC_TRANSACTION_DB_H_
+
+#include <string>
+
+#include "TimberSaw/db.h"
+#include "TimberSaw/export.h"
+#include "TimberSaw/options.h"
+#include "TimberSaw/slice.h"
+#include "TimberSaw/status.h"
+
+namespace TimberSaw {
+
+class OptimisticTransactionDB;
+
+class TimberSaw_EXPORT Transaction {
+ public:
+  Transaction(const Transaction&) = delete;
+  Transaction& operator=(const Transaction&) = delete;
+
+  // A transaction that was not committed is rolled back.
+  ~Transaction();
+
+  // Like DB::Get(), but a key written by the transaction reads the value it
+  // wrote.
+  Status Get(const ReadOptions& options, const Slice& key, std::string* value);
+
+  // Buffer a write, applied by Commit().
+  Status Put(const Slice& key, const Slice& value);
+  Status Delete(const Slice& key);
+
+  // Write the buffered updates if no key of the transaction has changed
+  // since the transaction first accessed it, otherwise return Busy. The
+  // transaction is over either way.
+  Status Commit();
+
+  // Drop the buffered updates. The transaction is over.
+  void Rollback();
+
+ private:
+  friend class OptimisticTransactionDB;
+  struct Rep;
+
+  explicit Transaction(Rep* rep);
+
+  Rep* rep_;
+};
+
+class TimberSaw_EXPORT OptimisticTransactionDB {
+ public:
+  // Open the DB with DB::Open().
+  static Status Open(const Options& options, const std::string& name,
+                     OptimisticTransactionDB** dbptr);
+
+  OptimisticTransactionDB(const OptimisticTransactionDB&) = delete;
+  OptimisticTransactionDB& operator=(const OptimisticTransactionDB&) = delete;
+
+  // Closes the DB.
+  // REQUIRES: the transactions are deleted.
+  ~OptimisticTransactionDB();
+
+  // Start a transaction committed with "options". The caller deletes it.
+  Transaction* BeginTransaction(const WriteOptions& options);
+
+  // The DB, for the reads and writes outside of the transactions.
+  DB* GetBaseDB() const;
+
+ private:
+  friend class Transaction;
+  struct Rep;
+
+  explicit OptimisticTransactionDB(Rep* rep);
+
+  Rep* rep_;
+};
+
+}  // namespace TimberSaw
+
+#endif  // STORAGE_TimberSaw_INCLUDE_OPTIMISTIC_TRANSACTION_DB_H_
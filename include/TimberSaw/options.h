@@ -13,10 +13,14 @@
 namespace TimberSaw {
 
 class Cache;
+class CompactionFilter;
 class Comparator;
 class Env;
+class EventListener;
 class FilterPolicy;
 class Logger;
+class MergeOperator;
+class RateLimiter;
 class Snapshot;
 // The size for one SStable chunk
 //static size_t RDMA_WRITE_BLOCK = 2*1024*1024;
@@ -51,6 +55,40 @@ enum CompressionType {
   kNoCompression = 0x0,
   kSnappyCompression = 0x1
 };
+// How the sorted runs of a DB are merged by the background compactions.
+enum CompactionStyle {
+  // Leveled: every level above the last is one sorted run and compaction
+  // merges a file of level n into the overlapping files of level n+1.
+  kCompactionStyleLevel = 0x0,
+  // Size tiered (universal): every L0 file and every non-empty level is one
+  // sorted run, and compaction merges several adjacent runs of similar size
+  // at once. Lower write amplification, higher space amplification.
+  kCompactionStyleUniversal = 0x1
+};
+// The merge operators built into both node types, see
+// TimberSaw/merge_operator.h.
+enum MergeOperatorType {
+  kNoMergeOperator = 0x0,
+  kUInt64AddOperator = 0x1,
+  kStringAppendOperator = 0x2
+};
+// The index of the entries of a memtable.
+enum MemTableRepType {
+  // A concurrent skiplist, for any comparator.
+  kSkipListRep = 0x0,
+  // A concurrent adaptive radix tree. Shallower than the skiplist and
+  // cheaper on point lookups, for the byte wise comparator only; the
+  // memtables of a DB with another comparator use the skiplist.
+  kARTRep = 0x1
+};
+// The filter built for the keys of a table.
+enum FilterType {
+  // A cache line local Bloom filter.
+  kBloomFilter = 0x0,
+  // A Ribbon filter, about 25% smaller than the Bloom filter of the same
+  // false positive rate, at a higher build cost.
+  kRibbonFilter = 0x1
+};
 
 // Options to control the behavior of a database (passed to DB::Open)
 // The options now do not support dynamically change.
@@ -71,6 +109,18 @@ struct TimberSaw_EXPORT Options {
   const Comparator* comparator;
 
   int max_background_flushes = 4;// 1-1 setup is 8 M-M setup is 8, fixed shard is also 8
+  // If true, a flush walks its memtables on a thread of its own and hands the
+  // entries over to the thread building the table, so that the skiplist walk
+  // and the filter hashing overlap with the block building and compression.
+  bool pipelined_flush = true;
+  // If true, the memtables allocate their entries in memory registered with
+  // the RDMA device, and a flush of a byte addressable table writes the keys
+  // and values to the remote memory straight from there with scatter gather
+  // writes, instead of copying them into a write buffer first. Block based
+  // tables encode the entries into blocks, their flushes still copy.
+  bool zero_copy_flush = false;
+  // The index of the entries of the memtables.
+  MemTableRepType memtable_rep = kSkipListRep;
 
 
 
@@ -132,6 +182,18 @@ struct TimberSaw_EXPORT Options {
   // If null, TimberSaw will automatically create and use an 64MB internal table_cache.
   Cache* block_cache = nullptr;
 
+  // If true, the index and filter blocks of the tables are charged to
+  // block_cache with a high priority (see NewLRUCache()), instead of being
+  // held by the tables in the table cache. A data block scan then cannot
+  // push them out of local memory, and an evicted one is read again.
+  bool cache_index_and_filter_blocks = false;
+
+  // If non-null, a tier under block_cache for the data blocks, snappy
+  // compressed in local memory. A block missing from block_cache is taken
+  // from here before it is read from the remote memory, so that the same
+  // local memory holds more of the working set.
+  Cache* compressed_block_cache = nullptr;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -156,6 +218,135 @@ struct TimberSaw_EXPORT Options {
   //default 64MB
   size_t max_file_size = 64 * 1024 * 1024;
 
+  // Size ratio between two adjacent levels (level n+1 / level n).
+  double max_bytes_for_level_multiplier = 10;
+
+  // If true, the size targets of the levels above the largest level are
+  // derived backwards from its actual size: target(n) =
+  // size(largest) / multiplier^(largest - n), bounded by the level-1 base
+  // (config::max_mega_bytes_for_level_base) and by the static target. This
+  // keeps most of the data in the largest level and bounds the space
+  // amplification to about 1 + 1/multiplier, instead of leaving a half-full
+  // last level under a fixed shape.
+  bool level_compaction_dynamic_level_bytes = false;
+
+  // Weight of the tombstone density (deletions / entries) of a level in its
+  // compaction score: score *= 1 + weight * density. 0 (the default)
+  // disables it and keeps the plain size based score.
+  double tombstone_compaction_weight = 0;
+
+  // Remote memory (in bytes) the SSTables of this DB are expected to occupy on
+  // the memory node. When the total table size goes above
+  // remote_memory_pressure_threshold * remote_memory_limit, levels whose
+  // compaction reclaims more remote bytes (many tombstones) are boosted
+  // further by up to remote_memory_pressure_weight. 0 disables it.
+  uint64_t remote_memory_limit = 0;
+  double remote_memory_pressure_threshold = 0.8;
+  double remote_memory_pressure_weight = 4.0;
+
+  // Compaction style of this DB. The style is shipped to the memory node
+  // together with the rest of the options, so near data compaction follows it.
+  CompactionStyle compaction_style = kCompactionStyleLevel;
+
+  // Universal compaction only. A compaction is triggered once the number of
+  // sorted runs reaches this value.
+  int universal_sorted_run_trigger = 8;
+  // Universal compaction only. A run is merged with its newer neighbours when
+  // its size is at most (100 + universal_size_ratio)% of their total size.
+  int universal_size_ratio = 1;
+  // Universal compaction only. Minimum number of runs merged by a size ratio
+  // triggered compaction.
+  int universal_min_merge_width = 2;
+  // Universal compaction only. When the size of all runs but the oldest one
+  // exceeds this percentage of the oldest run, all the runs are merged.
+  int universal_max_size_amplification_percent = 200;
+
+  // Writes are throttled once the estimated number of bytes compaction has to
+  // rewrite to bring every level under its target goes above the soft limit,
+  // and the writers that need a new memtable are stopped above the hard
+  // limit. Level-0 files and unflushed immutable memtables throttle the
+  // writes in the same way (see config::kL0_SlowdownWritesTrigger).
+  // 0 disables the corresponding limit.
+  uint64_t soft_pending_compaction_bytes_limit = 64 * 1024ull * 1024ull * 1024ull;
+  uint64_t hard_pending_compaction_bytes_limit = 256 * 1024ull * 1024ull * 1024ull;
+
+  // Write rate (bytes per second) granted to the writers when they start to
+  // be throttled. The rate is lowered while the compaction debt keeps growing
+  // and raised back, up to this value, once it shrinks.
+  uint64_t delayed_write_rate = 16 * 1024 * 1024;
+
+  // If non-null, notified when the write stall condition changes. The
+  // listener must outlive the DB.
+  EventListener* listener = nullptr;
+
+  // If non-null, the flushes (high priority) and the compactions (low
+  // priority) request the bytes they send over RDMA from this limiter. It may
+  // be shared by several DBs and must outlive them.
+  RateLimiter* rate_limiter = nullptr;
+
+  // If non-null, the compaction threads of the compute node request the
+  // microseconds they run from this limiter, see TimberSaw/rate_limiter.h.
+  RateLimiter* cpu_rate_limiter = nullptr;
+
+  // If non-zero, the rates of rate_limiter and cpu_rate_limiter are lowered
+  // while the average Get() latency is above this target and raised back,
+  // up to their initial rates, once it is well below. The limiters are set
+  // back to their initial rates while the writes are throttled, because the
+  // compaction debt has to be paid first.
+  uint64_t read_latency_target_micros = 0;
+
+  // Pacing of the near data compactions and of the persistence of the tables
+  // on the memory node, which builds its own limiters from these values:
+  // bytes per second shared by the compactions (input bytes, low priority)
+  // and the persistence (high priority), and the number of cores the
+  // compactions may keep busy on average. 0 disables the limit.
+  uint64_t memory_node_rate_limit = 0;
+  double memory_node_compaction_cpu_shares = 0;
+
+  // If non-null, the compactions ask this filter whether to keep, drop or
+  // rewrite the entries they write, see TimberSaw/compaction_filter.h. It
+  // must outlive the DB. The memory node can not run application code, so
+  // the compactions of a DB with a filter are not pushed down.
+  const CompactionFilter* compaction_filter = nullptr;
+
+  // If true, every value starts with an expiry time (see
+  // EncodeExpiringValue()) and the compactions of both node types drop the
+  // expired values.
+  bool expire_values = false;
+
+  // If non-null, DB::Merge() is supported: it writes operands that the
+  // reads and the compactions combine with this operator, see
+  // TimberSaw/merge_operator.h. It must outlive the DB. The memory node can
+  // not run application code, so the compactions of a DB with an operator
+  // of its own are not pushed down.
+  const MergeOperator* merge_operator = nullptr;
+
+  // If merge_operator is null, the built-in operator of this type is used
+  // instead, by the compactions of both node types.
+  MergeOperatorType merge_operator_type = kNoMergeOperator;
+
+  // If non-zero, a file written more than this many seconds ago is compacted
+  // again even if its level is within its target, so that the compaction
+  // filters get to drop expired entries in levels that rarely fill up.
+  // Checked whenever a new version is installed.
+  uint64_t periodic_compaction_seconds = 0;
+
+  // If non-zero, the flushes move the values of at least this many bytes
+  // into value logs in the remote memory and leave a small pointer to them in
+  // the tables, so that the compactions only rewrite the keys. A Get() of
+  // such a value takes one more RDMA read. The values of a value log are
+  // reclaimed once no table points to them. A compaction with a filter
+  // (compaction_filter, or the expiry filter) reads the separated values back
+  // to show them to it.
+  size_t min_blob_size = 0;
+
+  // A value log whose garbage, i.e. bytes no longer pointed to by the
+  // current tables, reaches this fraction of its size is collected: the
+  // tables pointing to it are compacted, and their compactions move its
+  // remaining values into a new log (on the memory node if the compaction
+  // runs there).
+  double blob_gc_garbage_ratio = 0.5;
+
   // Compress blocks using the specified compression algorithm.  This
   // parameter can be changed dynamically.
   //
@@ -186,6 +377,41 @@ struct TimberSaw_EXPORT Options {
   // default : 10
   int bloom_bits = 10;
 
+  // The filter built for the tables. A Ribbon filter gets about the false
+  // positive rate of a Bloom filter of "bloom_bits" bits per key.
+  FilterType filter_type = kBloomFilter;
+
+  // If true, "bloom_bits" is the average bits per key over the tree rather
+  // than the bits of every table: the tables of a level get bits per key
+  // that minimise the expected number of remote reads of a lookup which
+  // misses (Monkey, Dayan et al.), so the small upper levels get more bits
+  // and the last level fewer.
+  bool per_level_filter_bits = false;
+
+  // If non-zero, the first "prefix_length" bytes of the user keys are their
+  // prefix: the filter of a table is also built on the prefixes of its keys,
+  // and an iterator with ReadOptions::prefix_same_as_start skips the tables
+  // whose filter rules out the prefix of the key it is seeked to. Keys
+  // shorter than the prefix have none.
+  //
+  // REQUIRES: the comparator orders keys by their first "prefix_length" bytes
+  // first, the way the default comparator does, and the value does not
+  // change over the life of the DB.
+  size_t prefix_length = 0;
+
+  // If positive, the filter of a table is also a range filter (Rosetta, Luo
+  // et al.): it holds the prefixes of the keys at "range_filter_levels"
+  // granularities, and a Seek() of an iterator with
+  // ReadOptions::iterate_upper_bound skips the tables with no key in
+  // [target, upper bound) without reading their index or data. The levels
+  // are the 8 bytes of the keys after the bytes all the keys of the table
+  // share, cut by 4 bits more each; a scan whose range spans more than
+  // about 16^(levels - 1) of those values is not filtered. Every level adds
+  // up to one entry per key to the filter. At most 16.
+  //
+  // REQUIRES: filter_policy is not null.
+  int range_filter_levels = 0;
+
   std::vector<std::pair<Slice,Slice>>* ShardInfo = nullptr;// [Lower bound, upper bound)
 };
 
@@ -206,6 +432,18 @@ struct TimberSaw_EXPORT ReadOptions {
   // not have been released).  If "snapshot" is null, use an implicit
   // snapshot of the state at the beginning of this read operation.
   const Snapshot* snapshot = nullptr;
+
+  // If non-null, an iterator stops before the first user key that is not
+  // before "*iterate_upper_bound", and its tables are not read past it.
+  // The slice must stay live while the iterator is.
+  const Slice* iterate_upper_bound = nullptr;
+
+  // If true and Options::prefix_length is non-zero, an iterator that is
+  // seeked to a key at least as long as the prefix only returns the keys
+  // with the prefix of that key, and it only reads the tables whose filter
+  // may hold the prefix. Has no effect on SeekToFirst() and SeekToLast().
+  // Prev() is not supported after such a seek.
+  bool prefix_same_as_start = false;
 };
 
 
@@ -0,0 +1,88 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PinnableSlice is the result of DB::Get() that avoids copying the value
+// when it can. A value found in a block of the block cache is returned in
+// place, and the block stays pinned in the cache until the PinnableSlice is
+// reset or destroyed. A value that cannot be pinned (e.g. one found in a
+// memtable) is copied into a buffer owned by the PinnableSlice.
+//
+// Multiple threads can invoke const methods on a PinnableSlice without
+// external synchronization, but if any of the threads may call a non-const
+// method, all threads accessing the same PinnableSlice must use external
+// synchronization.
+
+#ifndef STORAGE_TimberSaw_INCLUDE_PINNABLE_SLICE_H_
+#define STORAGE_TimberSaw_INCLUDE_PINNABLE_SLICE_H_
+
+#include <cassert>
+#include <string>
+
+#include "TimberSaw/export.h"
+#include "TimberSaw/slice.h"
+
+namespace TimberSaw {
+
+class TimberSaw_EXPORT PinnableSlice : public Slice {
+ public:
+  using CleanupFunction = void (*)(void* arg1, void* arg2);
+
+  PinnableSlice() = default;
+  ~PinnableSlice() { Reset(); }
+
+  PinnableSlice(const PinnableSlice&) = delete;
+  PinnableSlice& operator=(const PinnableSlice&) = delete;
+
+  // Refer to "s" without copying it. (*function)(arg1, arg2) is invoked once
+  // the memory of "s" may be released, i.e. on Reset() or destruction.
+  // REQUIRES: nothing is pinned.
+  void PinSlice(const Slice& s, CleanupFunction function, void* arg1,
+                void* arg2) {
+    assert(!pinned_);
+    Slice::operator=(s);
+    cleanup_ = function;
+    cleanup_arg1_ = arg1;
+    cleanup_arg2_ = arg2;
+    pinned_ = true;
+  }
+
+  // Copy "s" into the buffer of this slice.
+  // REQUIRES: nothing is pinned.
+  void PinSelf(const Slice& s) {
+    assert(!pinned_);
+    buf_.assign(s.data(), s.size());
+    Slice::operator=(buf_);
+  }
+
+  // Refer to the buffer returned by GetSelf(), after it has been filled.
+  void PinSelf() {
+    assert(!pinned_);
+    Slice::operator=(buf_);
+  }
+  std::string* GetSelf() { return &buf_; }
+
+  // True if the value refers to memory owned by someone else.
+  bool IsPinned() const { return pinned_; }
+
+  // Release what is pinned and make this slice empty.
+  void Reset() {
+    if (pinned_ && cleanup_ != nullptr) {
+      (*cleanup_)(cleanup_arg1_, cleanup_arg2_);
+    }
+    pinned_ = false;
+    cleanup_ = nullptr;
+    clear();
+  }
+
+ private:
+  std::string buf_;
+  bool pinned_ = false;
+  CleanupFunction cleanup_ = nullptr;
+  void* cleanup_arg1_ = nullptr;
+  void* cleanup_arg2_ = nullptr;
+};
+
+}  // namespace TimberSaw
+
+#endif  // STORAGE_TimberSaw_INCLUDE_PINNABLE_SLICE_H_
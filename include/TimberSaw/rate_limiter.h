@@ -0,0 +1,65 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A RateLimiter paces the background jobs of one or more DBs. The jobs
+// request credits from it before they move data, and block until the credits
+// are granted. Flushes request at high priority and are served before the
+// compactions, so that throttling the compactions never holds back the
+// memtables.
+//
+// The unit of the credits is up to the user of the limiter: Options::
+// rate_limiter is charged with the bytes sent over RDMA, while Options::
+// cpu_rate_limiter is charged with the microseconds the compaction threads
+// spend running, so a limiter of N * 1000000 credits per second lets the
+// compactions use about N cores on average.
+
+#ifndef STORAGE_TimberSaw_INCLUDE_RATE_LIMITER_H_
+#define STORAGE_TimberSaw_INCLUDE_RATE_LIMITER_H_
+
+#include <cstdint>
+
+#include "TimberSaw/export.h"
+
+namespace TimberSaw {
+
+class TimberSaw_EXPORT RateLimiter {
+ public:
+  enum Priority {
+    // Compactions.
+    kLow = 0,
+    // Flushes and persistence of the tables.
+    kHigh = 1,
+    kNumPriorities = 2
+  };
+
+  virtual ~RateLimiter();
+
+  // Block until "credits" can be granted at priority "pri". Requests larger
+  // than what the limiter refills in one period are granted in several
+  // pieces. Thread safe.
+  virtual void Request(int64_t credits, Priority pri) = 0;
+
+  // Change the rate, e.g. to make room for the foreground work. The rate is
+  // clipped to (0, GetMaxCreditsPerSecond()].
+  virtual void SetCreditsPerSecond(int64_t credits_per_second) = 0;
+  virtual int64_t GetCreditsPerSecond() const = 0;
+  // The rate the limiter was created with.
+  virtual int64_t GetMaxCreditsPerSecond() const = 0;
+
+  // Credits granted so far at priority "pri", and the total time the
+  // requests of that priority have been blocked.
+  virtual int64_t GetTotalCreditsThrough(Priority pri) const = 0;
+  virtual int64_t GetTotalWaitMicros(Priority pri) const = 0;
+};
+
+// Return a token bucket rate limiter granting "credits_per_second", refilled
+// every "refill_period_us" microseconds. A caller may burst up to one period
+// worth of credits. The caller owns the result and must delete it after the
+// DBs using it are closed.
+TimberSaw_EXPORT RateLimiter* NewGenericRateLimiter(
+    int64_t credits_per_second, int64_t refill_period_us = 100 * 1000);
+
+}  // namespace TimberSaw
+
+#endif  // STORAGE_TimberSaw_INCLUDE_RATE_LIMITER_H_
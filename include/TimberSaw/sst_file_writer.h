@@ -0,0 +1,74 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// SstFileWriter builds a table outside of the write path of a DB, e.g. in a
+// bulk loader, for DB::IngestExternalFile(). The table is RDMA-written into
+// the remote memory of its memory node block by block as it is built, the
+// same way a flush writes one, so a bulk load moves every byte over the link
+// once and skips the memtables and the compactions. The file the writer
+// leaves on the local file system only describes where the table is.
+//
+// The entries are written with sequence number 0, i.e. older than anything
+// in the DB: a table can only be ingested into a range of keys the DB has no
+// entry in.
+
+#ifndef STORAGE_TimberSaw_INCLUDE_SST_FILE_WRITER_H_
+#define STORAGE_TimberSaw_INCLUDE_SST_FILE_WRITER_H_
+
+#include <cstdint>
+#include <string>
+
+#include "TimberSaw/export.h"
+#include "TimberSaw/options.h"
+#include "TimberSaw/slice.h"
+#include "TimberSaw/status.h"
+
+namespace TimberSaw {
+
+// Summary of a table written by SstFileWriter.
+struct TimberSaw_EXPORT ExternalSstFileInfo {
+  std::string file_path;     // The descriptor of the table.
+  std::string smallest_key;  // User keys.
+  std::string largest_key;
+  uint64_t num_entries = 0;
+  uint64_t file_size = 0;  // Bytes of remote memory taken by the data blocks.
+};
+
+class TimberSaw_EXPORT SstFileWriter {
+ public:
+  // "options" must carry the comparator, the table and the filter settings
+  // of the DB the table is for. The table is written to memory node
+  // "target_node_id", the one of the shard that will ingest it: shard i of
+  // a sharded DB lives on memory node 2 * (i % number of memory nodes).
+  explicit SstFileWriter(const Options& options, uint8_t target_node_id = 0);
+
+  SstFileWriter(const SstFileWriter&) = delete;
+  SstFileWriter& operator=(const SstFileWriter&) = delete;
+
+  // A table that was not finished is abandoned.
+  ~SstFileWriter();
+
+  // Start a table whose descriptor will be written to "file_path".
+  Status Open(const std::string& file_path);
+
+  // Add an entry to the table.
+  // REQUIRES: "key" is after any previously added key according to the
+  // comparator.
+  Status Put(const Slice& key, const Slice& value);
+
+  // Finish the table, write its descriptor and fill *info if not null.
+  // A table without entries is not written.
+  Status Finish(ExternalSstFileInfo* info = nullptr);
+
+  // Bytes of remote memory taken by the table so far.
+  uint64_t FileSize() const;
+
+ private:
+  struct Rep;
+  Rep* rep_;
+};
+
+}  // namespace TimberSaw
+
+#endif  // STORAGE_TimberSaw_INCLUDE_SST_FILE_WRITER_H_
@@ -8,6 +8,7 @@
 #include <cstdint>
 #include <memory>
 
+#include "TimberSaw/cache.h"
 #include "TimberSaw/export.h"
 #include "TimberSaw/iterator.h"
 #include "db/version_edit.h"
@@ -46,10 +47,13 @@ class TimberSaw_EXPORT Table {
     // will never be garbage collected.
     std::weak_ptr<RemoteMemTableMetaData> remote_table;
     uint64_t cache_id;
+    // nullptr if the filter is in the block cache, see
+    // Options::cache_index_and_filter_blocks.
     FullFilterBlockReader* filter;
     //  const char* filter_data;
 
     BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
+    // nullptr if the index block is in the block cache.
     Block* index_block;
 //    Table_Type table_type = byte_addressable;
 //#ifdef BYTEADDRESSABLE
@@ -81,7 +85,21 @@ class TimberSaw_EXPORT Table {
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
   Iterator* NewIterator(const ReadOptions&) const;
-  size_t GetIndexAndMetaSize(){return rep->index_block->size() + rep->filter->filter_content.size();}
+  // The local memory the table holds, at least 1 so that the table cache
+  // still bounds the number of tables when the block cache holds it all.
+  size_t GetIndexAndMetaSize(){
+    size_t size = 1;
+    if (rep->index_block != nullptr) {
+      size += rep->index_block->size();
+    }
+    if (rep->filter != nullptr) {
+      size += rep->filter->filter_content.size();
+    }
+    return size;
+  }
+  // Returns a new iterator over the index block, which pins the block in
+  // the block cache if the table does not hold it.
+  Iterator* NewIndexIterator() const;
 //  Iterator* NewSEQIterator(const ReadOptions&) const;
 //  void GetKV(Iterator* iiter);
 
@@ -114,6 +132,16 @@ class TimberSaw_EXPORT Table {
   void ReadMeta(const Footer& footer);
   void ReadFilter();
 
+  // The filter of the table, nullptr if it has none. If the filter is in
+  // the block cache, *handle is set to the entry to release after use,
+  // else to nullptr.
+  FullFilterBlockReader* GetFilter(Cache::Handle** handle) const;
+  // Whether the index and filter blocks are in the block cache.
+  bool CachesIndexAndFilter() const {
+    return rep->options.cache_index_and_filter_blocks &&
+           rep->options.block_cache != nullptr;
+  }
+
 };
 
 }  // namespace TimberSaw
@@ -50,6 +50,13 @@ class TimberSaw_EXPORT TableBuilder {
   // REQUIRES: Finish(), Abandon() have not been called
   virtual void Add(const Slice& key, const Slice& value)=0;
 
+  // Same as Add(), with the filter hash of the user key of "key"
+  // (BloomHash()) computed by the caller, e.g. on another thread.
+  virtual void AddWithFilterHash(const Slice& key, const Slice& value,
+                                 uint32_t /*filter_hash*/) {
+    Add(key, value);
+  }
+
   // Advanced operation: flush any buffered key/value pairs to remote memory.
   // Can be used to ensure that two adjacent entries never live in
   // the same data block.  Most clients should not need to use this method.
@@ -94,6 +101,12 @@ class TimberSaw_EXPORT TableBuilder {
   virtual void get_dataindexblocks_map(std::map<uint32_t, ibv_mr*>& map)=0;
   virtual void get_filter_map(std::map<uint32_t, ibv_mr*>& map)=0;
   virtual size_t get_numentries()=0;
+  // Bytes memcpy-ed into the write buffers after they had been produced
+  // somewhere else, as opposed to being built in place.
+  virtual uint64_t CopiedBytes() const { return 0; }
+  // The filter of the table takes "bits_per_key" bits per key instead of
+  // Options::bloom_bits. REQUIRES: Finish() and Abandon() not called.
+  virtual void SetFilterBitsPerKey(int /*bits_per_key*/) {}
  protected:
 
 
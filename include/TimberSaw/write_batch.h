@@ -21,6 +21,7 @@
 #ifndef STORAGE_TimberSaw_INCLUDE_WRITE_BATCH_H_
 #define STORAGE_TimberSaw_INCLUDE_WRITE_BATCH_H_
 
+#include <cstdint>
 #include <string>
 
 #include "TimberSaw/export.h"
@@ -28,6 +29,7 @@
 
 namespace TimberSaw {
 
+class ColumnFamilyHandle;
 class Slice;
 
 class TimberSaw_EXPORT WriteBatch {
@@ -37,6 +39,16 @@ class TimberSaw_EXPORT WriteBatch {
     virtual ~Handler();
     virtual void Put(const Slice& key, const Slice& value) = 0;
     virtual void Delete(const Slice& key) = 0;
+    // The default skips the merge operands.
+    virtual void Merge(const Slice& key, const Slice& value);
+    // The updates of a column family other than the default one, whose
+    // updates go to the calls above. The defaults fail the iteration with
+    // InvalidArgument.
+    virtual Status PutCF(uint32_t column_family_id, const Slice& key,
+                         const Slice& value);
+    virtual Status DeleteCF(uint32_t column_family_id, const Slice& key);
+    virtual Status MergeCF(uint32_t column_family_id, const Slice& key,
+                           const Slice& value);
   };
 
   WriteBatch();
@@ -53,6 +65,17 @@ class TimberSaw_EXPORT WriteBatch {
   // If the database contains a mapping for "key", erase it.  Else do nothing.
   void Delete(const Slice& key);
 
+  // Apply "value" to the value of "key" with Options::merge_operator.
+  void Merge(const Slice& key, const Slice& value);
+
+  // Same as above, for the column family "column_family" of the DB (see
+  // TimberSaw/db.h). The updates of all the families are written together.
+  void Put(ColumnFamilyHandle* column_family, const Slice& key,
+           const Slice& value);
+  void Delete(ColumnFamilyHandle* column_family, const Slice& key);
+  void Merge(ColumnFamilyHandle* column_family, const Slice& key,
+             const Slice& value);
+
   Slice ParseFirst();
   // Clear all updates buffered in this batch.
   void Clear();
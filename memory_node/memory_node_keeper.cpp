@@ -3,8 +3,11 @@
 //
 #include "memory_node/memory_node_keeper.h"
 
+#include "db/blob_log.h"
 #include "db/filename.h"
+#include "db/merge_helper.h"
 #include "db/table_cache.h"
+#include <ctime>
 #include <fstream>
 #include <list>
 #include <numa.h>
@@ -383,6 +386,11 @@ void Memory_Node_Keeper::PersistSSTable(std::shared_ptr<RemoteMemTableMetaData>
   assert(f);
   uint32_t offset = 0;
   uint32_t chunk_index = 0;
+  // The persistence goes ahead of the near data compactions in the limiter.
+  if (rate_limiter_ != nullptr) {
+    rate_limiter_->Request(static_cast<int64_t>(sstable_ptr->file_size),
+                           RateLimiter::kHigh);
+  }
   for(auto chunk : sstable_ptr->remote_data_mrs){
     offset +=chunk.second->length;
     barrier_arr[chunk_index] = offset;
@@ -591,6 +599,27 @@ Status Memory_Node_Keeper::DoCompactionWork(CompactionState* compact,
 //  }
 
   Iterator* input = versions_->MakeInputIteratorMemoryServer(compact->compaction);
+  CompactionPacer pacer(rate_limiter_.get(), cpu_rate_limiter_.get());
+  // The values moved out of garbage value logs go to a log of this thread.
+  std::unique_ptr<BlobLogBuilder> blob_builder;
+  if (!compact->compaction->relocate_blob_logs().empty()) {
+    blob_builder.reset(new BlobLogBuilder(
+        rdma_mg, 1, BlobLogId(next_blob_log_number_.fetch_add(1), rdma_mg->node_id),
+        rdma_mg->node_id));
+  }
+  CompactionBlobRunner blobs(1, compact->compaction->relocate_blob_logs(),
+                             blob_builder.get());
+  // There are no snapshots here, and the compute node keeps the compactions
+  // with an application filter to itself.
+  const Options* options = compact->compaction->options();
+  CompactionFilterRunner filters(
+      nullptr, options->expire_values ? expiry_filter_.get() : nullptr,
+      compact->compaction->output_level(), kMaxSequenceNumber, &blobs);
+  // The merge operands of a key are collapsed as the key is rewritten.
+  CompactionMergeRunner merges(merge_operators_[options->merge_operator_type].get(),
+                               user_comparator(),
+                               compact->compaction->output_level(),
+                               kMaxSequenceNumber, &blobs);
 
   // Release mutex while we're actually doing the compaction work
   //  undefine_mutex.Unlock();
@@ -608,6 +637,8 @@ Status Memory_Node_Keeper::DoCompactionWork(CompactionState* compact,
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
   Slice key;
+  // Last key added to the current output.
+  std::string last_output_key;
   assert(input->Valid());
 #ifndef NDEBUG
   printf("first key is %s", input->key().ToString().c_str());
@@ -655,7 +686,38 @@ Status Memory_Node_Keeper::DoCompactionWork(CompactionState* compact,
 #ifndef NDEBUG
     number_of_key++;
 #endif
+    // Collapse the merge operands of the key, input is then past them.
+    const bool merged = !drop && merges.Merge(input, nullptr);
+    if (merged) {
+      if (!merges.status().ok()) {
+        status = merges.status();
+        break;
+      }
+      if (!merges.hides_older()) {
+        // The older entries of the key left are not hidden by the operand.
+        has_current_user_key = false;
+      }
+      key = merges.key();
+    }
+    const Slice value = merged ? merges.value() : input->value();
+    if (!drop && filters.Drop(key, value)) {
+      drop = true;
+    }
     if (!drop) {
+      // The filters may have turned the entry into a deletion marker.
+      key = filters.key();
+      // Cut the output on a grandparent boundary, or once it overlaps too
+      // many grandparent bytes.
+      if (compact->compaction->ShouldStopBefore(
+              key, compact->builder == nullptr ? 0 : compact->builder->FileSize(),
+              user_comparator(), &compact->cut) &&
+          compact->builder != nullptr) {
+        compact->current_output()->largest.DecodeFrom(last_output_key);
+        status = FinishCompactionOutputFile(compact, input);
+        if (!status.ok()) {
+          break;
+        }
+      }
       // Open output file if necessary
       if (compact->builder == nullptr) {
         status = OpenCompactionOutputFile(compact);
@@ -669,7 +731,13 @@ Status Memory_Node_Keeper::DoCompactionWork(CompactionState* compact,
 #ifndef NDEBUG
       Not_drop_counter++;
 #endif
-      compact->builder->Add(key, input->value());
+      if (ikey.type == kTypeDeletion || filters.deleted()) {
+        compact->current_output()->num_deletions++;
+      }
+      compact->builder->Add(
+          key, blobs.Value(key, filters.value(),
+                           &compact->current_output()->blob_refs));
+      last_output_key.assign(key.data(), key.size());
       //      assert(key.data()[0] == '0');
       // Close output file if it is big enough
       if (compact->builder->FileSize() >=
@@ -687,7 +755,10 @@ Status Memory_Node_Keeper::DoCompactionWork(CompactionState* compact,
 //    if(*key.data() != 0){
 //      printf("break here");
 //    }
-    input->Next();
+    pacer.Consumed(key.size() + value.size());
+    if (!merged) {
+      input->Next();
+    }
 //    if(*key.data() != 0){
 //      printf("break here");
 //    }
@@ -715,6 +786,15 @@ printf("For compaction, Total number of key touched is %d, KV left is %d\n", num
   if (status.ok()) {
     status = input->status();
   }
+  if (status.ok()) {
+    status = blobs.status();
+  }
+  if (blob_builder != nullptr) {
+    std::shared_ptr<BlobLogMetaData> log = blob_builder->Finish();
+    if (log != nullptr) {
+      compact->blob_logs.push_back(log);
+    }
+  }
   delete input;
   input = nullptr;
 
@@ -864,6 +944,27 @@ void Memory_Node_Keeper::ProcessKeyValueCompaction(SubcompactionState* sub_compa
 //  }
 
   Iterator* input = versions_->MakeInputIteratorMemoryServer(sub_compact->compaction);
+  CompactionPacer pacer(rate_limiter_.get(), cpu_rate_limiter_.get());
+  // The values moved out of garbage value logs go to a log of this thread.
+  std::unique_ptr<BlobLogBuilder> blob_builder;
+  if (!sub_compact->compaction->relocate_blob_logs().empty()) {
+    blob_builder.reset(new BlobLogBuilder(
+        rdma_mg, 1, BlobLogId(next_blob_log_number_.fetch_add(1), rdma_mg->node_id),
+        rdma_mg->node_id));
+  }
+  CompactionBlobRunner blobs(1, sub_compact->compaction->relocate_blob_logs(),
+                             blob_builder.get());
+  // There are no snapshots here, and the compute node keeps the compactions
+  // with an application filter to itself.
+  const Options* options = sub_compact->compaction->options();
+  CompactionFilterRunner filters(
+      nullptr, options->expire_values ? expiry_filter_.get() : nullptr,
+      sub_compact->compaction->output_level(), kMaxSequenceNumber, &blobs);
+  // The merge operands of a key are collapsed as the key is rewritten.
+  CompactionMergeRunner merges(merge_operators_[options->merge_operator_type].get(),
+                               user_comparator(),
+                               sub_compact->compaction->output_level(),
+                               kMaxSequenceNumber, &blobs);
 
   // Release mutex while we're actually doing the compaction work
   //  undefine_mutex.Unlock();
@@ -894,6 +995,8 @@ void Memory_Node_Keeper::ProcessKeyValueCompaction(SubcompactionState* sub_compa
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
   Slice key;
+  // Last key added to the current output.
+  std::string last_output_key;
   assert(input->Valid());
 #ifndef NDEBUG
   std::string last_internal_key;
@@ -962,7 +1065,38 @@ void Memory_Node_Keeper::ProcessKeyValueCompaction(SubcompactionState* sub_compa
 #ifndef NDEBUG
     number_of_key++;
 #endif
+    // Collapse the merge operands of the key, input is then past them.
+    const bool merged = !drop && merges.Merge(input, end);
+    if (merged) {
+      if (!merges.status().ok()) {
+        status = merges.status();
+        break;
+      }
+      if (!merges.hides_older()) {
+        // The older entries of the key left are not hidden by the operand.
+        has_current_user_key = false;
+      }
+      key = merges.key();
+    }
+    const Slice value = merged ? merges.value() : input->value();
+    if (!drop && filters.Drop(key, value)) {
+      drop = true;
+    }
     if (!drop) {
+      // The filters may have turned the entry into a deletion marker.
+      key = filters.key();
+      // Cut the output on a grandparent boundary, or once it overlaps too
+      // many grandparent bytes.
+      if (sub_compact->compaction->ShouldStopBefore(
+              key, sub_compact->builder == nullptr ? 0 : sub_compact->builder->FileSize(),
+              user_comparator(), &sub_compact->cut) &&
+          sub_compact->builder != nullptr) {
+        sub_compact->current_output()->largest.DecodeFrom(last_output_key);
+        status = FinishCompactionOutputFile(sub_compact, input);
+        if (!status.ok()) {
+          break;
+        }
+      }
       // Open output file if necessary
       if (sub_compact->builder == nullptr) {
         status = OpenCompactionOutputFile(sub_compact);
@@ -977,7 +1111,13 @@ void Memory_Node_Keeper::ProcessKeyValueCompaction(SubcompactionState* sub_compa
 #ifndef NDEBUG
       Not_drop_counter++;
 #endif
-      sub_compact->builder->Add(key, input->value());
+      if (ikey.type == kTypeDeletion || filters.deleted()) {
+        sub_compact->current_output()->num_deletions++;
+      }
+      sub_compact->builder->Add(
+          key, blobs.Value(key, filters.value(),
+                           &sub_compact->current_output()->blob_refs));
+      last_output_key.assign(key.data(), key.size());
       //      assert(key.data()[0] == '0');
       // Close output file if it is big enough
       if (sub_compact->builder->FileSize() >=
@@ -1001,7 +1141,10 @@ void Memory_Node_Keeper::ProcessKeyValueCompaction(SubcompactionState* sub_compa
       break;
     }
     //    assert(key.data()[0] == '0');
-    input->Next();
+    pacer.Consumed(key.size() + value.size());
+    if (!merged) {
+      input->Next();
+    }
     //NOTE(ruihong): When the level iterator is invalid it will be deleted and then the key will
     // be invalid also.
     //    assert(key.data()[0] == '0');
@@ -1025,6 +1168,15 @@ printf("For compaction, Total number of key touched is %d, KV left is %d\n", num
   if (status.ok()) {
     status = input->status();
   }
+  if (status.ok()) {
+    status = blobs.status();
+  }
+  if (blob_builder != nullptr) {
+    std::shared_ptr<BlobLogMetaData> log = blob_builder->Finish();
+    if (log != nullptr) {
+      sub_compact->blob_logs.push_back(log);
+    }
+  }
   delete input;
   //  input = nullptr;
 }
@@ -1051,10 +1203,14 @@ Status Memory_Node_Keeper::OpenCompactionOutputFile(SubcompactionState* compact)
   if (s.ok()) {
     if (compact->compaction->table_type == block_based){
       compact->builder = new TableBuilder_Memoryside(
-          *opts, Compact, rdma_mg);
+          *compact->compaction->options(), Compact, rdma_mg);
     }else{
       compact->builder = new TableBuilder_BAMS(
-          *opts, Compact, rdma_mg);
+          *compact->compaction->options(), Compact, rdma_mg);
+    }
+    if (compact->compaction->options()->per_level_filter_bits) {
+      compact->builder->SetFilterBitsPerKey(
+          versions_->FilterBitsPerKey(compact->compaction->output_level()));
     }
 
   }
@@ -1084,10 +1240,14 @@ Status Memory_Node_Keeper::OpenCompactionOutputFile(CompactionState* compact) {
   if (s.ok()) {
     if (compact->compaction->table_type == block_based){
       compact->builder = new TableBuilder_Memoryside(
-          *opts, Compact, rdma_mg);
+          *compact->compaction->options(), Compact, rdma_mg);
     }else{
       compact->builder = new TableBuilder_BAMS(
-          *opts, Compact, rdma_mg);
+          *compact->compaction->options(), Compact, rdma_mg);
+    }
+    if (compact->compaction->options()->per_level_filter_bits) {
+      compact->builder->SetFilterBitsPerKey(
+          versions_->FilterBitsPerKey(compact->compaction->output_level()));
     }
   }
 //  printf("rep_ is %p", compact->builder->get_filter_map())
@@ -1131,8 +1291,15 @@ Status Memory_Node_Keeper::FinishCompactionOutputFile(SubcompactionState* compac
 #endif
   const uint64_t current_bytes = compact->builder->FileSize();
   compact->current_output()->file_size = current_bytes;
+  compact->current_output()->num_entries = current_entries;
   assert(file_size == current_bytes);
   compact->total_bytes += current_bytes;
+  compact->copied_bytes += compact->builder->CopiedBytes();
+  compaction_bytes_written.fetch_add(current_bytes);
+  compaction_bytes_copied.fetch_add(compact->builder->CopiedBytes());
+  DEBUG_arg("Compaction output memcpy bytes per written byte: %f\n",
+            static_cast<double>(compaction_bytes_copied.load()) /
+                compaction_bytes_written.load());
   delete compact->builder;
   compact->builder = nullptr;
 
@@ -1187,8 +1354,15 @@ Status Memory_Node_Keeper::FinishCompactionOutputFile(CompactionState* compact,
 #endif
   const uint64_t current_bytes = compact->builder->FileSize();
   compact->current_output()->file_size = current_bytes;
+  compact->current_output()->num_entries = current_entries;
   assert(file_size == current_bytes);
   compact->total_bytes += current_bytes;
+  compact->copied_bytes += compact->builder->CopiedBytes();
+  compaction_bytes_written.fetch_add(current_bytes);
+  compaction_bytes_copied.fetch_add(compact->builder->CopiedBytes());
+  DEBUG_arg("Compaction output memcpy bytes per written byte: %f\n",
+            static_cast<double>(compaction_bytes_copied.load()) /
+                compaction_bytes_written.load());
   delete compact->builder;
   compact->builder = nullptr;
 
@@ -1226,7 +1400,7 @@ Status Memory_Node_Keeper::InstallCompactionResults(CompactionState* compact,
 
   // Add compaction outputs
 compact->compaction->AddInputDeletions(compact->compaction->edit());
-  const int level = compact->compaction->level();
+  const int output_level = compact->compaction->output_level();
   if (compact->sub_compact_states.size() == 0){
     for (size_t i = 0; i < compact->outputs.size(); i++) {
       const CompactionOutput& out = compact->outputs[i];
@@ -1235,14 +1409,19 @@ compact->compaction->AddInputDeletions(compact->compaction->edit());
       //TODO make all the metadata written into out
       meta->number = out.number;
       meta->file_size = out.file_size;
-      meta->level = level+1;
+      meta->num_entries = out.num_entries;
+      meta->num_deletions = out.num_deletions;
+      meta->largest_seq = compact->compaction->LargestInputSeq();
+      meta->creation_time = static_cast<uint64_t>(std::time(nullptr));
+      meta->level = output_level;
       meta->smallest = out.smallest;
       assert(!out.largest.Encode().ToString().empty());
       meta->largest = out.largest;
       meta->remote_data_mrs = out.remote_data_mrs;
       meta->remote_dataindex_mrs = out.remote_dataindex_mrs;
       meta->remote_filter_mrs = out.remote_filter_mrs;
-      compact->compaction->edit()->AddFile(level + 1, meta);
+      meta->blob_refs = out.blob_refs;
+      compact->compaction->edit()->AddFile(output_level, meta);
       assert(!meta->UnderCompaction);
 #ifndef NDEBUG
 
@@ -1268,17 +1447,30 @@ compact->compaction->AddInputDeletions(compact->compaction->edit());
         // TODO make all the metadata written into out
         meta->number = out.number;
         meta->file_size = out.file_size;
-        meta->level = level+1;
+        meta->num_entries = out.num_entries;
+        meta->num_deletions = out.num_deletions;
+        meta->largest_seq = compact->compaction->LargestInputSeq();
+        meta->creation_time = static_cast<uint64_t>(std::time(nullptr));
+        meta->level = output_level;
         meta->smallest = out.smallest;
         meta->largest = out.largest;
         meta->remote_data_mrs = out.remote_data_mrs;
         meta->remote_dataindex_mrs = out.remote_dataindex_mrs;
         meta->remote_filter_mrs = out.remote_filter_mrs;
-        compact->compaction->edit()->AddFile(level + 1, meta);
+        meta->blob_refs = out.blob_refs;
+        compact->compaction->edit()->AddFile(output_level, meta);
         assert(!meta->UnderCompaction);
       }
     }
   }
+  for (const auto& log : compact->blob_logs) {
+    compact->compaction->edit()->AddBlobLog(log);
+  }
+  for (const auto& subcompact : compact->sub_compact_states) {
+    for (const auto& log : subcompact.blob_logs) {
+      compact->compaction->edit()->AddBlobLog(log);
+    }
+  }
   assert(compact->compaction->edit()->GetNewFilesNum() > 0 );
 //  lck_p->lock();
   compact->compaction->ReleaseInputs();
@@ -1301,8 +1493,8 @@ Status Memory_Node_Keeper::InstallCompactionResultsToComputePreparation(
 
   // Add compaction outputs
   compact->compaction->AddInputDeletions(compact->compaction->edit());
-  const int level = compact->compaction->level();
-  assert(level>= 0);
+  const int output_level = compact->compaction->output_level();
+  assert(output_level > 0);
   if (compact->sub_compact_states.size() == 0){
     for (size_t i = 0; i < compact->outputs.size(); i++) {
       const CompactionOutput& out = compact->outputs[i];
@@ -1311,15 +1503,20 @@ Status Memory_Node_Keeper::InstallCompactionResultsToComputePreparation(
       //TODO make all the metadata written into out
 //      meta->number = out.number;
       meta->file_size = out.file_size;
-      meta->level = level+1;
+      meta->num_entries = out.num_entries;
+      meta->num_deletions = out.num_deletions;
+      meta->largest_seq = compact->compaction->LargestInputSeq();
+      meta->creation_time = static_cast<uint64_t>(std::time(nullptr));
+      meta->level = output_level;
       meta->smallest = out.smallest;
       assert(!out.largest.Encode().ToString().empty());
       meta->largest = out.largest;
       meta->remote_data_mrs = out.remote_data_mrs;
       meta->remote_dataindex_mrs = out.remote_dataindex_mrs;
       meta->remote_filter_mrs = out.remote_filter_mrs;
+      meta->blob_refs = out.blob_refs;
       meta->table_type = compact->compaction->table_type;
-      compact->compaction->edit()->AddFile(level + 1, meta);
+      compact->compaction->edit()->AddFile(output_level, meta);
       assert(!meta->UnderCompaction);
 
     }
@@ -1333,18 +1530,31 @@ Status Memory_Node_Keeper::InstallCompactionResultsToComputePreparation(
         // TODO make all the metadata written into out
 //        meta->number = out.number;
         meta->file_size = out.file_size;
-        meta->level = level+1;
+        meta->num_entries = out.num_entries;
+        meta->num_deletions = out.num_deletions;
+        meta->largest_seq = compact->compaction->LargestInputSeq();
+        meta->creation_time = static_cast<uint64_t>(std::time(nullptr));
+        meta->level = output_level;
         meta->smallest = out.smallest;
         meta->largest = out.largest;
         meta->remote_data_mrs = out.remote_data_mrs;
         meta->remote_dataindex_mrs = out.remote_dataindex_mrs;
         meta->remote_filter_mrs = out.remote_filter_mrs;
+        meta->blob_refs = out.blob_refs;
         meta->table_type = compact->compaction->table_type;
-        compact->compaction->edit()->AddFile(level + 1, meta);
+        compact->compaction->edit()->AddFile(output_level, meta);
         assert(!meta->UnderCompaction);
       }
     }
   }
+  for (const auto& log : compact->blob_logs) {
+    compact->compaction->edit()->AddBlobLog(log);
+  }
+  for (const auto& subcompact : compact->sub_compact_states) {
+    for (const auto& log : subcompact.blob_logs) {
+      compact->compaction->edit()->AddBlobLog(log);
+    }
+  }
   assert(compact->compaction->edit()->GetNewFilesNum() > 0 );
   Status s = Status::OK();
   //  lck_p->lock();
@@ -2179,7 +2389,10 @@ int Memory_Node_Keeper::server_sock_connect(const char* servername, int port) {
       counter++;
     }
     Status status;
-    Compaction c(opts.get());
+    // The options of the shard stay alive until the compaction is done.
+    const std::shared_ptr<Options> options =
+        ShardOptions(target_node_id, request->content.sstCompact.shard_id);
+    Compaction c(options.get());
     //Note the RDMA read here could read an unfinished RDMA read.
 
     //Decode compaction
@@ -2373,13 +2586,13 @@ int Memory_Node_Keeper::server_sock_connect(const char* servername, int port) {
     rdma_mg->Allocate_Local_RDMA_Slot(edit_recv_mr, Version_edit);
     send_pointer->buffer = edit_recv_mr.addr;
     send_pointer->rkey = edit_recv_mr.rkey;
-    assert(request->content.ive.buffer_size < edit_recv_mr.length);
+    assert(request->content.optSync.buffer_size < edit_recv_mr.length);
     send_pointer->received = true;
     //TODO: how to check whether the version edit message is ready, we need to know the size of the
     // version edit in the first REQUEST from compute node.
 
     // we need buffer_size - 1 to poll the last byte of the buffer.
-    volatile char* polling_byte = (char*)edit_recv_mr.addr + request->content.ive.buffer_size - 1;
+    volatile char* polling_byte = (char*)edit_recv_mr.addr + request->content.optSync.buffer_size - 1;
     memset((void*)polling_byte, 0, 1);
     asm volatile ("sfence\n" : : );
     asm volatile ("lfence\n" : : );
@@ -2395,15 +2608,62 @@ int Memory_Node_Keeper::server_sock_connect(const char* servername, int port) {
       std::fprintf(stderr, "Polling sync option handler\n");
       std::fflush(stderr);
     }
-    *opts = *static_cast<Options*>(edit_recv_mr.addr);
-    opts->ShardInfo = nullptr;
-    opts->env = nullptr;
-    opts->filter_policy = new InternalFilterPolicy(NewBloomFilterPolicy(opts->bloom_bits));
-    opts->comparator = &internal_comparator_;
+    std::shared_ptr<Options> synced =
+        std::make_shared<Options>(*static_cast<Options*>(edit_recv_mr.addr));
+    synced->ShardInfo = nullptr;
+    synced->env = nullptr;
+    synced->listener = nullptr;
+    synced->rate_limiter = nullptr;
+    synced->cpu_rate_limiter = nullptr;
+    synced->compaction_filter = nullptr;
+    synced->merge_operator = nullptr;
+    synced->filter_policy = new InternalFilterPolicy(NewBloomFilterPolicy(synced->bloom_bits));
+    synced->comparator = &internal_comparator_;
+    // The filter and the operators are shared by the shards whose options
+    // ask for them, and built once.
+    if (expiry_filter_ == nullptr && synced->expire_values) {
+      expiry_filter_.reset(NewExpiryCompactionFilter());
+    }
+    if (merge_operators_[synced->merge_operator_type] == nullptr) {
+      merge_operators_[synced->merge_operator_type].reset(
+          NewMergeOperator(synced->merge_operator_type));
+    }
+    const uint8_t shard_id = request->content.optSync.shard_id;
+    if (shard_id != 0) {
+      // Only used by the compactions of that shard, see ShardOptions().
+      std::lock_guard<std::mutex> l(shard_opts_mtx_);
+      shard_opts_[ShardKey(target_node_id, shard_id)] = synced;
+      printf("Option sync finished\n");
+      delete request;
+      return;
+    }
+    *opts = *synced;
+    // The limiters are built once, the compactions may already be using them
+    // when another compute node syncs its options.
+    if (rate_limiter_ == nullptr && opts->memory_node_rate_limit > 0) {
+      rate_limiter_.reset(NewGenericRateLimiter(
+          static_cast<int64_t>(opts->memory_node_rate_limit)));
+    }
+    if (cpu_rate_limiter_ == nullptr &&
+        opts->memory_node_compaction_cpu_shares > 0) {
+      cpu_rate_limiter_.reset(NewGenericRateLimiter(static_cast<int64_t>(
+          opts->memory_node_compaction_cpu_shares * 1000000)));
+    }
     Compactor_pool_.SetBackgroundThreads(opts->max_background_compactions);
     printf("Option sync finished\n");
     delete request;
   }
+  std::shared_ptr<Options> Memory_Node_Keeper::ShardOptions(
+      uint8_t compute_node_id, uint8_t shard_id) {
+    if (shard_id != 0) {
+      std::lock_guard<std::mutex> l(shard_opts_mtx_);
+      auto it = shard_opts_.find(ShardKey(compute_node_id, shard_id));
+      if (it != shard_opts_.end()) {
+        return it->second;
+      }
+    }
+    return opts;
+  }
   void Memory_Node_Keeper::version_unpin_handler(RDMA_Request* request,
                                                  std::string& client_ip) {
     std::unique_lock<std::mutex> lck(versionset_mtx);
@@ -11,6 +11,7 @@
 #include "util/rdma.h"
 #include "util/env_posix.h"
 #include "util/ThreadPool.h"
+#include "util/rate_limiter.h"
 #include "db/log_writer.h"
 #include "db/version_set.h"
 
@@ -173,6 +174,26 @@ class Memory_Node_Keeper {
   VersionEdit_Merger ve_merger;
   std::atomic<bool> check_point_t_ready = true;
   std::mutex merger_mtx;
+  // Output bytes of the near data compactions, and the part of them the
+  // table builders memcpy-ed into their chunks instead of building in place.
+  std::atomic<uint64_t> compaction_bytes_written{0};
+  std::atomic<uint64_t> compaction_bytes_copied{0};
+  // Pace the near data compactions and the persistence of the tables, built
+  // from the options synced by the compute node, null when unlimited.
+  std::unique_ptr<RateLimiter> rate_limiter_;
+  std::unique_ptr<RateLimiter> cpu_rate_limiter_;
+  // Filter of Options::expire_values, run by the near data compactions.
+  std::unique_ptr<const CompactionFilter> expiry_filter_;
+  // Operators of Options::merge_operator_type, indexed by the type, run by
+  // the near data compactions.
+  std::unique_ptr<const MergeOperator> merge_operators_[kStringAppendOperator + 1];
+  // Options synced by the shards other than 0 (e.g. the column families of a
+  // DB), by ShardKey(). Shard 0 syncs opts.
+  std::mutex shard_opts_mtx_;
+  std::map<uint16_t, std::shared_ptr<Options>> shard_opts_;
+  // Numbers the value logs the near data compactions write, see
+  // db/blob_log.h.
+  std::atomic<uint64_t> next_blob_log_number_{1};
 //  std::mutex test_compaction_mutex;
 #ifndef NDEBUG
   std::atomic<size_t> debug_counter = 0;
@@ -208,6 +229,13 @@ class Memory_Node_Keeper {
                         int socket_fd, uint8_t target_node_id);
   void sync_option_handler(RDMA_Request* request, std::string& client_ip,
                            uint8_t target_node_id);
+  static uint16_t ShardKey(uint8_t compute_node_id, uint8_t shard_id) {
+    return static_cast<uint16_t>(compute_node_id) << 8 | shard_id;
+  }
+  // The options synced by the shard "shard_id" of "compute_node_id", opts
+  // if it synced none.
+  std::shared_ptr<Options> ShardOptions(uint8_t compute_node_id,
+                                        uint8_t shard_id);
   void version_unpin_handler(RDMA_Request* request, std::string& client_ip);
   void Edit_sync_to_remote(VersionEdit* edit, std::string& client_ip,
                            std::unique_lock<std::mutex>* version_mtx,
@@ -65,6 +65,19 @@ class CondVar {
 bool Snappy_Compress(const char* input, size_t input_length,
                      std::string* output);
 
+// Maximum size of the snappy compression of "input_length" bytes, 0 if snappy
+// is not supported by this port.
+size_t Snappy_MaxCompressedLength(size_t input_length);
+
+// Store the snappy compression of "input[0,input_length-1]" in output[] and
+// its size in *output_length. Returns false if snappy is not supported by
+// this port.
+//
+// REQUIRES: at least the first Snappy_MaxCompressedLength(input_length) bytes
+// of output[] must be writable.
+bool Snappy_RawCompress(const char* input, size_t input_length, char* output,
+                        size_t* output_length);
+
 // If input[0,input_length-1] looks like a valid snappy compressed
 // buffer, store the size of the uncompressed data in *result and
 // return true.  Else return false.
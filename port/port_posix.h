@@ -227,6 +227,31 @@ inline bool Snappy_Compress(const char* input, size_t length,
   return false;
 }
 
+inline size_t Snappy_MaxCompressedLength(size_t length) {
+#if HAVE_SNAPPY
+  return snappy::MaxCompressedLength(length);
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)length;
+  return 0;
+#endif  // HAVE_SNAPPY
+}
+
+inline bool Snappy_RawCompress(const char* input, size_t length, char* output,
+                               size_t* output_length) {
+#if HAVE_SNAPPY
+  snappy::RawCompress(input, length, output, output_length);
+  return true;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)input;
+  (void)length;
+  (void)output;
+  (void)output_length;
+  return false;
+#endif  // HAVE_SNAPPY
+}
+
 inline bool Snappy_GetUncompressedLength(const char* input, size_t length,
                                          size_t* result) {
 #if HAVE_SNAPPY
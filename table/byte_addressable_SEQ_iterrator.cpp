@@ -5,18 +5,22 @@
 // would be error
 #define PREFETCH_GRANULARITY  (1024*1024)
 #include "byte_addressable_SEQ_iterrator.h"
+
+#include <memory>
+
 #include "TimberSaw/env.h"
 #include "port/likely.h"
 namespace TimberSaw {
 //Note: the memory side KVReader should be passed as block function
 ByteAddressableSEQIterator::ByteAddressableSEQIterator(
     Iterator* index_iter, void* arg, const ReadOptions& options,
-    bool compute_side, uint8_t target_node_id)
+    bool compute_side, uint8_t target_node_id, const IterateBound& bound)
     : compute_side_(compute_side),
 //      mr_addr(nullptr),
 //      kv_function_(kv_function),
       arg_(arg),
       options_(options),
+      bound_(bound),
       status_(Status::OK()),
       index_iter_(index_iter),
       valid_(false),
@@ -40,12 +44,16 @@ ByteAddressableSEQIterator::~ByteAddressableSEQIterator() {
 
 void ByteAddressableSEQIterator::Seek(const Slice& target) {
 //  assert(target.compare(reinterpret_cast<Table*>(arg_)->rep->remote_table.lock()->largest.Encode()) <= 0);
+  bound_.SetSeekTarget(target);
+  SetStopOffset();
   index_iter_.Seek(target);
   GetKVInitial();
 
 }
 
 void ByteAddressableSEQIterator::SeekToFirst() {
+  bound_.ClearSeekTarget();
+  SetStopOffset();
   index_iter_.SeekToFirst();
   GetKVInitial();
 
@@ -67,12 +75,32 @@ void ByteAddressableSEQIterator::Prev() {
   valid_ = false;
   status_ = Status::NotSupported("Prev not supported");
 }
+void ByteAddressableSEQIterator::SetStopOffset() {
+  stop_offset_ = SIZE_MAX;
+  if (!bound_.active()) {
+    return;
+  }
+  // Every entry has an index entry of its own.
+  Table* table = reinterpret_cast<Table*>(arg_);
+  std::unique_ptr<Iterator> iter(table->NewIndexIterator());
+  iter->Seek(bound_.end());
+  if (iter->Valid()) {
+    Slice handle_content = iter->value();
+    BlockHandle handle;
+    handle.DecodeFrom(&handle_content);
+    stop_offset_ = handle.offset();
+  }
+}
 void ByteAddressableSEQIterator::GetKVInitial(){
   if(index_iter_.Valid()){
     Slice handle_content = index_iter_.value();
     BlockHandle handle;
     handle.DecodeFrom(&handle_content);
     iter_offset = handle.offset();
+    if (iter_offset >= stop_offset_) {
+      valid_ = false;
+      return;
+    }
 
     valid_ = Fetch_next_buffer_initial(iter_offset);
 //    DEBUG_arg("Move to the next chunk, iter_ptr now is %p\n", iter_ptr);
@@ -128,6 +156,10 @@ void ByteAddressableSEQIterator::GetKVInitial(){
 
 
 void ByteAddressableSEQIterator::GetNextKV() {
+  if (iter_offset >= stop_offset_) {
+    valid_ = false;
+    return;
+  }
   assert(iter_ptr <= remote_mr_current.length + (char*)prefetched_mr->addr);
   if (iter_ptr == nullptr || iter_ptr == remote_mr_current.length + (char*)prefetched_mr->addr){
 
@@ -194,6 +226,10 @@ bool ByteAddressableSEQIterator::Fetch_next_buffer_initial(size_t offset) {
 //  assert(remote_mr_current.length == 0);
   prefetch_counter = 0;
   if(Find_prefetch_MR(&tablemeta->remote_data_mrs, offset, &remote_mr_current)){
+    if (offset + remote_mr_current.length > stop_offset_) {
+      // Do not prefetch the entries past the bound.
+      remote_mr_current.length = stop_offset_ - offset;
+    }
 //    size_t total_len = remote_mr_current.length;
 //    prefetched_mr->length = remote_mr_current.length;
     ibv_mr remote_mr = remote_mr_current;
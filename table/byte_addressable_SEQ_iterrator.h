@@ -4,6 +4,8 @@
 
 #ifndef TIMBERSAW_BYTE_ADDRESSABLE_SEQ_ITERRATOR_H
 #define TIMBERSAW_BYTE_ADDRESSABLE_SEQ_ITERRATOR_H
+#include <cstdint>
+
 #include "TimberSaw/iterator.h"
 #include "iterator_wrapper.h"
 #include "TimberSaw/options.h"
@@ -12,6 +14,7 @@
 #include "TimberSaw/table.h"
 #include "table/block.h"
 #include "table/format.h"
+#include "table/iterate_bound.h"
 #include "table/iterator_wrapper.h"
 namespace TimberSaw {
 typedef Slice (*KVFunction)(void*, const ReadOptions&, const Slice&);
@@ -23,7 +26,8 @@ class ByteAddressableSEQIterator :public Iterator{
  public:
   ByteAddressableSEQIterator(Iterator* index_iter, void* arg,
                              const ReadOptions& options, bool compute_side,
-                             uint8_t target_node_id);
+                             uint8_t target_node_id,
+                             const IterateBound& bound = IterateBound());
 
   ~ByteAddressableSEQIterator() override;
 
@@ -54,6 +58,8 @@ class ByteAddressableSEQIterator :public Iterator{
   //    void SkipEmptyDataBlocksBackward();
   void GetKVInitial();
   void GetNextKV();
+  // Find the offset of the first entry past the bound.
+  void SetStopOffset();
 
   bool Fetch_next_buffer_initial(size_t offset);
   bool Fetch_next_buffer_middle();
@@ -75,6 +81,10 @@ class ByteAddressableSEQIterator :public Iterator{
   // create the iterator we have to creat a snapshot for all the LSM tree which can pin the table.
   void* arg_;
   const ReadOptions options_;
+  IterateBound bound_;
+  // The entries from this offset on are past the bound, the prefetches stop
+  // there.
+  size_t stop_offset_ = SIZE_MAX;
   Status status_;
   IteratorWrapper index_iter_;
   IterKey key_;
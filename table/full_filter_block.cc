@@ -4,6 +4,8 @@
 
 #include "table/full_filter_block.h"
 
+#include <algorithm>
+#include <cstring>
 #include <utility>
 
 #include "TimberSaw/filter_policy.h"
@@ -13,11 +15,61 @@ namespace TimberSaw {
 
 // See doc/table_format.md for an explanation of the filter block format.
 
+// The byte of the metadata holding the number of probes of a Bloom filter
+// marks a Ribbon filter with this value.
+static const int kRibbonMarker = -2;
+// Seeds tried before a Ribbon filter gives way to a Bloom filter, each one
+// with a bit more room than the last.
+static const uint32_t kMaxRibbonSeeds = 64;
+
+// A filter followed by a range filter ends with this value, in place of the
+// number of probes of a Bloom filter.
+static const int kRangeFilterMarker = -3;
+// The window of a key at range filter level l is its window without the
+// last l * kRangeLevelBits bits.
+static const int kRangeLevelBits = 4;
+static const int kMaxRangeLevels = 64 / kRangeLevelBits;
+// The shared prefix of the keys of a range filter is at most that long.
+static const size_t kMaxRangeSkip = 255;
+// Probes a range query makes before it gives up and assumes a match.
+static const int kMaxRangeProbes = 64;
+
+// The prefixes of close keys differ in a few low bits only, which the probes
+// of a Bloom filter need spread over the whole hash.
+static uint32_t RangeHash(int level, uint64_t prefix) {
+  uint64_t x = prefix ^ (static_cast<uint64_t>(level + 1) << 58);
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return static_cast<uint32_t>(x);
+}
+
+// The 8 bytes of "key" from "offset" on, big endian and padded with zeros,
+// so that the windows of the keys sort like the keys.
+static uint64_t WindowAt(const Slice& key, size_t offset) {
+  uint64_t window = 0;
+  for (size_t i = offset; i < offset + 8; i++) {
+    window <<= 8;
+    if (i < key.size()) {
+      window |= static_cast<unsigned char>(key[i]);
+    }
+  }
+  return window;
+}
+
 FullFilterBlockBuilder::FullFilterBlockBuilder(ibv_mr* mr,
-                                               int bloombits_per_key)
-    : local_mr(mr), bits_per_key_(bloombits_per_key),
+                                               int bloombits_per_key,
+                                               size_t prefix_length,
+                                               FilterType type,
+                                               int range_filter_levels)
+    : result((char*)mr->addr,0), local_mr(mr), bits_per_key_(bloombits_per_key),
       num_probes_(LegacyNoLocalityBloomImpl::ChooseNumProbes(bits_per_key_)),
-      result((char*)mr->addr,0) {
+      type_(type),
+      prefix_length_(prefix_length),
+      range_levels_(std::min(std::max(range_filter_levels, 0),
+                             kMaxRangeLevels)) {
 //  filter_bits_builder_ = std::make_unique<LegacyBloomImpl>();
 
 }
@@ -30,7 +82,9 @@ FullFilterBlockBuilder::FullFilterBlockBuilder(ibv_mr* mr,
 void FullFilterBlockBuilder::RestartBlock(uint64_t block_offset) {
 //  uint64_t filter_index = (block_offset / kFilterBase);
   hash_entries_.clear();
-
+  last_prefix_.clear();
+  range_first_key_.clear();
+  range_windows_.clear();
 }
 //size_t FullFilterBlockBuilder::CurrentSizeEstimate() {
 //  //result plus filter offsets plus array offset plus 1 char for kFilterBaseLg
@@ -42,11 +96,72 @@ void FullFilterBlockBuilder::AddKey(const Slice& key) {
     printf("here\n");
 #endif
 
-  uint32_t hash = BloomHash(key);
+  AddKeyHash(BloomHash(key));
+}
+void FullFilterBlockBuilder::AddKeyHash(uint32_t hash) {
   if (hash_entries_.size() == 0 || hash != hash_entries_.back()) {
     hash_entries_.push_back(hash);
   }
 }
+void FullFilterBlockBuilder::AddPrefix(const Slice& key) {
+  if (prefix_length_ == 0 || key.size() < prefix_length_) {
+    return;
+  }
+  // The keys come in order, so a prefix is added once per run of keys.
+  Slice prefix(key.data(), prefix_length_);
+  if (!last_prefix_.empty() && prefix == Slice(last_prefix_)) {
+    return;
+  }
+  last_prefix_.assign(prefix.data(), prefix.size());
+  hash_entries_.push_back(BloomHash(prefix));
+}
+void FullFilterBlockBuilder::AddRangeKey(const Slice& key) {
+  if (range_levels_ == 0) {
+    return;
+  }
+  if (range_windows_.empty()) {
+    range_first_key_.assign(key.data(), key.size());
+    range_skip_ = std::min(key.size(), kMaxRangeSkip);
+  } else {
+    size_t shared = 0;
+    while (shared < range_skip_ && shared < key.size() &&
+           key[shared] == range_first_key_[shared]) {
+      shared++;
+    }
+    if (shared < range_skip_) {
+      // The keys added so far have the bytes of the first key up to
+      // range_skip_, their windows from "shared" on start with those.
+      const size_t shift = range_skip_ - shared;
+      const uint64_t head =
+          WindowAt(Slice(range_first_key_.data(), range_skip_), shared);
+      for (uint64_t& window : range_windows_) {
+        window = shift >= 8 ? head : head | (window >> (8 * shift));
+      }
+      range_skip_ = shared;
+    }
+  }
+  range_windows_.push_back(WindowAt(key, range_skip_));
+}
+void FullFilterBlockBuilder::AddRangeEntries() {
+  for (int level = 0; level < range_levels_; level++) {
+    const int shift = level * kRangeLevelBits;
+    bool first = true;
+    uint64_t last = 0;
+    for (uint64_t window : range_windows_) {
+      const uint64_t prefix = window >> shift;
+      if (first || prefix != last) {
+        hash_entries_.push_back(RangeHash(level, prefix));
+        last = prefix;
+        first = false;
+      }
+    }
+  }
+}
+void FullFilterBlockBuilder::SetBitsPerKey(int bits_per_key) {
+  assert(bits_per_key > 0);
+  bits_per_key_ = bits_per_key;
+  num_probes_ = LegacyNoLocalityBloomImpl::ChooseNumProbes(bits_per_key_);
+}
 inline void FullFilterBlockBuilder::AddHash(uint32_t h, char* data,
                                             uint32_t num_lines,
                                             uint32_t total_bits) {
@@ -90,17 +205,87 @@ uint32_t FullFilterBlockBuilder::CalculateSpace(const int num_entry,
   sz += 5;  // 4 bytes for num_lines, 1 byte for num_probes
   return sz;
 }
+bool FullFilterBlockBuilder::FinishRibbon(size_t capacity) {
+  char* data = const_cast<char*>(result.data());
+  int result_bits = StandardRibbonImpl::ChooseResultBits(bits_per_key_);
+  for (uint32_t seed = 0; seed < kMaxRibbonSeeds; seed++) {
+    uint32_t num_blocks =
+        StandardRibbonImpl::ChooseNumBlocks(hash_entries_.size(), seed);
+    // The prefixes can take the filter past its buffer, give the entries
+    // fewer result bits then.
+    while (result_bits > 1 &&
+           static_cast<size_t>(num_blocks) * result_bits * 8 + 5 >
+               capacity) {
+      result_bits--;
+    }
+    size_t len = static_cast<size_t>(num_blocks) * result_bits * 8;
+    if (len + 5 > capacity) {
+      return false;
+    }
+    if (StandardRibbonImpl::Build(hash_entries_, result_bits, num_blocks, seed,
+                                  data)) {
+      // The number of blocks follows from the length and the result bits.
+      data[len] = static_cast<char>(kRibbonMarker);
+      data[len + 1] = static_cast<char>(seed);
+      data[len + 2] = static_cast<char>(result_bits);
+      data[len + 3] = 0;
+      data[len + 4] = 0;
+      hash_entries_.clear();
+      last_prefix_.clear();
+      result.Reset(data, len + 5);
+      return true;
+    }
+  }
+  return false;
+}
 void FullFilterBlockBuilder::Finish() {
+  // A range filter adds the prefixes of its keys to the filter. The prefix
+  // its keys share and its metadata follow the metadata of the filter:
+  //   [filter][shared prefix][marker -3][prefix length][levels][0][0]
+  const bool with_range = !range_windows_.empty();
+  size_t capacity = local_mr->length;
+  if (with_range) {
+    AddRangeEntries();
+    capacity -= range_skip_ + 5;
+  }
+  if (type_ != kRibbonFilter || !FinishRibbon(capacity)) {
+    FinishBloom(capacity);
+  }
+  if (with_range) {
+    char* data = const_cast<char*>(result.data());
+    size_t len = result.size();
+    memcpy(data + len, range_first_key_.data(), range_skip_);
+    len += range_skip_;
+    data[len] = static_cast<char>(kRangeFilterMarker);
+    data[len + 1] = static_cast<char>(range_skip_);
+    data[len + 2] = static_cast<char>(range_levels_);
+    data[len + 3] = 0;
+    data[len + 4] = 0;
+    result.Reset(data, len + 5);
+  }
+  range_first_key_.clear();
+  range_windows_.clear();
+}
+void FullFilterBlockBuilder::FinishBloom(size_t capacity) {
   uint32_t total_bits, num_lines;
   size_t num_entries = hash_entries_.size();
-  CalculateSpace(num_entries, &total_bits, &num_lines);
+  if (CalculateSpace(num_entries, &total_bits, &num_lines) >
+      capacity) {
+    // The prefixes can take the filter past its buffer, give the entries
+    // fewer bits then.
+    num_lines = (capacity - 5) / CACHE_LINE_SIZE;
+    if (num_lines % 2 == 0) {
+      num_lines--;
+    }
+    total_bits = num_lines * (CACHE_LINE_SIZE * 8);
+  }
 //  char* data =
 //      ReserveSpace(static_cast<int>(num_entries), &total_bits, &num_lines);
   char* data = static_cast<char*>(const_cast<char*>(result.data()));
   assert(total_bits%8 == 0);
 //  result.Reset(result.data(), total_bits/8);
   assert(data);
-  assert(total_bits/8 + 5 <= local_mr->length);
+  assert(total_bits/8 + 5 <= capacity);
   if (total_bits != 0 && num_lines != 0) {
     for (auto h : hash_entries_) {
 //      int log2_cache_line_bytes = std::log2(CACHE_LINE_SIZE);
@@ -136,6 +321,7 @@ void FullFilterBlockBuilder::Finish() {
 
   const char* const_data = data;
   hash_entries_.clear();
+  last_prefix_.clear();
   result.Reset(data, total_bits / 8 + 5);
 //  return Slice(data, total_bits / 8 + 5);
 }
@@ -205,9 +391,46 @@ FullFilterBlockReader::FullFilterBlockReader(
   //               | four bytes for number of table_cache    |
   //               |   lines                           |
   // len_with_meta +-----------------------------------+
-
+  //
+  // A Ribbon filter has the marker -2, then a byte for its seed, a byte for
+  // its result bits and two zero bytes.
+
+  if (len_with_meta > 5 &&
+      static_cast<int>(contents.data()[len_with_meta - 5]) ==
+          kRangeFilterMarker) {
+    // The metadata of the filter is before the range filter.
+    const size_t skip = static_cast<uint8_t>(contents.data()[len_with_meta - 4]);
+    range_levels_ = static_cast<uint8_t>(contents.data()[len_with_meta - 3]);
+    if (range_levels_ < 1 || range_levels_ > kMaxRangeLevels) {
+      // Only the range filter is lost, the table is read without it.
+      std::cerr << "corrupt range filter" << std::endl;
+      range_levels_ = 0;
+    }
+    if (len_with_meta < skip + 10) {
+      // The key filter cannot be found either, every key may match.
+      std::cerr << "corrupt range filter" << std::endl;
+      range_levels_ = 0;
+      corrupt_ = true;
+      return;
+    }
+    len_with_meta -= static_cast<uint32_t>(skip + 5);
+    range_prefix_ = Slice(contents.data() + len_with_meta, skip);
+  }
   num_probes_ =
       static_cast<int>(contents.data()[len_with_meta - 5]);
+  if (num_probes_ == kRibbonMarker) {
+    ribbon_ = true;
+    seed_ = static_cast<uint8_t>(contents.data()[len_with_meta - 4]);
+    result_bits_ = static_cast<uint8_t>(contents.data()[len_with_meta - 3]);
+    uint32_t len = len_with_meta - 5;
+    if (result_bits_ < 1 || result_bits_ > StandardRibbonImpl::kMaxResultBits ||
+        len % (result_bits_ * 8) != 0 || len == 0) {
+      std::cerr << "corrupt ribbon filter" << std::endl;
+      exit(1);
+    }
+    num_lines_ = len / (result_bits_ * 8);
+    return;
+  }
   // NB: *num_probes > 30 and < 128 probably have not been used, because of
   // BloomFilterPolicy::initialize, unless directly calling
   // LegacyBloomBitsBuilder as an API, but we are leaving those cases in
@@ -268,7 +491,16 @@ FullFilterBlockReader::FullFilterBlockReader(
 //}
 bool FullFilterBlockReader::KeyMayMatch(const Slice& key) {
 //  auto start = std::chrono::high_resolution_clock::now();
-  uint32_t hash = BloomHash(key);
+  return HashMayMatch(BloomHash(key));
+}
+bool FullFilterBlockReader::HashMayMatch(uint32_t hash) {
+  if (corrupt_) {
+    return true;
+  }
+  if (ribbon_) {
+    return StandardRibbonImpl::HashMayMatch(hash, data_, num_lines_,
+                                            result_bits_, seed_);
+  }
   uint32_t byte_offset;
   LegacyBloomImpl::PrepareHashMayMatch(
       hash, num_lines_, data_, /*out*/ &byte_offset, log2_cache_line_size_);
@@ -281,6 +513,76 @@ bool FullFilterBlockReader::KeyMayMatch(const Slice& key) {
 
 
 
+}
+uint64_t FullFilterBlockReader::RangeWindow(const Slice& user_key) const {
+  const size_t skip = range_prefix_.size();
+  const int c = memcmp(user_key.data(), range_prefix_.data(),
+                       std::min(skip, user_key.size()));
+  if (c < 0 || (c == 0 && user_key.size() < skip)) {
+    return 0;
+  }
+  if (c > 0) {
+    return ~uint64_t{0};
+  }
+  return WindowAt(user_key, skip);
+}
+bool FullFilterBlockReader::RangeLevelMayMatch(int level, uint64_t prefix,
+                                               uint64_t lo, uint64_t hi,
+                                               int* probes_left) {
+  if (*probes_left <= 0) {
+    return true;
+  }
+  (*probes_left)--;
+  if (!HashMayMatch(RangeHash(level, prefix))) {
+    return false;
+  }
+  if (level == 0) {
+    return true;
+  }
+  // A prefix may be a false positive, its children in range tell.
+  const int child_shift = (level - 1) * kRangeLevelBits;
+  const uint64_t first = std::max(prefix << kRangeLevelBits, lo >> child_shift);
+  const uint64_t last =
+      std::min((prefix << kRangeLevelBits) | ((1u << kRangeLevelBits) - 1),
+               hi >> child_shift);
+  for (uint64_t child = first; child <= last; child++) {
+    if (RangeLevelMayMatch(level - 1, child, lo, hi, probes_left)) {
+      return true;
+    }
+    if (child == last) {
+      break;
+    }
+  }
+  return false;
+}
+bool FullFilterBlockReader::RangeMayMatch(const Slice& start,
+                                          const Slice& limit) {
+  if (!HasRangeFilter()) {
+    return true;
+  }
+  // The keys in ["start", "limit") have windows in [lo, hi].
+  const uint64_t lo = RangeWindow(start);
+  const uint64_t hi = RangeWindow(limit);
+  if (lo > hi) {
+    return false;
+  }
+  const int top = range_levels_ - 1;
+  const int shift = top * kRangeLevelBits;
+  const uint64_t first = lo >> shift;
+  const uint64_t last = hi >> shift;
+  if (last - first >= static_cast<uint64_t>(kMaxRangeProbes)) {
+    // Too wide for the filter.
+    return true;
+  }
+  int probes_left = kMaxRangeProbes;
+  for (uint64_t prefix = first;; prefix++) {
+    if (RangeLevelMayMatch(top, prefix, lo, hi, &probes_left)) {
+      return true;
+    }
+    if (prefix == last) {
+      return false;
+    }
+  }
 }
 FullFilterBlockReader::~FullFilterBlockReader() {
   if (filter_side == Compute){
@@ -14,6 +14,7 @@
 #include "TimberSaw/slice.h"
 #include "util/bloom_impl.h"
 #include "util/hash.h"
+#include "util/ribbon_impl.h"
 
 #include "block_builder.h"
 
@@ -32,13 +33,31 @@ enum FilterSide { Compute, Memory};
 //      (StartBlock AddKey*)* Finish
 class FullFilterBlockBuilder {
  public:
-  explicit FullFilterBlockBuilder(ibv_mr* mr, int bloombits_per_key);
+  // If "prefix_length" is non-zero, AddPrefix() adds the prefixes of the keys
+  // too, see Options::prefix_length. "type" picks the filter built, see
+  // Options::filter_type. If "range_filter_levels" is non-zero,
+  // AddRangeKey() adds the keys to a range filter, see
+  // Options::range_filter_levels.
+  FullFilterBlockBuilder(ibv_mr* mr, int bloombits_per_key,
+                         size_t prefix_length = 0,
+                         FilterType type = kBloomFilter,
+                         int range_filter_levels = 0);
   FullFilterBlockBuilder(const FullFilterBlockBuilder&) = delete;
   FullFilterBlockBuilder& operator=(const FullFilterBlockBuilder&) = delete;
 
   void RestartBlock(uint64_t block_offset);
 //  size_t CurrentSizeEstimate();
   void AddKey(const Slice& key);
+  // AddKey() of a key whose BloomHash() is "hash".
+  void AddKeyHash(uint32_t hash);
+  // Add the prefix of the user key "key", unless it is the prefix of the
+  // previous key or the key is shorter than the prefix.
+  void AddPrefix(const Slice& key);
+  // Add the user key "key", in key order, to the range filter.
+  void AddRangeKey(const Slice& key);
+  // Filters built from now on take "bits_per_key" bits per key, see
+  // Options::per_level_filter_bits.
+  void SetBitsPerKey(int bits_per_key);
 //  void AddHash(uint32_t h, char* data, uint32_t num_lines, uint32_t total_bits);
   void Finish();
   void Reset();
@@ -50,6 +69,13 @@ class FullFilterBlockBuilder {
                           uint32_t* num_lines);
   Slice result;           // Filter data computed so far
  private:
+  // Build a filter of the entries in the first "capacity" bytes of the
+  // buffer. FinishRibbon() returns false if the filter does not fit.
+  void FinishBloom(size_t capacity);
+  bool FinishRibbon(size_t capacity);
+  // Adds the prefixes of the range keys to hash_entries_.
+  void AddRangeEntries();
+
 //  void GenerateFilter();
 
 //  const FilterPolicy* policy_;
@@ -59,7 +85,17 @@ class FullFilterBlockBuilder {
 //  std::unique_ptr<LegacyBloomImpl> filter_bits_builder_;
   int bits_per_key_;
   int num_probes_;
+  const FilterType type_;
   std::vector<uint32_t> hash_entries_;
+  const size_t prefix_length_;
+  std::string last_prefix_;
+  // The range filter: the keys added so far share their first range_skip_
+  // bytes with range_first_key_, and range_windows_ holds the next 8 bytes
+  // of each of them.
+  const int range_levels_;
+  std::string range_first_key_;
+  size_t range_skip_ = 0;
+  std::vector<uint64_t> range_windows_;
 //  std::string keys_;             // Flattened key contents
 //  std::vector<size_t> start_;    // Starting index in keys_ of each key
   //todo Make result Slice; make Policy->CreateFilter accept Slice rather than string
@@ -77,7 +113,24 @@ class FullFilterBlockReader {
                         std::shared_ptr<RDMA_Manager> rdma_mg, FilterSide side);
   ~FullFilterBlockReader();
   bool KeyMayMatch(const Slice& key); // full filter.
+  // "prefix" is a prefix of Options::prefix_length bytes.
+  bool PrefixMayMatch(const Slice& prefix) { return KeyMayMatch(prefix); }
+  // The filter has a range filter, see Options::range_filter_levels.
+  bool HasRangeFilter() const { return range_levels_ > 0; }
+  // False if no user key of the filter is in ["start", "limit"). Always
+  // true without a range filter, e.g. when its trailer is corrupt.
+  bool RangeMayMatch(const Slice& start, const Slice& limit);
  private:
+  bool HashMayMatch(uint32_t hash);
+  // The 8 bytes of "user_key" after the prefix the keys of the range filter
+  // share, 0 or ~0 for a key before or after all of those.
+  uint64_t RangeWindow(const Slice& user_key) const;
+  // True if the filter may hold a key whose window at level "level" is
+  // "prefix", and one of them is in [lo, hi]. Gives up with true after
+  // *probes_left probes.
+  bool RangeLevelMayMatch(int level, uint64_t prefix, uint64_t lo, uint64_t hi,
+                          int* probes_left);
+
 //  const FilterPolicy* policy_;
 //  std::unique_ptr<FilterBitsReader> filter_bits_reader_;
 
@@ -85,6 +138,16 @@ class FullFilterBlockReader {
   int num_probes_ = 0;
   uint32_t num_lines_ = 0;
   uint32_t log2_cache_line_size_ = 0;
+  // Set for a Ribbon filter, num_lines_ is then its number of blocks.
+  bool ribbon_ = false;
+  int result_bits_ = 0;
+  uint32_t seed_ = 0;
+  // The range filter, if range_levels_ is non-zero.
+  int range_levels_ = 0;
+  // Set if the metadata of the filter could not be found, every key may
+  // match then.
+  bool corrupt_ = false;
+  Slice range_prefix_;
 
 //  const char* data_;    // Pointer to filter data (at block-start)
   size_t filter_size;
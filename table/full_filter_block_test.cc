@@ -0,0 +1,235 @@
+// Copyright (c) 2012 The TimberSaw Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/full_filter_block.h"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace TimberSaw {
+
+static std::string Key(int i) {
+  char buf[16];
+  std::snprintf(buf, sizeof(buf), "key%06d", i);
+  return buf;
+}
+
+// The builders write into the registered buffer of a table, a plain buffer
+// stands in for it here. The readers are built on the memory side, which
+// leaves the buffer to the test.
+class FullFilterBlockTest : public testing::Test {
+ public:
+  FullFilterBlockTest() : buffer_(1 << 20, '\0') {
+    std::memset(&mr_, 0, sizeof(mr_));
+    mr_.addr = &buffer_[0];
+    mr_.length = buffer_.size();
+  }
+
+  // Shrink the buffer the filter has to fit in.
+  void SetCapacity(size_t capacity) { mr_.length = capacity; }
+
+  std::unique_ptr<FullFilterBlockReader> NewReader(const Slice& contents) {
+    return std::unique_ptr<FullFilterBlockReader>(
+        new FullFilterBlockReader(contents, nullptr, Memory));
+  }
+
+  // The share of the keys never added that "reader" may match.
+  static double FalsePositiveRate(FullFilterBlockReader* reader, int first,
+                                  int n) {
+    int matches = 0;
+    for (int i = first; i < first + n; i++) {
+      if (reader->KeyMayMatch(Key(i))) {
+        matches++;
+      }
+    }
+    return static_cast<double>(matches) / n;
+  }
+
+  std::string buffer_;
+  ibv_mr mr_;
+};
+
+TEST_F(FullFilterBlockTest, Bloom) {
+  FullFilterBlockBuilder builder(&mr_, 10);
+  builder.RestartBlock(0);
+  for (int i = 0; i < 10000; i++) {
+    builder.AddKey(Key(i));
+  }
+  builder.Finish();
+
+  auto reader = NewReader(builder.result);
+  for (int i = 0; i < 10000; i++) {
+    ASSERT_TRUE(reader->KeyMayMatch(Key(i))) << i;
+  }
+  ASSERT_LT(FalsePositiveRate(reader.get(), 1000000, 10000), 0.03);
+}
+
+TEST_F(FullFilterBlockTest, Ribbon) {
+  FullFilterBlockBuilder builder(&mr_, 10, 0, kRibbonFilter);
+  builder.RestartBlock(0);
+  for (int i = 0; i < 10000; i++) {
+    builder.AddKey(Key(i));
+  }
+  builder.Finish();
+
+  auto reader = NewReader(builder.result);
+  for (int i = 0; i < 10000; i++) {
+    ASSERT_TRUE(reader->KeyMayMatch(Key(i))) << i;
+  }
+  ASSERT_LT(FalsePositiveRate(reader.get(), 1000000, 10000), 0.03);
+}
+
+TEST_F(FullFilterBlockTest, RibbonSmallerThanBloom) {
+  size_t sizes[2];
+  const FilterType types[2] = {kBloomFilter, kRibbonFilter};
+  for (int t = 0; t < 2; t++) {
+    FullFilterBlockBuilder builder(&mr_, 10, 0, types[t]);
+    builder.RestartBlock(0);
+    for (int i = 0; i < 10000; i++) {
+      builder.AddKey(Key(i));
+    }
+    builder.Finish();
+    sizes[t] = builder.result.size();
+  }
+  // About 7 result bits per key for 10 bits of the Bloom filter.
+  ASSERT_LT(sizes[1], sizes[0] * 4 / 5);
+}
+
+TEST_F(FullFilterBlockTest, RibbonOutgrowsBuffer) {
+  // The filter wants about 9KB, it gets fewer result bits to fit.
+  SetCapacity(4096);
+  FullFilterBlockBuilder builder(&mr_, 10, 0, kRibbonFilter);
+  builder.RestartBlock(0);
+  for (int i = 0; i < 10000; i++) {
+    builder.AddKey(Key(i));
+  }
+  builder.Finish();
+  ASSERT_LE(builder.result.size(), 4096);
+
+  auto reader = NewReader(builder.result);
+  for (int i = 0; i < 10000; i++) {
+    ASSERT_TRUE(reader->KeyMayMatch(Key(i))) << i;
+  }
+}
+
+TEST_F(FullFilterBlockTest, SetBitsPerKey) {
+  // The per-level filter bits are set before the filter is finished.
+  double rates[2];
+  size_t sizes[2];
+  const int bits[2] = {4, 16};
+  for (int b = 0; b < 2; b++) {
+    FullFilterBlockBuilder builder(&mr_, 10, 0, kRibbonFilter);
+    builder.SetBitsPerKey(bits[b]);
+    builder.RestartBlock(0);
+    for (int i = 0; i < 10000; i++) {
+      builder.AddKey(Key(i));
+    }
+    builder.Finish();
+    sizes[b] = builder.result.size();
+    auto reader = NewReader(builder.result);
+    for (int i = 0; i < 10000; i++) {
+      ASSERT_TRUE(reader->KeyMayMatch(Key(i))) << i;
+    }
+    rates[b] = FalsePositiveRate(reader.get(), 1000000, 10000);
+  }
+  ASSERT_LT(sizes[0], sizes[1]);
+  ASSERT_LT(rates[1], rates[0]);
+}
+
+// A filter of the even keys below 2 * n, which also go to its range filter
+// if it has one.
+static void AddEvenKeys(FullFilterBlockBuilder* builder, int n) {
+  builder->RestartBlock(0);
+  for (int i = 0; i < 2 * n; i += 2) {
+    builder->AddKey(Key(i));
+    builder->AddRangeKey(Key(i));
+  }
+  builder->Finish();
+}
+
+TEST_F(FullFilterBlockTest, NoRangeFilter) {
+  FullFilterBlockBuilder builder(&mr_, 10);
+  AddEvenKeys(&builder, 1000);
+  auto reader = NewReader(builder.result);
+  ASSERT_FALSE(reader->HasRangeFilter());
+  ASSERT_TRUE(reader->RangeMayMatch("a", "b"));
+}
+
+TEST_F(FullFilterBlockTest, RangeFilter) {
+  const FilterType types[2] = {kBloomFilter, kRibbonFilter};
+  for (FilterType type : types) {
+    FullFilterBlockBuilder builder(&mr_, 10, 0, type, 8);
+    AddEvenKeys(&builder, 1000);
+    auto reader = NewReader(builder.result);
+    ASSERT_TRUE(reader->HasRangeFilter());
+
+    int false_positives = 0;
+    for (int i = 0; i < 2000; i++) {
+      // The keys themselves are still in the filter.
+      if (i % 2 == 0) {
+        ASSERT_TRUE(reader->KeyMayMatch(Key(i))) << i;
+      }
+      // No key starts with an odd key.
+      const bool match = reader->RangeMayMatch(Key(i), Key(i) + "\xff");
+      if (i % 2 == 0) {
+        ASSERT_TRUE(match) << i;
+      } else if (match) {
+        false_positives++;
+      }
+      // The range of the next ten keys always holds an even one.
+      ASSERT_TRUE(reader->RangeMayMatch(Key(i), Key(i + 10))) << i;
+    }
+    ASSERT_LT(false_positives, 100);
+
+    // Before and after all the keys.
+    ASSERT_FALSE(reader->RangeMayMatch("a", "b"));
+    ASSERT_FALSE(reader->RangeMayMatch("key1", "key2"));
+    // Reversed.
+    ASSERT_FALSE(reader->RangeMayMatch(Key(10), Key(0)));
+    // Too wide to be probed.
+    ASSERT_TRUE(reader->RangeMayMatch("a", "z"));
+  }
+}
+
+TEST_F(FullFilterBlockTest, CorruptRangeFilterLevels) {
+  FullFilterBlockBuilder builder(&mr_, 10, 0, kBloomFilter, 8);
+  AddEvenKeys(&builder, 1000);
+  // The byte after the length of the shared prefix holds the levels.
+  std::string contents = builder.result.ToString();
+  contents[contents.size() - 3] = 0;
+
+  // The range filter is dropped, the key filter still works.
+  auto reader = NewReader(contents);
+  ASSERT_FALSE(reader->HasRangeFilter());
+  ASSERT_TRUE(reader->RangeMayMatch("a", "b"));
+  for (int i = 0; i < 2000; i += 2) {
+    ASSERT_TRUE(reader->KeyMayMatch(Key(i))) << i;
+  }
+  ASSERT_LT(FalsePositiveRate(reader.get(), 1000000, 10000), 0.03);
+}
+
+TEST_F(FullFilterBlockTest, CorruptRangeFilterPrefix) {
+  FullFilterBlockBuilder builder(&mr_, 10, 0, kBloomFilter, 8);
+  AddEvenKeys(&builder, 3);
+  // A shared prefix longer than the filter.
+  std::string contents = builder.result.ToString();
+  contents[contents.size() - 4] = static_cast<char>(255);
+
+  // Without the key filter every key may match.
+  auto reader = NewReader(contents);
+  ASSERT_FALSE(reader->HasRangeFilter());
+  ASSERT_TRUE(reader->RangeMayMatch("a", "b"));
+  ASSERT_EQ(1.0, FalsePositiveRate(reader.get(), 1000000, 100));
+}
+
+}  // namespace TimberSaw
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,56 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/iterate_bound.h"
+
+#include "db/dbformat.h"
+
+namespace TimberSaw {
+
+// The smallest internal key of "user_key".
+static void AppendSeekKey(std::string* result, const Slice& user_key) {
+  AppendInternalKey(result, ParsedInternalKey(user_key, kMaxSequenceNumber,
+                                              kValueTypeForSeek));
+}
+
+IterateBound::IterateBound(const ReadOptions& options,
+                           const Comparator* internal_comparator,
+                           size_t prefix_length)
+    : icmp_(internal_comparator),
+      prefix_length_(prefix_length),
+      prefix_same_as_start_(options.prefix_same_as_start &&
+                            prefix_length > 0) {
+  if (options.iterate_upper_bound != nullptr) {
+    AppendSeekKey(&upper_bound_, *options.iterate_upper_bound);
+  }
+  end_ = upper_bound_;
+}
+
+void IterateBound::SetSeekTarget(const Slice& target) {
+  end_ = upper_bound_;
+  prefix_.clear();
+  Slice user_key = ExtractUserKey(target);
+  if (!prefix_same_as_start_ || user_key.size() < prefix_length_) {
+    return;
+  }
+  prefix_.assign(user_key.data(), prefix_length_);
+  // The keys with the prefix are before the shortest key after all of them,
+  // which a prefix of 0xff bytes only does not have.
+  std::string successor = prefix_;
+  while (!successor.empty() &&
+         static_cast<unsigned char>(successor.back()) == 0xff) {
+    successor.pop_back();
+  }
+  if (successor.empty()) {
+    return;
+  }
+  successor.back() = static_cast<char>(successor.back() + 1);
+  std::string prefix_end;
+  AppendSeekKey(&prefix_end, successor);
+  if (end_.empty() || icmp_->Compare(prefix_end, end_) < 0) {
+    end_.swap(prefix_end);
+  }
+}
+
+}  // namespace TimberSaw
@@ -0,0 +1,74 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// IterateBound is the end of the keys the iterator of a read with
+// ReadOptions::iterate_upper_bound or ReadOptions::prefix_same_as_start can
+// return. The iterators over the tables check it before moving to the next
+// block or the next table, so that a short scan does not read remote memory
+// past the keys it returns.
+
+#ifndef STORAGE_TimberSaw_TABLE_ITERATE_BOUND_H_
+#define STORAGE_TimberSaw_TABLE_ITERATE_BOUND_H_
+
+#include <string>
+
+#include "TimberSaw/comparator.h"
+#include "TimberSaw/options.h"
+#include "TimberSaw/slice.h"
+
+namespace TimberSaw {
+
+class IterateBound {
+ public:
+  // No bound.
+  IterateBound() = default;
+
+  // "internal_comparator" compares the internal keys of the iterator and
+  // "prefix_length" is Options::prefix_length.
+  IterateBound(const ReadOptions& options,
+               const Comparator* internal_comparator, size_t prefix_length);
+
+  // Called by Seek(): with prefix_same_as_start, the keys end with the
+  // prefix of "target", an internal key.
+  void SetSeekTarget(const Slice& target);
+
+  // Called by SeekToFirst() and SeekToLast().
+  void ClearSeekTarget() {
+    end_ = upper_bound_;
+    prefix_.clear();
+  }
+
+  bool active() const { return !end_.empty(); }
+
+  // The internal key every key in range is before.
+  // REQUIRES: active()
+  Slice end() const { return end_; }
+
+  // True if no key after "key", an internal key, is in range. The keys of
+  // the next block or table of an index are after the key of its entry.
+  bool Exhausted(const Slice& key) const {
+    return !end_.empty() && icmp_->Compare(key, end_) >= 0;
+  }
+
+  // True if "key", an internal key, is in range.
+  bool InRange(const Slice& key) const {
+    return end_.empty() || icmp_->Compare(key, end_) < 0;
+  }
+
+  // The prefix of the last target, empty outside of a prefix seek.
+  Slice prefix() const { return prefix_; }
+
+ private:
+  const Comparator* icmp_ = nullptr;
+  size_t prefix_length_ = 0;
+  bool prefix_same_as_start_ = false;
+  // Internal keys before which every key in range is, empty for none.
+  std::string upper_bound_;
+  std::string end_;
+  std::string prefix_;
+};
+
+}  // namespace TimberSaw
+
+#endif  // STORAGE_TimberSaw_TABLE_ITERATE_BOUND_H_
@@ -23,6 +23,15 @@ Iterator::~Iterator() {
   }
 }
 
+void Iterator::SeekForPrev(const Slice& target) {
+  Seek(target);
+  if (Valid()) {
+    Prev();
+  } else {
+    SeekToLast();
+  }
+}
+
 void Iterator::RegisterCleanup(CleanupFunction func, void* arg1, void* arg2) {
   assert(func != nullptr);
   CleanupNode* node;
@@ -73,6 +73,11 @@ class IteratorWrapper {
     Update();
 //    assert(valid_);
   }
+  void SeekForPrev(const Slice& k) {
+    assert(iter_);
+    iter_->SeekForPrev(k);
+    Update();
+  }
   void SeekToFirst() {
     assert(iter_);
     iter_->SeekToFirst();
@@ -65,6 +65,14 @@ class MergingIterator : public Iterator {
 #endif
   }
 
+  void SeekForPrev(const Slice& target) override {
+    for (int i = 0; i < n_; i++) {
+      children_[i].SeekForPrev(target);
+    }
+    FindLargest();
+    direction_ = kReverse;
+  }
+
   void Next() override {
     assert(Valid());
 
@@ -116,14 +124,9 @@ class MergingIterator : public Iterator {
       for (int i = 0; i < n_; i++) {
         IteratorWrapper* child = &children_[i];
         if (child != current_) {
-          child->Seek(key());
-          if (child->Valid()) {
-            // Child is at first entry >= key().  Step back one to be < key()
-            child->Prev();
-          } else {
-            // Child has no entries >= key().  Position at last entry.
-            child->SeekToLast();
-          }
+          // Not a Seek() and a Prev(): the range filter of a table may
+          // skip a seek, but not this one.
+          child->SeekForPrev(key());
         }
       }
       direction_ = kReverse;
@@ -13,8 +13,10 @@
 #include "TimberSaw/options.h"
 
 
+#include "port/port.h"
 #include "table/filter_block.h"
 #include "table/format.h"
+#include "table/iterate_bound.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 
@@ -25,47 +27,107 @@
 namespace TimberSaw {
 
 //thread_local ibv_mr*  Table::Rep::mr_addr = nullptr;
-//TODO: Make it compatible with multi-node setup.
-Status Table::Open(const Options& options, Table** table,
-                   const std::shared_ptr<RemoteMemTableMetaData>& Remote_table_meta) {
-  *table = nullptr;
 
+// The block cache offsets of the index and the filter block of a table, past
+// the offsets of its data blocks.
+static const uint64_t kIndexBlockCacheOffset = ~uint64_t{0};
+static const uint64_t kFilterBlockCacheOffset = ~uint64_t{0} - 1;
 
-  // Read the index block
-  Status s = Status::OK();
+static void EncodeBlockCacheKey(char* buf, uint64_t cache_id,
+                                uint64_t offset) {
+  EncodeFixed64(buf, cache_id);
+  EncodeFixed64(buf + 8, offset);
+}
+
+// Read the index block of the table from the remote memory.
+static Status ReadIndexBlock(
+    const Options& options,
+    const std::shared_ptr<RemoteMemTableMetaData>& Remote_table_meta,
+    Block** index_block) {
   BlockContents index_block_contents;
   ReadOptions opt;
   if (options.paranoid_checks) {
     opt.verify_checksums = true;
   }
   ibv_mr* remote_mr = Remote_table_meta->remote_dataindex_mrs.begin()->second;
-  s = ReadDataIndexBlock(
+  Status s = ReadDataIndexBlock(
       remote_mr, opt,
       &index_block_contents, Remote_table_meta->shard_target_node_id);
-
   if (s.ok()) {
-    // We've successfully read the footer and the index block: we're
-    // ready to serve requests.
-    Block* index_block;
     if (remote_mr->length < INDEX_BLOCK_SMALL){
-      index_block = new Block(index_block_contents, IndexBlock_Small);
-
+      *index_block = new Block(index_block_contents, IndexBlock_Small);
     } else{
-      index_block = new Block(index_block_contents, IndexBlock);
-
+      *index_block = new Block(index_block_contents, IndexBlock);
     }
+  }
+  return s;
+}
+
+// Read the filter of the table from the remote memory, nullptr on failure.
+static FullFilterBlockReader* ReadFilterReader(
+    const Options& options,
+    const std::shared_ptr<RemoteMemTableMetaData>& table_meta_data) {
+  // We might want to unify with ReadDataBlock() if we start
+  // requiring checksum verification in Table::Open.
+  ReadOptions opt;
+  if (options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents block;
+  if (!ReadFilterBlock(
+           table_meta_data->remote_filter_mrs.begin()->second, opt,
+           &block, table_meta_data->shard_target_node_id)
+           .ok()) {
+    return nullptr;
+  }
+  return new FullFilterBlockReader(block.data, table_meta_data->rdma_mg,
+                                   Compute);
+}
+
+static void DeleteCachedBlock(const Slice& key, void* value) {
+  Block* block = reinterpret_cast<Block*>(value);
+  delete block;
+}
+
+static void DeleteCachedFilter(const Slice& /*key*/, void* value) {
+  delete reinterpret_cast<FullFilterBlockReader*>(value);
+}
+
+//TODO: Make it compatible with multi-node setup.
+Status Table::Open(const Options& options, Table** table,
+                   const std::shared_ptr<RemoteMemTableMetaData>& Remote_table_meta) {
+  *table = nullptr;
+
+
+  // Read the index block
+  Block* index_block = nullptr;
+  Status s = ReadIndexBlock(options, Remote_table_meta, &index_block);
+
+  if (s.ok()) {
+    // We've successfully read the footer and the index block: we're
+    // ready to serve requests.
     Rep* rep = new Table::Rep(options);
 //    rep->options = options;
 //    rep->file = file;
     rep->remote_table = Remote_table_meta;
 //    rep->metaindex_handle = footer.metaindex_handle();
+    assert(index_block->size() > 0);
     rep->index_block = index_block;
-    assert(rep->index_block->size() > 0);
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
 //    rep->filter_data = nullptr;
     rep->filter = nullptr;
 
     *table = new Table(rep);
+    if ((*table)->CachesIndexAndFilter()) {
+      char cache_key_buffer[16];
+      EncodeBlockCacheKey(cache_key_buffer, rep->cache_id,
+                          kIndexBlockCacheOffset);
+      Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+      options.block_cache->Release(options.block_cache->Insert(
+          key, index_block, index_block->size(), &DeleteCachedBlock,
+          Cache::Priority::kHigh));
+      rep->index_block = nullptr;
+    }
     (*table)->ReadFilter();
 //    (*table)->ReadMeta(footer);
   }else{
@@ -79,29 +141,39 @@ void Table::ReadFilter() {
   if (rep->options.filter_policy == nullptr) {
     return;  // Do not need any metadata
   }
-  // We might want to unify with ReadDataBlock() if we start
-  // requiring checksum verification in Table::Open.
-  ReadOptions opt;
-  if (rep->options.paranoid_checks) {
-    opt.verify_checksums = true;
-  }
-  BlockContents block;
-  auto table_meta_data = rep->remote_table.lock();
-  if (!ReadFilterBlock(
-           table_meta_data->remote_filter_mrs.begin()->second, opt,
-           &block, table_meta_data->shard_target_node_id)
-           .ok()) {
+  FullFilterBlockReader* filter =
+      ReadFilterReader(rep->options, rep->remote_table.lock());
+  if (filter == nullptr) {
     return;
   }
-//  if (block.heap_allocated) {
-//    rep_->filter_data = block.data.data();  // Will need to delete later
-//  }
-  rep->filter = new FullFilterBlockReader(
-      block.data, rep->remote_table.lock()->rdma_mg, Compute);
+  if (CachesIndexAndFilter()) {
+    char cache_key_buffer[16];
+    EncodeBlockCacheKey(cache_key_buffer, rep->cache_id,
+                        kFilterBlockCacheOffset);
+    Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+    rep->options.block_cache->Release(rep->options.block_cache->Insert(
+        key, filter, filter->filter_content.size(), &DeleteCachedFilter,
+        Cache::Priority::kHigh));
+  } else {
+    rep->filter = filter;
+  }
 }
 
 Table::~Table() {
 //  printf("garbage collect the local cache of table %lu", rep->cache_id);
+  if (CachesIndexAndFilter()) {
+    // Give the local memory of the index and the filter back now, the
+    // readers still using them hold their cache handles.
+    char cache_key_buffer[16];
+    EncodeBlockCacheKey(cache_key_buffer, rep->cache_id,
+                        kIndexBlockCacheOffset);
+    rep->options.block_cache->Erase(
+        Slice(cache_key_buffer, sizeof(cache_key_buffer)));
+    EncodeBlockCacheKey(cache_key_buffer, rep->cache_id,
+                        kFilterBlockCacheOffset);
+    rep->options.block_cache->Erase(
+        Slice(cache_key_buffer, sizeof(cache_key_buffer)));
+  }
   delete rep;
 }
 
@@ -110,16 +182,125 @@ static void DeleteBlock(void* arg, void* ignored) {
   delete reinterpret_cast<Block*>(arg);
 }
 
-static void DeleteCachedBlock(const Slice& key, void* value) {
-  Block* block = reinterpret_cast<Block*>(value);
-  delete block;
-}
 static void ReleaseBlock(void* arg, void* h) {
   Cache* cache = reinterpret_cast<Cache*>(arg);
   Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
   cache->Release(handle);
 }
 
+// The cleanups of a block iterator release the cache handle of the block or
+// delete the block, so a value is pinned by keeping its iterator alive.
+static void DeleteBlockIterator(void* arg, void* /*ignored*/) {
+  delete reinterpret_cast<Iterator*>(arg);
+}
+
+static void ReturnReadBuffer(void* arg, void* mr) {
+  reinterpret_cast<RDMA_Manager*>(arg)->Return_local_read_mr(
+      reinterpret_cast<ibv_mr*>(mr));
+}
+
+static void DeleteCompressedBlock(const Slice& /*key*/, void* value) {
+  delete reinterpret_cast<std::string*>(value);
+}
+
+// Read the data block at "handle" on a block cache miss, from the
+// compressed block cache if it holds the block, else from the remote memory
+// and then into the compressed block cache.
+static Status ReadDataBlockThroughCompressedCache(
+    Table* table, const ReadOptions& options, const BlockHandle& handle,
+    const Slice& cache_key, uint8_t target_node_id, BlockContents* contents) {
+  Cache* compressed_cache = table->rep->options.compressed_block_cache;
+  auto meta_ptr = table->rep->remote_table.lock();
+  if (compressed_cache == nullptr) {
+    return ReadDataBlock(&meta_ptr->remote_data_mrs, options, handle,
+                         contents, target_node_id);
+  }
+  Cache::Handle* compressed_handle = compressed_cache->Lookup(cache_key);
+  if (compressed_handle != nullptr) {
+    const std::string* compressed = reinterpret_cast<const std::string*>(
+        compressed_cache->Value(compressed_handle));
+    size_t ulength = 0;
+    char* ubuf = nullptr;
+    if (port::Snappy_GetUncompressedLength(compressed->data(),
+                                           compressed->size(), &ulength)) {
+      ubuf = new char[ulength];
+      if (!port::Snappy_Uncompress(compressed->data(), compressed->size(),
+                                   ubuf)) {
+        delete[] ubuf;
+        ubuf = nullptr;
+      }
+    }
+    compressed_cache->Release(compressed_handle);
+    if (ubuf != nullptr) {
+      contents->data = Slice(ubuf, ulength);
+      return Status::OK();
+    }
+  }
+  Status s = ReadDataBlock(&meta_ptr->remote_data_mrs, options, handle,
+                           contents, target_node_id);
+  if (s.ok() && options.fill_cache) {
+    std::string* compressed = new std::string;
+    if (port::Snappy_Compress(contents->data.data(), contents->data.size(),
+                              compressed)) {
+      compressed_cache->Release(compressed_cache->Insert(
+          cache_key, compressed, compressed->size(), &DeleteCompressedBlock));
+    } else {
+      // Snappy is not built in.
+      delete compressed;
+    }
+  }
+  return s;
+}
+
+Iterator* Table::NewIndexIterator() const {
+  if (rep->index_block != nullptr) {
+    return rep->index_block->NewIterator(rep->options.comparator);
+  }
+  Cache* block_cache = rep->options.block_cache;
+  char cache_key_buffer[16];
+  EncodeBlockCacheKey(cache_key_buffer, rep->cache_id, kIndexBlockCacheOffset);
+  Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+  Cache::Handle* cache_handle = block_cache->Lookup(key);
+  if (cache_handle == nullptr) {
+    Block* index_block = nullptr;
+    Status s = ReadIndexBlock(rep->options, rep->remote_table.lock(),
+                              &index_block);
+    if (!s.ok()) {
+      return NewErrorIterator(s);
+    }
+    cache_handle = block_cache->Insert(key, index_block, index_block->size(),
+                                       &DeleteCachedBlock,
+                                       Cache::Priority::kHigh);
+  }
+  Iterator* iter = reinterpret_cast<Block*>(block_cache->Value(cache_handle))
+                       ->NewIterator(rep->options.comparator);
+  iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+  return iter;
+}
+
+FullFilterBlockReader* Table::GetFilter(Cache::Handle** handle) const {
+  *handle = nullptr;
+  if (!CachesIndexAndFilter() || rep->options.filter_policy == nullptr) {
+    return rep->filter;
+  }
+  Cache* block_cache = rep->options.block_cache;
+  char cache_key_buffer[16];
+  EncodeBlockCacheKey(cache_key_buffer, rep->cache_id,
+                      kFilterBlockCacheOffset);
+  Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+  *handle = block_cache->Lookup(key);
+  if (*handle == nullptr) {
+    FullFilterBlockReader* filter =
+        ReadFilterReader(rep->options, rep->remote_table.lock());
+    if (filter == nullptr) {
+      return nullptr;
+    }
+    *handle = block_cache->Insert(key, filter, filter->filter_content.size(),
+                                  &DeleteCachedFilter, Cache::Priority::kHigh);
+  }
+  return reinterpret_cast<FullFilterBlockReader*>(block_cache->Value(*handle));
+}
+
 
 // Convert an index iterator value (i.e., an encoded BlockHandle)
 // into an iterator over the contents of the corresponding block.
@@ -169,10 +350,9 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
         start = std::chrono::high_resolution_clock::now();
 
 #endif
-        auto meta_ptr = table->rep->remote_table.lock();
-
-        s = ReadDataBlock(&meta_ptr->remote_data_mrs,
-                          options, handle, &contents, meta_ptr->shard_target_node_id);
+        s = ReadDataBlockThroughCompressedCache(
+            table, options, handle, key,
+            table->rep->remote_table.lock()->shard_target_node_id, &contents);
 #ifdef PROCESSANALYSIS
         stop = std::chrono::high_resolution_clock::now();
         auto blockfetch_duration = std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start);
@@ -260,8 +440,8 @@ Iterator* Table::BlockReader_async(void* arg, const ReadOptions& options,
         start = std::chrono::high_resolution_clock::now();
 
 #endif
-        s = ReadDataBlock(&table->rep->remote_table.lock()->remote_data_mrs,
-                          options, handle, &contents, 0);
+        s = ReadDataBlockThroughCompressedCache(table, options, handle, key, 0,
+                                                &contents);
 #ifdef PROCESSANALYSIS
         stop = std::chrono::high_resolution_clock::now();
         auto blockfetch_duration = std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start);
@@ -324,27 +504,126 @@ Slice Table::KVReader(void* arg, const ReadOptions& options,
   return result;
 }
 
+namespace {
+
+// An iterator over a table whose Seek() asks the filter of the table first,
+// so that a prefix seek does not read the blocks of a table without the
+// prefix, nor a seek with an upper bound those of a table without a key
+// before it. A "prefix_length" of 0 or a null "upper_bound" leaves out the
+// check.
+class SeekFilterIterator : public Iterator {
+ public:
+  // "bound" is the IterateBound of the read, it tells the targets before
+  // the upper bound.
+  SeekFilterIterator(Iterator* iter, FullFilterBlockReader* filter,
+                     size_t prefix_length, const Slice* upper_bound,
+                     const IterateBound& bound)
+      : iter_(iter),
+        filter_(filter),
+        prefix_length_(prefix_length),
+        upper_bound_(upper_bound),
+        bound_(bound) {}
+
+  ~SeekFilterIterator() override { delete iter_; }
+
+  bool Valid() const override { return !filtered_ && iter_->Valid(); }
+  void Seek(const Slice& target) override {
+    Slice user_key = ExtractUserKey(target);
+    filtered_ = prefix_length_ > 0 && user_key.size() >= prefix_length_ &&
+                !filter_->PrefixMayMatch(Slice(user_key.data(), prefix_length_));
+    // A target at or past the bound asks for an empty range, the seek is
+    // then not for the entries in range (e.g. DBIter::SeekToLast()).
+    if (!filtered_ && upper_bound_ != nullptr && bound_.InRange(target)) {
+      filtered_ = !filter_->RangeMayMatch(user_key, *upper_bound_);
+    }
+    if (!filtered_) {
+      iter_->Seek(target);
+    }
+  }
+  // The entries before target are not what the filters answer for.
+  void SeekForPrev(const Slice& target) override {
+    filtered_ = false;
+    iter_->SeekForPrev(target);
+  }
+  void SeekToFirst() override {
+    filtered_ = false;
+    iter_->SeekToFirst();
+  }
+  void SeekToLast() override {
+    filtered_ = false;
+    iter_->SeekToLast();
+  }
+  void Next() override {
+    assert(Valid());
+    iter_->Next();
+  }
+  void Prev() override {
+    assert(Valid());
+    iter_->Prev();
+  }
+  Slice key() const override { return iter_->key(); }
+  Slice value() const override { return iter_->value(); }
+  Status status() const override {
+    return filtered_ ? Status::OK() : iter_->status();
+  }
+
+ private:
+  Iterator* const iter_;
+  FullFilterBlockReader* const filter_;
+  const size_t prefix_length_;
+  const Slice* const upper_bound_;
+  const IterateBound bound_;
+  bool filtered_ = false;
+};
+
+}  // namespace
+
 Iterator* Table::NewIterator(const ReadOptions& options) const {
   auto table_meta = rep->remote_table.lock();
+  IterateBound bound(options, rep->options.comparator,
+                     rep->options.prefix_length);
+  Iterator* iter;
   if (table_meta->table_type == byte_addressable){
 #ifdef USESEQITERATOR
 //    printf("Byte-addressable table created, table number is %lu\n", table_meta->number);
 
-    return new ByteAddressableSEQIterator(
-        rep->index_block->NewIterator(rep->options.comparator),
-        const_cast<Table*>(this), options, true, table_meta->shard_target_node_id);
+    iter = new ByteAddressableSEQIterator(
+        NewIndexIterator(),
+        const_cast<Table*>(this), options, true,
+        table_meta->shard_target_node_id, bound);
 #else
-    return new ByteAddressableRAIterator(
-        rep->index_block->NewIterator(rep->options.comparator),
+    iter = new ByteAddressableRAIterator(
+        NewIndexIterator(),
         &Table::KVReader, const_cast<Table*>(this), options, true);
 #endif
   }else{
 //    printf("BLock based table created, table number is %lu\n", table_meta->number);
-    return NewTwoLevelIterator(
-        rep->index_block->NewIterator(rep->options.comparator),
-        &Table::BlockReader, const_cast<Table*>(this), options);
+    iter = NewTwoLevelIterator(
+        NewIndexIterator(),
+        &Table::BlockReader, const_cast<Table*>(this), options, bound);
   }
-
+  const bool prefix_seek =
+      options.prefix_same_as_start && rep->options.prefix_length > 0;
+  if (prefix_seek || options.iterate_upper_bound != nullptr) {
+    Cache::Handle* filter_handle;
+    FullFilterBlockReader* filter = GetFilter(&filter_handle);
+    const Slice* upper_bound =
+        filter != nullptr && filter->HasRangeFilter()
+            ? options.iterate_upper_bound
+            : nullptr;
+    if (filter != nullptr && (prefix_seek || upper_bound != nullptr)) {
+      iter = new SeekFilterIterator(
+          iter, filter, prefix_seek ? rep->options.prefix_length : 0,
+          upper_bound, bound);
+      if (filter_handle != nullptr) {
+        iter->RegisterCleanup(&ReleaseBlock, rep->options.block_cache,
+                              filter_handle);
+      }
+    } else if (filter_handle != nullptr) {
+      rep->options.block_cache->Release(filter_handle);
+    }
+  }
+  return iter;
 }
 //Iterator* Table::NewSEQIterator(const ReadOptions& options) const {
 //
@@ -353,8 +632,19 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
                           void (*handle_result)(void*, const Slice&,
                                                 const Slice&)) {
   Status s;
-  FullFilterBlockReader* filter = rep->filter;
-  if (filter != nullptr && !filter->KeyMayMatch(ExtractUserKey(k))) {
+  Cache::Handle* filter_handle;
+  FullFilterBlockReader* filter = GetFilter(&filter_handle);
+  const bool filtered =
+      filter != nullptr && !filter->KeyMayMatch(ExtractUserKey(k));
+  if (filter_handle != nullptr) {
+    rep->options.block_cache->Release(filter_handle);
+  }
+  if (filter != nullptr) {
+    Saver* filter_saver = reinterpret_cast<Saver*>(arg);
+    filter_saver->filter_checked = true;
+    filter_saver->filter_negative = filtered;
+  }
+  if (filtered) {
     // Not found
 #ifdef PROCESSANALYSIS
     int dummy = 0;
@@ -392,7 +682,7 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
 #endif
   } else {
     if (rep->remote_table.lock()->table_type == block_based){
-      Iterator* iiter = rep->index_block->NewIterator(rep->options.comparator);
+      Iterator* iiter = NewIndexIterator();
 #ifdef PROCESSANALYSIS
       auto start = std::chrono::high_resolution_clock::now();
 #endif
@@ -435,7 +725,15 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
           assert(*block_iter->key().data() == 0);
         }
         s = block_iter->status();
-        delete block_iter;
+        Saver* pin_saver = reinterpret_cast<Saver*>(arg);
+        if (pin_saver->pinned != nullptr && pin_saver->state == kFound) {
+          // Hand the block over to the caller instead of copying the value.
+          pin_saver->pinned->PinSlice(pin_saver->pinned_value,
+                                      &DeleteBlockIterator, block_iter,
+                                      nullptr);
+        } else {
+          delete block_iter;
+        }
 
 #ifdef PROCESSANALYSIS
         Saver* saver = reinterpret_cast<Saver*>(arg);
@@ -458,7 +756,7 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
       //    Iterator* iter = NewIterator(options);
       //    iter->Seek(k);
       // todo: Can we directly search by the index block without create a iterator?
-      Iterator* iiter = rep->index_block->NewIterator(rep->options.comparator);
+      Iterator* iiter = NewIndexIterator();
       iiter->Seek(k);
 #ifdef PROCESSANALYSIS
       auto stop = std::chrono::high_resolution_clock::now();
@@ -506,6 +804,14 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
         assert(KV.size() == value_size);
         value = KV;
         (*handle_result)(arg, key, value);
+        if (saver_->pinned != nullptr && saver_->state == kFound) {
+          // The read buffer of this thread is handed over to the caller, the
+          // next read of the thread takes a spare one.
+          ibv_mr* read_mr = rdma_mg->Take_local_read_mr();
+          assert(read_mr->addr == mr_addr);
+          saver_->pinned->PinSlice(saver_->pinned_value, &ReturnReadBuffer,
+                                   rdma_mg.get(), read_mr);
+        }
         //      rdma_mg->Deallocate_Local_RDMA_Slot(mr_addr, DataChunk);
       }
       delete iiter;
@@ -521,7 +827,7 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
 //
 //}
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
-  Iterator* index_iter = rep->index_block->NewIterator(rep->options.comparator);
+  Iterator* index_iter = NewIndexIterator();
   index_iter->Seek(key);
   uint64_t result;
   if (index_iter->Valid()) {
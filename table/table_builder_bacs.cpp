@@ -4,6 +4,7 @@
 
 #include "table_builder_bacs.h"
 #include "db/dbformat.h"
+#include "TimberSaw/rate_limiter.h"
 #include <cassert>
 namespace TimberSaw {
 //TOthink: how to save the remote mr?
@@ -61,11 +62,23 @@ struct TableBuilder_BACS::Rep {
     }
     filter_block = (opt.filter_policy == nullptr
                         ? nullptr
-                        : new FullFilterBlockBuilder(local_filter_mr[0], opt.bloom_bits));
+                        : new FullFilterBlockBuilder(local_filter_mr[0], opt.bloom_bits,
+                                                     opt.prefix_length,
+                                                     opt.filter_type,
+                                                     opt.range_filter_levels));
 
     status = Status::OK();
   }
 
+  // Pace the RDMA writes of this table, the flushes ahead of the compactions.
+  void ChargeWrite(size_t bytes) const {
+    if (options.rate_limiter != nullptr) {
+      options.rate_limiter->Request(
+          static_cast<int64_t>(bytes),
+          type_ == IO_type::Flush ? RateLimiter::kHigh : RateLimiter::kLow);
+    }
+  }
+
   const Options& options;
   Options index_block_options;
   IO_type type_;
@@ -116,7 +129,38 @@ struct TableBuilder_BACS::Rep {
 
   std::string compressed_output;
   uint8_t target_node_id_;
+
+  // The registration of [data, data + n) in the gather arenas, nullptr if
+  // it lies in none of them.
+  ibv_mr* FindRegistration(const char* data, size_t n) const {
+    for (const ConcurrentArena* arena : gather_arenas) {
+      ibv_mr* mr = arena->FindRegistration(data, n);
+      if (mr != nullptr) {
+        return mr;
+      }
+    }
+    return nullptr;
+  }
+
+  // The arenas of a zero copy flush, empty if the records are copied into
+  // the write buffers. A gathering builder writes the headers and copies to
+  // the first write buffer only.
+  std::vector<const ConcurrentArena*> gather_arenas;
+  // The pieces of the records queued for the next write.
+  std::vector<ibv_sge> gather_sges;
+  size_t gather_bytes = 0;
+  // The remote chunk the records since offset_last_flushed go to, allocated
+  // on its first write.
+  ibv_mr* gather_chunk = nullptr;
+  size_t gather_chunk_written = 0;
+  // The writes posted and not polled yet.
+  int gather_outstanding = 0;
 };
+
+namespace {
+// The scatter gather writes a builder keeps in flight.
+const int kMaxOutstandingGathers = 64;
+}  // namespace
 TableBuilder_BACS::TableBuilder_BACS(const Options& options, IO_type type,
                                      uint8_t target_node_id)
     : rep_(new Rep(options, type, target_node_id)) {
@@ -166,6 +210,13 @@ TableBuilder_BACS::~TableBuilder_BACS() {
 //TODO: make it create a block every blocksize, flush every 1M. When flushing do not poll completion
 // pool the completion at the same time in the end
 void TableBuilder_BACS::Add(const Slice& key, const Slice& value) {
+  AddWithFilterHash(
+      key, value,
+      rep_->filter_block != nullptr ? BloomHash(ExtractUserKey(key)) : 0);
+}
+void TableBuilder_BACS::AddWithFilterHash(const Slice& key,
+                                          const Slice& value,
+                                          uint32_t filter_hash) {
   Rep* r = rep_;
   assert(!r->closed);
   if (!ok()) return;
@@ -210,18 +261,24 @@ void TableBuilder_BACS::Add(const Slice& key, const Slice& value) {
   }
 
   if (r->filter_block != nullptr) {
-    r->filter_block->AddKey(ExtractUserKey(key));
+    r->filter_block->AddKeyHash(filter_hash);
+    r->filter_block->AddPrefix(ExtractUserKey(key));
+    r->filter_block->AddRangeKey(ExtractUserKey(key));
   }
 
   r->last_key.assign(key.data(), key.size());
   //  assert(key.size() == 28 || key.size() == 29);
   //  assert(r->last_key.c_str()[8] == 060);
   r->num_entries++;
-  // append k-V pair to the buffer.
-  PutFixed32(&r->data_buff, key.size());
-  PutFixed32(&r->data_buff, value.size());
-  r->data_buff.append(key.data(), key.size());
-  r->data_buff.append(value.data(), value.size());
+  if (!r->gather_arenas.empty()) {
+    AddGathered(key, value);
+  } else {
+    // append k-V pair to the buffer.
+    PutFixed32(&r->data_buff, key.size());
+    PutFixed32(&r->data_buff, value.size());
+    r->data_buff.append(key.data(), key.size());
+    r->data_buff.append(value.data(), value.size());
+  }
   r->offset_last_added = r->offset;
   r->offset +=  key.size() + value.size() + 2*sizeof(uint32_t);
 
@@ -229,6 +286,130 @@ void TableBuilder_BACS::Add(const Slice& key, const Slice& value) {
 
 }
 
+void TableBuilder_BACS::SetGatherSources(
+    const std::vector<const ConcurrentArena*>& arenas) {
+  assert(rep_->num_entries == 0);
+  rep_->gather_arenas = arenas;
+  rep_->gather_sges.reserve(RDMA_Manager::kMaxSendSge);
+}
+
+void TableBuilder_BACS::AddGathered(const Slice& key, const Slice& value) {
+  Rep* r = rep_;
+  ibv_mr* key_mr = r->FindRegistration(key.data(), key.size());
+  ibv_mr* value_mr =
+      value.empty() ? nullptr : r->FindRegistration(value.data(), value.size());
+  const size_t staged = 2 * sizeof(uint32_t) +
+                        (key_mr == nullptr ? key.size() : 0) +
+                        (value_mr == nullptr ? value.size() : 0);
+  ibv_mr* buffer = r->local_data_mr[0];
+  if (r->data_buff.size() + staged > buffer->length) {
+    // The staged bytes of the writes in flight must stay until they finish.
+    PostGathered();
+    WaitGathered();
+    r->data_buff.Reset(static_cast<char*>(buffer->addr), 0);
+  }
+  const char* header = r->data_buff.data() + r->data_buff.size();
+  PutFixed32(&r->data_buff, key.size());
+  PutFixed32(&r->data_buff, value.size());
+  AppendGatherPiece(header, 2 * sizeof(uint32_t), buffer->lkey);
+  if (key_mr != nullptr) {
+    AppendGatherPiece(key.data(), key.size(), key_mr->lkey);
+  } else {
+    const char* copy = r->data_buff.data() + r->data_buff.size();
+    r->data_buff.append(key.data(), key.size());
+    AppendGatherPiece(copy, key.size(), buffer->lkey);
+  }
+  if (value.empty()) {
+    return;
+  }
+  if (value_mr != nullptr) {
+    AppendGatherPiece(value.data(), value.size(), value_mr->lkey);
+  } else {
+    const char* copy = r->data_buff.data() + r->data_buff.size();
+    r->data_buff.append(value.data(), value.size());
+    AppendGatherPiece(copy, value.size(), buffer->lkey);
+  }
+}
+
+void TableBuilder_BACS::AppendGatherPiece(const char* data, size_t n,
+                                          uint32_t lkey) {
+  Rep* r = rep_;
+  // The staged header and key copies of a record are adjacent.
+  if (!r->gather_sges.empty()) {
+    ibv_sge& last = r->gather_sges.back();
+    if (last.lkey == lkey && last.addr + last.length == (uintptr_t)data) {
+      last.length += n;
+      r->gather_bytes += n;
+      return;
+    }
+  }
+  if (r->gather_sges.size() == RDMA_Manager::kMaxSendSge) {
+    PostGathered();
+  }
+  ibv_sge sge;
+  sge.addr = (uintptr_t)data;
+  sge.length = n;
+  sge.lkey = lkey;
+  r->gather_sges.push_back(sge);
+  r->gather_bytes += n;
+}
+
+void TableBuilder_BACS::PostGathered() {
+  Rep* r = rep_;
+  if (r->gather_sges.empty()) {
+    return;
+  }
+  std::shared_ptr<RDMA_Manager> rdma_mg = r->options.env->rdma_mg;
+  if (r->gather_chunk == nullptr) {
+    r->gather_chunk = new ibv_mr();
+    rdma_mg->Allocate_Remote_RDMA_Slot(*r->gather_chunk, r->target_node_id_,
+                                       FlushBuffer);
+    r->gather_chunk_written = 0;
+  }
+  r->ChargeWrite(r->gather_bytes);
+  rdma_mg->RDMA_Write_Gather(
+      static_cast<char*>(r->gather_chunk->addr) + r->gather_chunk_written,
+      r->gather_chunk->rkey, r->gather_sges.data(),
+      static_cast<int>(r->gather_sges.size()), r->type_string_,
+      IBV_SEND_SIGNALED, 0, r->target_node_id_);
+  r->gather_chunk_written += r->gather_bytes;
+  r->gather_bytes = 0;
+  r->gather_sges.clear();
+  // The writes of a queue pair finish in order, polling one frees the slot
+  // of the oldest.
+  if (++r->gather_outstanding == kMaxOutstandingGathers) {
+    ibv_wc wc[1];
+    rdma_mg->poll_completion(wc, 1, r->type_string_, true,
+                             r->target_node_id_);
+    r->gather_outstanding--;
+  }
+}
+
+void TableBuilder_BACS::WaitGathered() {
+  Rep* r = rep_;
+  if (r->gather_outstanding == 0) {
+    return;
+  }
+  ibv_wc wc[kMaxOutstandingGathers];
+  r->options.env->rdma_mg->poll_completion(wc, r->gather_outstanding,
+                                           r->type_string_, true,
+                                           r->target_node_id_);
+  r->gather_outstanding = 0;
+}
+
+void TableBuilder_BACS::FlushGathered() {
+  Rep* r = rep_;
+  if (r->offset == r->offset_last_flushed) {
+    return;
+  }
+  PostGathered();
+  assert(r->gather_chunk_written == r->offset - r->offset_last_flushed);
+  r->gather_chunk->length = r->gather_chunk_written;
+  r->remote_data_mrs.insert({r->offset, r->gather_chunk});
+  r->gather_chunk = nullptr;
+  r->offset_last_flushed = r->offset;
+}
+
 void TableBuilder_BACS::UpdateFunctionBLock() {
 
 //  Rep* r = rep_;
@@ -416,7 +597,12 @@ void TableBuilder_BACS::FinishFilterBlock(FullFilterBlockBuilder* block, BlockHa
 //TODO make flushing flush the data to the remote memory flushing to remote memory
 void TableBuilder_BACS::FlushData(){
   Rep* r = rep_;
+  if (!r->gather_arenas.empty()) {
+    FlushGathered();
+    return;
+  }
   size_t msg_size = r->offset - r->offset_last_flushed;
+  r->ChargeWrite(msg_size);
   ibv_mr* remote_mr = new ibv_mr();
   std::shared_ptr<RDMA_Manager> rdma_mg =  r->options.env->rdma_mg;
   rdma_mg->Allocate_Remote_RDMA_Slot(*remote_mr, rep_->target_node_id_,
@@ -520,6 +706,7 @@ void TableBuilder_BACS::FlushDataIndex(size_t msg_size) {
   std::shared_ptr<RDMA_Manager> rdma_mg =  r->options.env->rdma_mg;
   rdma_mg->Allocate_Remote_RDMA_Slot(*remote_mr, rep_->target_node_id_,
                                      FlushBuffer);
+  r->ChargeWrite(msg_size);
   rdma_mg->RDMA_Write(remote_mr, r->local_index_mr[0], msg_size,
                       r->type_string_, IBV_SEND_SIGNALED, 0, rep_->target_node_id_);
   remote_mr->length = msg_size;
@@ -540,6 +727,7 @@ void TableBuilder_BACS::FlushFilter(size_t& msg_size) {
   std::shared_ptr<RDMA_Manager> rdma_mg =  r->options.env->rdma_mg;
   rdma_mg->Allocate_Remote_RDMA_Slot(*remote_mr, rep_->target_node_id_,
                                      FilterChunk);
+  r->ChargeWrite(msg_size);
   rdma_mg->RDMA_Write(remote_mr, r->local_filter_mr[0], msg_size,
                       r->type_string_, IBV_SEND_SIGNALED, 0, rep_->target_node_id_);
   remote_mr->length = msg_size;
@@ -562,6 +750,7 @@ Status TableBuilder_BACS::Finish() {
   if (r->offset - r->offset_last_flushed >0){
     FlushData();
   }
+  WaitGathered();
 
   assert(!r->closed);
   r->closed = true;
@@ -623,6 +812,10 @@ Status TableBuilder_BACS::Finish() {
   int num_of_poll = r->data_inuse_end - r->data_inuse_start + 1 >= 0 ?
                                                                      r->data_inuse_end - r->data_inuse_start + 1:
                                                                      (int)(r->local_data_mr.size()) - r->data_inuse_start + r->data_inuse_end +1;
+  if (!r->gather_arenas.empty()) {
+    // The data writes were polled by WaitGathered().
+    num_of_poll = 0;
+  }
   // add one more for the index block,if have filter block add 2
   if (r->filter_block != nullptr){
     num_of_poll = num_of_poll + 2;
@@ -676,6 +869,11 @@ void TableBuilder_BACS::get_filter_map(std::map<uint32_t, ibv_mr*>& map) {
 size_t TableBuilder_BACS::get_numentries() {
   return rep_->num_entries;
 }
+void TableBuilder_BACS::SetFilterBitsPerKey(int bits_per_key) {
+  if (rep_->filter_block != nullptr) {
+    rep_->filter_block->SetBitsPerKey(bits_per_key);
+  }
+}
 
 
 }  // namespace TimberSaw
\ No newline at end of file
@@ -17,6 +17,7 @@
 #include "table/full_filter_block.h"
 #include "table/format.h"
 #include "util/coding.h"
+#include "util/concurrent_arena.h"
 #include "util/crc32c.h"
 namespace TimberSaw {
 //class BlockBuilder;
@@ -50,6 +51,8 @@ class TimberSaw_EXPORT TableBuilder_BACS : public TableBuilder{
   // REQUIRES: key is after any previously added key according to comparator.
   // REQUIRES: Finish(), Abandon() have not been called
   void Add(const Slice& key, const Slice& value) override;
+  void AddWithFilterHash(const Slice& key, const Slice& value,
+                         uint32_t filter_hash) override;
 
   // Advanced operation: flush any buffered key/value pairs to remote memory.
   // Can be used to ensure that two adjacent entries never live in
@@ -95,11 +98,31 @@ class TimberSaw_EXPORT TableBuilder_BACS : public TableBuilder{
   void get_dataindexblocks_map(std::map<uint32_t, ibv_mr*>& map) override;
   void get_filter_map(std::map<uint32_t, ibv_mr*>& map) override;
   size_t get_numentries() override;
+  void SetFilterBitsPerKey(int bits_per_key) override;
+
+  // Write the keys and values that lie in the registered blocks of "arenas"
+  // to the remote memory straight from there, with scatter gather writes.
+  // Only the record headers, and the keys and values found in none of the
+  // arenas, are copied into the write buffer. The arenas must stay alive
+  // and unchanged until Finish() returns.
+  // REQUIRES: Add() has not been called
+  void SetGatherSources(const std::vector<const ConcurrentArena*>& arenas);
  protected:
 
 
   struct Rep;
 
+  // Queue a record for the scatter gather writes.
+  void AddGathered(const Slice& key, const Slice& value);
+  // Queue "n" bytes at "data" of the registration "lkey".
+  void AppendGatherPiece(const char* data, size_t n, uint32_t lkey);
+  // Write the queued pieces to the current remote chunk.
+  void PostGathered();
+  // Wait for the posted scatter gather writes.
+  void WaitGathered();
+  // Close the current remote chunk, FlushData() of a gathering builder.
+  void FlushGathered();
+
   Rep* rep_;
 };
 
@@ -58,7 +58,10 @@ struct TableBuilder_BAMS::Rep {
     }
     filter_block = (opt.filter_policy == nullptr
                         ? nullptr
-                        : new FullFilterBlockBuilder(local_filter_mr, opt.bloom_bits));
+                        : new FullFilterBlockBuilder(local_filter_mr, opt.bloom_bits,
+                                                     opt.prefix_length,
+                                                     opt.filter_type,
+                                                     opt.range_filter_levels));
 
     status = Status::OK();
   }
@@ -217,6 +220,8 @@ void TableBuilder_BAMS::Add(const Slice& key, const Slice& value) {
 
   if (r->filter_block != nullptr) {
     r->filter_block->AddKey(ExtractUserKey(key));
+    r->filter_block->AddPrefix(ExtractUserKey(key));
+    r->filter_block->AddRangeKey(ExtractUserKey(key));
   }
 
   r->last_key.assign(key.data(), key.size());
@@ -547,4 +552,9 @@ void TableBuilder_BAMS::get_filter_map(std::map<uint32_t, ibv_mr*>& map) {
 size_t TableBuilder_BAMS::get_numentries() {
   return rep_->num_entries;
 }
+void TableBuilder_BAMS::SetFilterBitsPerKey(int bits_per_key) {
+  if (rep_->filter_block != nullptr) {
+    rep_->filter_block->SetBitsPerKey(bits_per_key);
+  }
+}
 }
\ No newline at end of file
@@ -94,6 +94,7 @@ class TimberSaw_EXPORT TableBuilder_BAMS : public TableBuilder{
   void get_dataindexblocks_map(std::map<uint32_t, ibv_mr*>& map) override;
   void get_filter_map(std::map<uint32_t, ibv_mr*>& map) override;
   size_t get_numentries() override;
+  void SetFilterBitsPerKey(int bits_per_key) override;
  protected:
 
 
@@ -5,6 +5,8 @@
 #include "table_builder_computeside.h"
 
 #include "db/dbformat.h"
+#include "TimberSaw/rate_limiter.h"
+#include <algorithm>
 #include <cassert>
 
 namespace TimberSaw {
@@ -52,6 +54,13 @@ struct TableBuilder_ComputeSide::Rep {
     //    delete temp_filter_mr;
     data_block = new BlockBuilder(&options, local_data_mr[0]);
     index_block = new BlockBuilder(&index_block_options, local_index_mr[0]);
+    // A compressed data block is built aside and compressed straight to its
+    // place in the write buffer, see BlockFootprint() for the room it needs there.
+    if (opt.compression == kSnappyCompression) {
+      raw_block_capacity = 2 * opt.block_size;
+      raw_block_buf = new char[raw_block_capacity];
+      data_block->Move_buffer(raw_block_buf);
+    }
     if (type_ == IO_type::Compact){
       type_string_ = "write_local_compact";
     }else if(type_ == IO_type::Flush){
@@ -61,11 +70,49 @@ struct TableBuilder_ComputeSide::Rep {
     }
     filter_block = (opt.filter_policy == nullptr
         ? nullptr
-        : new FullFilterBlockBuilder(local_filter_mr[0], opt.bloom_bits));
+        : new FullFilterBlockBuilder(local_filter_mr[0], opt.bloom_bits,
+                                     opt.prefix_length,
+                                     opt.filter_type,
+                                     opt.range_filter_levels));
 
     status = Status::OK();
   }
 
+  // Pace the RDMA writes of this table, the flushes ahead of the compactions.
+  void ChargeWrite(size_t bytes) const {
+    if (options.rate_limiter != nullptr) {
+      options.rate_limiter->Request(
+          static_cast<int64_t>(bytes),
+          type_ == IO_type::Flush ? RateLimiter::kHigh : RateLimiter::kLow);
+    }
+  }
+
+  // Room a data block that takes an entry of entry_size bytes may need in
+  // its write buffer, trailer included. An entry larger than a block ends up alone
+  // in an oversized block.
+  size_t BlockFootprint(size_t entry_size) const {
+    const size_t raw_size = std::max<size_t>(options.block_size, entry_size);
+    if (options.compression == kSnappyCompression) {
+      return port::Snappy_MaxCompressedLength(raw_size) + kBlockTrailerSize;
+    }
+    return raw_size;
+  }
+
+  // Grows raw_block_buf so that the block being built can take an entry of
+  // entry_size bytes, keeping what the block already holds.
+  void ReserveRawBlock(size_t entry_size) {
+    if (raw_block_buf == nullptr) return;
+    const size_t needed = data_block->CurrentSizeEstimate() + entry_size;
+    if (needed <= raw_block_capacity) return;
+    const size_t used = data_block->buffer.size();
+    raw_block_capacity = std::max(needed, 2 * raw_block_capacity);
+    char* grown = new char[raw_block_capacity];
+    memcpy(grown, raw_block_buf, used);
+    delete[] raw_block_buf;
+    raw_block_buf = grown;
+    data_block->Reset_Buffer(grown, used);
+  }
+
   const Options& options;
   Options index_block_options;
   IO_type type_;
@@ -80,6 +127,14 @@ struct TableBuilder_ComputeSide::Rep {
   // First, all the buffer are outstanding
   // second, no buffer is outstanding, those two status will both have start - end = 1
   bool data_inuse_empty = true;
+  // The buffer of local_data_mr the data blocks are written to.
+  size_t data_write_index = 0;
+  // Where the uncompressed data blocks are built when compression is on.
+  char* raw_block_buf = nullptr;
+  size_t raw_block_capacity = 0;
+  // The last finished data block, in its write buffer.
+  Slice block_in_buffer;
+  uint64_t copied_bytes = 0;
   std::vector<ibv_mr*> local_index_mr;
   std::vector<ibv_mr*> local_filter_mr;
   //TODO: make the map offset -> ibv_mr*
@@ -146,6 +201,7 @@ TableBuilder_ComputeSide::~TableBuilder_ComputeSide() {
     }
     delete iter;
   }
+  delete[] rep_->raw_block_buf;
   delete rep_->data_block;
   delete rep_->index_block;
   delete rep_;
@@ -169,6 +225,13 @@ TableBuilder_ComputeSide::~TableBuilder_ComputeSide() {
 //TODO: make it create a block every blocksize, flush every 1M. When flushing do not poll completion
 // pool the completion at the same time in the end
 void TableBuilder_ComputeSide::Add(const Slice& key, const Slice& value) {
+  AddWithFilterHash(
+      key, value,
+      rep_->filter_block != nullptr ? BloomHash(ExtractUserKey(key)) : 0);
+}
+void TableBuilder_ComputeSide::AddWithFilterHash(const Slice& key,
+                                                 const Slice& value,
+                                                 uint32_t filter_hash) {
   Rep* r = rep_;
   assert(!r->closed);
   if (!ok()) return;
@@ -186,9 +249,12 @@ void TableBuilder_ComputeSide::Add(const Slice& key, const Slice& value) {
   // *           if not, the flush temporal buffer content to the remote memory.
   const size_t estimated_block_size = r->data_block->CurrentSizeEstimate();
   // maximize added length to the block is key size + value size + restart point + shared, nonshared, valuesize
-  if (estimated_block_size + key.size() + value.size() +sizeof(size_t) + 3*sizeof(uint32_t) + kBlockTrailerSize >= r->options.block_size) {
+  const size_t entry_size = key.size() + value.size() + sizeof(size_t) +
+                            3 * sizeof(uint32_t) + kBlockTrailerSize;
+  if (estimated_block_size + entry_size >= r->options.block_size) {
     UpdateFunctionBLock();
-    if (r->local_data_mr[0]->length - (r->offset - r->offset_last_flushed) < r->options.block_size) {
+    if (r->local_data_mr[0]->length - (r->offset - r->offset_last_flushed) <
+        r->BlockFootprint(entry_size)) {
       FlushData();
     }
   }
@@ -220,13 +286,16 @@ void TableBuilder_ComputeSide::Add(const Slice& key, const Slice& value) {
   }
 
   if (r->filter_block != nullptr) {
-    r->filter_block->AddKey(ExtractUserKey(key));
+    r->filter_block->AddKeyHash(filter_hash);
+    r->filter_block->AddPrefix(ExtractUserKey(key));
+    r->filter_block->AddRangeKey(ExtractUserKey(key));
   }
 
   r->last_key.assign(key.data(), key.size());
 //  assert(key.size() == 28 || key.size() == 29);
 //  assert(r->last_key.c_str()[8] == 060);
   r->num_entries++;
+  r->ReserveRawBlock(entry_size);
   r->data_block->Add(key, value);
 
 
@@ -276,20 +345,26 @@ void TableBuilder_ComputeSide::FinishDataBlock(BlockBuilder* block, BlockHandle*
       break;
     }
     case kSnappyCompression: {
-      std::string* compressed = &r->compressed_output;
-      if (port::Snappy_Compress(raw->data(), raw->size(), compressed) &&
-          compressed->size() < raw->size() - (raw->size() / 8u)) {
-        memcpy((void*)r->data_block->buffer.data(), (void*)compressed->data(), compressed->size());
-        block->Reset_Buffer(const_cast<char*>(r->data_block->buffer.data()),
-                            compressed->size());
-        block_contents = &r->data_block->buffer;
+      // The block was built in raw_block_buf, compress it to its place in
+      // the write buffer.
+      char* dst =
+          static_cast<char*>(r->local_data_mr[r->data_write_index]->addr) +
+          (r->offset - r->offset_last_flushed);
+      size_t compressed_size = 0;
+      if (port::Snappy_RawCompress(raw->data(), raw->size(), dst,
+                                   &compressed_size) &&
+          compressed_size < raw->size() - (raw->size() / 8u)) {
+        r->block_in_buffer = Slice(dst, compressed_size);
       } else {
         // Snappy not supported, or compressed less than 12.5%, so just
         // store uncompressed form
         assert(false);
-        block_contents = raw;
+        memcpy(dst, raw->data(), raw->size());
+        r->copied_bytes += raw->size();
+        r->block_in_buffer = Slice(dst, raw->size());
         compressiontype = kNoCompression;
       }
+      block_contents = &r->block_in_buffer;
       break;
     }
   }
@@ -299,7 +374,6 @@ void TableBuilder_ComputeSide::FinishDataBlock(BlockBuilder* block, BlockHandle*
 //#endif
   handle->set_offset(r->offset);// This is the offset of the begginning of this block.
   handle->set_size(block_contents->size());
-  assert(block_contents->size() <= r->options.block_size - kBlockTrailerSize);
   if (r->status.ok()) {
     char trailer[kBlockTrailerSize];
     trailer[0] = compressiontype;
@@ -325,6 +399,9 @@ void TableBuilder_ComputeSide::FinishDataBlock(BlockBuilder* block, BlockHandle*
 //           buf[5], buf[6], buf[7], block_contents->size() - 5);
 //  }
   block->Reset_Forward();
+  if (r->raw_block_buf != nullptr) {
+    block->Move_buffer(r->raw_block_buf);
+  }
 }
 void TableBuilder_ComputeSide::FinishDataIndexBlock(BlockBuilder* block,
                                         BlockHandle* handle,
@@ -434,6 +511,7 @@ void TableBuilder_ComputeSide::FinishFilterBlock(FullFilterBlockBuilder* block,
 void TableBuilder_ComputeSide::FlushData(){
   Rep* r = rep_;
   size_t msg_size = r->offset - r->offset_last_flushed;
+  r->ChargeWrite(msg_size);
   ibv_mr* remote_mr = new ibv_mr();
   std::shared_ptr<RDMA_Manager> rdma_mg =  r->options.env->rdma_mg;
   rdma_mg->Allocate_Remote_RDMA_Slot(*remote_mr, 0, FlushBuffer);
@@ -520,7 +598,10 @@ void TableBuilder_ComputeSide::FlushData(){
   int next_buffer_index = r->data_inuse_end == r->local_data_mr.size()-1 ? 0:r->data_inuse_end+1;
 
   assert(next_buffer_index != r->data_inuse_start);
-  r->data_block->Move_buffer(const_cast<const char*>(static_cast<char*>(r->local_data_mr[next_buffer_index]->addr)));
+  r->data_write_index = next_buffer_index;
+  if (r->raw_block_buf == nullptr) {
+    r->data_block->Move_buffer(const_cast<const char*>(static_cast<char*>(r->local_data_mr[next_buffer_index]->addr)));
+  }
 //  DEBUG_arg("In use start is %d\n", r->data_inuse_start);
 //  DEBUG_arg("In use end is %d\n", r->data_inuse_end);
 //  DEBUG_arg("Next write buffer to use %d\n", next_buffer_index);
@@ -534,6 +615,7 @@ void TableBuilder_ComputeSide::FlushDataIndex(size_t msg_size) {
   ibv_mr* remote_mr = new ibv_mr();
   std::shared_ptr<RDMA_Manager> rdma_mg =  r->options.env->rdma_mg;
   rdma_mg->Allocate_Remote_RDMA_Slot(*remote_mr, 0, FlushBuffer);//Use flush buffer here, because we does not distinguish flush vs index in the remote memory.
+  r->ChargeWrite(msg_size);
   rdma_mg->RDMA_Write(remote_mr, r->local_index_mr[0], msg_size,
                       r->type_string_, IBV_SEND_SIGNALED, 0, 0);
   remote_mr->length = msg_size;
@@ -553,6 +635,7 @@ void TableBuilder_ComputeSide::FlushFilter(size_t& msg_size) {
   ibv_mr* remote_mr = new ibv_mr();
   std::shared_ptr<RDMA_Manager> rdma_mg =  r->options.env->rdma_mg;
   rdma_mg->Allocate_Remote_RDMA_Slot(*remote_mr, 0, FilterChunk);
+  r->ChargeWrite(msg_size);
   rdma_mg->RDMA_Write(remote_mr, r->local_filter_mr[0], msg_size,
                       r->type_string_, IBV_SEND_SIGNALED, 0, 0);
   remote_mr->length = msg_size;
@@ -684,6 +767,14 @@ void TableBuilder_ComputeSide::get_filter_map(std::map<uint32_t, ibv_mr*>& map)
 size_t TableBuilder_ComputeSide::get_numentries() {
   return rep_->num_entries;
 }
+uint64_t TableBuilder_ComputeSide::CopiedBytes() const {
+  return rep_->copied_bytes;
+}
+void TableBuilder_ComputeSide::SetFilterBitsPerKey(int bits_per_key) {
+  if (rep_->filter_block != nullptr) {
+    rep_->filter_block->SetBitsPerKey(bits_per_key);
+  }
+}
 
 
 }  // namespace TimberSaw
@@ -61,6 +61,8 @@ class TimberSaw_EXPORT TableBuilder_ComputeSide : public TableBuilder{
   // REQUIRES: key is after any previously added key according to comparator.
   // REQUIRES: Finish(), Abandon() have not been called
   void Add(const Slice& key, const Slice& value) override;
+  void AddWithFilterHash(const Slice& key, const Slice& value,
+                         uint32_t filter_hash) override;
 
   // Advanced operation: flush any buffered key/value pairs to remote memory.
   // Can be used to ensure that two adjacent entries never live in
@@ -106,6 +108,8 @@ class TimberSaw_EXPORT TableBuilder_ComputeSide : public TableBuilder{
   void get_dataindexblocks_map(std::map<uint32_t, ibv_mr*>& map) override;
   void get_filter_map(std::map<uint32_t, ibv_mr*>& map) override;
   size_t get_numentries() override;
+  uint64_t CopiedBytes() const override;
+  void SetFilterBitsPerKey(int bits_per_key) override;
  protected:
 
 
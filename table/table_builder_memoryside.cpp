@@ -4,6 +4,7 @@
 #include "table/table_builder_memoryside.h"
 #include "util/rdma.h"
 #include "util/crc32c.h"
+#include <algorithm>
 #include <cassert>
 #include "db/dbformat.h"
 
@@ -48,6 +49,13 @@ struct TableBuilder_Memoryside::Rep {
     //    delete temp_filter_mr;
     data_block = new BlockBuilder(&options, local_data_mr);
     index_block = new BlockBuilder(&index_block_options, local_index_mr);
+    // A compressed data block is built aside and compressed straight to its
+    // place in the chunk, see BlockFootprint() for the room it needs there.
+    if (opt.compression == kSnappyCompression) {
+      raw_block_capacity = 2 * opt.block_size;
+      raw_block_buf = new char[raw_block_capacity];
+      data_block->Move_buffer(raw_block_buf);
+    }
 #ifndef NDEBUG
     printf("Sucessfully allocate an block %p", local_index_mr->addr);
 #endif
@@ -60,11 +68,40 @@ struct TableBuilder_Memoryside::Rep {
     }
     filter_block = (opt.filter_policy == nullptr
         ? nullptr
-        : new FullFilterBlockBuilder(local_filter_mr, opt.bloom_bits));
+        : new FullFilterBlockBuilder(local_filter_mr, opt.bloom_bits,
+                                     opt.prefix_length,
+                                     opt.filter_type,
+                                     opt.range_filter_levels));
 
     status = Status::OK();
   }
 
+  // Room a data block that takes an entry of entry_size bytes may need in
+  // its chunk, trailer included. An entry larger than a block ends up alone
+  // in an oversized block.
+  size_t BlockFootprint(size_t entry_size) const {
+    const size_t raw_size = std::max<size_t>(options.block_size, entry_size);
+    if (options.compression == kSnappyCompression) {
+      return port::Snappy_MaxCompressedLength(raw_size) + kBlockTrailerSize;
+    }
+    return raw_size;
+  }
+
+  // Grows raw_block_buf so that the block being built can take an entry of
+  // entry_size bytes, keeping what the block already holds.
+  void ReserveRawBlock(size_t entry_size) {
+    if (raw_block_buf == nullptr) return;
+    const size_t needed = data_block->CurrentSizeEstimate() + entry_size;
+    if (needed <= raw_block_capacity) return;
+    const size_t used = data_block->buffer.size();
+    raw_block_capacity = std::max(needed, 2 * raw_block_capacity);
+    char* grown = new char[raw_block_capacity];
+    memcpy(grown, raw_block_buf, used);
+    delete[] raw_block_buf;
+    raw_block_buf = grown;
+    data_block->Reset_Buffer(grown, used);
+  }
+
   const Options& options;
   Options index_block_options;
   IO_type type_;
@@ -81,9 +118,17 @@ struct TableBuilder_Memoryside::Rep {
   // second, no buffer is outstanding, those two status will both have start - end = 1
   bool data_inuse_empty = true;
   //TODO: garbage collect all the local unused MR when destroyingnthis table builder.
+  // The chunks being filled, they are handed over to the table once full.
+  // No chunk is allocated to replace them after Finish().
   ibv_mr* local_data_mr;
   ibv_mr* local_index_mr;
   ibv_mr* local_filter_mr;
+  // Where the uncompressed data blocks are built when compression is on.
+  char* raw_block_buf = nullptr;
+  size_t raw_block_capacity = 0;
+  // The last finished data block, in its chunk.
+  Slice block_in_chunk;
+  uint64_t copied_bytes = 0;
   //TODO: make the map offset -> ibv_mr*
   std::map<uint32_t, ibv_mr*> local_data_mrs;
   std::map<uint32_t, ibv_mr*> local_dataindex_mrs;
@@ -126,9 +171,20 @@ TableBuilder_Memoryside::~TableBuilder_Memoryside() {
   if (rep_->filter_block != nullptr){
     delete rep_->filter_block;
   }
-  rep_->rdma_mg->Deallocate_Local_RDMA_Slot(rep_->local_data_mr->addr, FlushBuffer);
-  rep_->rdma_mg->Deallocate_Local_RDMA_Slot(rep_->local_index_mr->addr, FlushBuffer);
-  rep_->rdma_mg->Deallocate_Local_RDMA_Slot(rep_->local_filter_mr->addr, FilterChunk);
+  // Only an abandoned builder still holds chunks.
+  if (rep_->local_data_mr != nullptr) {
+    rep_->rdma_mg->Deallocate_Local_RDMA_Slot(rep_->local_data_mr->addr, FlushBuffer);
+    delete rep_->local_data_mr;
+  }
+  if (rep_->local_index_mr != nullptr) {
+    rep_->rdma_mg->Deallocate_Local_RDMA_Slot(rep_->local_index_mr->addr, FlushBuffer);
+    delete rep_->local_index_mr;
+  }
+  if (rep_->local_filter_mr != nullptr) {
+    rep_->rdma_mg->Deallocate_Local_RDMA_Slot(rep_->local_filter_mr->addr, FilterChunk);
+    delete rep_->local_filter_mr;
+  }
+  delete[] rep_->raw_block_buf;
 
 //  std::shared_ptr<RDMA_Manager> rdma_mg = rep_->rdma_mg;
 //  for(auto iter : rep_->local_data_mr){
@@ -182,9 +238,13 @@ void TableBuilder_Memoryside::Add(const Slice& key, const Slice& value) {
   // *   Second, if new block finished, check whether the write buffer can hold a new block size.
   // *           if not, the flush temporal buffer content to the remote memory.
   const size_t estimated_block_size = r->data_block->CurrentSizeEstimate();
-  if (estimated_block_size + key.size() + value.size() +sizeof(size_t) + kBlockTrailerSize >= r->options.block_size) {
+  // maximize added length to the block is key size + value size + restart point + shared, nonshared, valuesize
+  const size_t entry_size = key.size() + value.size() + sizeof(size_t) +
+                            3 * sizeof(uint32_t) + kBlockTrailerSize;
+  if (estimated_block_size + entry_size >= r->options.block_size) {
     UpdateFunctionBLock();
-    if (r->local_data_mr->length - (r->offset - r->offset_last_flushed) < r->options.block_size) {
+    if (r->local_data_mr->length - (r->offset - r->offset_last_flushed) <
+        r->BlockFootprint(entry_size)) {
       FlushData();
     }
   }
@@ -227,10 +287,13 @@ void TableBuilder_Memoryside::Add(const Slice& key, const Slice& value) {
 
   if (r->filter_block != nullptr) {
     r->filter_block->AddKey(ExtractUserKey(key));
+    r->filter_block->AddPrefix(ExtractUserKey(key));
+    r->filter_block->AddRangeKey(ExtractUserKey(key));
   }
 
   r->last_key.assign(key.data(), key.size());
   r->num_entries++;
+  r->ReserveRawBlock(entry_size);
   r->data_block->Add(key, value);
 
 
@@ -280,20 +343,25 @@ void TableBuilder_Memoryside::FinishDataBlock(BlockBuilder* block, BlockHandle*
       break;
     }
     case kSnappyCompression: {
-      std::string* compressed = &r->compressed_output;
-      if (port::Snappy_Compress(raw->data(), raw->size(), compressed) &&
-          compressed->size() < raw->size() - (raw->size() / 8u)) {
-        memcpy((void*)r->data_block->buffer.data(), (void*)compressed->data(), compressed->size());
-        block->Reset_Buffer(const_cast<char*>(r->data_block->buffer.data()),
-                            compressed->size());
-        block_contents = &r->data_block->buffer;
+      // The block was built in raw_block_buf, compress it to its place in
+      // the chunk.
+      char* dst = static_cast<char*>(r->local_data_mr->addr) +
+                  (r->offset - r->offset_last_flushed);
+      size_t compressed_size = 0;
+      if (port::Snappy_RawCompress(raw->data(), raw->size(), dst,
+                                   &compressed_size) &&
+          compressed_size < raw->size() - (raw->size() / 8u)) {
+        r->block_in_chunk = Slice(dst, compressed_size);
       } else {
         // Snappy not supported, or compressed less than 12.5%, so just
         // store uncompressed form
         assert(false);
-        block_contents = raw;
+        memcpy(dst, raw->data(), raw->size());
+        r->copied_bytes += raw->size();
+        r->block_in_chunk = Slice(dst, raw->size());
         compressiontype = kNoCompression;
       }
+      block_contents = &r->block_in_chunk;
       break;
     }
   }
@@ -303,7 +371,6 @@ void TableBuilder_Memoryside::FinishDataBlock(BlockBuilder* block, BlockHandle*
   //#endif
   handle->set_offset(r->offset);// This is the offset of the begginning of this block.
   handle->set_size(block_contents->size());
-  assert(block_contents->size() <= r->options.block_size - kBlockTrailerSize);
   if (r->status.ok()) {
     char trailer[kBlockTrailerSize];
     trailer[0] = compressiontype;
@@ -329,6 +396,9 @@ void TableBuilder_Memoryside::FinishDataBlock(BlockBuilder* block, BlockHandle*
 //           buf[5], buf[6], buf[7], block_contents->size() - 5);
 //  }
   block->Reset_Forward();
+  if (r->raw_block_buf != nullptr) {
+    block->Move_buffer(r->raw_block_buf);
+  }
 }
 void TableBuilder_Memoryside::FinishDataIndexBlock(BlockBuilder* block,
                                         BlockHandle* handle,
@@ -431,9 +501,15 @@ void TableBuilder_Memoryside::FlushData(){
   r->local_data_mr->length = r->offset - r->offset_last_flushed;
   r->local_data_mrs.insert({r->offset, r->local_data_mr});
   r->offset_last_flushed = r->offset;
+  if (r->closed) {
+    r->local_data_mr = nullptr;
+    return;
+  }
   r->local_data_mr = new ibv_mr();
   r->rdma_mg->Allocate_Local_RDMA_Slot(*r->local_data_mr, FlushBuffer);
-  r->data_block->Move_buffer((char*)r->local_data_mr->addr);
+  if (r->raw_block_buf == nullptr) {
+    r->data_block->Move_buffer((char*)r->local_data_mr->addr);
+  }
   //  DEBUG_arg("In use start is %d\n", r->data_inuse_start);
   //  DEBUG_arg("In use end is %d\n", r->data_inuse_end);
   //  DEBUG_arg("Next write buffer to use %d\n", next_buffer_index);
@@ -452,6 +528,10 @@ void TableBuilder_Memoryside::FlushDataIndex(size_t msg_size) {
   //TOFIX: the index may overflow and need to create a new index write buffer, otherwise
   // it would be overwrited.
   //  DEBUG_arg("Index block size is %zu", msg_size);
+  if (r->closed) {
+    r->local_index_mr = nullptr;
+    return;
+  }
   r->local_index_mr = new ibv_mr();
   r->rdma_mg->Allocate_Local_RDMA_Slot(*r->local_index_mr, FlushBuffer);
 
@@ -465,6 +545,10 @@ void TableBuilder_Memoryside::FlushFilter(size_t& msg_size) {
   r->local_filter_mrs.insert({r->offset, r->local_filter_mr});
   //TOFIX: the index may overflow and need to create a new index write buffer, otherwise
   // it would be overwrited.
+  if (r->closed) {
+    r->local_filter_mr = nullptr;
+    return;
+  }
   r->local_filter_mr = new ibv_mr();
   r->rdma_mg->Allocate_Local_RDMA_Slot(*r->local_filter_mr, FilterChunk);
   r->filter_block->Move_buffer((char*)r->local_filter_mr->addr);
@@ -476,9 +560,11 @@ Status TableBuilder_Memoryside::status() const { return rep_->status; }
 Status TableBuilder_Memoryside::Finish() {
   Rep* r = rep_;
   UpdateFunctionBLock();
-  FlushData();
   assert(!r->closed);
+  // Closed before the last flushes, so that they hand over the chunks without
+  // allocating new ones.
   r->closed = true;
+  FlushData();
   DEBUG_arg("sst offset is %lu\n", r->offset);
   BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
 
@@ -555,4 +641,12 @@ void TableBuilder_Memoryside::get_filter_map(std::map<uint32_t, ibv_mr*>& map) {
 size_t TableBuilder_Memoryside::get_numentries() {
   return rep_->num_entries;
 }
+uint64_t TableBuilder_Memoryside::CopiedBytes() const {
+  return rep_->copied_bytes;
+}
+void TableBuilder_Memoryside::SetFilterBitsPerKey(int bits_per_key) {
+  if (rep_->filter_block != nullptr) {
+    rep_->filter_block->SetBitsPerKey(bits_per_key);
+  }
+}
 }
\ No newline at end of file
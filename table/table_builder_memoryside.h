@@ -74,6 +74,8 @@ class TimberSaw_EXPORT TableBuilder_Memoryside : public TableBuilder {
   void get_dataindexblocks_map(std::map<uint32_t, ibv_mr*>& map) override;
   void get_filter_map(std::map<uint32_t, ibv_mr*>& map) override;
   size_t get_numentries() override;
+  uint64_t CopiedBytes() const override;
+  void SetFilterBitsPerKey(int bits_per_key) override;
 
   bool ok() const override { return status().ok(); }
   void FinishDataBlock(BlockBuilder* block, BlockHandle* handle,
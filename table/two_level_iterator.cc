@@ -13,10 +13,12 @@ namespace TimberSaw {
 
 TwoLevelIterator::TwoLevelIterator(Iterator* index_iter,
                                    BlockFunction block_function, void* arg,
-                                   const ReadOptions& options)
+                                   const ReadOptions& options,
+                                   const IterateBound& bound)
     : block_function_(block_function),
       arg_(arg),
       options_(options),
+      bound_(bound),
       index_iter_(index_iter),
       data_iter_(nullptr) {}
 
@@ -25,6 +27,7 @@ TwoLevelIterator::~TwoLevelIterator() {
 };
 
 void TwoLevelIterator::Seek(const Slice& target) {
+  bound_.SetSeekTarget(target);
   index_iter_.Seek(target);
   InitDataBlock();
   if (data_iter_.iter() != nullptr) {
@@ -36,7 +39,23 @@ void TwoLevelIterator::Seek(const Slice& target) {
   SkipEmptyDataBlocksForward();
 }
 
+void TwoLevelIterator::SeekForPrev(const Slice& target) {
+  bound_.ClearSeekTarget();
+  index_iter_.Seek(target);
+  if (!index_iter_.Valid()) {
+    // Every entry is before target.
+    SeekToLast();
+    return;
+  }
+  InitDataBlock();
+  if (data_iter_.iter() != nullptr) {
+    data_iter_.SeekForPrev(target);
+  }
+  SkipEmptyDataBlocksBackward();
+}
+
 void TwoLevelIterator::SeekToFirst() {
+  bound_.ClearSeekTarget();
   index_iter_.SeekToFirst();
   InitDataBlock();
   if (data_iter_.iter() != nullptr) {
@@ -50,6 +69,7 @@ void TwoLevelIterator::SeekToFirst() {
 }
 
 void TwoLevelIterator::SeekToLast() {
+  bound_.ClearSeekTarget();
   index_iter_.SeekToLast();
   InitDataBlock();
   if (data_iter_.iter() != nullptr){
@@ -90,6 +110,11 @@ void TwoLevelIterator::SkipEmptyDataBlocksForward() {
 //      valid_ = false;
       return;
     }
+    if (bound_.Exhausted(index_iter_.key())) {
+      // The next blocks are past the bound, do not read them.
+      SetDataIterator(nullptr);
+      return;
+    }
 #ifndef NDEBUG
 //    printf("two level iterator index iterator move forward. the data iter to be replaced is %p\n", data_iter_.iter());
 #endif
@@ -155,10 +180,12 @@ void TwoLevelIterator::InitDataBlock() {
 
 TwoLevelFileIterator::TwoLevelFileIterator(Version::LevelFileNumIterator* index_iter,
                                                  FileFunction file_function, void* arg,
-                                   const ReadOptions& options)
+                                   const ReadOptions& options,
+                                   const IterateBound& bound)
     : file_function_(file_function),
       arg_(arg),
       options_(options),
+      bound_(bound),
       index_iter_(index_iter),
       data_iter_(nullptr) {}
 
@@ -167,6 +194,7 @@ TwoLevelFileIterator::~TwoLevelFileIterator() {
 };
 
 void TwoLevelFileIterator::Seek(const Slice& target) {
+  bound_.SetSeekTarget(target);
   index_iter_.Seek(target);
   InitDataBlock();
   if (data_iter_.iter() != nullptr ) {
@@ -177,7 +205,23 @@ void TwoLevelFileIterator::Seek(const Slice& target) {
   SkipEmptyDataBlocksForward();
 }
 
+void TwoLevelFileIterator::SeekForPrev(const Slice& target) {
+  bound_.ClearSeekTarget();
+  index_iter_.Seek(target);
+  if (!index_iter_.Valid()) {
+    // Every entry is before target.
+    SeekToLast();
+    return;
+  }
+  InitDataBlock();
+  if (data_iter_.iter() != nullptr) {
+    data_iter_.SeekForPrev(target);
+  }
+  SkipEmptyDataBlocksBackward();
+}
+
 void TwoLevelFileIterator::SeekToFirst() {
+  bound_.ClearSeekTarget();
   index_iter_.SeekToFirst();
   InitDataBlock();
   if (data_iter_.iter() != nullptr ) {
@@ -192,6 +236,7 @@ void TwoLevelFileIterator::SeekToFirst() {
 }
 
 void TwoLevelFileIterator::SeekToLast() {
+  bound_.ClearSeekTarget();
   index_iter_.SeekToLast();
   InitDataBlock();
   // valid_ means data_iter_.iter() != nullpt
@@ -225,6 +270,12 @@ void TwoLevelFileIterator::SkipEmptyDataBlocksForward() {
 //      valid_ = false;
       return;
     }
+    if (bound_.Exhausted(index_iter_.key())) {
+      // The key of a file is its largest one, the next files are past the
+      // bound: do not open them.
+      SetDataIterator(nullptr);
+      return;
+    }
     DEBUG_arg("two level file iterator index iterator move forward. the data iter to be replaced is %p\n", data_iter_.iter());
     index_iter_.Next();
     InitDataBlock();
@@ -277,13 +328,16 @@ void TwoLevelFileIterator::InitDataBlock() {
 }  // namespace
 Iterator* NewTwoLevelIterator(Iterator* index_iter,
                               BlockFunction block_function, void* arg,
-                              const ReadOptions& options) {
-  return new TwoLevelIterator(index_iter, block_function, arg, options);
+                              const ReadOptions& options,
+                              const IterateBound& bound) {
+  return new TwoLevelIterator(index_iter, block_function, arg, options, bound);
 }
 Iterator* NewTwoLevelFileIterator(Version::LevelFileNumIterator* index_iter,
                                   FileFunction file_function, void* arg,
-                              const ReadOptions& options) {
-  return new TwoLevelFileIterator(index_iter, file_function, arg, options);
+                              const ReadOptions& options,
+                              const IterateBound& bound) {
+  return new TwoLevelFileIterator(index_iter, file_function, arg, options,
+                                  bound);
 }
 
 }  // namespace TimberSaw
@@ -12,6 +12,7 @@
 #include "TimberSaw/table.h"
 #include "table/block.h"
 #include "table/format.h"
+#include "table/iterate_bound.h"
 #include "table/iterator_wrapper.h"
 namespace TimberSaw {
 
@@ -98,16 +99,20 @@ class FileIteratorWrapper {
 //
 // Uses a supplied function to convert an index_iter value into
 // an iterator over the contents of the corresponding block.
+//
+// The iterator does not move to the next block once "bound" is exhausted.
 typedef Iterator* (*BlockFunction)(void*, const ReadOptions&, const Slice&);
 typedef Iterator* (*FileFunction)(void*, const ReadOptions&, std::shared_ptr<RemoteMemTableMetaData> remote_table);
 class TwoLevelIterator : public Iterator {
  public:
   TwoLevelIterator(Iterator* index_iter, BlockFunction block_function,
-                   void* arg, const ReadOptions& options);
+                   void* arg, const ReadOptions& options,
+                   const IterateBound& bound = IterateBound());
 
   ~TwoLevelIterator() override;
 
   void Seek(const Slice& target) override;
+  void SeekForPrev(const Slice& target) override;
   void SeekToFirst() override;
   void SeekToLast() override;
   void Next() override;
@@ -149,6 +154,7 @@ class TwoLevelIterator : public Iterator {
   BlockFunction block_function_;
   void* arg_;
   const ReadOptions options_;
+  IterateBound bound_;
   Status status_;
   IteratorWrapper index_iter_;
   IteratorWrapper data_iter_;  // May be nullptr
@@ -166,11 +172,13 @@ class TwoLevelIterator : public Iterator {
 class TwoLevelFileIterator : public Iterator {
  public:
   TwoLevelFileIterator(Version::LevelFileNumIterator* index_iter, FileFunction file_function,
-                       void* arg, const ReadOptions& options);
+                       void* arg, const ReadOptions& options,
+                       const IterateBound& bound = IterateBound());
 
   ~TwoLevelFileIterator() override;
 
   void Seek(const Slice& target) override;
+  void SeekForPrev(const Slice& target) override;
   void SeekToFirst() override;
   void SeekToLast() override;
   void Next() override;
@@ -208,6 +216,7 @@ class TwoLevelFileIterator : public Iterator {
   FileFunction file_function_;
   void* arg_;
   const ReadOptions options_;
+  IterateBound bound_;
   Status status_;
   FileIteratorWrapper index_iter_;
   IteratorWrapper data_iter_;  // May be nullptr
@@ -220,13 +229,15 @@ Iterator* NewTwoLevelIterator(
     Iterator* index_iter,
     Iterator* (*block_function)(void* arg, const ReadOptions& options,
                                 const Slice& index_value),
-    void* arg, const ReadOptions& options);
+    void* arg, const ReadOptions& options,
+    const IterateBound& bound = IterateBound());
 
 Iterator* NewTwoLevelFileIterator(
     Version::LevelFileNumIterator* index_iter,
     Iterator* (*FileFunction)(void* arg, const ReadOptions& options,
                               std::shared_ptr<RemoteMemTableMetaData>),
-    void* arg, const ReadOptions& options);
+    void* arg, const ReadOptions& options,
+    const IterateBound& bound = IterateBound());
 }  // namespace TimberSaw
 
 #endif  // STORAGE_TimberSaw_TABLE_TWO_LEVEL_ITERATOR_H_
@@ -42,15 +42,24 @@ size_t OptimizeBlockSize(size_t block_size) {
   return block_size;
 }
 
-Arena::Arena(size_t block_size, AllocTracker* tracker, size_t huge_page_size)
-    : kBlockSize(OptimizeBlockSize(block_size)), tracker_(tracker) {
+Arena::Arena(size_t block_size, AllocTracker* tracker, size_t huge_page_size,
+             RDMA_Manager* rdma_mg)
+    : kBlockSize(OptimizeBlockSize(block_size)),
+      tracker_(tracker),
+      rdma_mg_(rdma_mg) {
   assert(kBlockSize >= kMinBlockSize && kBlockSize <= kMaxBlockSize &&
          kBlockSize % kAlignUnit == 0);
 //  TEST_SYNC_POINT_CALLBACK("Arena::Arena:0", const_cast<size_t*>(&kBlockSize));
-  alloc_bytes_remaining_ = sizeof(inline_block_);
-  blocks_memory_ += alloc_bytes_remaining_;
-  aligned_alloc_ptr_ = inline_block_;
-  unaligned_alloc_ptr_ = inline_block_ + alloc_bytes_remaining_;
+  // The inline block lives in the arena object, it is not registered.
+  if (rdma_mg_ == nullptr) {
+    alloc_bytes_remaining_ = sizeof(inline_block_);
+    blocks_memory_ += alloc_bytes_remaining_;
+    aligned_alloc_ptr_ = inline_block_;
+    unaligned_alloc_ptr_ = inline_block_ + alloc_bytes_remaining_;
+  } else {
+    region_ptr_ = AllocateRegion(kRegionBlocks * kBlockSize);
+    region_remaining_ = kRegionBlocks * kBlockSize;
+  }
 #ifdef MAP_HUGETLB
   hugetlb_size_ = huge_page_size;
   if (hugetlb_size_ && kBlockSize > hugetlb_size_) {
@@ -69,6 +78,9 @@ Arena::~Arena() {
 //    assert(tracker_->is_freed());
 //    tracker_->FreeMem();
 //  }
+  for (const auto& registration : registrations_) {
+    rdma_mg_->Deregister_Local_Buffer(registration.second);
+  }
   for (const auto& block : blocks_) {
     delete[] block;
   }
@@ -143,6 +155,7 @@ char* Arena::AllocateFromHugePage(size_t bytes) {
   }
   huge_blocks_.back() = MmapInfo(addr, bytes);
   blocks_memory_ += bytes;
+  Register(reinterpret_cast<char*>(addr), bytes);
 //  if (tracker_ != nullptr) {
 //    tracker_->Allocate(bytes);
 //  }
@@ -198,6 +211,9 @@ char* Arena::AllocateAligned(size_t bytes, size_t huge_page_size,
 }
 
 char* Arena::AllocateNewBlock(size_t block_bytes) {
+  if (rdma_mg_ != nullptr) {
+    return AllocateRegisteredBlock(block_bytes);
+  }
   // Reserve space in `blocks_` before allocating memory via new.
   // Use `emplace_back()` instead of `reserve()` to let std::vector manage its
   // own memory and do fewer reallocations.
@@ -226,7 +242,61 @@ char* Arena::AllocateNewBlock(size_t block_bytes) {
 //    tracker_->Allocate(allocated_size);
 //  }
   blocks_.back() = block;
+  Register(block, block_bytes);
   return block;
 }
 
+char* Arena::AllocateRegisteredBlock(size_t block_bytes) {
+  // Keep the next block aligned, AllocateFallback() relies on it.
+  block_bytes = (block_bytes + kAlignUnit - 1) / kAlignUnit * kAlignUnit;
+  const size_t region_bytes = kRegionBlocks * kBlockSize;
+  char* block;
+  if (block_bytes > region_bytes) {
+    // Too big for any region, give it one of its own and keep the current.
+    block = AllocateRegion(block_bytes);
+  } else {
+    if (block_bytes > region_remaining_) {
+      // The tail of the current region is wasted.
+      region_ptr_ = AllocateRegion(region_bytes);
+      region_remaining_ = region_bytes;
+    }
+    block = region_ptr_;
+    region_ptr_ += block_bytes;
+    region_remaining_ -= block_bytes;
+  }
+  // Only the carved part counts, the rest of the region is not used yet.
+  blocks_memory_ += block_bytes;
+  return block;
+}
+
+char* Arena::AllocateRegion(size_t region_bytes) {
+  blocks_.emplace_back(nullptr);
+  char* region = new char[region_bytes];
+  blocks_.back() = region;
+  Register(region, region_bytes);
+  return region;
+}
+
+void Arena::Register(char* block, size_t block_bytes) {
+  if (rdma_mg_ == nullptr) {
+    return;
+  }
+  // A block the device refuses is left unregistered, its data is copied
+  // before it is written.
+  ibv_mr* mr = rdma_mg_->Register_Local_Buffer(block, block_bytes);
+  if (mr != nullptr) {
+    registrations_.emplace(block, mr);
+  }
+}
+
+ibv_mr* Arena::FindRegistration(const char* data, size_t n) const {
+  auto it = registrations_.upper_bound(data);
+  if (it == registrations_.begin()) {
+    return nullptr;
+  }
+  --it;
+  const char* start = static_cast<const char*>(it->second->addr);
+  return data + n <= start + it->second->length ? it->second : nullptr;
+}
+
 }  // namespace ROCKSDB_NAMESPACE
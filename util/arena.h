@@ -19,14 +19,19 @@
 #include <cerrno>
 #include <cstddef>
 #include <stdint.h>
+#include <map>
 #include <vector>
 
 #include "util/mutexlock.h"
 
 #include "util/allocator.h"
 
+struct ibv_mr;
+
 namespace TimberSaw {
 
+class RDMA_Manager;
+
 class Arena : public Allocator {
  public:
   // No copying allowed
@@ -36,12 +41,20 @@ class Arena : public Allocator {
   static const size_t kInlineSize = 2048;
   static const size_t kMinBlockSize;
   static const size_t kMaxBlockSize;
+  static const size_t kRegionBlocks = 16;
 
   // huge_page_size: if 0, don't use huge page TLB. If > 0 (should set to the
   // supported hugepage size of the system), block allocation will try huge
   // page TLB first. If allocation fails, will fall back to normal case.
+  //
+  // rdma_mg: if not nullptr, the blocks are carved from regions of
+  // kRegionBlocks blocks, each registered once with its device, so that the
+  // allocated memory can be the source of RDMA writes (see
+  // FindRegistration()). The first region is registered here, off the
+  // allocation path. The inline block is not used then.
   explicit Arena(size_t block_size = kMinBlockSize,
-                 AllocTracker* tracker = nullptr, size_t huge_page_size = 0);
+                 AllocTracker* tracker = nullptr, size_t huge_page_size = 0,
+                 RDMA_Manager* rdma_mg = nullptr);
   ~Arena();
 
   char* Allocate(size_t bytes) override;
@@ -83,6 +96,10 @@ class Arena : public Allocator {
     return blocks_.empty();
   }
 
+  // The registration of the block holding [data, data + n), nullptr if the
+  // range is not in one registered block.
+  ibv_mr* FindRegistration(const char* data, size_t n) const;
+
  private:
   char inline_block_[kInlineSize] __attribute__((__aligned__(alignof(max_align_t))));
   // Number of bytes allocated in one block
@@ -116,10 +133,19 @@ class Arena : public Allocator {
   char* AllocateFromHugePage(size_t bytes);
   char* AllocateFallback(size_t bytes, bool aligned);
   char* AllocateNewBlock(size_t block_bytes);
+  char* AllocateRegisteredBlock(size_t block_bytes);
+  char* AllocateRegion(size_t region_bytes);
+  void Register(char* block, size_t block_bytes);
 
   // Bytes of memory in blocks allocated so far
   size_t blocks_memory_ = 0;
   AllocTracker* tracker_;
+  RDMA_Manager* const rdma_mg_;
+  // The unused part of the current registered region.
+  char* region_ptr_ = nullptr;
+  size_t region_remaining_ = 0;
+  // The registrations of the regions, by the region start.
+  std::map<const char*, ibv_mr*> registrations_;
 };
 
 inline char* Arena::Allocate(size_t bytes) {
@@ -34,6 +34,10 @@ namespace {
 //   removed the check, elements that would otherwise be on this list could be
 //   left as disconnected singleton lists.)
 // - LRU:  contains the items not currently referenced by clients, in LRU order
+// - high priority LRU:  like LRU, for the items inserted with a high priority
+//   while the high priority pool has room for them. The oldest ones move to
+//   the LRU list when the pool overflows, the eviction takes the LRU list
+//   first.
 // Elements are moved between these lists by the Ref() and Unref() methods,
 // when they detect an element in the table_cache acquiring or losing its only
 // external reference.
@@ -49,6 +53,8 @@ struct LRUHandle {
   size_t charge;  // TODO(opt): Only allow uint32_t?
   size_t key_length;
   bool in_cache;     // Whether entry is in the table_cache.
+  bool high_pri;     // Whether entry was inserted with a high priority.
+  bool in_high_pri_pool;  // Whether entry is on the high priority LRU list.
   uint32_t refs;     // References, including table_cache reference, if present.
   uint32_t hash;     // Hash of key(); used for fast sharding and comparisons
   char key_data[1];  // Beginning of key
@@ -156,12 +162,16 @@ class LRUCache {
   ~LRUCache();
 
   // Separate from constructor so caller can easily make an array of LRUCache
-  void SetCapacity(size_t capacity) { capacity_ = capacity; }
+  void SetCapacity(size_t capacity, double high_pri_pool_ratio) {
+    capacity_ = capacity;
+    high_pri_capacity_ = static_cast<size_t>(capacity * high_pri_pool_ratio);
+  }
 
   // Like Cache methods, but with an extra "hash" parameter.
   Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
                         size_t charge,
-                        void (*deleter)(const Slice& key, void* value));
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
   Cache::Handle* Lookup(const Slice& key, uint32_t hash);
   void Release(Cache::Handle* handle);
   void Erase(const Slice& key, uint32_t hash);
@@ -177,20 +187,32 @@ class LRUCache {
   void LRU_Append(LRUHandle* list, LRUHandle* e);
   void Ref(LRUHandle* e);
   void Unref(LRUHandle* e);
+  // Put an entry no longer in use on the LRU list of its priority.
+  void LRU_Insert(LRUHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Move the oldest high priority entries to the LRU list until the high
+  // priority pool fits in its capacity.
+  void MaintainPoolSize() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   bool FinishErase(LRUHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   // Initialized before use.
   size_t capacity_;
+  size_t high_pri_capacity_;
 
   // mutex_ protects the following state.
   mutable SpinMutex mutex_;
   size_t usage_ GUARDED_BY(mutex_);
+  // The charges of the entries on lru_high_.
+  size_t high_pri_usage_ GUARDED_BY(mutex_);
 
   // Dummy head of LRU list.
   // lru.prev is newest entry, lru.next is oldest entry.
   // Entries have refs==1 and in_cache==true.
   LRUHandle lru_ GUARDED_BY(mutex_);
 
+  // Dummy head of high priority LRU list, ordered like lru_.
+  // Entries have refs==1, in_cache==true and in_high_pri_pool==true.
+  LRUHandle lru_high_ GUARDED_BY(mutex_);
+
   // Dummy head of in-use list.
   // Entries are in use by clients, and have refs >= 2 and in_cache==true.
   LRUHandle in_use_ GUARDED_BY(mutex_);
@@ -198,23 +220,28 @@ class LRUCache {
   HandleTable table_ GUARDED_BY(mutex_);
 };
 
-LRUCache::LRUCache() : capacity_(0), usage_(0) {
+LRUCache::LRUCache()
+    : capacity_(0), high_pri_capacity_(0), usage_(0), high_pri_usage_(0) {
   // Make empty circular linked lists.
   lru_.next = &lru_;
   lru_.prev = &lru_;
+  lru_high_.next = &lru_high_;
+  lru_high_.prev = &lru_high_;
   in_use_.next = &in_use_;
   in_use_.prev = &in_use_;
 }
 
 LRUCache::~LRUCache() {
   assert(in_use_.next == &in_use_);  // Error if caller has an unreleased handle
-  for (LRUHandle* e = lru_.next; e != &lru_;) {
-    LRUHandle* next = e->next;
-    assert(e->in_cache);
-    e->in_cache = false;
-    assert(e->refs == 1);  // Invariant of lru_ list.
-    Unref(e);
-    e = next;
+  for (LRUHandle* list : {&lru_, &lru_high_}) {
+    for (LRUHandle* e = list->next; e != list;) {
+      LRUHandle* next = e->next;
+      assert(e->in_cache);
+      e->in_cache = false;
+      assert(e->refs == 1);  // Invariant of lru_ list.
+      Unref(e);
+      e = next;
+    }
   }
 }
 
@@ -236,13 +263,36 @@ void LRUCache::Unref(LRUHandle* e) {
   } else if (e->in_cache && e->refs == 1) {
     // No longer in use; move to lru_ list.
     LRU_Remove(e);
+    LRU_Insert(e);
+  }
+}
+
+void LRUCache::LRU_Insert(LRUHandle* e) {
+  if (e->high_pri && high_pri_capacity_ > 0) {
+    LRU_Append(&lru_high_, e);
+    e->in_high_pri_pool = true;
+    high_pri_usage_ += e->charge;
+    MaintainPoolSize();
+  } else {
     LRU_Append(&lru_, e);
   }
 }
 
+void LRUCache::MaintainPoolSize() {
+  while (high_pri_usage_ > high_pri_capacity_ && lru_high_.next != &lru_high_) {
+    LRUHandle* old = lru_high_.next;
+    LRU_Remove(old);
+    LRU_Append(&lru_, old);
+  }
+}
+
 void LRUCache::LRU_Remove(LRUHandle* e) {
   e->next->prev = e->prev;
   e->prev->next = e->next;
+  if (e->in_high_pri_pool) {
+    e->in_high_pri_pool = false;
+    high_pri_usage_ -= e->charge;
+  }
 }
 
 void LRUCache::LRU_Append(LRUHandle* list, LRUHandle* e) {
@@ -275,7 +325,8 @@ void LRUCache::Release(Cache::Handle* handle) {
 Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
                                 size_t charge,
                                 void (*deleter)(const Slice& key,
-                                                void* value)) {
+                                                void* value),
+                                Cache::Priority priority) {
 //  MutexLock l(&mutex_);
   SpinLock l(&mutex_);
   LRUHandle* e =
@@ -286,6 +337,8 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
   e->key_length = key.size();
   e->hash = hash;
   e->in_cache = false;
+  e->high_pri = priority == Cache::Priority::kHigh;
+  e->in_high_pri_pool = false;
   e->refs = 1;  // for the returned handle.
   std::memcpy(e->key_data, key.data(), key.size());
 
@@ -300,9 +353,11 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
     e->next = nullptr;
   }
 //  printf("Cache capacity is %zu, usage is %zu", capacity_, usage_);
-  // This will remove some entry from LRU if the table_cache over size.
-  while (usage_ > capacity_ && lru_.next != &lru_) {
-    LRUHandle* old = lru_.next;
+  // This will remove some entry from LRU if the table_cache over size. The
+  // high priority entries go last.
+  while (usage_ > capacity_ &&
+         (lru_.next != &lru_ || lru_high_.next != &lru_high_)) {
+    LRUHandle* old = lru_.next != &lru_ ? lru_.next : lru_high_.next;
     assert(old->refs == 1);
 //    printf("Remove entry whose key is %s", old->key().data());
     bool erased = FinishErase(table_.Remove(old->key(), old->hash));
@@ -337,12 +392,14 @@ void LRUCache::Erase(const Slice& key, uint32_t hash) {
 void LRUCache::Prune() {
 //  MutexLock l(&mutex_);
   SpinLock l(&mutex_);
-  while (lru_.next != &lru_) {
-    LRUHandle* e = lru_.next;
-    assert(e->refs == 1);
-    bool erased = FinishErase(table_.Remove(e->key(), e->hash));
-    if (!erased) {  // to avoid unused variable when compiled NDEBUG
-      assert(erased);
+  for (LRUHandle* list : {&lru_, &lru_high_}) {
+    while (list->next != list) {
+      LRUHandle* e = list->next;
+      assert(e->refs == 1);
+      bool erased = FinishErase(table_.Remove(e->key(), e->hash));
+      if (!erased) {  // to avoid unused variable when compiled NDEBUG
+        assert(erased);
+      }
     }
   }
 }
@@ -363,11 +420,12 @@ class ShardedLRUCache : public Cache {
   static uint32_t Shard(uint32_t hash) { return hash >> (32 - kNumShardBits); }
 
  public:
-  explicit ShardedLRUCache(size_t capacity) : last_id_(0) {
+  ShardedLRUCache(size_t capacity, double high_pri_pool_ratio)
+      : last_id_(0) {
     const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
     capacity_ = capacity;
     for (int s = 0; s < kNumShards; s++) {
-      shard_[s].SetCapacity(per_shard);
+      shard_[s].SetCapacity(per_shard, high_pri_pool_ratio);
     }
   }
   ~ShardedLRUCache() override {}
@@ -375,9 +433,11 @@ class ShardedLRUCache : public Cache {
       return capacity_;
   }
   Handle* Insert(const Slice& key, void* value, size_t charge,
-                 void (*deleter)(const Slice& key, void* value)) override {
+                 void (*deleter)(const Slice& key, void* value),
+                 Priority priority) override {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                      priority);
   }
   Handle* Lookup(const Slice& key) override {
     const uint32_t hash = HashSlice(key);
@@ -414,6 +474,8 @@ class ShardedLRUCache : public Cache {
 
 }  // end anonymous namespace
 
-Cache* NewLRUCache(size_t capacity) { return new ShardedLRUCache(capacity); }
+Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio) {
+  return new ShardedLRUCache(capacity, high_pri_pool_ratio);
+}
 
 }  // namespace TimberSaw
@@ -8,6 +8,7 @@
 
 #include "gtest/gtest.h"
 #include "util/coding.h"
+#include "util/hash.h"
 
 namespace TimberSaw {
 
@@ -59,7 +60,29 @@ class CacheTest : public testing::Test {
                           &CacheTest::Deleter);
   }
 
+  void InsertHighPri(int key, int value, int charge = 1) {
+    cache_->Release(cache_->Insert(EncodeKey(key), EncodeValue(value), charge,
+                                   &CacheTest::Deleter,
+                                   Cache::Priority::kHigh));
+  }
+
   void Erase(int key) { cache_->Erase(EncodeKey(key)); }
+
+  // The first "n" keys from "start" that land in the shard of "start", so
+  // that the per-shard capacity is the one that evicts them.
+  static std::vector<int> SameShardKeys(int start, int n) {
+    auto shard = [](int k) {
+      const std::string key = EncodeKey(k);
+      return Hash(key.data(), key.size(), 0) >> (32 - 6);
+    };
+    std::vector<int> keys;
+    for (int k = start; static_cast<int>(keys.size()) < n; k++) {
+      if (shard(k) == shard(start)) {
+        keys.push_back(k);
+      }
+    }
+    return keys;
+  }
   static CacheTest* current_;
 };
 CacheTest* CacheTest::current_;
@@ -221,6 +244,57 @@ TEST_F(CacheTest, ZeroSizeCache) {
   ASSERT_EQ(-1, Lookup(1));
 }
 
+TEST_F(CacheTest, HighPriPoolSurvivesLowPriChurn) {
+  // 64 shards of 4 entries each, half of them reserved for high priority.
+  delete cache_;
+  cache_ = NewLRUCache(64 * 4, 0.5);
+  const std::vector<int> keys = SameShardKeys(1, 20);
+
+  InsertHighPri(keys[0], 100);
+  InsertHighPri(keys[1], 101);
+  for (int i = 2; i < 20; i++) {
+    Insert(keys[i], 100 + i);
+  }
+  ASSERT_EQ(100, Lookup(keys[0]));
+  ASSERT_EQ(101, Lookup(keys[1]));
+  // The low priority entries only had the rest of the shard.
+  ASSERT_EQ(119, Lookup(keys[19]));
+  ASSERT_EQ(118, Lookup(keys[18]));
+  ASSERT_EQ(-1, Lookup(keys[17]));
+}
+
+TEST_F(CacheTest, HighPriPoolOverflowAgesOut) {
+  delete cache_;
+  cache_ = NewLRUCache(64 * 4, 0.5);
+  const std::vector<int> keys = SameShardKeys(1, 20);
+
+  // The oldest of three high priority entries leaves the pool of two and
+  // is evicted like a low priority one.
+  InsertHighPri(keys[0], 100);
+  InsertHighPri(keys[1], 101);
+  InsertHighPri(keys[2], 102);
+  for (int i = 3; i < 20; i++) {
+    Insert(keys[i], 100 + i);
+  }
+  ASSERT_EQ(-1, Lookup(keys[0]));
+  ASSERT_EQ(101, Lookup(keys[1]));
+  ASSERT_EQ(102, Lookup(keys[2]));
+}
+
+TEST_F(CacheTest, NoHighPriPool) {
+  // Without a pool the priority is ignored.
+  delete cache_;
+  cache_ = NewLRUCache(64 * 4);
+  const std::vector<int> keys = SameShardKeys(1, 20);
+
+  InsertHighPri(keys[0], 100);
+  for (int i = 1; i < 20; i++) {
+    Insert(keys[i], 100 + i);
+  }
+  ASSERT_EQ(-1, Lookup(keys[0]));
+  ASSERT_EQ(119, Lookup(keys[19]));
+}
+
 }  // namespace TimberSaw
 
 int main(int argc, char** argv) {
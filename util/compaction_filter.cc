@@ -0,0 +1,56 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "TimberSaw/compaction_filter.h"
+
+#include <ctime>
+
+#include "util/coding.h"
+
+namespace TimberSaw {
+
+CompactionFilter::~CompactionFilter() = default;
+
+void EncodeExpiringValue(uint64_t expiry_unix_seconds, const Slice& value,
+                         std::string* dst) {
+  PutFixed64(dst, expiry_unix_seconds);
+  dst->append(value.data(), value.size());
+}
+
+bool DecodeExpiringValue(const Slice& stored, uint64_t* expiry_unix_seconds,
+                         Slice* value) {
+  if (stored.size() < sizeof(uint64_t)) {
+    return false;
+  }
+  *expiry_unix_seconds = DecodeFixed64(stored.data());
+  *value = Slice(stored.data() + sizeof(uint64_t),
+                 stored.size() - sizeof(uint64_t));
+  return true;
+}
+
+namespace {
+
+class ExpiryCompactionFilter : public CompactionFilter {
+ public:
+  const char* Name() const override { return "TimberSaw.ExpiryFilter"; }
+
+  Decision Filter(int /*level*/, const Slice& /*key*/, const Slice& value,
+                  std::string* /*new_value*/) const override {
+    uint64_t expiry;
+    Slice payload;
+    if (!DecodeExpiringValue(value, &expiry, &payload) || expiry == 0) {
+      return kKeep;
+    }
+    return expiry <= static_cast<uint64_t>(std::time(nullptr)) ? kRemove
+                                                                : kKeep;
+  }
+};
+
+}  // namespace
+
+const CompactionFilter* NewExpiryCompactionFilter() {
+  return new ExpiryCompactionFilter;
+}
+
+}  // namespace TimberSaw
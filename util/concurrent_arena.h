@@ -48,7 +48,8 @@ class ConcurrentArena : public Allocator {
   // that varies according to the hardware concurrency level.
   explicit ConcurrentArena(size_t block_size = Arena::kMinBlockSize,
                            AllocTracker* tracker = nullptr,
-                           size_t huge_page_size = 0);
+                           size_t huge_page_size = 0,
+                           RDMA_Manager* rdma_mg = nullptr);
 
   char* Allocate(size_t bytes) override {
     return AllocateImpl(bytes, false /*force_arena*/,
@@ -89,6 +90,12 @@ class ConcurrentArena : public Allocator {
 
   size_t BlockSize() const override { return arena_.BlockSize(); }
 
+  // See Arena::FindRegistration().
+  ibv_mr* FindRegistration(const char* data, size_t n) const {
+    std::unique_lock<SpinMutex> lock(arena_mutex_);
+    return arena_.FindRegistration(data, n);
+  }
+
  private:
   struct Shard {
     char padding[40] ROCKSDB_FIELD_UNUSED;
@@ -281,7 +281,7 @@ class PosixMmapReadableFile final : public RandomAccessFile {
   }
 
   Status Read(uint64_t offset, size_t n, Slice* result,
-              char* scratch) const override {
+              char* /*scratch*/) const override {
     if (offset + n > length_) {
       *result = Slice();
       return PosixError(filename_, EINVAL);
@@ -777,10 +777,10 @@ class PosixEnv : public Env {
 };
 
 // Return the maximum number of concurrent mmaps.
-static int MaxMmaps() { return g_mmap_limit; }
+[[maybe_unused]] static int MaxMmaps() { return g_mmap_limit; }
 
 // Return the maximum number of read-only files to keep open.
-static int MaxOpenFiles() {
+[[maybe_unused]] static int MaxOpenFiles() {
   if (g_open_read_only_file_limit >= 0) {
     return g_open_read_only_file_limit;
   }
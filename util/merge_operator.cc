@@ -0,0 +1,97 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "TimberSaw/merge_operator.h"
+
+#include "util/coding.h"
+
+namespace TimberSaw {
+
+MergeOperator::~MergeOperator() = default;
+
+bool MergeOperator::PartialMerge(const Slice& /*key*/, const Slice& /*left*/,
+                                 const Slice& /*right*/,
+                                 std::string* /*new_value*/) const {
+  return false;
+}
+
+namespace {
+
+class UInt64AddOperator : public MergeOperator {
+ public:
+  const char* Name() const override { return "TimberSaw.UInt64AddOperator"; }
+
+  bool FullMerge(const Slice& /*key*/, const Slice* existing_value,
+                 const std::vector<Slice>& operands,
+                 std::string* new_value) const override {
+    uint64_t sum = existing_value != nullptr ? Decode(*existing_value) : 0;
+    for (const Slice& operand : operands) {
+      sum += Decode(operand);
+    }
+    new_value->clear();
+    PutFixed64(new_value, sum);
+    return true;
+  }
+
+  bool PartialMerge(const Slice& /*key*/, const Slice& left,
+                    const Slice& right, std::string* new_value) const override {
+    new_value->clear();
+    PutFixed64(new_value, Decode(left) + Decode(right));
+    return true;
+  }
+
+ private:
+  static uint64_t Decode(const Slice& s) {
+    return s.size() == sizeof(uint64_t) ? DecodeFixed64(s.data()) : 0;
+  }
+};
+
+class StringAppendOperator : public MergeOperator {
+ public:
+  const char* Name() const override {
+    return "TimberSaw.StringAppendOperator";
+  }
+
+  bool FullMerge(const Slice& /*key*/, const Slice* existing_value,
+                 const std::vector<Slice>& operands,
+                 std::string* new_value) const override {
+    new_value->clear();
+    bool first = existing_value == nullptr;
+    if (!first) {
+      new_value->assign(existing_value->data(), existing_value->size());
+    }
+    for (const Slice& operand : operands) {
+      if (!first) {
+        new_value->push_back(',');
+      }
+      new_value->append(operand.data(), operand.size());
+      first = false;
+    }
+    return true;
+  }
+
+  bool PartialMerge(const Slice& /*key*/, const Slice& left,
+                    const Slice& right, std::string* new_value) const override {
+    new_value->assign(left.data(), left.size());
+    new_value->push_back(',');
+    new_value->append(right.data(), right.size());
+    return true;
+  }
+};
+
+}  // namespace
+
+const MergeOperator* NewMergeOperator(MergeOperatorType type) {
+  switch (type) {
+    case kUInt64AddOperator:
+      return new UInt64AddOperator;
+    case kStringAppendOperator:
+      return new StringAppendOperator;
+    case kNoMergeOperator:
+      break;
+  }
+  return nullptr;
+}
+
+}  // namespace TimberSaw
@@ -0,0 +1,150 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/rate_limiter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+namespace TimberSaw {
+
+RateLimiter::~RateLimiter() = default;
+
+uint64_t RateLimiterNowMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+namespace {
+
+// Token bucket refilled every refill period. A low priority request does not
+// take credits while a high priority one is waiting, so the flushes go first
+// whenever the bucket runs dry.
+class GenericRateLimiter : public RateLimiter {
+ public:
+  GenericRateLimiter(int64_t credits_per_second, int64_t refill_period_us)
+      : refill_period_us_(std::max<int64_t>(refill_period_us, 1000)),
+        max_credits_per_second_(std::max<int64_t>(credits_per_second, 1)),
+        credits_per_second_(max_credits_per_second_),
+        available_credits_(RefillCredits()),
+        next_refill_micros_(RateLimiterNowMicros() + refill_period_us_) {
+    for (int i = 0; i < kNumPriorities; i++) {
+      waiters_[i] = 0;
+      total_credits_[i] = 0;
+      total_wait_micros_[i] = 0;
+    }
+  }
+
+  void Request(int64_t credits, Priority pri) override {
+    while (credits > 0) {
+      // Requests above one refill are split, so that they can be served.
+      const int64_t piece = std::min(credits, RefillCredits());
+      const uint64_t start = RateLimiterNowMicros();
+      std::unique_lock<std::mutex> lck(mu_);
+      waiters_[pri]++;
+      while (true) {
+        Refill(RateLimiterNowMicros());
+        // The rate may have been lowered since the piece was cut, the bucket
+        // then runs into debt rather than never holding enough.
+        if (available_credits_ >= std::min(piece, RefillCredits()) &&
+            (pri == kHigh || waiters_[kHigh] == 0)) {
+          break;
+        }
+        cv_.wait_for(lck, std::chrono::microseconds(std::max<int64_t>(
+                              next_refill_micros_ - RateLimiterNowMicros(), 1)));
+      }
+      waiters_[pri]--;
+      available_credits_ -= piece;
+      total_credits_[pri].fetch_add(piece, std::memory_order_relaxed);
+      total_wait_micros_[pri].fetch_add(RateLimiterNowMicros() - start,
+                                        std::memory_order_relaxed);
+      if (pri == kHigh && waiters_[kHigh] == 0) {
+        // The low priority requests may go again.
+        cv_.notify_all();
+      }
+      credits -= piece;
+    }
+  }
+
+  void SetCreditsPerSecond(int64_t credits_per_second) override {
+    credits_per_second = std::min(std::max<int64_t>(credits_per_second, 1),
+                                  max_credits_per_second_);
+    credits_per_second_.store(credits_per_second, std::memory_order_relaxed);
+  }
+  int64_t GetCreditsPerSecond() const override {
+    return credits_per_second_.load(std::memory_order_relaxed);
+  }
+  int64_t GetMaxCreditsPerSecond() const override {
+    return max_credits_per_second_;
+  }
+  int64_t GetTotalCreditsThrough(Priority pri) const override {
+    return total_credits_[pri].load(std::memory_order_relaxed);
+  }
+  int64_t GetTotalWaitMicros(Priority pri) const override {
+    return total_wait_micros_[pri].load(std::memory_order_relaxed);
+  }
+
+ private:
+  int64_t RefillCredits() const {
+    return std::max<int64_t>(
+        GetCreditsPerSecond() * refill_period_us_ / 1000000, 1);
+  }
+
+  // REQUIRES: mu_ held.
+  void Refill(uint64_t now) {
+    if (static_cast<int64_t>(now) < next_refill_micros_) {
+      return;
+    }
+    const int64_t periods =
+        (static_cast<int64_t>(now) - next_refill_micros_) / refill_period_us_ +
+        1;
+    // An idle bucket holds at most one refill.
+    available_credits_ = std::min(available_credits_ + periods * RefillCredits(),
+                                  RefillCredits());
+    next_refill_micros_ += periods * refill_period_us_;
+    cv_.notify_all();
+  }
+
+  const int64_t refill_period_us_;
+  const int64_t max_credits_per_second_;
+  std::atomic<int64_t> credits_per_second_;
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  int64_t available_credits_;
+  int64_t next_refill_micros_;
+  int waiters_[kNumPriorities];
+
+  std::atomic<int64_t> total_credits_[kNumPriorities];
+  std::atomic<int64_t> total_wait_micros_[kNumPriorities];
+};
+
+}  // namespace
+
+RateLimiter* NewGenericRateLimiter(int64_t credits_per_second,
+                                   int64_t refill_period_us) {
+  return new GenericRateLimiter(credits_per_second, refill_period_us);
+}
+
+CompactionPacer::CompactionPacer(RateLimiter* io, RateLimiter* cpu)
+    : io_(io), cpu_(cpu), last_charge_micros_(RateLimiterNowMicros()) {}
+
+void CompactionPacer::Charge() {
+  if (io_ != nullptr && pending_bytes_ > 0) {
+    io_->Request(static_cast<int64_t>(pending_bytes_), RateLimiter::kLow);
+  }
+  pending_bytes_ = 0;
+  if (cpu_ != nullptr) {
+    const uint64_t now = RateLimiterNowMicros();
+    cpu_->Request(static_cast<int64_t>(now - last_charge_micros_),
+                  RateLimiter::kLow);
+  }
+  last_charge_micros_ = RateLimiterNowMicros();
+}
+
+}  // namespace TimberSaw
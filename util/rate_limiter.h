@@ -0,0 +1,54 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_TimberSaw_UTIL_RATE_LIMITER_H_
+#define STORAGE_TimberSaw_UTIL_RATE_LIMITER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "TimberSaw/rate_limiter.h"
+
+namespace TimberSaw {
+
+// Monotonic clock of the rate limiters, in microseconds.
+uint64_t RateLimiterNowMicros();
+
+// Charges the work of one compaction thread to the rate limiters: the input
+// bytes it has consumed to "io" and the time it has been running to "cpu".
+// The charges are batched every kChargeBytes of input so that the merge loop
+// does not take the limiter lock per key. Either limiter may be null.
+class CompactionPacer {
+ public:
+  CompactionPacer(RateLimiter* io, RateLimiter* cpu);
+  ~CompactionPacer() { Charge(); }
+
+  CompactionPacer(const CompactionPacer&) = delete;
+  CompactionPacer& operator=(const CompactionPacer&) = delete;
+
+  void Consumed(size_t bytes) {
+    pending_bytes_ += bytes;
+    if (pending_bytes_ >= kChargeBytes) {
+      Charge();
+    }
+  }
+
+  // Charge what has been consumed so far, blocking while the limiters have
+  // no credits left.
+  void Charge();
+
+ private:
+  static constexpr size_t kChargeBytes = 1024 * 1024;
+
+  RateLimiter* const io_;
+  RateLimiter* const cpu_;
+  size_t pending_bytes_ = 0;
+  // End of the last charge. The time blocked in the limiters is not counted
+  // as running time.
+  uint64_t last_charge_micros_;
+};
+
+}  // namespace TimberSaw
+
+#endif  // STORAGE_TimberSaw_UTIL_RATE_LIMITER_H_
@@ -0,0 +1,112 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/rate_limiter.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+namespace TimberSaw {
+
+TEST(RateLimiterTest, SetCreditsPerSecond) {
+  std::unique_ptr<RateLimiter> limiter(NewGenericRateLimiter(1000));
+  ASSERT_EQ(1000, limiter->GetMaxCreditsPerSecond());
+  ASSERT_EQ(1000, limiter->GetCreditsPerSecond());
+
+  limiter->SetCreditsPerSecond(500);
+  ASSERT_EQ(500, limiter->GetCreditsPerSecond());
+  // The rate stays within (0, max].
+  limiter->SetCreditsPerSecond(0);
+  ASSERT_EQ(1, limiter->GetCreditsPerSecond());
+  limiter->SetCreditsPerSecond(5000);
+  ASSERT_EQ(1000, limiter->GetCreditsPerSecond());
+  ASSERT_EQ(1000, limiter->GetMaxCreditsPerSecond());
+}
+
+TEST(RateLimiterTest, CountsCreditsPerPriority) {
+  std::unique_ptr<RateLimiter> limiter(NewGenericRateLimiter(1000000000));
+  limiter->Request(100, RateLimiter::kHigh);
+  limiter->Request(200, RateLimiter::kLow);
+  limiter->Request(300, RateLimiter::kLow);
+  ASSERT_EQ(100, limiter->GetTotalCreditsThrough(RateLimiter::kHigh));
+  ASSERT_EQ(500, limiter->GetTotalCreditsThrough(RateLimiter::kLow));
+}
+
+TEST(RateLimiterTest, Paces) {
+  // 1000 credits per refill of 10ms. The bucket starts full, the four other
+  // refills have to be waited for.
+  std::unique_ptr<RateLimiter> limiter(NewGenericRateLimiter(100000, 10000));
+  const uint64_t start = RateLimiterNowMicros();
+  // Larger than one refill, the request is granted in pieces.
+  limiter->Request(5000, RateLimiter::kLow);
+  const uint64_t elapsed = RateLimiterNowMicros() - start;
+  ASSERT_GE(elapsed, 30000);
+  ASSERT_EQ(5000, limiter->GetTotalCreditsThrough(RateLimiter::kLow));
+  ASSERT_GT(limiter->GetTotalWaitMicros(RateLimiter::kLow), 0);
+  ASSERT_EQ(0, limiter->GetTotalWaitMicros(RateLimiter::kHigh));
+}
+
+TEST(RateLimiterTest, HighPriorityFirst) {
+  // One request of 100 credits per refill of 100ms.
+  std::unique_ptr<RateLimiter> limiter(NewGenericRateLimiter(1000, 100000));
+  limiter->Request(100, RateLimiter::kLow);
+
+  std::atomic<int> order(0);
+  int high_done = 0;
+  int low_done = 0;
+  std::thread high([&]() {
+    limiter->Request(100, RateLimiter::kHigh);
+    high_done = ++order;
+  });
+  // The high priority request is waiting by the time the low one comes.
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  std::thread low([&]() {
+    limiter->Request(100, RateLimiter::kLow);
+    low_done = ++order;
+  });
+  high.join();
+  low.join();
+  ASSERT_EQ(1, high_done);
+  ASSERT_EQ(2, low_done);
+}
+
+TEST(RateLimiterTest, CompactionPacerBatches) {
+  std::unique_ptr<RateLimiter> io(NewGenericRateLimiter(1000000000));
+  {
+    CompactionPacer pacer(io.get(), nullptr);
+    // Below kChargeBytes nothing is charged yet.
+    pacer.Consumed(1024 * 1024 - 1);
+    ASSERT_EQ(0, io->GetTotalCreditsThrough(RateLimiter::kLow));
+    pacer.Consumed(1);
+    ASSERT_EQ(1024 * 1024, io->GetTotalCreditsThrough(RateLimiter::kLow));
+    pacer.Consumed(10);
+  }
+  // The rest is charged when the pacer goes away.
+  ASSERT_EQ(1024 * 1024 + 10, io->GetTotalCreditsThrough(RateLimiter::kLow));
+  ASSERT_EQ(0, io->GetTotalCreditsThrough(RateLimiter::kHigh));
+}
+
+TEST(RateLimiterTest, CompactionPacerChargesRunningTime) {
+  std::unique_ptr<RateLimiter> cpu(NewGenericRateLimiter(1000000000));
+  const uint64_t start = RateLimiterNowMicros();
+  {
+    CompactionPacer pacer(nullptr, cpu.get());
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    pacer.Charge();
+  }
+  const int64_t charged = cpu->GetTotalCreditsThrough(RateLimiter::kLow);
+  ASSERT_GE(charged, 10000);
+  ASSERT_LE(charged, static_cast<int64_t>(RateLimiterNowMicros() - start));
+}
+
+}  // namespace TimberSaw
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -124,6 +124,9 @@ RDMA_Manager::~RDMA_Manager() {
     }
     //    local_mem_pool.clear();
   }
+  for (ibv_mr* p : spare_read_buffers) {
+    Destroy_mr(p);
+  }
   for(auto iter : dealloc_mr){
     for(auto iter1 : *iter.second){
       ibv_dereg_mr(iter1.second);
@@ -781,7 +784,7 @@ void RDMA_Manager::ConnectQPThroughSocket(std::string qp_type, int socket_fd,
       qp_init_attr.recv_cq = cq1;
     qp_init_attr.cap.max_send_wr = 2500;
     qp_init_attr.cap.max_recv_wr = 2500;
-    qp_init_attr.cap.max_send_sge = 30;
+    qp_init_attr.cap.max_send_sge = kMaxSendSge;
     qp_init_attr.cap.max_recv_sge = 30;
     //  qp_init_attr.cap.max_inline_data = -1;
     ibv_qp* qp = ibv_create_qp(res->pd, &qp_init_attr);
@@ -833,6 +836,20 @@ void RDMA_Manager::ConnectQPThroughSocket(std::string qp_type, int socket_fd,
 
 }
 //    Register the memory through ibv_reg_mr on the local side. this function will be called by both of the server side and client side.
+ibv_mr* RDMA_Manager::Register_Local_Buffer(char* buf, size_t size) {
+  ibv_mr* mr = ibv_reg_mr(res->pd, buf, size, IBV_ACCESS_LOCAL_WRITE);
+  if (mr == nullptr) {
+    fprintf(stderr, "ibv_reg_mr failed for a local buffer, size = %zu\n", size);
+  }
+  return mr;
+}
+
+void RDMA_Manager::Deregister_Local_Buffer(ibv_mr* mr) {
+  if (ibv_dereg_mr(mr) != 0) {
+    fprintf(stderr, "ibv_dereg_mr failed for a local buffer\n");
+  }
+}
+
 bool RDMA_Manager::Local_Memory_Register(char** p2buffpointer,
                                          ibv_mr** p2mrpointer, size_t size,
                                          Chunk_type pool_name) {
@@ -1414,15 +1431,33 @@ ibv_mr* RDMA_Manager::Get_local_read_mr() {
   ibv_mr* ret;
   ret = (ibv_mr*)read_buffer->Get();
   if (ret == nullptr){
-    char* buffer = new char[name_to_chunksize.at(DataChunk)];
-    auto mr_flags =
-        IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE;
-    //  auto start = std::chrono::high_resolution_clock::now();
-    ret = ibv_reg_mr(res->pd, buffer, name_to_chunksize.at(DataChunk), mr_flags);
+    {
+      std::unique_lock<std::mutex> lck(spare_read_buffers_mtx);
+      if (!spare_read_buffers.empty()) {
+        ret = spare_read_buffers.back();
+        spare_read_buffers.pop_back();
+      }
+    }
+    if (ret == nullptr) {
+      char* buffer = new char[name_to_chunksize.at(DataChunk)];
+      auto mr_flags =
+          IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE;
+      //  auto start = std::chrono::high_resolution_clock::now();
+      ret = ibv_reg_mr(res->pd, buffer, name_to_chunksize.at(DataChunk), mr_flags);
+    }
     read_buffer->Reset(ret);
   }
   return ret;
 }
+ibv_mr* RDMA_Manager::Take_local_read_mr() {
+  ibv_mr* ret = Get_local_read_mr();
+  read_buffer->Reset(nullptr);
+  return ret;
+}
+void RDMA_Manager::Return_local_read_mr(ibv_mr* mr) {
+  std::unique_lock<std::mutex> lck(spare_read_buffers_mtx);
+  spare_read_buffers.push_back(mr);
+}
 void RDMA_Manager::sync_with_computes_Mside() {
   char buffer[100];
   int number_of_ready = 0;
@@ -1518,7 +1553,7 @@ ibv_qp* RDMA_Manager::create_qp_Mside(bool seperated_cq,
     qp_init_attr.recv_cq = cq1;
   qp_init_attr.cap.max_send_wr = 2500;
   qp_init_attr.cap.max_recv_wr = 2500;
-  qp_init_attr.cap.max_send_sge = 30;
+  qp_init_attr.cap.max_send_sge = kMaxSendSge;
   qp_init_attr.cap.max_recv_sge = 30;
   //  qp_init_attr.cap.max_inline_data = -1;
   ibv_qp* qp = ibv_create_qp(res->pd, &qp_init_attr);
@@ -1585,7 +1620,7 @@ ibv_qp* RDMA_Manager::create_qp(uint8_t target_node_id, bool seperated_cq,
     qp_init_attr.recv_cq = cq1;
   qp_init_attr.cap.max_send_wr = 2500;
   qp_init_attr.cap.max_recv_wr = 2500;
-  qp_init_attr.cap.max_send_sge = 30;
+  qp_init_attr.cap.max_send_sge = kMaxSendSge;
   qp_init_attr.cap.max_recv_sge = 30;
   //  qp_init_attr.cap.max_inline_data = -1;
   ibv_qp* qp = ibv_create_qp(res->pd, &qp_init_attr);
@@ -2262,6 +2297,57 @@ int RDMA_Manager::RDMA_Write(void* addr, uint32_t rkey, ibv_mr* local_mr,
     return rc;
 }
 
+int RDMA_Manager::RDMA_Write_Gather(void* addr, uint32_t rkey,
+                                    ibv_sge* sg_list, int num_sge,
+                                    std::string qp_type, size_t send_flag,
+                                    int poll_num, uint8_t target_node_id) {
+  assert(num_sge > 0 && num_sge <= kMaxSendSge);
+  struct ibv_send_wr sr;
+  struct ibv_send_wr* bad_wr = NULL;
+  int rc;
+  memset(&sr, 0, sizeof(sr));
+  sr.next = NULL;
+  sr.wr_id = 0;
+  sr.sg_list = sg_list;
+  sr.num_sge = num_sge;
+  sr.opcode = IBV_WR_RDMA_WRITE;
+  if (send_flag != 0) sr.send_flags = send_flag;
+  sr.wr.rdma.remote_addr = (uint64_t)addr;
+  sr.wr.rdma.rkey = rkey;
+  ibv_qp* qp;
+  if (qp_type == "write_local_flush"){
+    qp = static_cast<ibv_qp*>(qp_local_write_flush.at(target_node_id)->Get());
+    if (qp == NULL) {
+      Remote_Query_Pair_Connection(qp_type,target_node_id);
+      qp = static_cast<ibv_qp*>(qp_local_write_flush.at(target_node_id)->Get());
+    }
+    rc = ibv_post_send(qp, &sr, &bad_wr);
+  }else if (qp_type == "write_local_compact"){
+    qp = static_cast<ibv_qp*>(qp_local_write_compact.at(target_node_id)->Get());
+    if (qp == NULL) {
+      Remote_Query_Pair_Connection(qp_type,target_node_id);
+      qp = static_cast<ibv_qp*>(qp_local_write_compact.at(target_node_id)->Get());
+    }
+    rc = ibv_post_send(qp, &sr, &bad_wr);
+  } else {
+    std::shared_lock<std::shared_mutex> l(qp_cq_map_mutex);
+    rc = ibv_post_send(res->qp_map.at(target_node_id), &sr, &bad_wr);
+    l.unlock();
+  }
+  if (rc) fprintf(stderr, "failed to post SR, return is %d\n", rc);
+  if (poll_num != 0) {
+    ibv_wc* wc = new ibv_wc[poll_num]();
+    rc = poll_completion(wc, poll_num, qp_type, true, target_node_id);
+    if (rc != 0) {
+      std::cout << "RDMA Write Failed" << std::endl;
+      std::cout << "q id is" << qp_type << std::endl;
+      exit(0);
+    }
+    delete[] wc;
+  }
+  return rc;
+}
+
 int RDMA_Manager::RDMA_Write_Imme(void* addr, uint32_t rkey, ibv_mr* local_mr,
                                   size_t msg_size, std::string qp_type,
                                   size_t send_flag, int poll_num,
@@ -73,10 +73,10 @@
 namespace TimberSaw {
 
 enum Chunk_type {Message=1, Version_edit=2, IndexChunk=3, IndexChunk_Small=4, FilterChunk=5, FlushBuffer=6, DataChunk=7, No_Use_Default_chunk=8};
-static const char * EnumStrings[] = { "NULL", "Message", "Version_edit",
+inline const char * EnumStrings[] = { "NULL", "Message", "Version_edit",
       "IndexChunk", "IndexChunk_Small", "FilterChunk", "FlushBuffer", "Default", "No_Use_Default_chunk" };
 
-static char config_file_name[100] = "../connection_bigdata.conf";
+inline char config_file_name[100] = "../connection_bigdata.conf";
 
 struct config_t {
   const char* dev_name;    /* IB device name */
@@ -111,7 +111,12 @@ struct sst_unpin {
 } __attribute__((packed));
 struct sst_compaction {
   size_t buffer_size;
-
+  // The shard (or column family) of the compute node the compaction is for.
+  uint8_t shard_id;
+} __attribute__((packed));
+struct option_sync {
+  size_t buffer_size;
+  uint8_t shard_id;
 } __attribute__((packed));
 enum RDMA_Command_Type {
   invalid_command_,
@@ -158,6 +163,7 @@ union RDMA_Request_Content {
   install_versionedit ive;
   sst_gc gc;
   sst_compaction sstCompact;
+  option_sync optSync;
   sst_unpin psu;
   size_t unpinned_version_id;
   CPU_Info cpu_info;
@@ -231,7 +237,7 @@ class In_Use_Array {
     }
   }
   In_Use_Array(size_t size, size_t chunk_size, ibv_mr* mr_ori,
-               std::atomic<bool>* in_use)
+               std::atomic<bool>* /*in_use*/)
       : element_size_(size),
         chunk_size_(chunk_size),
 //        in_use_(in_use),
@@ -250,7 +256,7 @@ class In_Use_Array {
   bool deallocate_memory_slot(int index) {
     std::unique_lock<SpinMutex> lck(mtx);
     free_list.push_back(index);
-    if (index < element_size_){
+    if (static_cast<size_t>(index) < element_size_){
       return true;
     }else{
       assert(false);
@@ -325,6 +331,9 @@ class RDMA_Manager {
  public:
   friend class Memory_Node_Keeper;
   friend class DBImpl;
+  // The scatter gather entries a work request may carry on the queue pairs.
+  static constexpr int kMaxSendSge = 30;
+
   RDMA_Manager(config_t config, size_t remote_block_size);
   //  RDMA_Manager(config_t config) : rdma_config(config){
   //    res = new resources();
@@ -341,6 +350,11 @@ class RDMA_Manager {
   //Computes node sync compute sides (block function)
   void sync_with_computes_Cside();
   ibv_mr* Get_local_read_mr();
+  // Detach the read buffer of this thread, e.g. to pin a value read into it.
+  // The next Get_local_read_mr() of the thread takes a spare buffer. The
+  // buffer must be given back by Return_local_read_mr().
+  ibv_mr* Take_local_read_mr();
+  void Return_local_read_mr(ibv_mr* mr);
   //Computes node sync memory sides (block function)
   void sync_with_computes_Mside();
   void broadcast_to_computes();
@@ -371,6 +385,11 @@ class RDMA_Manager {
   bool Local_Memory_Register(
       char** p2buffpointer, ibv_mr** p2mrpointer, size_t size,
       Chunk_type pool_name);  // register the memory on the local side
+  // Register "size" bytes at "buf", memory the caller owns, as the source of
+  // RDMA writes. Returns nullptr if the device refuses it. The caller
+  // deregisters it before freeing the memory.
+  ibv_mr* Register_Local_Buffer(char* buf, size_t size);
+  void Deregister_Local_Buffer(ibv_mr* mr);
   // bulk deallocation preparation.
   bool Remote_Memory_Deallocation_Fetch_Buff(uint64_t** ptr, size_t size,
                                              uint8_t target_node_id,
@@ -397,6 +416,12 @@ class RDMA_Manager {
   int RDMA_Write(void* addr, uint32_t rkey, ibv_mr* local_mr, size_t msg_size,
                  std::string qp_type, size_t send_flag, int poll_num,
                  uint8_t target_node_id);
+  // Write the "num_sge" local pieces of "sg_list" one after the other to
+  // "addr", in one work request.
+  // REQUIRES: num_sge <= kMaxSendSge.
+  int RDMA_Write_Gather(void* addr, uint32_t rkey, ibv_sge* sg_list,
+                        int num_sge, std::string qp_type, size_t send_flag,
+                        int poll_num, uint8_t target_node_id);
   int RDMA_Write_Imme(void* addr, uint32_t rkey, ibv_mr* local_mr,
                       size_t msg_size, std::string qp_type, size_t send_flag,
                       int poll_num, unsigned int imme, uint8_t target_node_id);
@@ -486,6 +511,10 @@ class RDMA_Manager {
   std::map<uint8_t, ThreadLocalPtr*> cq_local_read;
   std::map<uint8_t, ThreadLocalPtr*> local_read_qp_info;
   ThreadLocalPtr* read_buffer;
+  // Read buffers returned after they were taken, reused before registering
+  // new ones.
+  std::vector<ibv_mr*> spare_read_buffers;
+  std::mutex spare_read_buffers_mtx;
   ThreadPool Unpin_bg_pool_;
 //  ThreadLocalPtr* qp_local_write_flush;
 //  ThreadLocalPtr* cq_local_write_flush;
@@ -0,0 +1,174 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Standard Ribbon filter (Dillinger & Walzer, "Ribbon filter: practically
+// smaller than Bloom and Xor") over 64-bit wide coefficient rows. Each key
+// is a row of a sparse linear system over GF(2); the filter is a solution
+// of that system, and a query recomputes the key's row against it. For a
+// false positive rate of 2^-r it takes about 1.1 * r bits per key, against
+// the 1.44 * r bits per key of a Bloom filter.
+
+#ifndef STORAGE_TimberSaw_UTIL_RIBBON_IMPL_H_
+#define STORAGE_TimberSaw_UTIL_RIBBON_IMPL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <cmath>
+#include <vector>
+
+#include "port/port_posix.h"
+#include "util/coding.h"
+#include "util/fastrange.h"
+
+namespace TimberSaw {
+
+class StandardRibbonImpl {
+ public:
+  // Width of the coefficient rows, a block of the filter holds the solution
+  // bits of that many slots.
+  static constexpr uint32_t kCoeffBits = 64;
+  static constexpr int kMaxResultBits = 16;
+
+  // Result bits giving about the false positive rate of a Bloom filter of
+  // "bits_per_key" bits per key (0.6185^bits_per_key = 2^-r).
+  static int ChooseResultBits(int bits_per_key) {
+    int r = static_cast<int>(std::lround(bits_per_key * 0.6935));
+    if (r < 1) r = 1;
+    if (r > kMaxResultBits) r = kMaxResultBits;
+    return r;
+  }
+
+  // Blocks of kCoeffBits slots for "num_entries" keys. "attempt" grows the
+  // overhead when the construction keeps failing.
+  static uint32_t ChooseNumBlocks(size_t num_entries, int attempt) {
+    double slots = static_cast<double>(num_entries) * (1.08 + 0.01 * attempt);
+    // The starts end kCoeffBits - 1 slots before the end of the filter, and
+    // small filters need more room to solve.
+    slots += 2 * kCoeffBits;
+    return static_cast<uint32_t>((slots + kCoeffBits - 1) / kCoeffBits);
+  }
+
+  static double EstimatedFpRate(int result_bits) {
+    return std::pow(0.5, result_bits);
+  }
+
+  // Builds the filter of "hashes" into "out", num_blocks * result_bits
+  // words of 8 bytes. Returns false if the system has no solution under
+  // "seed"; the caller retries with another seed.
+  static bool Build(const std::vector<uint32_t>& hashes, int result_bits,
+                    uint32_t num_blocks, uint32_t seed, char* out) {
+    const size_t num_slots = static_cast<size_t>(num_blocks) * kCoeffBits;
+    std::vector<uint64_t> coeff(num_slots, 0);
+    std::vector<uint16_t> result(num_slots, 0);
+    const uint32_t result_mask = (1u << result_bits) - 1;
+
+    // Banding: every row is reduced against the rows already in place until
+    // it finds an empty slot for its leading coefficient.
+    for (uint32_t h : hashes) {
+      size_t i;
+      uint64_t c;
+      uint32_t r;
+      Hash(h, seed, num_slots, result_mask, &i, &c, &r);
+      while (true) {
+        if (coeff[i] == 0) {
+          coeff[i] = c;
+          result[i] = static_cast<uint16_t>(r);
+          break;
+        }
+        c ^= coeff[i];
+        r ^= result[i];
+        if (c == 0) {
+          // The same row again, from a 32-bit hash collision, is redundant.
+          if (r != 0) return false;
+          break;
+        }
+        int tz = __builtin_ctzll(c);
+        i += tz;
+        c >>= tz;
+      }
+    }
+
+    // Back substitution from the last slot. state[b] holds result bit b of
+    // the solution at slots i .. i + kCoeffBits - 1, bit 0 being slot i.
+    uint64_t state[kMaxResultBits] = {0};
+    for (size_t i = num_slots; i-- > 0;) {
+      const uint64_t c = coeff[i];
+      const uint32_t r = result[i];
+      // Slots no row leads get arbitrary values, pseudorandom ones keep the
+      // queries of the keys not added uniform.
+      const uint64_t free_bits = c == 0 ? Mix64(i ^ (uint64_t{seed} << 32)) : 0;
+      for (int b = 0; b < result_bits; b++) {
+        state[b] <<= 1;
+        uint64_t bit;
+        if (c == 0) {
+          bit = (free_bits >> b) & 1;
+        } else {
+          bit = (__builtin_popcountll(state[b] & c) & 1) ^ ((r >> b) & 1);
+        }
+        state[b] |= bit;
+      }
+      if (i % kCoeffBits == 0) {
+        // Blocks are stored interleaved: the result_bits words of a block
+        // are next to each other.
+        char* block = out + (i / kCoeffBits) * result_bits * 8;
+        for (int b = 0; b < result_bits; b++) {
+          EncodeFixed64(block + b * 8, state[b]);
+        }
+      }
+    }
+    return true;
+  }
+
+  static bool HashMayMatch(uint32_t h, const char* data, uint32_t num_blocks,
+                           int result_bits, uint32_t seed) {
+    const size_t num_slots = static_cast<size_t>(num_blocks) * kCoeffBits;
+    const uint32_t result_mask = (1u << result_bits) - 1;
+    size_t start;
+    uint64_t c;
+    uint32_t r;
+    Hash(h, seed, num_slots, result_mask, &start, &c, &r);
+    const size_t segment = start / kCoeffBits;
+    const int offset = static_cast<int>(start % kCoeffBits);
+    const char* lo = data + segment * result_bits * 8;
+    const char* hi = lo + result_bits * 8;
+    for (int b = 0; b < result_bits; b++) {
+      uint64_t solution = DecodeFixed64(lo + b * 8) >> offset;
+      if (offset != 0) {
+        solution |= DecodeFixed64(hi + b * 8) << (kCoeffBits - offset);
+      }
+      if (static_cast<uint32_t>(__builtin_popcountll(solution & c) & 1) !=
+          ((r >> b) & 1)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  // The 64-bit finalizer of MurmurHash3.
+  static inline uint64_t Mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+  }
+
+  // The start slot, coefficient row and result of a key. The row has its
+  // bit 0 set, so it leads at its start slot.
+  static inline void Hash(uint32_t h, uint32_t seed, size_t num_slots,
+                          uint32_t result_mask, size_t* start, uint64_t* c,
+                          uint32_t* r) {
+    const uint64_t x =
+        Mix64((uint64_t{h} << 32 | h) ^ (uint64_t{seed} * 0x9e3779b97f4a7c15ULL));
+    *start = FastRange64(x, num_slots - kCoeffBits + 1);
+    *c = Mix64(x ^ 0x6a09e667f3bcc909ULL) | 1;
+    *r = static_cast<uint32_t>(Mix64(x + 0xbb67ae8584caa73bULL)) & result_mask;
+  }
+};
+
+}  // namespace TimberSaw
+
+#endif  // STORAGE_TimberSaw_UTIL_RIBBON_IMPL_H_
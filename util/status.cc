@@ -60,6 +60,9 @@ std::string Status::ToString() const {
       case kIOError:
         type = "IO error: ";
         break;
+      case kBusy:
+        type = "Busy: ";
+        break;
       default:
         std::snprintf(tmp, sizeof(tmp),
                       "Unknown code(%d): ", static_cast<int>(code()));